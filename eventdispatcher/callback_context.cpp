@@ -0,0 +1,104 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the callback context.
+ *
+ * The guards only save a few pointers in a thread local structure so
+ * they can be used around each callback at nearly no cost.
+ */
+
+// self
+//
+#include    "eventdispatcher/callback_context.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ed
+{
+
+
+
+/** \brief Get the callback context of the current thread.
+ *
+ * \return A reference to this thread context.
+ */
+callback_context_t & get_callback_context()
+{
+    thread_local callback_context_t g_context;
+    return g_context;
+}
+
+
+/** \brief Mark the start of a callback.
+ *
+ * The communicator creates one of these guards around the callbacks
+ * of each connection.
+ *
+ * \param[in] c  The connection whose callbacks are about to be called.
+ * \param[in] start_date  The current date in microseconds.
+ */
+callback_guard::callback_guard(connection * c, std::int64_t start_date)
+    : f_context(get_callback_context())
+{
+    f_context.f_connection.store(c, std::memory_order_relaxed);
+    f_context.f_command.store(nullptr, std::memory_order_relaxed);
+    f_context.f_start_date.store(start_date, std::memory_order_release);
+}
+
+
+/** \brief Mark the end of a callback.
+ */
+callback_guard::~callback_guard()
+{
+    f_context.f_start_date.store(0, std::memory_order_release);
+    f_context.f_connection.store(nullptr, std::memory_order_relaxed);
+}
+
+
+/** \brief Mark the command being dispatched.
+ *
+ * The dispatcher creates one of these guards while it dispatches a
+ * message.
+ *
+ * \param[in] command  The command being dispatched. It must remain
+ * valid until the guard is destroyed.
+ */
+command_guard::command_guard(std::string const & command)
+    : f_context(get_callback_context())
+    , f_previous(f_context.f_command.exchange(&command, std::memory_order_relaxed))
+{
+}
+
+
+/** \brief Restore the previous command.
+ */
+command_guard::~command_guard()
+{
+    f_context.f_command.store(f_previous, std::memory_order_relaxed);
+}
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
@@ -0,0 +1,88 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Track the callback currently running in a thread.
+ *
+ * The communicator and the dispatcher save the connection and the command
+ * being processed in a per thread context. Tools such as the stall
+ * detector and the signal profiler read that context, possibly from
+ * another thread or from a signal handler, hence the atomic variables.
+ */
+
+// C++
+//
+#include    <atomic>
+#include    <cstdint>
+#include    <string>
+
+
+
+namespace ed
+{
+
+
+
+class connection;
+
+
+struct callback_context_t
+{
+    std::atomic<std::int64_t>       f_start_date = 0;
+    std::atomic<connection *>       f_connection = nullptr;
+    std::atomic<std::string const *>
+                                    f_command = nullptr;
+};
+
+
+callback_context_t &                get_callback_context();
+
+
+class callback_guard
+{
+public:
+                                    callback_guard(connection * c, std::int64_t start_date);
+                                    callback_guard(callback_guard const &) = delete;
+                                    ~callback_guard();
+
+    callback_guard &                operator = (callback_guard const &) = delete;
+
+private:
+    callback_context_t &            f_context;
+};
+
+
+class command_guard
+{
+public:
+                                    command_guard(std::string const & command);
+                                    command_guard(command_guard const &) = delete;
+                                    ~command_guard();
+
+    command_guard &                 operator = (command_guard const &) = delete;
+
+private:
+    callback_context_t &            f_context;
+    std::string const *             f_previous = nullptr;
+};
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
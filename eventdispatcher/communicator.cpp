@@ -48,8 +48,12 @@
 //
 #include    "eventdispatcher/communicator.h"
 
+#include    "eventdispatcher/callback_context.h"
+#include    "eventdispatcher/connection_with_send_message.h"
 #include    "eventdispatcher/exception.h"
 #include    "eventdispatcher/signal.h"
+#include    "eventdispatcher/signal_profiler.h"
+#include    "eventdispatcher/stall_detector.h"
 #include    "eventdispatcher/utils.h"
 
 
@@ -80,6 +84,7 @@
 // C
 //
 #include    <poll.h>
+#include    <sys/epoll.h>
 #include    <sys/resource.h>
 
 
@@ -271,6 +276,15 @@ bool communicator::remove_connection(connection::pointer_t connection)
 
     connection->connection_removed();
 
+    // no replies can be received once removed; the callbacks run on
+    // the next loop so they do not run from within this function
+    //
+    connection_with_send_message * c(dynamic_cast<connection_with_send_message *>(connection.get()));
+    if(c != nullptr)
+    {
+        c->cancel_requests(true);
+    }
+
     if(f_debug_connections != snaplogger::severity_t::SEVERITY_OFF)
     {
         log_connections(f_debug_connections);
@@ -449,6 +463,152 @@ snapdev::timespec_ex const & communicator::get_idle() const
 }
 
 
+/** \brief Get the scheduler used by run().
+ *
+ * \return The current scheduler.
+ */
+scheduler_t communicator::get_scheduler() const
+{
+    return f_scheduler;
+}
+
+
+/** \brief Select how run() processes the ready connections.
+ *
+ * By default, the communicator uses the SCHEDULER_PRIORITY which calls
+ * the callbacks of all the connections with events in priority order.
+ * A busy connection with a small priority number can then starve the
+ * other connections.
+ *
+ * The SCHEDULER_DEFICIT_ROUND_ROBIN makes sure that each ready
+ * connection gets its share of processing time. Each time a connection
+ * is ready, it receives its quantum (see set_priority_quantum()). The
+ * time spent in its callbacks is subtracted from its deficit. When the
+ * deficit is zero or negative, the events of that connection are
+ * deferred to the next loop (poll() reports them again). The starting
+ * point in the list of ready connections rotates on each loop.
+ *
+ * The connections in the latency class (see set_latency_class()) and
+ * the signal connections are processed first.
+ *
+ * \param[in] scheduler  The scheduler to use.
+ */
+void communicator::set_scheduler(scheduler_t scheduler)
+{
+    f_scheduler = scheduler;
+}
+
+
+/** \brief Get the quantum of a priority class.
+ *
+ * \param[in] priority  The priority of a connection.
+ *
+ * \return The quantum in microseconds given to connections with that
+ * priority on each round.
+ */
+std::int64_t communicator::get_priority_quantum(priority_t priority) const
+{
+    auto it(f_quantums.upper_bound(priority));
+    if(it == f_quantums.begin())
+    {
+        return DEFAULT_SCHEDULER_QUANTUM;
+    }
+    --it;
+    return it->second;
+}
+
+
+/** \brief Define the quantum of a priority class.
+ *
+ * A priority class starts at \p priority and goes up to the next
+ * priority class. Connections with a priority smaller than the first
+ * class use DEFAULT_SCHEDULER_QUANTUM.
+ *
+ * The quantum is the processing time, in microseconds, a connection of
+ * that class receives each time it is ready. Giving a larger quantum to
+ * a class gives it a larger share of the processing time.
+ *
+ * \exception parameter_error
+ * The priority must be valid and the quantum must be positive.
+ *
+ * \param[in] priority  The first priority of the class.
+ * \param[in] quantum_us  The quantum in microseconds.
+ */
+void communicator::set_priority_quantum(priority_t priority, std::int64_t quantum_us)
+{
+    if(priority < EVENT_MIN_PRIORITY
+    || priority > EVENT_MAX_PRIORITY)
+    {
+        throw parameter_error(
+                  "communicator::set_priority_quantum(): priority out of range ("
+                + std::to_string(priority)
+                + ").");
+    }
+    if(quantum_us <= 0)
+    {
+        throw parameter_error("communicator::set_priority_quantum(): the quantum must be positive.");
+    }
+
+    f_quantums[priority] = quantum_us;
+}
+
+
+/** \brief Get the largest priority of the latency class.
+ *
+ * \return The largest priority of the latency class or
+ * EVENT_MIN_PRIORITY - 1 if there is no latency class.
+ */
+priority_t communicator::get_latency_priority() const
+{
+    return f_latency_priority;
+}
+
+
+/** \brief Get the processing time budget of the latency class.
+ *
+ * \return The budget in microseconds.
+ */
+std::int64_t communicator::get_latency_budget() const
+{
+    return f_latency_budget;
+}
+
+
+/** \brief Define the latency class.
+ *
+ * With the SCHEDULER_DEFICIT_ROUND_ROBIN scheduler, connections with
+ * a priority smaller or equal to \p priority are processed first. Once
+ * these connections used \p budget_us microseconds within one loop,
+ * the remaining ones are scheduled with the other connections.
+ *
+ * Use EVENT_MIN_PRIORITY - 1 to remove the latency class.
+ *
+ * \exception parameter_error
+ * The priority must be valid and the budget must be positive.
+ *
+ * \param[in] priority  The largest priority of the latency class.
+ * \param[in] budget_us  The processing time budget of the class per loop.
+ */
+void communicator::set_latency_class(priority_t priority, std::int64_t budget_us)
+{
+    if(priority < EVENT_MIN_PRIORITY - 1
+    || priority > EVENT_MAX_PRIORITY)
+    {
+        throw parameter_error(
+                  "communicator::set_latency_class(): priority out of range ("
+                + std::to_string(priority)
+                + ").");
+    }
+    if(budget_us <= 0)
+    {
+        throw parameter_error("communicator::set_latency_class(): the budget must be positive.");
+    }
+
+    f_latency_priority = priority;
+    f_latency_budget = budget_us;
+}
+
+
 /** \brief Run until all connections are removed.
  *
  * This function "blocks" until all the connections added to this
@@ -470,6 +630,8 @@ snapdev::timespec_ex const & communicator::get_idle() const
  * allows for a 100% valid shutdown procedure.
  *
  * \return true if the loop exits because the list of connections is empty.
+ *
+ * \sa process_events()
  */
 bool communicator::run()
 {
@@ -483,63 +645,241 @@ bool communicator::run()
 
     snapdev::safe_variable running(f_running, true);
 
-    std::vector<bool> enabled;
-    std::vector<struct pollfd> fds;
+    initialize_metrics();
+
     f_force_sort = true;
     for(;;)
     {
+        f_iterations->increment();
+
         // any connections?
         if(f_connections.empty())
         {
             return true;
         }
 
-        if(f_force_sort)
+        std::int64_t const timeout(prepare_poll());
+        if(timeout == NOTHING_TO_POLL)
         {
-            // sort the connections by priority
-            //
-            std::stable_sort(f_connections.begin(), f_connections.end(), connection::compare);
-            f_force_sort = false;
+            SNAP_LOG_FATAL
+                << "communicator::run(): nothing to poll() on. All connections are disabled? (Ignoring "
+                << f_polled.size()
+                << " and exiting the run() loop anyway.)"
+                << SNAP_LOG_SEND;
+            return false;
         }
 
-        // make a copy because the callbacks may end up making
-        // changes to the main list and we would have problems
-        // with that here...
-        //
-        connection::vector_t connections(f_connections);
-        size_t max_connections(connections.size());
+        poll_and_dispatch(timeout);
+    }
+}
 
-        // timeout is do not time out by default
+
+/** \brief Run one non-blocking iteration of the loop.
+ *
+ * This function is used when another event loop, such as the Qt loop,
+ * drives the process instead of run(). It calls poll() with a timeout
+ * of zero, calls the callbacks of the connections which are ready or
+ * timed out, and then prepares the next wait:
+ *
+ * \li the descriptor returned by get_poll_fd() is updated to reflect
+ *     the set of sockets to wait on; it becomes readable as soon as one
+ *     of them has an event;
+ * \li get_poll_timeout() returns the number of milliseconds until the
+ *     next connection times out.
+ *
+ * The other loop is expected to watch the get_poll_fd() descriptor,
+ * to arm a timer with get_poll_timeout(), and to call this function
+ * whenever one or the other triggers. Since connections can also be
+ * added, removed, enabled, or disabled from the other loop callbacks,
+ * it is also a good idea to call this function before that loop blocks.
+ *
+ * \exception recursive_call
+ * This function cannot be called from a callback, nor while run() is
+ * running.
+ *
+ * \return false once the list of connections is empty.
+ */
+bool communicator::process_events()
+{
+    if(f_running)
+    {
+        SNAP_LOG_FATAL
+            << "communicator::process_events(): recursively called from within a callback."
+            << SNAP_LOG_SEND;
+        throw recursive_call("communicator::process_events(): recursively called from within a callback.");
+    }
+
+    snapdev::safe_variable running(f_running, true);
+
+    initialize_metrics();
+
+    if(!f_connections.empty())
+    {
+        f_iterations->increment();
+        if(prepare_poll() != NOTHING_TO_POLL)
+        {
+            poll_and_dispatch(0);
+        }
+    }
+
+    // prepare the next wait
+    //
+    f_poll_timeout = -1;
+    if(!f_connections.empty())
+    {
+        std::int64_t const timeout(prepare_poll());
+        if(timeout != NOTHING_TO_POLL)
+        {
+            f_poll_timeout = timeout;
+        }
+    }
+    else
+    {
+        f_polled.clear();
+        f_fds.clear();
+    }
+    update_poll_fd();
+
+    return !f_connections.empty();
+}
+
+
+/** \brief Get a descriptor which becomes readable when events occur.
+ *
+ * This function returns an epoll descriptor which includes all the
+ * sockets the last call to process_events() found that the communicator
+ * has to wait on. It can be watched by another event loop (i.e. with a
+ * QSocketNotifier) so process_events() gets called only when something
+ * happens instead of having to poll the communicator at regular
+ * intervals.
+ *
+ * The descriptor is created on the first call. It is owned by the
+ * communicator, do not close it.
+ *
+ * \exception runtime_error
+ * If the epoll descriptor cannot be created, this exception is raised.
+ *
+ * \return The epoll file descriptor.
+ *
+ * \sa process_events()
+ * \sa get_poll_timeout()
+ */
+int communicator::get_poll_fd()
+{
+    if(f_poll_fd == nullptr)
+    {
+        f_poll_fd.reset(epoll_create1(EPOLL_CLOEXEC));
+        if(f_poll_fd == nullptr)
+        {
+            int const e(errno);
+            throw runtime_error(
+                      "communicator::get_poll_fd(): epoll_create1() failed with error "
+                    + std::to_string(e)
+                    + " -- "
+                    + strerror(e));
+        }
+        update_poll_fd();
+    }
+
+    return f_poll_fd.get();
+}
+
+
+/** \brief Get the delay until the next timeout.
+ *
+ * After a call to process_events(), this function returns the number
+ * of milliseconds until one of the connections times out. If no
+ * connection has a timeout, the function returns -1.
+ *
+ * \return The delay in milliseconds or -1.
+ */
+std::int64_t communicator::get_poll_timeout() const
+{
+    return f_poll_timeout;
+}
+
+
+/** \brief Get the metrics used by the loop.
+ *
+ * The metrics are per thread, so this function retrieves them on each
+ * entry in run() or process_events().
+ */
+void communicator::initialize_metrics()
+{
+    metrics & m(metrics::instance());
+    f_iterations = &m.get_counter("ed_loop_iterations_total");
+    f_poll_wait = &m.get_histogram("ed_loop_poll_wait_us");
+    f_wakeups_saved = &m.get_counter("ed_loop_timer_wakeups_saved_total");
+    f_callback_duration = &m.get_histogram("ed_loop_callback_duration_us");
+    f_timeouts_fired = &m.get_counter("ed_loop_timeouts_total");
+}
+
+
+/** \brief Prepare the list of sockets to poll() on.
+ *
+ * This function takes a copy of the list of connections and builds
+ * the array of pollfd structures for the ones which are enabled and
+ * have a valid socket. It also saves the timeout timestamps of the
+ * connections.
+ *
+ * \return The poll() timeout in milliseconds, -1 if no connection has
+ * a timeout, or NOTHING_TO_POLL if there are no sockets and no timeouts.
+ */
+std::int64_t communicator::prepare_poll()
+{
+    if(f_force_sort)
+    {
+        // sort the connections by priority
         //
-        std::int64_t next_timeout_timestamp(std::numeric_limits<std::int64_t>::max());
+        std::stable_sort(f_connections.begin(), f_connections.end(), connection::compare);
+        f_force_sort = false;
+    }
 
-        // clear() is not supposed to delete the buffer of vectors
+    // make a copy because the callbacks may end up making
+    // changes to the main list and we would have problems
+    // with that here...
+    //
+    f_polled = f_connections;
+    size_t max_connections(f_polled.size());
+
+    // timeout is do not time out by default
+    //
+    // with slack, the next timeout is the earliest end of the
+    // windows [timestamp, timestamp + slack] which is usually later
+    // than the earliest timestamp; all the timeouts due by then get
+    // processed in the same wakeup
+    //
+    f_next_timeout_timestamp = std::numeric_limits<std::int64_t>::max();
+    f_earliest_timeout_timestamp = std::numeric_limits<std::int64_t>::max();
+
+    // clear() is not supposed to delete the buffer of vectors
+    //
+    f_enabled.clear();
+    f_fds.clear();
+    f_deadlines.clear();
+    f_fds.reserve(max_connections); // avoid more than 1 allocation
+    for(size_t idx(0); idx < max_connections; ++idx)
+    {
+        connection::pointer_t c(f_polled[idx]);
+        c->f_fds_position = -1;
+
+        // is the connection enabled?
+        //
+        // note that we save that value for later use in our loop
+        // below because otherwise we will miss many events and
+        // it tends to break things; that means you may get your
+        // callback called even while disabled
         //
-        enabled.clear();
-        fds.clear();
-        fds.reserve(max_connections); // avoid more than 1 allocation
-        for(size_t idx(0); idx < max_connections; ++idx)
+        f_enabled.push_back(c->is_enabled());
+        if(!f_enabled[idx])
         {
-            connection::pointer_t c(connections[idx]);
-            c->f_fds_position = -1;
-
-            // is the connection enabled?
-            //
-            // note that we save that value for later use in our loop
-            // below because otherwise we will miss many events and
-            // it tends to break things; that means you may get your
-            // callback called even while disabled
-            //
-            enabled.push_back(c->is_enabled());
-            if(!enabled[idx])
-            {
-                //SNAP_LOG_TRACE
-                //    << "communicator::run(): connection '"
-                //    << c->get_name()
-                //    << "' has been disabled, so ignored."
-                //    << SNAP_LOG_SEND;
-                continue;
-            }
+            //SNAP_LOG_TRACE
+            //    << "communicator::run(): connection '"
+            //    << c->get_name()
+            //    << "' has been disabled, so ignored."
+            //    << SNAP_LOG_SEND;
+            continue;
+        }
 //SNAP_LOG_TRACE
 //    << "communicator::run(): handling connection "
 //    << idx
@@ -550,145 +890,190 @@ bool communicator::run()
 //    << "' since it is enabled..."
 //    << SNAP_LOG_SEND;
 
-            // check whether a timeout is defined in this connection
+        // check whether a timeout is defined in this connection
+        //
+        std::int64_t const timestamp(c->save_timeout_timestamp());
+        if(timestamp != -1)
+        {
+            // the timeout event gives us a time when to tick
             //
-            std::int64_t const timestamp(c->save_timeout_timestamp());
-            if(timestamp != -1)
-            {
-                // the timeout event gives us a time when to tick
-                //
-                if(timestamp < next_timeout_timestamp)
-                {
-                    next_timeout_timestamp = timestamp;
-                }
-            }
-
-            // is there any events to listen on?
-            int e(0);
-            if(c->is_listener() || c->is_signal())
-            {
-                e |= POLLIN;
-            }
-            if(c->is_reader())
+            std::int64_t const latest(timestamp + c->get_timeout_slack());
+            if(latest < f_next_timeout_timestamp)
             {
-                e |= POLLIN | POLLPRI | POLLRDHUP;
+                f_next_timeout_timestamp = latest;
             }
-            if(c->is_writer())
+            if(timestamp < f_earliest_timeout_timestamp)
             {
-                e |= POLLOUT | POLLRDHUP;
-            }
-            if(e == 0)
-            {
-                // this should only happen on timer objects
-                //
-                continue;
+                f_earliest_timeout_timestamp = timestamp;
             }
+            f_deadlines.push_back(timestamp);
+        }
 
-            // do we have a currently valid socket? (i.e. the connection
-            // may have been closed or we may be handling a timer or
-            // signal object)
+        // is there any events to listen on?
+        int e(0);
+        if(c->is_listener() || c->is_signal())
+        {
+            e |= POLLIN;
+        }
+        if(c->is_reader())
+        {
+            e |= POLLIN | POLLPRI | POLLRDHUP;
+        }
+        if(c->is_writer())
+        {
+            e |= POLLOUT | POLLRDHUP;
+        }
+        if(e == 0)
+        {
+            // this should only happen on timer objects
             //
-            if(!c->valid_socket())
-            {
-                continue;
-            }
+            continue;
+        }
 
-            // this is considered valid, add this connection to the list
-            //
-            // save the position since we may skip some entries...
-            // (otherwise we would have to use -1 as the socket to
-            // allow for such dead entries, but avoiding such entries
-            // saves time)
-            //
-            c->f_fds_position = fds.size();
+        // do we have a currently valid socket? (i.e. the connection
+        // may have been closed or we may be handling a timer or
+        // signal object)
+        //
+        if(!c->valid_socket())
+        {
+            continue;
+        }
 
-            // here the debug connections allows us to only show connections
-            // we actually are actively waiting against (become a remaining
-            // connection which is not added here is ignored)
-            //
-            // note that we use yet another flag to make sure that it does
-            // not happen unless the programmer really wants to really hard
-            // see set_show_connections() for other details
-            //
-            if(get_show_connections()
-            && f_debug_connections != snaplogger::severity_t::SEVERITY_OFF)
-            {
-                snaplogger::message msg(f_debug_connections);
-                msg << "communicator listening on connection: \""
-                    << c->get_name()
-                    << "\"";
-                snaplogger::send_message(msg);
-            }
+        // this is considered valid, add this connection to the list
+        //
+        // save the position since we may skip some entries...
+        // (otherwise we would have to use -1 as the socket to
+        // allow for such dead entries, but avoiding such entries
+        // saves time)
+        //
+        c->f_fds_position = f_fds.size();
 
-            struct pollfd fd;
-            fd.fd = c->get_socket();
-            fd.events = e;
-            fd.revents = 0; // probably useless... (kernel should clear those)
-            fds.push_back(fd);
+        // here the debug connections allows us to only show connections
+        // we actually are actively waiting against (become a remaining
+        // connection which is not added here is ignored)
+        //
+        // note that we use yet another flag to make sure that it does
+        // not happen unless the programmer really wants to really hard
+        // see set_show_connections() for other details
+        //
+        if(get_show_connections()
+        && f_debug_connections != snaplogger::severity_t::SEVERITY_OFF)
+        {
+            snaplogger::message msg(f_debug_connections);
+            msg << "communicator listening on connection: \""
+                << c->get_name()
+                << "\"";
+            snaplogger::send_message(msg);
         }
 
-        // compute the right timeout
-        std::int64_t timeout(-1);
-        if(next_timeout_timestamp != std::numeric_limits<int64_t>::max())
+        struct pollfd fd;
+        fd.fd = c->get_socket();
+        fd.events = e;
+        fd.revents = 0; // probably useless... (kernel should clear those)
+        f_fds.push_back(fd);
+    }
+
+    // compute the right timeout
+    std::int64_t timeout(-1);
+    if(f_next_timeout_timestamp != std::numeric_limits<int64_t>::max())
+    {
+        std::int64_t const now(get_current_date());
+        timeout = f_next_timeout_timestamp - now;
+        if(timeout < 0)
         {
-            std::int64_t const now(get_current_date());
-            timeout = next_timeout_timestamp - now;
-            if(timeout < 0)
+            // timeout is in the past so timeout immediately, but
+            // still check for events if any
+            //
+            timeout = 0;
+        }
+        else
+        {
+            // convert microseconds to milliseconds for poll()
+            //
+            // when the slack delayed this wakeup, round up so the
+            // timeouts we waited for are due once poll() returns
+            //
+            if(f_earliest_timeout_timestamp < f_next_timeout_timestamp)
             {
-                // timeout is in the past so timeout immediately, but
-                // still check for events if any
-                //
-                timeout = 0;
+                timeout += 999;
             }
-            else
+            timeout /= 1000;
+            if(timeout == 0)
             {
-                // convert microseconds to milliseconds for poll()
+                // less than one is a waste of time (CPU intensive
+                // until the time is reached, we can be 1 ms off
+                // instead...)
                 //
-                timeout /= 1000;
-                if(timeout == 0)
-                {
-                    // less than one is a waste of time (CPU intensive
-                    // until the time is reached, we can be 1 ms off
-                    // instead...)
-                    //
-                    timeout = 1;
-                }
+                timeout = 1;
             }
         }
-        else if(fds.empty())
-        {
-            SNAP_LOG_FATAL
-                << "communicator::run(): nothing to poll() on. All connections are disabled? (Ignoring "
-                << max_connections
-                << " and exiting the run() loop anyway.)"
-                << SNAP_LOG_SEND;
-            return false;
-        }
+    }
+    else if(f_fds.empty())
+    {
+        return NOTHING_TO_POLL;
+    }
 
+    return timeout;
+}
+
+
+/** \brief Wait for events and call the corresponding callbacks.
+ *
+ * This function calls poll() on the sockets gathered by prepare_poll()
+ * and then processes the connections with events or timeouts.
+ *
+ * \param[in] timeout  The poll() timeout in milliseconds.
+ */
+void communicator::poll_and_dispatch(std::int64_t timeout)
+{
 //SNAP_LOG_TRACE << "communicator::run(): ready to poll(); "
-//               << "count " << fds.size()
+//               << "count " << f_fds.size()
 //               << " timeout " << timeout
-//               << " (next was: " << next_timeout_timestamp
+//               << " (next was: " << f_next_timeout_timestamp
 //               << ", current ~ " << get_current_date()
 //               << ")"
 //               << SNAP_LOG_SEND;
 
-        // TODO: add support for ppoll() so we can support signals cleanly
-        //       with nearly no additional work from us
+    // TODO: add support for ppoll() so we can support signals cleanly
+    //       with nearly no additional work from us
+    //
+    errno = 0;
+    snapdev::timespec_ex start_on(snapdev::now());
+    int const r(poll(f_fds.empty() ? nullptr : &f_fds[0], f_fds.size(), timeout));
+    snapdev::timespec_ex end_on(snapdev::now());
+    snapdev::timespec_ex const waited(end_on - start_on);
+    f_idle += waited;
+    f_poll_wait->record(waited.to_usec());
+    if(r == 0
+    && f_earliest_timeout_timestamp < f_next_timeout_timestamp)
+    {
+        // the slack delayed this wakeup; without it, we would have
+        // woken up once per distinct timestamp now due
         //
-        errno = 0;
-        snapdev::timespec_ex start_on(snapdev::now());
-        int const r(poll(fds.empty() ? nullptr : &fds[0], fds.size(), timeout));
-        snapdev::timespec_ex end_on(snapdev::now());
-        f_idle += end_on - start_on;
-        if(r >= 0)
-        {
-            // quick sanity check
-            //
-            if(static_cast<size_t>(r) > connections.size())
+        std::int64_t const now(get_current_date());
+        std::sort(f_deadlines.begin(), f_deadlines.end());
+        std::uint64_t due(0);
+        for(std::size_t idx(0); idx < f_deadlines.size() && f_deadlines[idx] <= now; ++idx)
+        {
+            if(idx == 0
+            || f_deadlines[idx] != f_deadlines[idx - 1])
             {
-                throw runtime_error("communicator::run(): poll() returned a number of events to handle larger than the input allows.");
+                ++due;
             }
+        }
+        if(due > 1)
+        {
+            f_wakeups_saved->increment(due - 1);
+        }
+    }
+    if(r >= 0)
+    {
+        // quick sanity check
+        //
+        if(static_cast<size_t>(r) > f_polled.size())
+        {
+            throw runtime_error("communicator::run(): poll() returned a number of events to handle larger than the input allows.");
+        }
 //SNAP_LOG_TRACE
 //    <<"tid="
 //    << cppthread::gettid()
@@ -697,182 +1082,409 @@ bool communicator::run()
 //    << " events to handle"
 //    << SNAP_LOG_SEND;
 
-            // check each connection one by one for:
-            //
-            // 1) fds events, including signals
-            // 2) timeouts
-            //
-            // and execute the corresponding callbacks
+        if(f_scheduler == scheduler_t::SCHEDULER_DEFICIT_ROUND_ROBIN)
+        {
+            // gather the connections with events or timeouts and
+            // share the processing time between them
             //
-            for(size_t idx(0); idx < connections.size(); ++idx)
+            std::int64_t const now(get_current_date());
+            f_ready.clear();
+            for(size_t idx(0); idx < f_polled.size(); ++idx)
             {
-                connection::pointer_t c(connections[idx]);
-
-                // is the connection enabled?
-                //
-                // note that we check whether that connection was enabled
-                // before poll() was called; this is very important because
-                // the last poll() events must be run even if a previous
-                // callback call just disabled this very connection
-                // (i.e. at the time we called poll() the connection was
-                // still enabled and therefore we are expected to call
-                // their callbacks even if it just got disabled by an
-                // earlier callback)
-                //
-                if(!enabled[idx])
+                if(!f_enabled[idx])
                 {
-                    //SNAP_LOG_TRACE
-                    //    << "communicator::run(): in loop, connection '"
-                    //    << c->get_name()
-                    //    << "' has been disabled, so ignored!"
-                    //    << SNAP_LOG_SEND;
                     continue;
                 }
-
-                // if we have a valid fds position then an event other
-                // than a timeout occurred on that connection
-                //
-                if(c->f_fds_position >= 0)
+                connection::pointer_t c(f_polled[idx]);
+                int const revents(c->f_fds_position >= 0 ? f_fds[c->f_fds_position].revents : 0);
+                std::int64_t const timestamp(c->get_saved_timeout_timestamp());
+                if(revents != 0
+                || (timestamp != -1 && now >= timestamp))
                 {
-                    struct pollfd * fd(&fds[c->f_fds_position]);
-
-                    // if any events were found by poll(), process them now
-                    //
-//SNAP_LOG_TRACE
-//    <<"tid="
-//    << cppthread::gettid()
-//    << ", communicator::run(): events for "
-//    << c->get_name()
-//    << " = "
-//    << fd->revents
-//    << SNAP_LOG_SEND;
-                    if(fd->revents != 0)
-                    {
-                        // an event happened on this one
-                        //
-                        if((fd->revents & (POLLIN | POLLPRI)) != 0)
-                        {
-                            // we consider that Unix signals have the greater priority
-                            // and thus handle them first
-                            //
-                            if(c->is_signal())
-                            {
-                                signal * ss(dynamic_cast<signal *>(c.get()));
-                                if(ss != nullptr)
-                                {
-                                    ss->process();
-                                }
-                            }
-                            else if(c->is_listener())
-                            {
-                                // a listener is a special case and we want
-                                // to call process_accept() instead
-                                //
-                                c->process_accept();
-                            }
-                            else
-                            {
-                                c->process_read();
-                            }
-                        }
-                        if((fd->revents & POLLOUT) != 0)
-                        {
-                            c->process_write();
-                        }
-                        if((fd->revents & POLLERR) != 0)
-                        {
-                            c->process_error();
-                        }
-                        if((fd->revents & (POLLHUP | POLLRDHUP)) != 0)
-                        {
-                            c->process_hup();
-                        }
-                        if((fd->revents & POLLNVAL) != 0)
-                        {
-                            c->process_invalid();
-                        }
-                    }
+                    f_ready.push_back({ c, revents });
                 }
+            }
+            process_deficit_round_robin(f_ready);
+            return;
+        }
 
-                // now check whether we have a timeout on this connection
-                //
-                std::int64_t const timestamp(c->get_saved_timeout_timestamp());
-                if(timestamp != -1)
-                {
-                    std::int64_t const now(get_current_date());
-                    if(now >= timestamp)
-                    {
-//SNAP_LOG_TRACE
-//    << "communicator::run(): timer of connection = '"<< c->get_name()
-//    << "', timestamp = " << timestamp
-//    << ", now = " << now
-//    << ", now >= timestamp --> " << (now >= timestamp ? "TRUE (timed out!)" : "FALSE")
-//    << SNAP_LOG_SEND;
+        // check each connection one by one for:
+        //
+        // 1) fds events, including signals
+        // 2) timeouts
+        //
+        // and execute the corresponding callbacks
+        //
+        for(size_t idx(0); idx < f_polled.size(); ++idx)
+        {
+            connection::pointer_t c(f_polled[idx]);
 
-                        // move the timeout as required first
-                        // (because the callback may move it too)
-                        //
-                        c->calculate_next_tick();
-
-                        // the timeout date needs to be reset if the tick
-                        // happened for that date
-                        //
-                        std::int64_t const timeout_date(c->get_timeout_date());
-                        if(timeout_date >= 0
-                        && now >= timeout_date)
-                        {
-                            c->set_timeout_date(-1);
-                        }
-
-                        // then run the callback
-                        //
-                        c->process_timeout();
-                    }
-                }
+            // is the connection enabled?
+            //
+            // note that we check whether that connection was enabled
+            // before poll() was called; this is very important because
+            // the last poll() events must be run even if a previous
+            // callback call just disabled this very connection
+            // (i.e. at the time we called poll() the connection was
+            // still enabled and therefore we are expected to call
+            // their callbacks even if it just got disabled by an
+            // earlier callback)
+            //
+            if(!f_enabled[idx])
+            {
+                //SNAP_LOG_TRACE
+                //    << "communicator::run(): in loop, connection '"
+                //    << c->get_name()
+                //    << "' has been disabled, so ignored!"
+                //    << SNAP_LOG_SEND;
+                continue;
+            }
+
+            process_connection(c, c->f_fds_position >= 0 ? f_fds[c->f_fds_position].revents : 0);
+        }
+    }
+    else
+    {
+        // r < 0 means an error occurred
+        //
+        if(errno == EINTR)
+        {
+            if(stall_detector::interrupted()
+            || signal_profiler::is_profiling())
+            {
+                // our stall detector signal arrived just after the
+                // callback returned or the profiler SIGPROF arrived
+                // while entering poll()
+                //
+                return;
             }
+
+            // Note: if the user wants to prevent this error, he should
+            //       use the signal with the Unix signals that may
+            //       happen while calling poll().
+            //
+            throw runtime_error("communicator::run(): EINTR occurred while in poll() -- interrupts are not supported yet");
+        }
+        if(errno == EFAULT)
+        {
+            throw invalid_parameter("communicator::run(): buffer was moved out of our address space?");
+        }
+        if(errno == EINVAL)
+        {
+            // if this is really because nfds is too large then it may be
+            // a "soft" error that can be fixed; that being said, my
+            // current Linux version supports 16K files which frankly
+            // when we reach that level we have a problem...
+            //
+            struct rlimit rl;
+            getrlimit(RLIMIT_NOFILE, &rl);
+            throw invalid_parameter(
+                        "communicator::run(): too many file fds for poll, limit is currently "
+                      + std::to_string(rl.rlim_cur)
+                      + ", your kernel top limit is "
+                      + std::to_string(rl.rlim_max));
+        }
+        if(errno == ENOMEM)
+        {
+            throw runtime_error("communicator::run(): poll() failed trying to allocate memory");
+        }
+        int const e(errno);
+        throw runtime_error(
+                    "communicator::run(): poll() failed with error "
+                  + std::to_string(e)
+                  + " -- "
+                  + strerror(e));
+    }
+}
+
+
+/** \brief Synchronize the epoll descriptor with the pollfd array.
+ *
+ * When get_poll_fd() was called, this function updates the set of
+ * sockets watched by the epoll descriptor to match the array of pollfd
+ * structures prepared by prepare_poll().
+ *
+ * The events registered for each socket are cached along the identifier
+ * of the connection which owns it. A socket whose events and owner did
+ * not change since the last call is left alone, so the kernel is only
+ * called when a socket gets added, modified, or removed.
+ *
+ * A socket may be closed and its number reused by a new connection
+ * between two calls. The kernel already dropped the old entry in that
+ * case, which is why a change of owner always re-registers the socket.
+ */
+void communicator::update_poll_fd()
+{
+    if(f_poll_fd == nullptr)
+    {
+        return;
+    }
+
+    poll_event_t::map_t wanted;
+    for(auto const & c : f_polled)
+    {
+        if(c->f_fds_position < 0)
+        {
+            continue;
+        }
+        struct pollfd const & fd(f_fds[c->f_fds_position]);
+        auto const it(wanted.find(fd.fd));
+        if(it == wanted.end())
+        {
+            // the POLL... and EPOLL... flags have the same values
+            //
+            wanted[fd.fd] = poll_event_t{ static_cast<std::uint32_t>(fd.events), c->get_id() };
         }
         else
         {
-            // r < 0 means an error occurred
+            it->second.f_events |= static_cast<std::uint32_t>(fd.events);
+        }
+    }
+
+    for(auto const & registered : f_poll_events)
+    {
+        if(wanted.find(registered.first) == wanted.end())
+        {
+            // the socket may already be closed, ignore errors
             //
-            if(errno == EINTR)
+            epoll_ctl(f_poll_fd.get(), EPOLL_CTL_DEL, registered.first, nullptr);
+        }
+    }
+
+    for(auto const & w : wanted)
+    {
+        int op(EPOLL_CTL_ADD);
+        auto const registered(f_poll_events.find(w.first));
+        if(registered != f_poll_events.end())
+        {
+            if(registered->second.f_connection_id == w.second.f_connection_id)
             {
-                // Note: if the user wants to prevent this error, he should
-                //       use the signal with the Unix signals that may
-                //       happen while calling poll().
+                if(registered->second.f_events == w.second.f_events)
+                {
+                    continue;
+                }
+                op = EPOLL_CTL_MOD;
+            }
+            else
+            {
+                // new owner, the old entry may or may not still exist
                 //
-                throw runtime_error("communicator::run(): EINTR occurred while in poll() -- interrupts are not supported yet");
+                epoll_ctl(f_poll_fd.get(), EPOLL_CTL_DEL, w.first, nullptr);
             }
-            if(errno == EFAULT)
+        }
+
+        epoll_event event = {};
+        event.events = w.second.f_events;
+        event.data.fd = w.first;
+        if(epoll_ctl(f_poll_fd.get(), op, w.first, &event) != 0)
+        {
+            int const e(errno);
+            SNAP_LOG_ERROR
+                << "communicator::update_poll_fd(): could not "
+                << (op == EPOLL_CTL_ADD ? "add" : "modify")
+                << " socket "
+                << w.first
+                << " in the epoll set (errno: "
+                << e
+                << " -- "
+                << strerror(e)
+                << ")."
+                << SNAP_LOG_SEND;
+
+            // connection identifiers start at 1, so this forces a new
+            // attempt on the next call
+            //
+            wanted[w.first].f_connection_id = 0;
+        }
+    }
+
+    f_poll_events.swap(wanted);
+}
+
+
+
+/** \brief Call the callbacks of one connection.
+ *
+ * This function calls the callbacks corresponding to the \p revents
+ * returned by poll() and then checks whether the connection timed out.
+ *
+ * The time spent in the callbacks is added to the connection scheduling
+ * statistics.
+ *
+ * \param[in] c  The connection to process.
+ * \param[in] revents  The events returned by poll() or 0.
+ *
+ * \return The number of microseconds spent in the callbacks.
+ */
+std::int64_t communicator::process_connection(connection::pointer_t c, int revents)
+{
+    std::int64_t const timestamp(c->get_saved_timeout_timestamp());
+    if(revents == 0
+    && timestamp == -1)
+    {
+        return 0;
+    }
+
+    std::int64_t const start_date(get_current_date());
+    bool processed(false);
+    callback_guard guard(c.get(), start_date);
+
+    // if any events were found by poll(), process them now
+    //
+    if(revents != 0)
+    {
+        processed = true;
+
+        // an event happened on this one
+        //
+        if((revents & (POLLIN | POLLPRI)) != 0)
+        {
+            // we consider that Unix signals have the greater priority
+            // and thus handle them first
+            //
+            if(c->is_signal())
             {
-                throw invalid_parameter("communicator::run(): buffer was moved out of our address space?");
+                signal * ss(dynamic_cast<signal *>(c.get()));
+                if(ss != nullptr)
+                {
+                    ss->process();
+                }
             }
-            if(errno == EINVAL)
+            else if(c->is_listener())
             {
-                // if this is really because nfds is too large then it may be
-                // a "soft" error that can be fixed; that being said, my
-                // current Linux version supports 16K files which frankly
-                // when we reach that level we have a problem...
+                // a listener is a special case and we want
+                // to call process_accept() instead
                 //
-                struct rlimit rl;
-                getrlimit(RLIMIT_NOFILE, &rl);
-                throw invalid_parameter(
-                            "communicator::run(): too many file fds for poll, limit is currently "
-                          + std::to_string(rl.rlim_cur)
-                          + ", your kernel top limit is "
-                          + std::to_string(rl.rlim_max));
+                c->process_accept();
             }
-            if(errno == ENOMEM)
+            else
             {
-                throw runtime_error("communicator::run(): poll() failed trying to allocate memory");
+                c->process_read();
             }
-            int const e(errno);
-            throw runtime_error(
-                        "communicator::run(): poll() failed with error "
-                      + std::to_string(e)
-                      + " -- "
-                      + strerror(e));
         }
+        if((revents & POLLOUT) != 0)
+        {
+            c->process_write();
+        }
+        if((revents & POLLERR) != 0)
+        {
+            c->process_error();
+        }
+        if((revents & (POLLHUP | POLLRDHUP)) != 0)
+        {
+            c->process_hup();
+        }
+        if((revents & POLLNVAL) != 0)
+        {
+            c->process_invalid();
+        }
+    }
+
+    // now check whether we have a timeout on this connection
+    //
+    if(timestamp != -1)
+    {
+        std::int64_t const now(get_current_date());
+        if(now >= timestamp)
+        {
+            processed = true;
+
+            // move the timeout as required first
+            // (because the callback may move it too)
+            //
+            c->calculate_next_tick();
+
+            // the timeout date needs to be reset if the tick
+            // happened for that date
+            //
+            std::int64_t const timeout_date(c->get_timeout_date());
+            if(timeout_date >= 0
+            && now >= timeout_date)
+            {
+                c->set_timeout_date(-1);
+            }
+
+            // then run the callback
+            //
+            ++c->f_timeouts;
+            f_timeouts_fired->increment();
+            c->process_timeout();
+        }
+    }
+
+    if(!processed)
+    {
+        return 0;
+    }
+
+    std::int64_t const used(get_current_date() - start_date);
+    ++c->f_scheduled_events;
+    c->f_processing_time += used;
+    f_callback_duration->record(used);
+    return used;
+}
+
+
+/** \brief Process the ready connections with the deficit round robin.
+ *
+ * First the signals and the connections in the latency class get
+ * processed, as long as the latency budget is not exhausted. Then each
+ * remaining connection receives its quantum and gets processed only if
+ * its deficit is positive. Otherwise its events are deferred: poll()
+ * reports them again on the next loop and by then the connection will
+ * have received another quantum.
+ *
+ * The deficit is capped to one quantum so a connection which was idle
+ * for a while cannot monopolize the loop.
+ *
+ * \param[in,out] ready  The connections with events or timeouts, sorted
+ * by priority.
+ */
+void communicator::process_deficit_round_robin(ready_vector_t & ready)
+{
+    std::int64_t latency_used(0);
+    for(auto & r : ready)
+    {
+        connection::pointer_t c(r.f_connection);
+        if(c->is_signal())
+        {
+            process_connection(c, r.f_revents);
+            r.f_connection.reset();
+            continue;
+        }
+        if(c->get_priority() > f_latency_priority
+        || latency_used >= f_latency_budget)
+        {
+            continue;
+        }
+        latency_used += process_connection(c, r.f_revents);
+        r.f_connection.reset();
+    }
+
+    std::size_t const max(ready.size());
+    if(max == 0)
+    {
+        return;
+    }
+    std::size_t const start(f_round_robin_position % max);
+    ++f_round_robin_position;
+    for(std::size_t idx(0); idx < max; ++idx)
+    {
+        ready_t & r(ready[(start + idx) % max]);
+        if(r.f_connection == nullptr)
+        {
+            continue;
+        }
+
+        connection::pointer_t c(r.f_connection);
+        std::int64_t const quantum(get_priority_quantum(c->get_priority()));
+        c->f_deficit = std::min(c->f_deficit + quantum, quantum);
+        if(c->f_deficit <= 0)
+        {
+            ++c->f_deferred_events;
+            continue;
+        }
+        c->f_deficit -= process_connection(c, r.f_revents);
     }
 }
 
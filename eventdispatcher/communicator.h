@@ -29,6 +29,7 @@
 // self
 //
 #include    <eventdispatcher/connection.h>
+#include    <eventdispatcher/metrics.h>
 
 
 // snaplogger
@@ -38,15 +39,38 @@
 
 // snapdev
 //
+#include    <snapdev/raii_generic_deleter.h>
 #include    <snapdev/timespec_ex.h>
 
 
+// C++
+//
+#include    <map>
+#include    <vector>
+
+
+// C
+//
+#include    <poll.h>
+
+
 
 namespace ed
 {
 
 
 
+constexpr std::int64_t const            DEFAULT_SCHEDULER_QUANTUM = 5'000;      // 5ms per round
+constexpr std::int64_t const            DEFAULT_LATENCY_BUDGET = 10'000;        // 10ms per loop
+
+
+enum class scheduler_t
+{
+    SCHEDULER_PRIORITY,                 // visit ready connections in priority order (default)
+    SCHEDULER_DEFICIT_ROUND_ROBIN,      // share the processing time between ready connections
+};
+
+
 // WARNING: a communicator object must be allocated and held in a shared pointer (see pointer_t)
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wnon-virtual-dtor"
@@ -68,8 +92,18 @@ public:
     bool                                get_show_connections() const;
     void                                set_show_connections(bool status);
     snapdev::timespec_ex const &        get_idle() const;
+    scheduler_t                         get_scheduler() const;
+    void                                set_scheduler(scheduler_t scheduler);
+    std::int64_t                        get_priority_quantum(priority_t priority) const;
+    void                                set_priority_quantum(priority_t priority, std::int64_t quantum_us);
+    priority_t                          get_latency_priority() const;
+    std::int64_t                        get_latency_budget() const;
+    void                                set_latency_class(priority_t priority, std::int64_t budget_us);
 
     virtual bool                        run();
+    bool                                process_events();
+    int                                 get_poll_fd();
+    std::int64_t                        get_poll_timeout() const;
 
 private:
                                         communicator();
@@ -77,12 +111,56 @@ private:
 
     communicator &                      operator = (communicator const &) = delete;
 
+    struct ready_t
+    {
+        connection::pointer_t           f_connection = connection::pointer_t();
+        int                             f_revents = 0;
+    };
+    typedef std::vector<ready_t>        ready_vector_t;
+
+    struct poll_event_t
+    {
+        typedef std::map<int, poll_event_t>    map_t;
+
+        std::uint32_t                   f_events = 0;
+        std::uint64_t                   f_connection_id = 0;
+    };
+
+    static constexpr std::int64_t const NOTHING_TO_POLL = -2;
+
+    void                                initialize_metrics();
+    std::int64_t                        prepare_poll();
+    void                                poll_and_dispatch(std::int64_t timeout);
+    void                                update_poll_fd();
+    std::int64_t                        process_connection(connection::pointer_t c, int revents);
+    void                                process_deficit_round_robin(ready_vector_t & ready);
+
     connection::vector_t                f_connections = connection::vector_t();
+    connection::vector_t                f_polled = connection::vector_t();
+    std::vector<bool>                   f_enabled = std::vector<bool>();
+    std::vector<struct pollfd>          f_fds = std::vector<struct pollfd>();
+    std::vector<std::int64_t>           f_deadlines = std::vector<std::int64_t>();
+    ready_vector_t                      f_ready = ready_vector_t();
+    std::int64_t                        f_next_timeout_timestamp = 0;
+    std::int64_t                        f_earliest_timeout_timestamp = 0;
+    snapdev::raii_fd_t                  f_poll_fd = snapdev::raii_fd_t();
+    poll_event_t::map_t                 f_poll_events = poll_event_t::map_t();
+    std::int64_t                        f_poll_timeout = -1;
     bool                                f_force_sort = true;
     bool                                f_running = false;
     bool                                f_show_connections = false;
     snaplogger::severity_t              f_debug_connections = snaplogger::severity_t::SEVERITY_OFF;
     snapdev::timespec_ex                f_idle = snapdev::timespec_ex();
+    scheduler_t                         f_scheduler = scheduler_t::SCHEDULER_PRIORITY;
+    std::map<priority_t, std::int64_t>  f_quantums = std::map<priority_t, std::int64_t>();
+    priority_t                          f_latency_priority = EVENT_MIN_PRIORITY - 1;
+    std::int64_t                        f_latency_budget = DEFAULT_LATENCY_BUDGET;
+    std::size_t                         f_round_robin_position = 0;
+    metrics_counter *                   f_iterations = nullptr;
+    metrics_histogram *                 f_poll_wait = nullptr;
+    metrics_counter *                   f_wakeups_saved = nullptr;
+    metrics_histogram *                 f_callback_duration = nullptr;
+    metrics_counter *                   f_timeouts_fired = nullptr;
 };
 #pragma GCC diagnostic pop
 
@@ -43,6 +43,7 @@
 
 // C++
 //
+#include    <atomic>
 #include    <cstring>
 
 
@@ -64,11 +65,31 @@ namespace ed
 
 
 
+namespace
+{
+
+
+
+/** \brief The identifier of the next connection.
+ *
+ * Connections can be created in any thread so the counter is atomic.
+ */
+std::atomic<std::uint64_t>      g_next_id = std::atomic<std::uint64_t>(1);
+
+
+
+} // no name namespace
+
+
+
 /** \brief Initializes the connection.
  *
  * This function initializes a base connection object.
+ *
+ * Each connection receives a unique identifier (see get_id()).
  */
 connection::connection()
+    : f_id(g_next_id.fetch_add(1, std::memory_order_relaxed))
 {
 }
 
@@ -117,6 +138,20 @@ std::string const & connection::get_name() const
 }
 
 
+/** \brief Retrieve the unique identifier of the connection.
+ *
+ * Names are not unique (all the clients of a server often share the
+ * same name) so the metrics use this identifier to distinguish the
+ * connections.
+ *
+ * \return The identifier of this connection, starting at 1.
+ */
+std::uint64_t connection::get_id() const
+{
+    return f_id;
+}
+
+
 /** \brief Change the name of the connection.
  *
  * A connection can be given a name. This is mainly for debug purposes.
@@ -424,6 +459,131 @@ void connection::set_processing_time_limit(std::int32_t processing_time_limit)
 }
 
 
+/** \brief Get the number of times this connection was processed.
+ *
+ * Each time the communicator calls the callbacks of this connection
+ * because of an event or a timeout, this counter is incremented.
+ *
+ * \return The number of times this connection events were processed.
+ *
+ * \sa reset_scheduling_stats()
+ */
+std::int64_t connection::get_scheduled_events() const
+{
+    return f_scheduled_events;
+}
+
+
+/** \brief Get the number of times this connection was deferred.
+ *
+ * When the communicator uses the deficit round robin scheduler, a
+ * connection which used more than its share of processing time gets
+ * its events deferred to a later loop. This counter is incremented
+ * each time that happens.
+ *
+ * \return The number of times this connection events were deferred.
+ *
+ * \sa communicator::set_scheduler()
+ */
+std::int64_t connection::get_deferred_events() const
+{
+    return f_deferred_events;
+}
+
+
+/** \brief Get the total time spent in this connection callbacks.
+ *
+ * \return The processing time in microseconds.
+ */
+std::int64_t connection::get_processing_time() const
+{
+    return f_processing_time;
+}
+
+
+/** \brief Reset the scheduling statistics.
+ *
+ * This function resets the counters returned by get_scheduled_events(),
+ * get_deferred_events(), and get_processing_time() to zero.
+ */
+void connection::reset_scheduling_stats()
+{
+    f_scheduled_events = 0;
+    f_deferred_events = 0;
+    f_processing_time = 0;
+}
+
+
+/** \brief Get the number of bytes read by this connection.
+ *
+ * The buffer connections count the bytes they read from their socket.
+ * Other connections return 0.
+ *
+ * \return The total number of bytes read.
+ */
+std::uint64_t connection::get_bytes_read() const
+{
+    return f_bytes_read;
+}
+
+
+/** \brief Get the number of bytes written by this connection.
+ *
+ * The buffer connections count the bytes they write to their socket.
+ * Other connections return 0.
+ *
+ * \return The total number of bytes written.
+ */
+std::uint64_t connection::get_bytes_written() const
+{
+    return f_bytes_written;
+}
+
+
+/** \brief Get the number of times this connection timed out.
+ *
+ * \return The number of times process_timeout() was called by the
+ * communicator.
+ */
+std::uint64_t connection::get_timeouts() const
+{
+    return f_timeouts;
+}
+
+
+/** \brief Get the number of bytes waiting to be written.
+ *
+ * The buffer connections reimplement this function to return the size
+ * of their output buffer.
+ *
+ * \return The number of bytes in the output buffer, 0 by default.
+ */
+std::size_t connection::get_output_size() const
+{
+    return 0;
+}
+
+
+/** \brief Add to the number of bytes read.
+ *
+ * \param[in] size  The number of bytes just read.
+ */
+void connection::add_bytes_read(std::size_t size)
+{
+    f_bytes_read += size;
+}
+
+
+/** \brief Add to the number of bytes written.
+ *
+ * \param[in] size  The number of bytes just written.
+ */
+void connection::add_bytes_written(std::size_t size)
+{
+    f_bytes_written += size;
+}
+
+
 /** \brief Return the delay between ticks when this connection times out.
  *
  * All connections can include a timeout delay in microseconds which is
@@ -710,6 +870,57 @@ std::int64_t connection::get_timeout_timestamp() const
 }
 
 
+/** \brief Get the slack allowed on this connection timeouts.
+ *
+ * \return The number of microseconds the timeout may be delayed by.
+ *
+ * \sa set_timeout_slack()
+ */
+std::int64_t connection::get_timeout_slack() const
+{
+    return f_timeout_slack;
+}
+
+
+/** \brief Allow the timeout of this connection to happen a little late.
+ *
+ * By default, the communicator wakes up as close as possible to each
+ * timeout. With hundreds of periodic timers, this means waking up many
+ * times per second for work which could as well be done at once.
+ *
+ * The slack tells the communicator that this connection's timeout can
+ * happen anywhere between its timestamp and its timestamp plus
+ * \p slack_us. The communicator then waits until the earliest end of
+ * such windows and processes all the timeouts which are due by then
+ * in a single wakeup. A connection with a slack of 0 (the default)
+ * always gets its exact deadline.
+ *
+ * The slack applies to the timeout date and the timeout delay alike.
+ * Since the ticks of a timeout delay do not slip, a delayed tick does
+ * not move the following ones.
+ *
+ * \exception parameter_error
+ * The slack cannot be negative.
+ *
+ * \param[in] slack_us  The slack in microseconds.
+ *
+ * \sa get_timeout_slack()
+ */
+void connection::set_timeout_slack(std::int64_t slack_us)
+{
+    if(slack_us < 0)
+    {
+        throw parameter_error(
+                      "connection::set_timeout_slack():"
+                      " slack_us parameter cannot be negative, "
+                    + std::to_string(slack_us)
+                    + " is not valid.");
+    }
+
+    f_timeout_slack = slack_us;
+}
+
+
 /** \brief Save the timeout stamp just before calling poll().
  *
  * This function is called by the run() function before the poll()
@@ -78,6 +78,7 @@ public:
 
     std::string const &         get_name() const;
     void                        set_name(std::string const & name);
+    std::uint64_t               get_id() const;
 
     virtual bool                is_listener() const;
     virtual bool                is_signal() const;
@@ -98,6 +99,15 @@ public:
     std::int32_t                get_processing_time_limit() const;
     void                        set_processing_time_limit(std::int32_t processing_time_limit);
 
+    std::int64_t                get_scheduled_events() const;
+    std::int64_t                get_deferred_events() const;
+    std::int64_t                get_processing_time() const;
+    void                        reset_scheduling_stats();
+    std::uint64_t               get_bytes_read() const;
+    std::uint64_t               get_bytes_written() const;
+    std::uint64_t               get_timeouts() const;
+    virtual std::size_t         get_output_size() const;
+
     std::int64_t                get_timeout_delay() const;
     void                        set_timeout_delay(std::int64_t timeout_us);
     void                        set_timeout_delay(snapdev::timespec_ex const & date);
@@ -106,6 +116,8 @@ public:
     void                        set_timeout_date(std::int64_t date_us);
     void                        set_timeout_date(snapdev::timespec_ex const & date);
     std::int64_t                get_timeout_timestamp() const;
+    std::int64_t                get_timeout_slack() const;
+    void                        set_timeout_slack(std::int64_t slack_us);
 
     void                        non_blocking();
     bool                        is_non_blocking() const;
@@ -131,6 +143,8 @@ public:
 
 protected:
     std::int64_t                save_timeout_timestamp();
+    void                        add_bytes_read(std::size_t size);
+    void                        add_bytes_written(std::size_t size);
 
 private:
     enum class non_blocking_state_t : std::uint8_t
@@ -144,6 +158,7 @@ private:
 
     std::int64_t                get_saved_timeout_timestamp() const;
 
+    std::uint64_t const         f_id;
     std::string                 f_name = std::string();
     bool                        f_enabled = true;
     bool                        f_done = false;
@@ -156,8 +171,16 @@ private:
     std::int64_t                f_timeout_next_date = -1;           // in microseconds, when we use the f_timeout_delay
     std::int64_t                f_timeout_date = -1;                // in microseconds
     std::int64_t                f_saved_timeout_stamp = -1;         // in microseconds
+    std::int64_t                f_timeout_slack = 0;                // in microseconds
     std::int32_t                f_processing_time_limit = 500'000;  // in microseconds
     int                         f_fds_position = -1;
+    std::int64_t                f_deficit = 0;                      // in microseconds, deficit round robin scheduler
+    std::int64_t                f_scheduled_events = 0;
+    std::int64_t                f_deferred_events = 0;
+    std::int64_t                f_processing_time = 0;              // in microseconds
+    std::uint64_t               f_bytes_read = 0;
+    std::uint64_t               f_bytes_written = 0;
+    std::uint64_t               f_timeouts = 0;
 };
 #pragma GCC diagnostic pop
 
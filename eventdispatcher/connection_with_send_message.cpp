@@ -33,7 +33,16 @@
 #include    "eventdispatcher/dispatcher.h"
 #include    "eventdispatcher/dispatcher_support.h"
 #include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/metrics.h"
 #include    "eventdispatcher/names.h"
+#include    "eventdispatcher/signal_profiler.h"
+#include    "eventdispatcher/timer.h"
+#include    "eventdispatcher/utils.h"
+
+
+// advgetopt
+//
+#include    <advgetopt/validator_integer.h>
 
 
 // snaplogger
@@ -53,8 +62,15 @@
 #include    <libaddr/addr_parser.h>
 
 
+// C++
+//
+#include    <limits>
+
+
 // C
 //
+#include    <unistd.h>
+
 #ifdef __SANITIZE_ADDRESS__
 #include    <sanitizer/lsan_interface.h>
 #endif
@@ -71,6 +87,94 @@ namespace ed
 
 
 
+namespace
+{
+
+
+
+/** \brief Timer used to time out requests.
+ *
+ * The connection_with_send_message creates one such timer when it has
+ * requests in flight. The timer is set to the date when the oldest
+ * request times out.
+ */
+class request_timer
+    : public timer
+{
+public:
+    typedef std::shared_ptr<request_timer>  pointer_t;
+
+    request_timer(connection_with_send_message * c)
+        : timer(-1)
+        , f_connection(c)
+    {
+        set_name("connection_with_send_message::request_timer");
+    }
+
+    request_timer(request_timer const & rhs) = delete;
+    request_timer & operator = (request_timer const & rhs) = delete;
+
+    virtual void process_timeout() override
+    {
+        f_connection->process_request_timeouts();
+    }
+
+private:
+    connection_with_send_message *  f_connection = nullptr;
+};
+
+
+/** \brief Timer used to call the callbacks of canceled requests.
+ *
+ * When the communicator removes a connection, the requests still in
+ * flight get canceled. The callbacks are not called from within
+ * remove_connection(); instead they are saved in this one shot timer
+ * which calls them on the next run of the event loop. The timer does
+ * not depend on the connection, which may be gone by then.
+ */
+class canceled_requests
+    : public timer
+{
+public:
+    typedef std::shared_ptr<canceled_requests>  pointer_t;
+    typedef std::pair<connection_with_send_message::request_callback_t, message>
+                                                request_t;
+    typedef std::vector<request_t>              vector_t;
+
+    canceled_requests(vector_t && requests)
+        : timer(0)
+        , f_requests(std::move(requests))
+    {
+        set_name("connection_with_send_message::canceled_requests");
+    }
+
+    canceled_requests(canceled_requests const & rhs) = delete;
+    canceled_requests & operator = (canceled_requests const & rhs) = delete;
+
+    virtual void process_timeout() override
+    {
+        // keep a reference while the callbacks run
+        //
+        pointer_t self(std::static_pointer_cast<canceled_requests>(shared_from_this()));
+        communicator::instance()->remove_connection(self);
+
+        for(auto & r : f_requests)
+        {
+            r.first(request_status_t::REQUEST_STATUS_CANCELED, r.second);
+        }
+        f_requests.clear();
+    }
+
+private:
+    vector_t                        f_requests = vector_t();
+};
+
+
+
+} // no name namespace
+
+
+
 /** \brief Initialize the connection.
  *
  * This constructor initialize the connection with a send_message() function.
@@ -102,6 +206,18 @@ connection_with_send_message::connection_with_send_message(std::string const & s
  */
 connection_with_send_message::~connection_with_send_message()
 {
+    // the callbacks are not called here since the derived object is
+    // already gone; the requests still in flight are silently dropped
+    //
+    if(!f_requests.empty())
+    {
+        SNAP_LOG_DEBUG
+            << "dropping "
+            << f_requests.size()
+            << " request(s) still in flight on destruction."
+            << SNAP_LOG_SEND;
+    }
+    communicator::instance()->remove_connection(f_request_timer);
 }
 
 
@@ -111,7 +227,9 @@ connection_with_send_message::~connection_with_send_message()
  * To check whether a service is alive, send the ALIVE message. This
  * function builds an ABSOLUTELY reply and attaches the "serial" parameter
  * as is if present in the ALIVE message. It also includes the original
- * "timestamp" parameter.
+ * "timestamp" parameter. The "serial" is also copied to the "reply_to"
+ * parameter so a request sent with send_request() gets its reply (see
+ * mark_reply()).
  *
  * The function also adds one field named "reply_timestamp" with the Unix
  * time in seconds with a precision of nanoseconds (after the decimal point,
@@ -139,6 +257,7 @@ void connection_with_send_message::msg_alive(message & msg)
     {
         absolutely.add_parameter(g_name_ed_param_serial, msg.get_parameter(g_name_ed_param_serial));
     }
+    mark_reply(absolutely, msg);
     if(msg.has_parameter(g_name_ed_param_timestamp))
     {
         absolutely.add_parameter(g_name_ed_param_timestamp, msg.get_parameter(g_name_ed_param_timestamp));
@@ -157,6 +276,42 @@ void connection_with_send_message::msg_alive(message & msg)
 }
 
 
+/** \brief Reply to the STATS message.
+ *
+ * This function replies to the STATS message with a STATISTICS message.
+ * The "metrics" parameter includes the metrics of this thread and of the
+ * connections in the communicator in the Prometheus text format.
+ *
+ * The "serial" parameter is copied as is if present in the STATS message.
+ * It is also copied to the "reply_to" parameter (see mark_reply()).
+ *
+ * \param[in] msg  The STATS message.
+ */
+void connection_with_send_message::msg_stats(message & msg)
+{
+    message statistics;
+    statistics.user_data(msg.user_data<void>());
+    statistics.reply_to(msg);
+    statistics.set_command(g_name_ed_cmd_statistics);
+    if(msg.has_parameter(g_name_ed_param_serial))
+    {
+        statistics.add_parameter(g_name_ed_param_serial, msg.get_parameter(g_name_ed_param_serial));
+    }
+    mark_reply(statistics, msg);
+    statistics.add_parameter(g_name_ed_param_metrics, metrics::instance().to_prometheus());
+    if(!send_message(statistics, false))
+    {
+        SNAP_LOG_WARNING
+            << "could not reply to \""
+            << msg.get_command()
+            << "\" with a "
+            << g_name_ed_cmd_statistics
+            << " message."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
 /** \brief Build the HELP reply and send it.
  *
  * When a service registers with the communicator daemon, it sends a REGISTER
@@ -257,6 +412,118 @@ void connection_with_send_message::msg_log_rotate(message & msg)
 }
 
 
+/** \brief Start or stop the sampling profiler.
+ *
+ * The PROFILE message accepts the following parameters:
+ *
+ * \li action -- "start" (default), "stop" or "status";
+ * \li duration -- the number of seconds to profile, 30 by default, 0 to
+ * profile until a PROFILE message with action "stop" is received;
+ * \li frequency -- the number of samples per second;
+ * \li filename -- the basename of the file where the collapsed stacks
+ * get saved, by default "ed-profile-<pid>-<date>.folded".
+ *
+ * The file is created in the directory defined with
+ * signal_profiler::set_profile_directory(). If no directory was defined,
+ * the profile is not saved. The "filename" cannot include a slash so
+ * a peer cannot write anywhere else. The file is created with O_EXCL
+ * and O_NOFOLLOW so an existing file or a symbolic link is never
+ * overwritten.
+ *
+ * The function replies with a PROFILING message with the "status"
+ * ("running", "stopped", "busy" or "invalid"), the "filename" and the
+ * number of "samples" collected so far.
+ *
+ * \param[in] msg  The PROFILE message.
+ */
+void connection_with_send_message::msg_profile(message & msg)
+{
+    signal_profiler::pointer_t profiler(signal_profiler::get_instance());
+
+    std::string const action(msg.has_parameter(g_name_ed_param_action)
+            ? msg.get_parameter(g_name_ed_param_action)
+            : std::string("start"));
+    std::string status;
+    if(action == "start")
+    {
+        std::string const basename(msg.has_parameter(g_name_ed_param_filename)
+                ? msg.get_parameter(g_name_ed_param_filename)
+                : "ed-profile-"
+                    + std::to_string(getpid())
+                    + '-'
+                    + std::to_string(get_current_date())
+                    + ".folded");
+        std::string const & directory(signal_profiler::get_profile_directory());
+        bool const valid_basename(!basename.empty()
+                && basename != "."
+                && basename != ".."
+                && basename.find('/') == std::string::npos);
+        std::string const filename(directory.empty() || !valid_basename
+                ? std::string()
+                : directory + '/' + basename);
+        std::int64_t const duration(msg.has_parameter(g_name_ed_param_duration)
+                ? msg.get_integer_parameter(g_name_ed_param_duration)
+                : 30);
+        std::int64_t const frequency(msg.has_parameter(g_name_ed_param_frequency)
+                ? msg.get_integer_parameter(g_name_ed_param_frequency)
+                : DEFAULT_PROFILER_FREQUENCY);
+        if(duration < 0
+        || !valid_basename)
+        {
+            status = "invalid";
+        }
+        else
+        {
+            try
+            {
+                status = profiler->start(frequency, duration * 1'000'000, filename)
+                            ? "running"
+                            : "busy";
+            }
+            catch(invalid_parameter const & e)
+            {
+                SNAP_LOG_ERROR
+                    << "could not start the profiler: "
+                    << e.what()
+                    << SNAP_LOG_SEND;
+                status = "invalid";
+            }
+        }
+    }
+    else if(action == "stop")
+    {
+        profiler->stop();
+        status = "stopped";
+    }
+    else if(action == "status")
+    {
+        status = profiler->is_running() ? "running" : "stopped";
+    }
+    else
+    {
+        status = "invalid";
+    }
+
+    message profiling;
+    profiling.user_data(msg.user_data<void>());
+    profiling.reply_to(msg);
+    profiling.set_command(g_name_ed_cmd_profiling);
+    profiling.add_parameter(g_name_ed_param_status, status);
+    profiling.add_parameter(g_name_ed_param_filename, profiler->get_filename());
+    profiling.add_parameter(g_name_ed_param_samples, profiler->get_samples());
+    if(!send_message(profiling, false))
+    {
+        SNAP_LOG_WARNING
+            << "could not reply to \""
+            << msg.get_command()
+            << "\" with a "
+            << g_name_ed_cmd_profiling
+            << " message."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
 /** \brief Call you stop() function with true.
  *
  * This command means that someone is asking your daemon to quit as soon as
@@ -911,5 +1178,381 @@ void connection_with_send_message::send_commands(message * msg)
 
 
 
+/** \brief Send a request and wait for its reply asynchronously.
+ *
+ * This function adds a "serial" parameter to \p msg, sends it, and
+ * saves the request in a table of requests in flight. When a message
+ * with a "reply_to" parameter set to that serial comes back on this
+ * connection, it is viewed as the reply: it is not dispatched and
+ * instead the \p callback gets called with REQUEST_STATUS_REPLIED and
+ * the reply message.
+ *
+ * The other side is expected to call mark_reply() on its reply, which
+ * copies the "serial" of the request in the "reply_to" parameter (as done
+ * by msg_alive() with the ABSOLUTELY reply). Only the "reply_to" parameter
+ * is used to match replies because both sides number their own requests
+ * starting at 1: a request from the peer often has the same "serial" as
+ * one of our own requests.
+ *
+ * There is no limit to the number of requests in flight on one
+ * connection. Each request gets its own serial number so the replies
+ * can come back in any order.
+ *
+ * If no reply is received within \p timeout_us microseconds, the
+ * \p callback is called with REQUEST_STATUS_TIMEOUT and the original
+ * request. If the connection gets removed from the communicator or
+ * cancel_request() is called, the callback is called with
+ * REQUEST_STATUS_CANCELED and the original request. When the
+ * communicator removes the connection, the cancellation is deferred to
+ * the next run of the event loop so the callbacks do not run from
+ * within remove_connection().
+ *
+ * \note
+ * The request table is checked by dispatch_message() which means
+ * the connection must derive from dispatcher_support.
+ *
+ * \exception invalid_parameter
+ * The callback cannot be null and the timeout must be -1 (no timeout)
+ * or a positive number.
+ *
+ * \param[in,out] msg  The request to send. The "serial" parameter gets
+ * added to it.
+ * \param[in] callback  The function called once the request is done.
+ * \param[in] timeout_us  The number of microseconds to wait for the
+ * reply or -1 to wait until the connection gets removed.
+ *
+ * \return The serial number of the request or 0 if the message could
+ * not be sent.
+ */
+connection_with_send_message::serial_t connection_with_send_message::send_request(
+          message & msg
+        , request_callback_t callback
+        , std::int64_t timeout_us)
+{
+    if(callback == nullptr)
+    {
+        throw invalid_parameter("send_request() called without a callback.");
+    }
+    if(timeout_us <= 0
+    && timeout_us != -1)
+    {
+        throw invalid_parameter("send_request() timeout must be -1 or a positive number of microseconds.");
+    }
+
+    do
+    {
+        ++f_next_serial;
+    }
+    while(f_next_serial == 0
+       || f_requests.find(f_next_serial) != f_requests.end());
+    serial_t const serial(f_next_serial);
+
+    msg.add_parameter(g_name_ed_param_serial, serial);
+    if(!send_message(msg, false))
+    {
+        return 0;
+    }
+
+    std::int64_t const now(get_current_date());
+    request_t & r(f_requests[serial]);
+    r.f_message = msg;
+    r.f_callback = callback;
+    r.f_sent_date = now;
+    r.f_timeout_date = timeout_us == -1 ? -1 : now + timeout_us;
+    if(r.f_timeout_date != -1)
+    {
+        f_request_timeouts.insert(std::make_pair(r.f_timeout_date, serial));
+    }
+
+    request_stats_t & stats(f_request_stats[msg.get_command()]);
+    ++stats.f_sent;
+    ++stats.f_in_flight;
+
+    update_request_timer();
+
+    return serial;
+}
+
+
+/** \brief Mark a message as the reply to a request.
+ *
+ * A request sent with send_request() includes a "serial" parameter. The
+ * reply must include that number in its "reply_to" parameter for the
+ * sender to match it with its request. This function copies the "serial"
+ * parameter of \p request, if present, to the "reply_to" parameter of
+ * \p reply.
+ *
+ * \param[in,out] reply  The reply message.
+ * \param[in] request  The request being replied to.
+ */
+void connection_with_send_message::mark_reply(message & reply, message const & request)
+{
+    if(request.has_parameter(g_name_ed_param_serial))
+    {
+        reply.add_parameter(g_name_ed_param_reply_to, request.get_parameter(g_name_ed_param_serial));
+    }
+}
+
+
+/** \brief Check whether a message is the reply to a request.
+ *
+ * This function is called by dispatch_message() before the message gets
+ * dispatched. If the message has a "reply_to" parameter which matches
+ * a request in flight, the request callback is called and the function
+ * returns true.
+ *
+ * The "serial" parameter is not used here. A message with only a "serial"
+ * is a request from the peer and it gets dispatched as usual.
+ *
+ * \param[in] msg  The message to check.
+ *
+ * \return true if the message was a reply and it was processed.
+ */
+bool connection_with_send_message::process_reply(message & msg)
+{
+    if(f_requests.empty()
+    || !msg.has_parameter(g_name_ed_param_reply_to))
+    {
+        return false;
+    }
+
+    // the other side may use "reply_to" for its own purpose, so do not
+    // throw on invalid numbers
+    //
+    std::int64_t serial(0);
+    if(!advgetopt::validator_integer::convert_string(msg.get_parameter(g_name_ed_param_reply_to), serial)
+    || serial <= 0
+    || serial > std::numeric_limits<serial_t>::max())
+    {
+        return false;
+    }
+
+    auto it(f_requests.find(static_cast<serial_t>(serial)));
+    if(it == f_requests.end())
+    {
+        return false;
+    }
+
+    end_request(it, request_status_t::REQUEST_STATUS_REPLIED, &msg);
+    return true;
+}
+
+
+/** \brief Cancel one request.
+ *
+ * The callback of the request gets called with REQUEST_STATUS_CANCELED.
+ * If the reply arrives later, it gets dispatched as a normal message.
+ *
+ * \param[in] serial  The serial number returned by send_request().
+ *
+ * \return true if the request was found and canceled.
+ */
+bool connection_with_send_message::cancel_request(serial_t serial)
+{
+    auto it(f_requests.find(serial));
+    if(it == f_requests.end())
+    {
+        return false;
+    }
+
+    end_request(it, request_status_t::REQUEST_STATUS_CANCELED, nullptr);
+    return true;
+}
+
+
+/** \brief Cancel all the requests in flight.
+ *
+ * This function is called when the connection gets removed from the
+ * communicator since no replies can be received after that. The
+ * permanent connections also call it when they lose their connection.
+ *
+ * When \p defer is true, the requests are removed from the table
+ * immediately but their callbacks get called by a one shot timer on
+ * the next run of the event loop. The communicator uses that mode
+ * since remove_connection() may itself be called from a callback and
+ * the request callbacks are likely to add or remove connections.
+ *
+ * \param[in] defer  Whether to call the callbacks later.
+ */
+void connection_with_send_message::cancel_requests(bool defer)
+{
+    if(defer)
+    {
+        if(f_requests.empty())
+        {
+            return;
+        }
+
+        canceled_requests::vector_t canceled;
+        canceled.reserve(f_requests.size());
+        for(auto & r : f_requests)
+        {
+            request_ended(r.second, request_status_t::REQUEST_STATUS_CANCELED);
+            canceled.emplace_back(std::move(r.second.f_callback), std::move(r.second.f_message));
+        }
+        f_requests.clear();
+        f_request_timeouts.clear();
+        update_request_timer();
+
+        communicator::instance()->add_connection(
+                std::make_shared<canceled_requests>(std::move(canceled)));
+        return;
+    }
+
+    while(!f_requests.empty())
+    {
+        end_request(f_requests.begin(), request_status_t::REQUEST_STATUS_CANCELED, nullptr);
+    }
+}
+
+
+/** \brief Time out the requests which did not receive a reply in time.
+ *
+ * This function is called by the request timer.
+ */
+void connection_with_send_message::process_request_timeouts()
+{
+    std::int64_t const now(get_current_date());
+    while(!f_request_timeouts.empty()
+       && f_request_timeouts.begin()->first <= now)
+    {
+        auto it(f_requests.find(f_request_timeouts.begin()->second));
+        if(it == f_requests.end())
+        {
+            // this should not happen
+            //
+            f_request_timeouts.erase(f_request_timeouts.begin());
+            continue;
+        }
+        end_request(it, request_status_t::REQUEST_STATUS_TIMEOUT, nullptr);
+    }
+
+    update_request_timer();
+}
+
+
+/** \brief Get the number of requests waiting for a reply.
+ *
+ * \return The number of requests in flight.
+ */
+std::size_t connection_with_send_message::get_requests_in_flight() const
+{
+    return f_requests.size();
+}
+
+
+/** \brief Get the request statistics.
+ *
+ * The statistics are kept per command: the number of requests in
+ * flight, sent, replied, timed out, canceled, and the latency of the
+ * replies (total, minimum and maximum in microseconds).
+ *
+ * \return The map of statistics keyed by command.
+ */
+connection_with_send_message::request_stats_map_t const & connection_with_send_message::get_request_stats() const
+{
+    return f_request_stats;
+}
+
+
+/** \brief Remove a request from the table and call its callback.
+ *
+ * The request is removed before the callback gets called so the
+ * callback can safely send new requests.
+ *
+ * \param[in] it  The iterator to the request to end.
+ * \param[in] status  The reason why the request ends.
+ * \param[in] reply  The reply or nullptr.
+ */
+void connection_with_send_message::end_request(
+          request_map_t::iterator it
+        , request_status_t status
+        , message * reply)
+{
+    serial_t const serial(it->first);
+    request_t r(std::move(it->second));
+    f_requests.erase(it);
+    if(r.f_timeout_date != -1)
+    {
+        f_request_timeouts.erase(std::make_pair(r.f_timeout_date, serial));
+    }
+
+    update_request_timer();
+
+    request_ended(r, status);
+
+    r.f_callback(status, reply == nullptr ? r.f_message : *reply);
+}
+
+
+/** \brief Update the statistics of a request that ended.
+ *
+ * \param[in] r  The request that ended.
+ * \param[in] status  The reason why the request ends.
+ */
+void connection_with_send_message::request_ended(
+          request_t const & r
+        , request_status_t status)
+{
+    request_stats_t & stats(f_request_stats[r.f_message.get_command()]);
+    --stats.f_in_flight;
+    switch(status)
+    {
+    case request_status_t::REQUEST_STATUS_REPLIED:
+        {
+            std::int64_t const latency(get_current_date() - r.f_sent_date);
+            if(stats.f_replied == 0
+            || latency < stats.f_min_latency)
+            {
+                stats.f_min_latency = latency;
+            }
+            if(latency > stats.f_max_latency)
+            {
+                stats.f_max_latency = latency;
+            }
+            stats.f_total_latency += latency;
+            ++stats.f_replied;
+        }
+        break;
+
+    case request_status_t::REQUEST_STATUS_TIMEOUT:
+        ++stats.f_timed_out;
+        break;
+
+    case request_status_t::REQUEST_STATUS_CANCELED:
+        ++stats.f_canceled;
+        break;
+
+    }
+}
+
+
+/** \brief Update the request timer.
+ *
+ * The timer is added to the communicator while requests with a timeout
+ * are in flight and it is set to the date of the next timeout.
+ */
+void connection_with_send_message::update_request_timer()
+{
+    if(f_request_timeouts.empty())
+    {
+        if(f_request_timer != nullptr)
+        {
+            communicator::instance()->remove_connection(f_request_timer);
+            f_request_timer.reset();
+        }
+        return;
+    }
+
+    if(f_request_timer == nullptr)
+    {
+        f_request_timer = std::make_shared<request_timer>(this);
+        communicator::instance()->add_connection(f_request_timer);
+    }
+    f_request_timer->set_timeout_date(f_request_timeouts.begin()->first);
+}
+
+
+
 } // namespace ed
 // vim: ts=4 sw=4 et
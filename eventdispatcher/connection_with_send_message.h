@@ -47,6 +47,9 @@
 // C++
 //
 #include    <list>
+#include    <map>
+#include    <set>
+#include    <unordered_map>
 
 
 
@@ -55,6 +58,33 @@ namespace ed
 
 
 
+class timer;
+
+
+constexpr std::int64_t const    DEFAULT_REQUEST_TIMEOUT = 10LL * 1'000'000LL;  // 10 seconds
+
+
+enum class request_status_t
+{
+    REQUEST_STATUS_REPLIED,         // the reply was received
+    REQUEST_STATUS_TIMEOUT,         // no reply in time
+    REQUEST_STATUS_CANCELED,        // disconnected or cancel_request() called
+};
+
+
+struct request_stats_t
+{
+    std::size_t                 f_in_flight = 0;
+    std::size_t                 f_sent = 0;
+    std::size_t                 f_replied = 0;
+    std::size_t                 f_timed_out = 0;
+    std::size_t                 f_canceled = 0;
+    std::int64_t                f_total_latency = 0;    // in microseconds
+    std::int64_t                f_min_latency = 0;
+    std::int64_t                f_max_latency = 0;
+};
+
+
 class connection_with_send_message
 {
 public:
@@ -65,6 +95,11 @@ public:
     typedef std::list<weak_t>   list_weak_t;
     typedef std::function<bool(advgetopt::string_set_t & commands)>
                                 help_callback_t;
+    typedef std::uint32_t       serial_t;
+    typedef std::function<void(request_status_t status, message & msg)>
+                                request_callback_t;
+    typedef std::map<std::string, request_stats_t>
+                                request_stats_map_t;
 
                                 connection_with_send_message(std::string const & service_name = std::string());
     virtual                     ~connection_with_send_message();
@@ -76,10 +111,12 @@ public:
     virtual void                msg_alive(message & msg);
     virtual void                msg_leak(message & msg);
     virtual void                msg_log_rotate(message & msg);
+    virtual void                msg_profile(message & msg);
     virtual void                msg_quitting(message & msg);
     virtual void                msg_ready(message & msg);
     virtual void                msg_restart(message & msg);
     virtual void                msg_service_unavailable(message & msg);
+    virtual void                msg_stats(message & msg);
     virtual void                msg_stop(message & msg);
     virtual void                msg_log_unknown(message & msg); // also log INVALID
     virtual void                msg_reply_with_unknown(message & msg);
@@ -97,12 +134,50 @@ public:
     void                        add_help_callback(help_callback_t callback);
     void                        send_commands(message * msg = nullptr);
 
+    serial_t                    send_request(
+                                      message & msg
+                                    , request_callback_t callback
+                                    , std::int64_t timeout_us = DEFAULT_REQUEST_TIMEOUT);
+    static void                 mark_reply(message & reply, message const & request);
+    bool                        process_reply(message & msg);
+    bool                        cancel_request(serial_t serial);
+    void                        cancel_requests(bool defer = false);
+    void                        process_request_timeouts();
+    std::size_t                 get_requests_in_flight() const;
+    request_stats_map_t const & get_request_stats() const;
+
 private:
+    struct request_t
+    {
+        message                 f_message = message();
+        request_callback_t      f_callback = request_callback_t();
+        std::int64_t            f_sent_date = 0;
+        std::int64_t            f_timeout_date = 0;
+    };
+    typedef std::unordered_map<serial_t, request_t>
+                                request_map_t;
+    typedef std::set<std::pair<std::int64_t, serial_t>>
+                                request_timeout_t;
+
+    void                        end_request(
+                                      request_map_t::iterator it
+                                    , request_status_t status
+                                    , message * reply);
+    void                        request_ended(
+                                      request_t const & r
+                                    , request_status_t status);
+    void                        update_request_timer();
+
     std::string                 f_service_name = std::string();
     bool                        f_ready = false;
     addr::addr                  f_my_address = addr::addr();
     snapdev::callback_manager<help_callback_t>
                                 f_help_callbacks = snapdev::callback_manager<help_callback_t>();
+    serial_t                    f_next_serial = 0;
+    request_map_t               f_requests = request_map_t();
+    request_timeout_t           f_request_timeouts = request_timeout_t();
+    request_stats_map_t         f_request_stats = request_stats_map_t();
+    std::shared_ptr<timer>      f_request_timer = std::shared_ptr<timer>();
 };
 
 
@@ -23,6 +23,8 @@
 
 #include    <eventdispatcher/fd_buffer_connection.h>
 #include    <eventdispatcher/signal.h>
+#include    <eventdispatcher/timer.h>
+#include    <eventdispatcher/utils.h>
 
 
 
@@ -42,13 +44,12 @@
 #include    <snapdev/not_reached.h>
 #include    <snapdev/not_used.h>
 #include    <snapdev/raii_generic_deleter.h>
-#include    <snapdev/tokenize_string.h>
 
 
 // C++
 //
-#include    <deque>
 #include    <iostream>
+#include    <vector>
 
 
 // C
@@ -77,6 +78,9 @@ namespace detail
 
 
 constexpr char const g_default_history_filename[] = "~/.snap_history";
+constexpr std::size_t const g_default_scrollback_size = 1'000;
+constexpr int const g_default_frame_rate = 30;
+constexpr int const g_min_screen_height = 8;
 
 
 /** \brief This is the actual implementation of the ncurses application.
@@ -240,6 +244,29 @@ public:
         ncurses_impl *      f_impl;
     };
 
+    class frame_timer
+        : public timer
+    {
+    public:
+        frame_timer(ncurses_impl * impl)
+            : timer(-1)
+            , f_impl(impl)
+        {
+            set_name("cui_frame_timer");
+        }
+
+        frame_timer(frame_timer const & rhs) = delete;
+        frame_timer & operator = (frame_timer const & rhs) = delete;
+
+        virtual void process_timeout() override
+        {
+            f_impl->render_frame();
+        }
+
+    private:
+        ncurses_impl *      f_impl;
+    };
+
     static pointer_t ptr()
     {
         if(g_cui_connection->f_impl == nullptr)
@@ -269,6 +296,7 @@ public:
             p->capture_winch();
             p->capture_tstp();
             p->capture_cont();
+            p->capture_frame_timer();
         }
         return ce->f_impl;
     }
@@ -278,6 +306,7 @@ public:
 
     ~ncurses_impl()
     {
+        release_frame_timer();
         release_cont();
         release_tstp();
         release_winch();
@@ -371,7 +400,7 @@ public:
     {
         int const y(getmaxy(f_win_output));
         f_yscroll += y;
-        int const max(std::max(0, static_cast<int>(f_output.size() - y)));
+        int const max(std::max(0, static_cast<int>(f_output_count) - y));
         f_yscroll = std::min(f_yscroll, max);
 
         // refresh the output window
@@ -394,75 +423,63 @@ public:
         output("Ready.\nType /help or F1 for help screen.");
     }
 
+    /** \brief One line of output.
+     *
+     * The scrollback ring keeps the text of each line along the color
+     * pair used to draw it so the line gets redrawn with the same colors.
+     */
+    struct output_line_t
+    {
+        std::string     f_line = std::string();
+        int             f_pair = 0;
+    };
+
     void output(std::string const & content,
                 cui_connection::color_t f = cui_connection::color_t::NORMAL,
                 cui_connection::color_t b = cui_connection::color_t::NORMAL)
     {
-        pointer_t p(ptr());
-
-        // TODO: make this work when one of the colors is not set to NORMAL
-        //
-        // TODO: win_output_redisplay() will redraw these lines but
-        //       totally ignore the color settings
-        //
+        int pair(0);
         if(f != cui_connection::color_t::NORMAL
         || b != cui_connection::color_t::NORMAL)
         {
-            int const pair((static_cast<NCURSES_COLOR_T>(f) | (static_cast<NCURSES_COLOR_T>(b) << 4)) + 1);
-            wattron(f_win_output, COLOR_PAIR(pair));
+            pair = (static_cast<NCURSES_COLOR_T>(f) | (static_cast<NCURSES_COLOR_T>(b) << 4)) + 1;
         }
 
-        // save all the lines in f_output vector so we can redraw it in
-        // case of a resize
-        //
-        // one day we may work on Page Up/Down to scroll through
-        // this buffer too!
+        // save all the lines in the scrollback ring; they get drawn
+        // on the next frame, along all the other lines received until
+        // then, and are used to redraw the window on a resize or when
+        // scrolling with Page Up/Down
         //
-        const char * newline(f_first_line ? "" : "\n");
-        f_first_line = false;
-
         // tokenize keeping all the spaces (no trimming)
         //
-        std::list<std::string> lines;
-        snapdev::tokenize_string(lines, content, "\n");
-        if(!content.empty()
-        && content.back() == '\n'
-        && lines.back().empty())
+        std::string::size_type start(0);
+        for(;;)
         {
-            lines.pop_back();
-        }
-        for(auto const & l : lines)
-        {
-            p->f_output.push_back(l);
-            while(p->f_output.size() > 1000) // TODO: make history size a variable
-            {
-                p->f_output.pop_front();
-            }
-
-            if(wprintw(f_win_output, "%s%s", newline, l.c_str()) != OK)
+            std::string::size_type const pos(content.find('\n', start));
+            if(pos == std::string::npos)
             {
-                fatal_error("wprintw() to output window failed.");
-                snapdev::NOT_REACHED();
+                if(start < content.length()
+                || start == 0)
+                {
+                    push_output(content.substr(start), pair);
+                }
+                break;
             }
-
-            newline = "\n";
-        }
-
-        if(f != cui_connection::color_t::NORMAL
-        || b != cui_connection::color_t::NORMAL)
-        {
-            int const pair((static_cast<NCURSES_COLOR_T>(f) | (static_cast<NCURSES_COLOR_T>(b) << 4)) + 1);
-            wattroff(f_win_output, COLOR_PAIR(pair));
+            push_output(content.substr(start, pos - start), pair);
+            start = pos + 1;
         }
 
-        refresh();
+        schedule_frame();
     }
 
     void clear_output()
     {
         // lose all output
         //
-        f_output.clear();
+        f_output_start = 0;
+        f_output_count = 0;
+        f_pending = 0;
+        f_yscroll = 0;
 
         // makes the next refresh repaint the screen from scratch
         //
@@ -482,6 +499,88 @@ public:
         resize();
     }
 
+    void set_scrollback_size(std::size_t lines)
+    {
+        if(lines == 0)
+        {
+            lines = 1;
+        }
+
+        // keep the last lines
+        //
+        std::vector<output_line_t> output(lines);
+        std::size_t const keep(std::min(lines, f_output_count));
+        for(std::size_t idx(0); idx < keep; ++idx)
+        {
+            output[idx] = std::move(output_at(f_output_count - keep + idx));
+        }
+        f_output.swap(output);
+        f_output_start = 0;
+        f_output_count = keep;
+        f_pending = std::min(f_pending, keep);
+    }
+
+    std::size_t get_scrollback_size() const
+    {
+        return f_output.size();
+    }
+
+    void set_frame_rate(int fps)
+    {
+        f_frame_delay = fps <= 0 ? 0 : 1'000'000 / fps;
+    }
+
+    int get_frame_rate() const
+    {
+        return f_frame_delay == 0 ? 0 : static_cast<int>(1'000'000 / f_frame_delay);
+    }
+
+    /** \brief Draw the lines received since the last frame.
+     *
+     * This function is called by the frame timer. It draws all the
+     * lines added to the scrollback ring since the last frame and then
+     * refreshes the screen once.
+     *
+     * If more lines than the window can show were received, or when the
+     * user scrolled up, the window gets redrawn from the ring instead,
+     * which bounds the cost of one frame to the size of the window.
+     */
+    void render_frame()
+    {
+        f_last_frame = get_current_date();
+        if(f_pending == 0)
+        {
+            return;
+        }
+
+        int const height(getmaxy(f_win_output));
+        if(f_yscroll > 0)
+        {
+            // keep the lines the user is looking at in place
+            //
+            int const max(std::max(0, static_cast<int>(f_output_count) - height));
+            f_yscroll = std::min(f_yscroll + static_cast<int>(f_pending), max);
+            f_pending = 0;
+            win_output_redisplay(false);
+            return;
+        }
+
+        if(f_pending >= static_cast<std::size_t>(height))
+        {
+            f_pending = 0;
+            win_output_redisplay(false);
+            return;
+        }
+
+        for(std::size_t idx(f_output_count - f_pending); idx < f_output_count; ++idx)
+        {
+            print_output_line(output_at(idx));
+        }
+        f_pending = 0;
+
+        refresh();
+    }
+
     void refresh()
     {
         update_panels();
@@ -714,7 +813,7 @@ private:
         }
 
         getmaxyx(f_win_main, f_screen_height, f_screen_width);
-        if(f_screen_height < 5)
+        if(f_screen_height < g_min_screen_height)
         {
             fatal_error("your console is not tall enough for this application.");
             snapdev::NOT_REACHED();
@@ -759,57 +858,7 @@ private:
         //
         curs_set(2); // ignore errors
 
-        draw_borders();
-
-        // create two child windows
-        //
-        // WARNING: the order is important for the panels get stacked from
-        //          bottom to top
-        //
-        f_win_output = newwin(f_screen_height - 7, f_screen_width - 2, 1, 1);
-        if(f_win_output == nullptr)
-        {
-            fatal_error("could not create output window.");
-            snapdev::NOT_REACHED();
-        }
-        f_pan_output = new_panel(f_win_output);
-        if(f_pan_output == nullptr)
-        {
-            fatal_error("could not create output panel.");
-            snapdev::NOT_REACHED();
-        }
-
-        f_win_input = newwin(4, f_screen_width - 2, f_screen_height - 5, 1);
-        if(f_win_input == nullptr)
-        {
-            fatal_error("could not create input window.");
-            snapdev::NOT_REACHED();
-        }
-        f_pan_input = new_panel(f_win_input);
-        if(f_pan_input == nullptr)
-        {
-            fatal_error("could not create input panel.");
-            snapdev::NOT_REACHED();
-        }
-
-        // allow strings longer than the output window and show only the
-        // last part if the string doesn't fit
-        //
-        if(scrollok(f_win_output, TRUE) != OK)
-        {
-            fatal_error("scrollok() failed; could not setup output window to scoll on large lines.");
-            snapdev::NOT_REACHED();
-        }
-        //if(scrollok(f_win_input, TRUE) != OK) -- TBD
-        //{
-        //    fatal_error("scrollok() failed; could not setup input window to scoll on large lines.");
-        //    snapdev::NOT_REACHED();
-        //}
-
-        // we want to make the wgetch() function non-blocking so that way
-        // other things can happen
-        //
-        wtimeout(f_win_input, 0);
+        create_windows();
 
         // to make sure the cursor gets at the right place
         //
@@ -820,29 +869,7 @@ private:
     {
         if(f_visual_mode)
         {
-            if(f_pan_output != nullptr)
-            {
-                del_panel(f_pan_output);
-                f_pan_output = nullptr;
-            }
-
-            if(f_win_output != nullptr)
-            {
-                delwin(f_win_output);
-                f_win_output = nullptr;
-            }
-
-            if(f_pan_input != nullptr)
-            {
-                del_panel(f_pan_input);
-                f_pan_input = nullptr;
-            }
-
-            if(f_win_input != nullptr)
-            {
-                delwin(f_win_input);
-                f_win_input = nullptr;
-            }
+            delete_windows();
 
             // f_win_main -- this is handled by f_term
 
@@ -1043,22 +1070,247 @@ private:
         f_cont_signal.reset();
     }
 
+    void capture_frame_timer()
+    {
+        f_frame_timer = std::make_shared<frame_timer>(this);
+        if(!ed::communicator::instance()->add_connection(f_frame_timer))
+        {
+            // without the timer, draw each line immediately
+            //
+            f_frame_timer.reset();
+        }
+    }
+
+    void release_frame_timer()
+    {
+        if(f_frame_timer != nullptr)
+        {
+            ed::communicator::instance()->remove_connection(f_frame_timer);
+            f_frame_timer.reset();
+        }
+    }
+
+    /** \brief Make sure the pending lines get drawn.
+     *
+     * The lines are not drawn on each output() call. Instead, the frame
+     * timer is set to wake up once the frame delay elapsed since the
+     * last frame so all the lines received in between are drawn with a
+     * single refresh. Even when that delay already elapsed, the drawing
+     * happens on the next communicator loop so a burst of lines read
+     * from one buffer ends up in the same frame.
+     */
+    void schedule_frame()
+    {
+        if(f_frame_timer == nullptr
+        || f_frame_delay == 0)
+        {
+            render_frame();
+            return;
+        }
+
+        if(f_frame_timer->get_timeout_date() == -1)
+        {
+            f_frame_timer->set_timeout_date(std::max(
+                      get_current_date()
+                    , f_last_frame + f_frame_delay));
+        }
+    }
+
+    /** \brief Add a line to the scrollback ring.
+     *
+     * When the ring is full, the oldest line gets overwritten.
+     *
+     * \param[in] line  The line to add.
+     * \param[in] pair  The color pair used to draw the line, 0 for normal.
+     */
+    void push_output(std::string const & line, int pair)
+    {
+        std::size_t const size(f_output.size());
+        std::size_t idx(0);
+        if(f_output_count < size)
+        {
+            idx = (f_output_start + f_output_count) % size;
+            ++f_output_count;
+        }
+        else
+        {
+            idx = f_output_start;
+            f_output_start = (f_output_start + 1) % size;
+        }
+        f_output[idx].f_line = line;
+        f_output[idx].f_pair = pair;
+
+        f_pending = std::min(f_pending + 1, f_output_count);
+    }
+
+    /** \brief Retrieve a line from the scrollback ring.
+     *
+     * \param[in] idx  The index of the line, 0 being the oldest line.
+     *
+     * \return A reference to the line.
+     */
+    output_line_t & output_at(std::size_t idx)
+    {
+        return f_output[(f_output_start + idx) % f_output.size()];
+    }
+
+    void print_output_line(output_line_t const & l)
+    {
+        if(l.f_pair != 0)
+        {
+            wattron(f_win_output, COLOR_PAIR(l.f_pair));
+        }
+
+        if(wprintw(f_win_output, "%s%s", f_first_line ? "" : "\n", l.f_line.c_str()) != OK)
+        {
+            fatal_error("wprintw() to output window failed.");
+            snapdev::NOT_REACHED();
+        }
+        f_first_line = false;
+
+        if(l.f_pair != 0)
+        {
+            wattroff(f_win_output, COLOR_PAIR(l.f_pair));
+        }
+    }
+
     void process_window_change()
     {
         endwin();
         resize();
     }
 
+    /** \brief Create the output and input windows.
+     *
+     * Each area is composed of two windows: a border window which gets
+     * a box and a title and an inner window derived from it where the
+     * output or input gets written. That way clearing the inner window
+     * (werase(), wclrtoeol(), etc.) never touches the borders which
+     * then only need to be drawn once.
+     *
+     * The panels are attached to the border windows. The bottom border
+     * of the output window is hidden by the top border of the input
+     * window which uses tees to connect to the sides.
+     */
+    void create_windows()
+    {
+        // WARNING: the order is important for the panels get stacked from
+        //          bottom to top
+        //
+        f_win_output_border = newwin(f_screen_height - 5, f_screen_width, 0, 0);
+        if(f_win_output_border == nullptr)
+        {
+            fatal_error("could not create output border window.");
+            snapdev::NOT_REACHED();
+        }
+        f_pan_output = new_panel(f_win_output_border);
+        if(f_pan_output == nullptr)
+        {
+            fatal_error("could not create output panel.");
+            snapdev::NOT_REACHED();
+        }
+        f_win_output = derwin(f_win_output_border, f_screen_height - 7, f_screen_width - 2, 1, 1);
+        if(f_win_output == nullptr)
+        {
+            fatal_error("could not create output window.");
+            snapdev::NOT_REACHED();
+        }
+
+        f_win_input_border = newwin(6, f_screen_width, f_screen_height - 6, 0);
+        if(f_win_input_border == nullptr)
+        {
+            fatal_error("could not create input border window.");
+            snapdev::NOT_REACHED();
+        }
+        f_pan_input = new_panel(f_win_input_border);
+        if(f_pan_input == nullptr)
+        {
+            fatal_error("could not create input panel.");
+            snapdev::NOT_REACHED();
+        }
+        f_win_input = derwin(f_win_input_border, 4, f_screen_width - 2, 1, 1);
+        if(f_win_input == nullptr)
+        {
+            fatal_error("could not create input window.");
+            snapdev::NOT_REACHED();
+        }
+
+        // the panels refresh the border windows, make sure the changes
+        // in the inner windows are seen there
+        //
+        syncok(f_win_output, TRUE);
+        syncok(f_win_input, TRUE);
+
+        // allow strings longer than the output window and show only the
+        // last part if the string doesn't fit
+        //
+        if(scrollok(f_win_output, TRUE) != OK)
+        {
+            fatal_error("scrollok() failed; could not setup output window to scoll on large lines.");
+            snapdev::NOT_REACHED();
+        }
+        //if(scrollok(f_win_input, TRUE) != OK) -- TBD
+        //{
+        //    fatal_error("scrollok() failed; could not setup input window to scoll on large lines.");
+        //    snapdev::NOT_REACHED();
+        //}
+
+        // we want to make the wgetch() function non-blocking so that way
+        // other things can happen
+        //
+        wtimeout(f_win_input, 0);
+
+        draw_borders();
+    }
+
+    void delete_windows()
+    {
+        if(f_pan_input != nullptr)
+        {
+            del_panel(f_pan_input);
+            f_pan_input = nullptr;
+        }
+
+        if(f_win_input != nullptr)
+        {
+            delwin(f_win_input);
+            f_win_input = nullptr;
+        }
+
+        if(f_win_input_border != nullptr)
+        {
+            delwin(f_win_input_border);
+            f_win_input_border = nullptr;
+        }
+
+        if(f_pan_output != nullptr)
+        {
+            del_panel(f_pan_output);
+            f_pan_output = nullptr;
+        }
+
+        if(f_win_output != nullptr)
+        {
+            delwin(f_win_output);
+            f_win_output = nullptr;
+        }
+
+        if(f_win_output_border != nullptr)
+        {
+            delwin(f_win_output_border);
+            f_win_output_border = nullptr;
+        }
+    }
+
     void draw_borders()
     {
-        // setup the background window with borders and names
+        // setup the border windows with borders and names
         //
-        wborder(f_win_main, 0, 0, 0, 0, 0, 0, 0, 0);
-        mvwaddch(f_win_main, f_screen_height - 6, 0, ACS_LTEE);
-        mvwhline(f_win_main, f_screen_height - 6, 1, ACS_HLINE, f_screen_width - 2);
-        mvwaddch(f_win_main, f_screen_height - 6, f_screen_width - 1, ACS_RTEE);
-        mvwprintw(f_win_main, 0, 2, " Output ");
-        mvwprintw(f_win_main, f_screen_height - 6, 2, " Console (Ctrl-D on empty line to exit) ");
+        box(f_win_output_border, 0, 0);
+        mvwprintw(f_win_output_border, 0, 2, " Output ");
+
+        wborder(f_win_input_border, 0, 0, 0, 0, ACS_LTEE, ACS_RTEE, 0, 0);
+        mvwprintw(f_win_input_border, 0, 2, " Console (Ctrl-D on empty line to exit) ");
     }
 
     static int readline_getc(FILE * dummy)
@@ -1136,8 +1388,6 @@ private:
             snapdev::NOT_REACHED();
         }
 
-        draw_borders();
-
         // redraw the output buffer
         //
         // DO NOT USE the output() function for a few reasons:
@@ -1146,33 +1396,17 @@ private:
         //   2. it will re-add the buffer to itself
         //   3. the change of f_output may crash the for() loop
         //
-        int y(getmaxy(f_win_output));
-        int skip(std::max(0, static_cast<int>(f_output.size() - y - f_yscroll)));
-        char const * nl = "";
-        for(auto const & l : f_output)
+        // the ring gives us direct access to the first line to show
+        //
+        int const y(getmaxy(f_win_output));
+        std::size_t const last(f_output_count - std::min(f_output_count, static_cast<std::size_t>(f_yscroll)));
+        std::size_t const first(last - std::min(last, static_cast<std::size_t>(y)));
+        f_first_line = true;
+        for(std::size_t idx(first); idx < last; ++idx)
         {
-            if(skip > 0)
-            {
-                // we have a list so there isn't a really good way to skip
-                // lines than looping until skip == 0
-                //
-                --skip;
-                continue;
-            }
-            --y;
-            if(y < 0)
-            {
-                // we're done
-                //
-                break;
-            }
-            if(wprintw(f_win_output, "%s%s", nl, l.c_str()) != OK)
-            {
-                fatal_error("wprintw() to output window failed");
-                snapdev::NOT_REACHED();
-            }
-            nl = "\n";
+            print_output_line(output_at(idx));
         }
+        f_pending = 0;
 
         // We batch window updates when resizing
         //
@@ -1300,28 +1534,17 @@ private:
         //
         getmaxyx(f_win_main, f_screen_height, f_screen_width);
 
-        if(f_screen_height < 5)
+        if(f_screen_height < g_min_screen_height)
         {
             fatal_error("window too small after resize");
             snapdev::NOT_REACHED();
         }
 
-        if(wresize(f_win_output, f_screen_height - 7, f_screen_width - 2) != OK)
-        {
-            fatal_error("wresize of output window failed");
-            snapdev::NOT_REACHED();
-        }
-        if(wresize(f_win_input, 4, f_screen_width - 2) != OK)
-        {
-            fatal_error("wresize of input window failed");
-            snapdev::NOT_REACHED();
-        }
-
-        if(mvwin(f_win_input, f_screen_height - 5, 1) != OK)
-        {
-            fatal_error("mvwin of input window failed");
-            snapdev::NOT_REACHED();
-        }
+        // the inner windows cannot be moved or resized independently
+        // from their border windows, recreating them is simpler
+        //
+        delete_windows();
+        create_windows();
 
         // batch refreshes and commit them with doupdate() in refresh()
         //
@@ -1345,6 +1568,7 @@ private:
         //
         if(g_cui_connection->f_impl != nullptr)
         {
+            g_cui_connection->f_impl->release_frame_timer();
             g_cui_connection->f_impl->release_cont();
             g_cui_connection->f_impl->release_tstp();
             g_cui_connection->f_impl->release_winch();
@@ -1476,17 +1700,25 @@ private:
     signal::pointer_t               f_winch_signal = signal::pointer_t();
     signal::pointer_t               f_tstp_signal = signal::pointer_t();
     signal::pointer_t               f_cont_signal = signal::pointer_t();
+    timer::pointer_t                f_frame_timer = timer::pointer_t();
     std::string                     f_history_filename = std::string();
     std::string                     f_command_prompt_in_output = std::string();
     SCREEN *                        f_term = nullptr;
     WINDOW *                        f_win_main = nullptr;
+    WINDOW *                        f_win_output_border = nullptr;
     WINDOW *                        f_win_output = nullptr;
     PANEL *                         f_pan_output = nullptr;
+    WINDOW *                        f_win_input_border = nullptr;
     WINDOW *                        f_win_input = nullptr;
     PANEL *                         f_pan_input = nullptr;
     int                             f_screen_width = 0;
     int                             f_screen_height = 0;
-    std::deque<std::string>         f_output = std::deque<std::string>();
+    std::vector<output_line_t>      f_output = std::vector<output_line_t>(g_default_scrollback_size);
+    std::size_t                     f_output_start = 0;
+    std::size_t                     f_output_count = 0;
+    std::size_t                     f_pending = 0;
+    std::int64_t                    f_frame_delay = 1'000'000 / g_default_frame_rate;
+    std::int64_t                    f_last_frame = 0;
     int                             f_yscroll = 0;
     bool                            f_visual_mode = false;
     bool                            f_has_handlers = false;
@@ -1582,6 +1814,61 @@ void cui_connection::refresh()
 }
 
 
+/** \brief Change the number of lines kept in the output window.
+ *
+ * The output lines are kept in a ring so the window can be redrawn
+ * after a resize and scrolled with Page Up/Down. Once the ring is
+ * full, the oldest lines get dropped. The default is 1,000 lines.
+ *
+ * When reducing the size, the most recent lines are kept.
+ *
+ * \param[in] lines  The number of lines to keep (at least 1).
+ */
+void cui_connection::set_scrollback_size(std::size_t lines)
+{
+    f_impl->set_scrollback_size(lines);
+}
+
+
+/** \brief Get the number of lines kept in the output window.
+ *
+ * \return The size of the scrollback ring.
+ */
+std::size_t cui_connection::get_scrollback_size() const
+{
+    return f_impl->get_scrollback_size();
+}
+
+
+/** \brief Limit the number of times the output window gets redrawn.
+ *
+ * The output() function does not draw the lines immediately. Instead,
+ * all the lines received within one frame are drawn at once and the
+ * screen gets refreshed once. When more lines than the window can show
+ * are received in one frame, only the last ones get drawn. This keeps
+ * the console responsive when tailing a very busy stream.
+ *
+ * The default is 30 frames per second. Use 0 to draw each line as
+ * soon as it is received.
+ *
+ * \param[in] fps  The maximum number of frames per second or 0.
+ */
+void cui_connection::set_frame_rate(int fps)
+{
+    f_impl->set_frame_rate(fps);
+}
+
+
+/** \brief Get the maximum number of frames per second.
+ *
+ * \return The frame rate or 0 if lines get drawn immediately.
+ */
+int cui_connection::get_frame_rate() const
+{
+    return f_impl->get_frame_rate();
+}
+
+
 void cui_connection::set_prompt(std::string const & prompt)
 {
     f_impl->set_prompt(prompt);
@@ -63,6 +63,10 @@ public:
     void            output(std::string const & line, color_t f, color_t b);
     void            clear_output();
     void            refresh();
+    void            set_scrollback_size(std::size_t lines);
+    std::size_t     get_scrollback_size() const;
+    void            set_frame_rate(int fps);
+    int             get_frame_rate() const;
     void            set_prompt(std::string const & prompt);
     void            prompt_to_output_command(std::string const & prompt);
     int             get_screen_width() const;
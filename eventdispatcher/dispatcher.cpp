@@ -27,6 +27,7 @@
 //
 #include    "eventdispatcher/dispatcher.h"
 
+#include    "eventdispatcher/callback_context.h"
 #include    "eventdispatcher/names.h"
 
 
@@ -173,12 +174,16 @@ dispatcher::dispatcher(ed::connection_with_send_message * c)
  * \li HELP -- msg_help() -- returns the list of all the messages
  * \li LEAK -- msg_leak() -- log memory usage
  * \li LOG_ROTATE -- msg_log_rotate() -- reopen() the logger
+ * \li PROFILE -- msg_profile() -- start or stop the signal_profiler and
+ *                 reply with PROFILING
  * \li QUITTING -- msg_quitting() -- calls stop(true);
  * \li READY -- msg_ready() -- calls ready() -- communicatord always
  *              sends that message so it has to be supported
  * \li RESTART -- msg_restart() -- calls restart() -- it is triggered
  *                when a restart is required (i.e. the library was
  *                upgraded, a configuration file was updated, etc.)
+ * \li STATS -- msg_stats() -- reply with STATISTICS and the metrics in
+ *               the Prometheus text format
  * \li STOP -- msg_stop() -- calls stop(false);
  * \li UNKNOWN -- msg_log_unknown() -- in case we receive a message we
  *                don't understand
@@ -231,7 +236,7 @@ void dispatcher::add_communicator_commands(bool auto_catch_all)
 {
     // avoid more than one realloc()
     //
-    f_matches.reserve(f_matches.size() + 11);
+    f_matches.reserve(f_matches.size() + 13);
 
     add_matches({
         define_match(
@@ -259,6 +264,11 @@ void dispatcher::add_communicator_commands(bool auto_catch_all)
             , Callback(std::bind(&connection_with_send_message::msg_log_rotate, f_connection, std::placeholders::_1))
             , Priority(dispatcher_match::DISPATCHER_MATCH_SYSTEM_PRIORITY)
         ),
+        define_match(
+              Expression(g_name_ed_cmd_profile)
+            , Callback(std::bind(&connection_with_send_message::msg_profile, f_connection, std::placeholders::_1))
+            , Priority(dispatcher_match::DISPATCHER_MATCH_SYSTEM_PRIORITY)
+        ),
         define_match(
               Expression(g_name_ed_cmd_quitting)
             , Callback(std::bind(&connection_with_send_message::msg_quitting, f_connection, std::placeholders::_1))
@@ -279,6 +289,11 @@ void dispatcher::add_communicator_commands(bool auto_catch_all)
             , Callback(std::bind(&connection_with_send_message::msg_service_unavailable, f_connection, std::placeholders::_1))
             , Priority(dispatcher_match::DISPATCHER_MATCH_SYSTEM_PRIORITY)
         ),
+        define_match(
+              Expression(g_name_ed_cmd_stats)
+            , Callback(std::bind(&connection_with_send_message::msg_stats, f_connection, std::placeholders::_1))
+            , Priority(dispatcher_match::DISPATCHER_MATCH_SYSTEM_PRIORITY)
+        ),
         define_match(
               Expression(g_name_ed_cmd_stop)
             , Callback(std::bind(&connection_with_send_message::msg_stop, f_connection, std::placeholders::_1))
@@ -454,6 +469,33 @@ bool dispatcher::dispatch(message & msg)
             << SNAP_LOG_SEND;
     }
 
+    command_metrics_t & cm(get_command_metrics(msg.get_command()));
+    std::int64_t const start_date(get_current_date());
+    command_guard guard(msg.get_command());
+
+    bool const result(dispatch_matches(msg));
+
+    cm.f_messages->increment();
+    cm.f_duration->record(get_current_date() - start_date);
+    if(!result)
+    {
+        cm.f_unhandled->increment();
+    }
+
+    return result;
+}
+
+
+/** \brief Search for the match and execute its callback.
+ *
+ * This function is the implementation of dispatch() without the metrics.
+ *
+ * \param[in,out] msg  The message being dispatched.
+ *
+ * \return true if the message was handled.
+ */
+bool dispatcher::dispatch_matches(message & msg)
+{
     // go in order to execute matches
     //
     // remember that a dispatcher with just a set of well defined command
@@ -490,6 +532,70 @@ bool dispatcher::dispatch(message & msg)
 }
 
 
+/** \brief Get the metrics of a command.
+ *
+ * The metrics are cached in the dispatcher so we only search the
+ * registry once per command.
+ *
+ * Only the commands registered with a one to one match get their own
+ * label. The peer can send any command so all the others are grouped
+ * under the "other" label to keep the number of series bounded.
+ *
+ * \param[in] command  The command of the message being dispatched.
+ *
+ * \return The metrics of that command.
+ */
+dispatcher::command_metrics_t & dispatcher::get_command_metrics(std::string const & command)
+{
+    auto it(f_command_metrics.find(command));
+    if(it != f_command_metrics.end())
+    {
+        return it->second;
+    }
+
+    bool registered(false);
+    for(auto const & m : f_matches)
+    {
+        if(m.f_expr != nullptr
+        && (m.match_is_one_to_one_match()
+            || m.match_is_one_to_one_callback_match())
+        && command == m.f_expr)
+        {
+            registered = true;
+            break;
+        }
+    }
+
+    if(!registered)
+    {
+        if(f_other_metrics.f_messages == nullptr)
+        {
+            init_command_metrics(f_other_metrics, "other");
+        }
+        return f_other_metrics;
+    }
+
+    command_metrics_t & cm(f_command_metrics[command]);
+    init_command_metrics(cm, command);
+    return cm;
+}
+
+
+/** \brief Retrieve the metrics of a command from the registry.
+ *
+ * \param[out] cm  The command metrics to initialize.
+ * \param[in] label  The value of the "command" label.
+ */
+void dispatcher::init_command_metrics(command_metrics_t & cm, std::string const & label)
+{
+    metrics & m(metrics::instance());
+    std::string const labels(metrics::label("command", label));
+    cm.f_messages = &m.get_counter("ed_dispatch_messages_total", labels);
+    cm.f_unhandled = &m.get_counter("ed_dispatch_unhandled_total", labels);
+    cm.f_duration = &m.get_histogram("ed_dispatch_duration_us", labels);
+}
+
+
 /** \brief Set whether the dispatcher should trace your messages or not.
  *
  * By default, the f_trace flag is set to false. You can change it to
@@ -28,6 +28,7 @@
 //
 #include    <eventdispatcher/dispatcher_match.h>
 #include    <eventdispatcher/connection_with_send_message.h>
+#include    <eventdispatcher/metrics.h>
 #include    <eventdispatcher/utils.h>
 
 
@@ -60,11 +61,26 @@ public:
     dispatcher_match    define_catch_all() const;
 
 private:
+    struct command_metrics_t
+    {
+        metrics_counter *           f_messages = nullptr;
+        metrics_counter *           f_unhandled = nullptr;
+        metrics_histogram *         f_duration = nullptr;
+    };
+    typedef std::map<std::string, command_metrics_t>
+                                    command_metrics_map_t;
+
+    bool                            dispatch_matches(message & msg);
+    command_metrics_t &             get_command_metrics(std::string const & command);
+    void                            init_command_metrics(command_metrics_t & cm, std::string const & label);
+
     connection_with_send_message *  f_connection = nullptr;
     dispatcher_match::vector_t      f_matches = {};
     dispatcher_match                f_end = {};
     bool                            f_trace = false;
     bool                            f_show_matches = false;
+    command_metrics_map_t           f_command_metrics = command_metrics_map_t();
+    command_metrics_t               f_other_metrics = command_metrics_t();
 };
 
 
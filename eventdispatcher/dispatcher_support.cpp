@@ -29,8 +29,11 @@
 //
 #include    "eventdispatcher/dispatcher_support.h"
 
+#include    "eventdispatcher/connection.h"
+#include    "eventdispatcher/connection_with_send_message.h"
 #include    "eventdispatcher/dispatcher.h"
 #include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/message_capture.h"
 
 
 // snaplogger
@@ -120,6 +123,14 @@ dispatcher::pointer_t dispatcher_support::get_dispatcher() const
  * commands that the default msg_help() wont' understand, then you
  * need to also implement the help() function.
  *
+ * When the message_capture is active, the message is first saved in
+ * the capture file.
+ *
+ * If this object is also a connection_with_send_message and the message
+ * is the reply to a request sent with send_request() (its "reply_to"
+ * parameter matches the "serial" of a request in flight), then the
+ * message is passed to the request callback instead of being dispatched.
+ *
  * \param[in,out] msg  The message being dispatched.
  *
  * \return true if the dispatcher handled the message, false if the
@@ -127,6 +138,24 @@ dispatcher::pointer_t dispatcher_support::get_dispatcher() const
  */
 bool dispatcher_support::dispatch_message(message & msg)
 {
+    if(message_capture::is_active())
+    {
+        connection * conn(dynamic_cast<connection *>(this));
+        message_capture::capture(
+                  capture_direction_t::CAPTURE_DIRECTION_RECEIVED
+                , conn == nullptr ? std::string() : conn->get_name()
+                , msg);
+    }
+
+    // replies to requests sent with send_request() go to their callback
+    //
+    connection_with_send_message * c(dynamic_cast<connection_with_send_message *>(this));
+    if(c != nullptr
+    && c->process_reply(msg))
+    {
+        return true;
+    }
+
     auto d(f_dispatcher.lock());
     if(d != nullptr)
     {
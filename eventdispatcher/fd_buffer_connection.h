@@ -45,6 +45,7 @@ public:
     bool                        has_input() const;
     bool                        has_output() const;
     virtual bool                is_writer() const override;
+    virtual std::size_t         get_output_size() const override;
 
     // fd_connection implementation
     virtual ssize_t             write(void const * data, size_t const length) override;
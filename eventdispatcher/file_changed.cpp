@@ -21,6 +21,15 @@
  *
  * This class is a wrapper around the inotify library. It allows you to
  * listen to various changes to files.
+ *
+ * When the SNAP_FILE_CHANGED_EVENT_RECURSIVE flag is used, the class
+ * also watches all the sub-directories, including the ones created
+ * later. Bursts of write events can be merged using a coalescing window.
+ *
+ * The class can also use the fanotify interface instead. In that case,
+ * one mark covers an entire filesystem (or mount point) and the paths
+ * get filtered in user space. This avoids the max_user_watches limit
+ * and the time it takes to add one watch per directory on large trees.
  */
 
 
@@ -28,7 +37,10 @@
 //
 #include    "eventdispatcher/file_changed.h"
 
+#include    "eventdispatcher/communicator.h"
 #include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/timer.h"
+#include    "eventdispatcher/utils.h"
 
 
 // snaplogger
@@ -38,20 +50,28 @@
 
 // snapdev
 //
-#include    <snapdev/glob_to_list.h>
 #include    <snapdev/pathinfo.h>
 
 
 // C++
 //
 #include    <algorithm>
+#include    <climits>
 #include    <cstring>
+#include    <vector>
 
 
 // C
 //
+#include    <dirent.h>
+#include    <fcntl.h>
 #include    <fnmatch.h>
+#include    <sys/fanotify.h>
 #include    <sys/inotify.h>
+#include    <sys/stat.h>
+#include    <sys/statfs.h>
+#include    <sys/syscall.h>
+#include    <unistd.h>
 
 
 // last include
@@ -72,9 +92,178 @@ namespace
 constexpr char const * const    g_no_path = "/";
 
 
+/** \brief Events which get merged by the coalescing window.
+ *
+ * While a file gets written, the inotify system sends one IN_MODIFY
+ * per write() and the close sends an IN_CLOSE_WRITE. Events only
+ * composed of these flags are merged in one notification per path
+ * when a coalescing window is defined. Any other event (create,
+ * delete, etc.) first flushes the pending event of that path so the
+ * order is preserved.
+ */
+constexpr file_event_mask_t const   g_coalesced_events = SNAP_FILE_CHANGED_EVENT_ATTRIBUTES
+                                                       | SNAP_FILE_CHANGED_EVENT_WRITE
+                                                       | SNAP_FILE_CHANGED_EVENT_ACCESS
+                                                       | SNAP_FILE_CHANGED_EVENT_UPDATED;
+
+
+/** \brief Events supported by the fanotify backend.
+ *
+ * The fanotify event flags use the same values as the inotify flags
+ * so the events_to_mask() and mask_to_events() functions are used
+ * with both backends. The inotify only flags (IN_EXCL_UNLINK,
+ * IN_ONLYDIR, etc.) must be removed before calling fanotify_mark().
+ */
+constexpr std::uint64_t const       g_fanotify_events = FAN_ACCESS
+                                                      | FAN_MODIFY
+                                                      | FAN_ATTRIB
+                                                      | FAN_CLOSE_WRITE
+                                                      | FAN_CLOSE_NOWRITE
+                                                      | FAN_OPEN
+                                                      | FAN_MOVED_FROM
+                                                      | FAN_MOVED_TO
+                                                      | FAN_CREATE
+                                                      | FAN_DELETE
+                                                      | FAN_DELETE_SELF
+                                                      | FAN_MOVE_SELF;
+
+
+/** \brief Directory entry events.
+ *
+ * A mount mark does not support these events. They are removed from
+ * the mask when the FILE_CHANGED_BACKEND_FANOTIFY_MOUNT backend is used.
+ */
+constexpr std::uint64_t const       g_fanotify_dirent_events = FAN_MOVED_FROM
+                                                             | FAN_MOVED_TO
+                                                             | FAN_CREATE
+                                                             | FAN_DELETE
+                                                             | FAN_DELETE_SELF
+                                                             | FAN_MOVE_SELF;
+
+
+/** \brief Maximum number of directories kept in the fanotify cache.
+ *
+ * Transforming a file handle in a path requires an open_by_handle_at()
+ * and a readlink(). The result is cached per directory. The entries of a
+ * directory and its sub-directories are removed when that directory is
+ * moved or deleted. The whole cache is cleared when it reaches this size.
+ */
+constexpr std::size_t const         g_max_directory_cache = 4096;
+
+
+struct dir_entry_t
+{
+    std::string     f_name = std::string();
+    bool            f_directory = false;
+};
+
+
+/** \brief Read the entries of a directory.
+ *
+ * This function reads the directory using the getdents64() system call
+ * with a large buffer so a directory with thousands of entries is read
+ * in very few system calls. Contrary to glob(), the entries are not
+ * sorted and no stat() is needed to know whether an entry is a
+ * directory (unless the file system does not return the type).
+ *
+ * Like the glob() with "*" used before, the hidden entries (names
+ * starting with a period) are ignored.
+ *
+ * \param[in] path  The path to the directory to read.
+ * \param[out] entries  The list of entries found in the directory.
+ *
+ * \return true if the directory could be read.
+ */
+bool read_directory(std::string const & path, std::vector<dir_entry_t> & entries)
+{
+    int const fd(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if(fd == -1)
+    {
+        return false;
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    for(;;)
+    {
+        long const size(syscall(SYS_getdents64, fd, buffer.data(), buffer.size()));
+        if(size <= 0)
+        {
+            close(fd);
+            return size == 0;
+        }
+
+        for(long pos(0); pos < size;)
+        {
+            struct dirent64 const * d(reinterpret_cast<struct dirent64 const *>(buffer.data() + pos));
+            pos += d->d_reclen;
+
+            if(d->d_name[0] == '.')
+            {
+                continue;
+            }
+
+            dir_entry_t e;
+            e.f_name = d->d_name;
+            if(d->d_type == DT_UNKNOWN)
+            {
+                struct stat st = {};
+                e.f_directory = fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+                             && S_ISDIR(st.st_mode);
+            }
+            else
+            {
+                e.f_directory = d->d_type == DT_DIR;
+            }
+            entries.push_back(e);
+        }
+    }
+}
+
+
 } // no name namepsace
 
 
+
+namespace detail
+{
+
+
+/** \brief Timer used to send the coalesced events.
+ *
+ * The timer of the file_changed connection itself is left to the user,
+ * so the coalescing window uses its own timer. It gets added to the
+ * communicator only while events are pending.
+ */
+class file_changed_timer
+    : public timer
+{
+public:
+    typedef std::shared_ptr<file_changed_timer>  pointer_t;
+
+    file_changed_timer(file_changed * parent)
+        : timer(-1)
+        , f_parent(parent)
+    {
+        set_name("file_changed::coalescing_timer");
+    }
+
+    file_changed_timer(file_changed_timer const &) = delete;
+    file_changed_timer & operator = (file_changed_timer const &) = delete;
+
+    virtual void process_timeout() override
+    {
+        f_parent->flush_coalesced_events(false);
+    }
+
+private:
+    file_changed *  f_parent = nullptr;
+};
+
+
+} // namespace detail
+
+
+
 file_event::file_event(
           std::string const & watched_path
         , file_event_mask_t events
@@ -190,6 +379,13 @@ void file_changed::watch_t::merge_watch(
         }
     }
 
+    // the fanotify backend does not use inotify watches
+    //
+    if(inotify == -1)
+    {
+        return;
+    }
+
     // The documentation is not 100% clear about an update so for now
     // I remove the existing watch and create a new one... it should
     // not happen very often anyway
@@ -228,6 +424,14 @@ void file_changed::watch_t::merge_watch(
 
 void file_changed::watch_t::remove_watch(int inotify)
 {
+    if(inotify == -1)
+    {
+        // the fanotify marks are per filesystem, not per watch
+        //
+        f_watch = -1;
+        return;
+    }
+
     if(f_watch != -1)
     {
         int const r(inotify_rm_watch(inotify, f_watch));
@@ -279,12 +483,54 @@ bool file_changed::watch_t::match_patterns(std::string const & filename)
 
 
 
-file_changed::file_changed()
-    : f_inotify(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+/** \brief Initialize the file_changed connection.
+ *
+ * By default the connection uses inotify which requires one watch per
+ * directory. The fanotify backends instead use one mark for an entire
+ * filesystem (or mount point) which is much faster to set up on large
+ * trees and does not count against the max_user_watches limit. The
+ * events are then filtered against the watched paths and patterns in
+ * user space.
+ *
+ * \note
+ * The fanotify backends require the CAP_SYS_ADMIN capability (to add
+ * the mark) and CAP_DAC_READ_SEARCH (to transform the file handles
+ * received with the events in paths).
+ *
+ * \exception initialization_error
+ * The inotify_init1() or fanotify_init() function failed.
+ *
+ * \param[in] backend  The kernel interface used to watch the files.
+ */
+file_changed::file_changed(file_changed_backend_t backend)
+    : f_backend(backend)
 {
-    if(f_inotify == -1)
+    if(is_fanotify())
+    {
+        f_fanotify = fanotify_init(
+                  FAN_CLASS_NOTIF
+                | FAN_CLOEXEC
+                | FAN_NONBLOCK
+                | FAN_REPORT_DFID_NAME
+                , O_RDONLY | O_LARGEFILE);
+        if(f_fanotify == -1)
+        {
+            int const e(errno);
+            throw initialization_error(
+                      "file_changed: fanotify_init() failed (errno: "
+                    + std::to_string(e)
+                    + " -- "
+                    + strerror(e)
+                    + ").");
+        }
+    }
+    else
     {
-        throw initialization_error("file_changed: inotify_init1() failed.");
+        f_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(f_inotify == -1)
+        {
+            throw initialization_error("file_changed: inotify_init1() failed.");
+        }
     }
 }
 
@@ -301,7 +547,34 @@ file_changed::~file_changed()
         w.second->remove_watch(f_inotify);
     }
 
-    close(f_inotify);
+    if(f_inotify != -1)
+    {
+        close(f_inotify);
+    }
+    if(f_fanotify != -1)
+    {
+        close(f_fanotify);
+    }
+    for(auto const & m : f_mount_fds)
+    {
+        close(m.second);
+    }
+}
+
+
+/** \brief Get the backend used by this connection.
+ *
+ * \return The backend as defined in the constructor.
+ */
+file_changed_backend_t file_changed::get_backend() const
+{
+    return f_backend;
+}
+
+
+bool file_changed::is_fanotify() const
+{
+    return f_backend != file_changed_backend_t::FILE_CHANGED_BACKEND_INOTIFY;
 }
 
 
@@ -365,60 +638,214 @@ void file_changed::merge_watch(
         // not found
         //
         watch = std::make_shared<watch_t>(watched_path, pattern, events, flags);
-        watch->add_watch(f_inotify);
+        if(is_fanotify())
+        {
+            add_fanotify_mark(watch);
+            ++f_next_fanotify_id;
+            watch->f_watch = f_next_fanotify_id;
+            f_fanotify_watches.insert(std::make_pair(watch->f_real_path, watch));
+        }
+        else
+        {
+            watch->add_watch(f_inotify);
+        }
         f_watches[watch->f_watch] = watch;
     }
     else
     {
         watch = wevent->second;
+        int const previous_watch(watch->f_watch);
         watch->merge_watch(f_inotify, pattern, events, flags);
+        if(is_fanotify())
+        {
+            add_fanotify_mark(watch);
+        }
+        else if(watch->f_watch != previous_watch)
+        {
+            f_watches.erase(previous_watch);
+            f_watches[watch->f_watch] = watch;
+        }
     }
 
-    if((watch->f_events & SNAP_FILE_CHANGED_EVENT_EXISTS) != 0)
+    struct stat s = {};
+    if(stat(watch->f_watched_path.c_str(), &s) == 0
+    && S_ISDIR(s.st_mode))
     {
-        struct stat s = {};
-        if(stat(watch->f_watched_path.c_str(), &s) == 0
-        && S_ISDIR(s.st_mode))
+        // the watcher wants events for all existing files on the first
+        // connection and/or to watch all the sub-directories (with
+        // fanotify, the sub-directories are already covered by the mark)
+        //
+        if((watch->f_events & SNAP_FILE_CHANGED_EVENT_EXISTS) != 0
+        || ((watch->f_events & SNAP_FILE_CHANGED_EVENT_RECURSIVE) != 0 && !is_fanotify()))
         {
-            // the watcher wants events for all existing files on the first
-            // connection so send those now
-            //
-            // Note: the patterns we support here are for fnmatch() and
-            //       because of that the glob() has to be called with "*"
-            //       and then we filter by fnmatch() here
-            //
-            snapdev::glob_to_list<std::list<std::string>> files;
-            if(files.read_path<
-                     snapdev::glob_to_list_flag_t::GLOB_FLAG_IGNORE_ERRORS>(watch->f_watched_path + "/*"))
+            scan_directory(
+                  watch
+                , watch->f_events & SNAP_FILE_CHANGED_EVENT_EXISTS);
+        }
+    }
+    else if((watch->f_events & SNAP_FILE_CHANGED_EVENT_EXISTS) != 0)
+    {
+        // this is a file, so just send an event for that file
+        //
+        // TBD: should the path be broken up in a path & filename?
+        //      I need to test and see what happens if I watch a
+        //      file directly... what event do we sent the user
+        //
+        file_event const watch_event(
+                  watch->f_watched_path
+                , SNAP_FILE_CHANGED_EVENT_EXISTS
+                , std::string());
+        process_event(watch_event);
+    }
+}
+
+
+/** \brief Add a watch on a sub-directory of a recursive watch.
+ *
+ * The new watch uses the same events and patterns as its \p parent.
+ * If the directory is already watched (i.e. it was moved back in or
+ * the user also watches it directly), the masks get merged and no new
+ * watch is created.
+ *
+ * Errors are not fatal here since the sub-directory may already be
+ * gone or the process may have reached the max_user_watches limit.
+ * They get logged and the function returns a null pointer.
+ *
+ * \param[in] parent  The watch of the parent directory.
+ * \param[in] path  The full path to the sub-directory.
+ *
+ * \return The new watch or nullptr.
+ */
+file_changed::watch_t::pointer_t file_changed::add_child_watch(
+      watch_t::pointer_t parent
+    , std::string const & path)
+{
+    int const wd(inotify_add_watch(f_inotify, path.c_str(), parent->f_mask | IN_MASK_ADD));
+    if(wd == -1)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "inotify_add_watch() could not watch sub-directory \""
+            << path
+            << "\" (errno: "
+            << e
+            << " -- "
+            << strerror(e)
+            << ")."
+            << SNAP_LOG_SEND;
+        return watch_t::pointer_t();
+    }
+
+    if(f_watches.find(wd) != f_watches.end())
+    {
+        return watch_t::pointer_t();
+    }
+
+    watch_t::pointer_t child(std::make_shared<watch_t>(*parent));
+    child->f_watched_path = path;
+    child->f_watch = wd;
+    child->f_child = true;
+    f_watches[wd] = child;
+    return child;
+}
+
+
+/** \brief Remove the watches created for sub-directories of \p path.
+ *
+ * When a watched sub-directory gets moved out of the tree, its watch
+ * and the watches of its own sub-directories must be removed since
+ * their paths are not valid anymore.
+ *
+ * \param[in] path  The path of the directory that moved away.
+ */
+void file_changed::remove_child_watches(std::string const & path)
+{
+    std::string const prefix(path + '/');
+    for(auto it(f_watches.begin()); it != f_watches.end();)
+    {
+        if(it->second->f_child
+        && (it->second->f_watched_path == path
+            || it->second->f_watched_path.compare(0, prefix.length(), prefix) == 0))
+        {
+            it->second->remove_watch(f_inotify);
+            it = f_watches.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+
+/** \brief Scan a directory.
+ *
+ * This function reads the entries of the directory watched by \p watch.
+ * If \p report is not SNAP_FILE_CHANGED_EVENT_NO_EVENTS, the entries
+ * matching the watch patterns get reported with those events.
+ *
+ * When the watch is recursive, a watch is added on each sub-directory
+ * and these get scanned in turn. This is done with a stack instead of
+ * recursive calls since a tree can be very deep.
+ *
+ * \param[in] watch  The watch of the directory to scan.
+ * \param[in] report  The events to report for each entry found.
+ */
+void file_changed::scan_directory(
+      watch_t::pointer_t watch
+    , file_event_mask_t report)
+{
+    std::vector<watch_t::pointer_t> stack{ watch };
+    std::vector<dir_entry_t> entries;
+    while(!stack.empty())
+    {
+        watch_t::pointer_t w(stack.back());
+        stack.pop_back();
+
+        entries.clear();
+        if(!read_directory(w->f_watched_path, entries))
+        {
+            continue;
+        }
+
+        for(auto const & e : entries)
+        {
+            if(report != SNAP_FILE_CHANGED_EVENT_NO_EVENTS
+            && w->match_patterns(e.f_name))
             {
-                for(auto const & filename : files)
+                file_event const watch_event(
+                          w->f_watched_path
+                        , report | (e.f_directory ? SNAP_FILE_CHANGED_EVENT_DIRECTORY : 0)
+                        , e.f_name);
+                process_event(watch_event);
+            }
+
+            if(e.f_directory
+            && (w->f_events & SNAP_FILE_CHANGED_EVENT_RECURSIVE) != 0)
+            {
+                std::string const path(w->f_watched_path + '/' + e.f_name);
+                if(is_fanotify())
                 {
-                    std::string const basename(snapdev::pathinfo::basename(filename));
-                    if(watch->match_patterns(basename))
+                    // the mark already covers the sub-directory, we only
+                    // need to report its files
+                    //
+                    if(report != SNAP_FILE_CHANGED_EVENT_NO_EVENTS)
                     {
-                        file_event const watch_event(
-                                  watch->f_watched_path
-                                , SNAP_FILE_CHANGED_EVENT_EXISTS
-                                , basename);
-                        process_event(watch_event);
+                        watch_t::pointer_t child(std::make_shared<watch_t>(*w));
+                        child->f_watched_path = path;
+                        stack.push_back(child);
+                    }
+                }
+                else
+                {
+                    watch_t::pointer_t child(add_child_watch(w, path));
+                    if(child != nullptr)
+                    {
+                        stack.push_back(child);
                     }
                 }
             }
         }
-        else
-        {
-            // this is a file, so just send an event for that file
-            //
-            // TBD: should the path be broken up in a path & filename?
-            //      I need to test and see what happens if I watch a
-            //      file directly... what event do we sent the user
-            //
-            file_event const watch_event(
-                      watch->f_watched_path
-                    , SNAP_FILE_CHANGED_EVENT_EXISTS
-                    , std::string());
-            process_event(watch_event);
-        }
     }
 }
 
@@ -507,12 +934,197 @@ void file_changed::stop_watch(std::string watch_path)
 
     if(wevent != f_watches.end())
     {
+        bool const recursive((wevent->second->f_events & SNAP_FILE_CHANGED_EVENT_RECURSIVE) != 0);
         wevent->second->remove_watch(f_inotify);
+        if(is_fanotify())
+        {
+            auto const range(f_fanotify_watches.equal_range(wevent->second->f_real_path));
+            for(auto it(range.first); it != range.second; ++it)
+            {
+                if(it->second == wevent->second)
+                {
+                    f_fanotify_watches.erase(it);
+                    break;
+                }
+            }
+        }
         f_watches.erase(wevent);
+
+        if(recursive)
+        {
+            remove_child_watches(watch_path);
+        }
+
+        // the marks cover entire filesystems so we can only remove them
+        // once no more paths are being watched
+        //
+        if(is_fanotify()
+        && f_watches.empty())
+        {
+            unsigned int const flags(f_backend == file_changed_backend_t::FILE_CHANGED_BACKEND_FANOTIFY_MOUNT
+                                        ? FAN_MARK_FLUSH | FAN_MARK_MOUNT
+                                        : FAN_MARK_FLUSH | FAN_MARK_FILESYSTEM);
+            fanotify_mark(f_fanotify, flags, 0, AT_FDCWD, nullptr);
+            f_directory_cache.clear();
+            f_directory_paths.clear();
+        }
     }
 }
 
 
+/** \brief Get the coalescing window.
+ *
+ * \return The coalescing window in microseconds, 0 when turned off.
+ *
+ * \sa set_coalescing_window()
+ */
+std::int64_t file_changed::get_coalescing_window() const
+{
+    return f_coalescing_window;
+}
+
+
+/** \brief Merge bursts of write events.
+ *
+ * While a file gets written, the inotify system sends one event per
+ * write() call. When deploying many files, this can represent a very
+ * large number of events. With a coalescing window, the attribute,
+ * write, access and update events of a given path get merged (their
+ * flags are OR'ed) and the resulting event is sent once the window
+ * elapsed after the first one.
+ *
+ * Other events are never delayed. They first flush the pending event
+ * of the same path, if any, so the order of the events of one path is
+ * kept.
+ *
+ * Set the window to 0 (the default) to send every event immediately.
+ *
+ * \exception parameter_error
+ * The window cannot be negative.
+ *
+ * \param[in] window_us  The coalescing window in microseconds.
+ */
+void file_changed::set_coalescing_window(std::int64_t window_us)
+{
+    if(window_us < 0)
+    {
+        throw parameter_error(
+                  "file_changed::set_coalescing_window(): window_us parameter cannot be negative, "
+                + std::to_string(window_us)
+                + " is not valid.");
+    }
+
+    f_coalescing_window = window_us;
+    if(f_coalescing_window == 0)
+    {
+        flush_coalesced_events(true);
+    }
+}
+
+
+/** \brief Send the coalesced events.
+ *
+ * This function sends the pending events which reached the end of
+ * their window or all of them if \p all is true.
+ *
+ * \param[in] all  Whether to send all the pending events.
+ */
+void file_changed::flush_coalesced_events(bool all)
+{
+    std::int64_t const now(get_current_date());
+    std::vector<file_event> ready;
+    std::int64_t next_date(-1);
+    for(auto it(f_pending_events.begin()); it != f_pending_events.end();)
+    {
+        std::int64_t const date(it->second.f_date + f_coalescing_window);
+        if(all || date <= now)
+        {
+            ready.emplace_back(it->first.first, it->second.f_events, it->first.second);
+            it = f_pending_events.erase(it);
+        }
+        else
+        {
+            if(next_date == -1 || date < next_date)
+            {
+                next_date = date;
+            }
+            ++it;
+        }
+    }
+
+    if(f_coalescing_timer != nullptr)
+    {
+        if(next_date == -1)
+        {
+            communicator::instance()->remove_connection(f_coalescing_timer);
+        }
+        else
+        {
+            f_coalescing_timer->set_timeout_date(next_date);
+        }
+    }
+
+    for(auto const & e : ready)
+    {
+        process_event(e);
+    }
+}
+
+
+/** \brief Send an event, possibly through the coalescing window.
+ *
+ * \param[in] watch_event  The event to send.
+ */
+void file_changed::emit_event(file_event const & watch_event)
+{
+    if(f_coalescing_window <= 0)
+    {
+        process_event(watch_event);
+        return;
+    }
+
+    pending_key_t const key(watch_event.get_watched_path(), watch_event.get_filename());
+    if((watch_event.get_events() & ~g_coalesced_events) == 0)
+    {
+        auto it(f_pending_events.find(key));
+        if(it != f_pending_events.end())
+        {
+            it->second.f_events |= watch_event.get_events();
+            return;
+        }
+
+        std::int64_t const now(get_current_date());
+        f_pending_events[key] = pending_event_t{ watch_event.get_events(), now };
+
+        if(f_coalescing_timer == nullptr)
+        {
+            f_coalescing_timer = std::make_shared<detail::file_changed_timer>(this);
+        }
+        if(f_pending_events.size() == 1)
+        {
+            f_coalescing_timer->set_timeout_date(now + f_coalescing_window);
+            communicator::instance()->add_connection(f_coalescing_timer);
+        }
+        return;
+    }
+
+    // any other event first sends the pending event of the same path
+    //
+    auto it(f_pending_events.find(key));
+    if(it != f_pending_events.end())
+    {
+        file_event const pending(key.first, it->second.f_events, key.second);
+        f_pending_events.erase(it);
+        if(f_pending_events.empty())
+        {
+            communicator::instance()->remove_connection(f_coalescing_timer);
+        }
+        process_event(pending);
+    }
+    process_event(watch_event);
+}
+
+
 bool file_changed::is_reader() const
 {
     return true;
@@ -528,7 +1140,7 @@ int file_changed::get_socket() const
         return -1;
     }
 
-    return f_inotify;
+    return is_fanotify() ? f_fanotify : f_inotify;
 }
 
 
@@ -561,6 +1173,17 @@ void file_changed::set_enable(bool enabled)
 }
 
 
+/** \brief The connection was removed from the communicator.
+ *
+ * The pending coalesced events are sent immediately and the coalescing
+ * timer gets removed too.
+ */
+void file_changed::connection_removed()
+{
+    flush_coalesced_events(true);
+}
+
+
 void file_changed::process_read()
 {
     // were notifications closed in between?
@@ -569,17 +1192,23 @@ void file_changed::process_read()
     //       just can't happen; but I think that at some point it will on
     //       some errors and then we have to test the fd like this
     //
+    if(is_fanotify())
+    {
+        process_fanotify_read();
+        return;
+    }
+
     if(f_inotify == -1)
     {
         return;
     }
 
-    // WARNING: this is about 4Kb of buffer on the stack
-    //          it is NOT 256 structures because all events with a name
+    // WARNING: this is about 16Kb of buffer on the stack
+    //          it is NOT 1024 structures because all events with a name
     //          have the name included in themselves and that "eats"
     //          space in the next structure
     //
-    struct inotify_event buffer[256];
+    struct inotify_event buffer[1024];
 
     for(;;)
     {
@@ -686,16 +1315,47 @@ void file_changed::process_read()
             {
                 // convert the inotify event in one of our events
                 //
-                auto const & wevent(f_watches.find(ievent.wd));
+                auto const wevent(f_watches.find(ievent.wd));
                 if(wevent != f_watches.end())
                 {
-                    if(wevent->second->match_patterns(filename))
+                    // the callback may remove the watch so keep a copy
+                    //
+                    watch_t::pointer_t const w(wevent->second);
+                    if(w->match_patterns(filename))
                     {
                         file_event const watch_event(
-                                  wevent->second->f_watched_path
+                                  w->f_watched_path
                                 , mask_to_events(ievent.mask)
                                 , filename);
-                        process_event(watch_event);
+                        emit_event(watch_event);
+                    }
+
+                    // in a recursive watch, new sub-directories get
+                    // watched and the ones moved away are forgotten
+                    //
+                    if((w->f_events & SNAP_FILE_CHANGED_EVENT_RECURSIVE) != 0
+                    && (ievent.mask & IN_ISDIR) != 0
+                    && !filename.empty()
+                    && filename[0] != '.')
+                    {
+                        std::string const path(w->f_watched_path + '/' + filename);
+                        if((ievent.mask & (IN_CREATE | IN_MOVED_TO)) != 0)
+                        {
+                            // files may have been created in the new
+                            // directory before we added the watch
+                            //
+                            watch_t::pointer_t child(add_child_watch(w, path));
+                            if(child != nullptr)
+                            {
+                                scan_directory(
+                                      child
+                                    , w->f_events & SNAP_FILE_CHANGED_EVENT_CREATED);
+                            }
+                        }
+                        else if((ievent.mask & IN_MOVED_FROM) != 0)
+                        {
+                            remove_child_watches(path);
+                        }
                     }
 
                     // if the event received included IN_IGNORED then we need
@@ -703,12 +1363,11 @@ void file_changed::process_read()
                     //
                     if((ievent.mask & IN_IGNORED) != 0)
                     {
-                        // before losing the wevent, make sure we disconnect
+                        // before losing the watch, make sure we disconnect
                         // from the OS version
                         //
-                        wevent->second->remove_watch(f_inotify);
+                        w->remove_watch(f_inotify);
                         f_watches.erase(ievent.wd);
-                        f_watches.erase(wevent);
                     }
                 }
                 else
@@ -730,6 +1389,401 @@ void file_changed::process_read()
 }
 
 
+/** \brief Add the fanotify mark for a watch.
+ *
+ * With the fanotify backend, the mark is added on the filesystem (or
+ * mount point) of the watched path. The mask of the mark is the union
+ * of the masks of all the watches of that filesystem since the kernel
+ * merges the masks of the same mark.
+ *
+ * The function also keeps a file descriptor to a directory of that
+ * filesystem. It is necessary to transform the file handles received
+ * with the events in paths.
+ *
+ * \exception initialization_error
+ * The path does not exist or the mark could not be added.
+ *
+ * \param[in] watch  The watch to add a mark for.
+ */
+void file_changed::add_fanotify_mark(watch_t::pointer_t watch)
+{
+    // the paths we receive from the kernel are canonical
+    //
+    if(watch->f_real_path.empty())
+    {
+        char real_path[PATH_MAX + 1];
+        if(realpath(watch->f_watched_path.c_str(), real_path) == nullptr)
+        {
+            throw initialization_error(
+                      "file_changed: could not determine the real path of \""
+                    + watch->f_watched_path
+                    + "\".");
+        }
+        watch->f_real_path = real_path;
+    }
+
+    std::uint64_t mask(watch->f_mask & g_fanotify_events);
+    unsigned int flags(FAN_MARK_ADD | FAN_MARK_FILESYSTEM);
+    if(f_backend == file_changed_backend_t::FILE_CHANGED_BACKEND_FANOTIFY_MOUNT)
+    {
+        mask &= ~g_fanotify_dirent_events;
+        flags = FAN_MARK_ADD | FAN_MARK_MOUNT;
+    }
+    if(mask == 0)
+    {
+        throw initialization_error(
+                  "file_changed: none of the events to watch on \""
+                + watch->f_watched_path
+                + "\" are supported by a fanotify mount mark.");
+    }
+
+    if(fanotify_mark(f_fanotify, flags, mask | FAN_ONDIR, AT_FDCWD, watch->f_real_path.c_str()) != 0)
+    {
+        int const e(errno);
+        std::stringstream ss;
+        ss << "fanotify_mark() returned an error (errno: "
+           << e
+           << " -- "
+           << strerror(e)
+           << ").";
+        initialization_error err(ss.str());
+        SNAP_LOG_FATAL
+            << err
+            << SNAP_LOG_SEND;
+        throw err;
+    }
+
+    struct statfs sfs = {};
+    if(statfs(watch->f_real_path.c_str(), &sfs) != 0)
+    {
+        return;
+    }
+    std::pair<int, int> const fsid(sfs.f_fsid.__val[0], sfs.f_fsid.__val[1]);
+    if(f_mount_fds.find(fsid) != f_mount_fds.end())
+    {
+        return;
+    }
+
+    struct stat st = {};
+    std::string directory(watch->f_real_path);
+    if(stat(directory.c_str(), &st) != 0
+    || !S_ISDIR(st.st_mode))
+    {
+        directory = snapdev::pathinfo::dirname(directory);
+    }
+    int const fd(open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if(fd != -1)
+    {
+        f_mount_fds[fsid] = fd;
+    }
+}
+
+
+/** \brief Transform a fanotify directory handle in a path.
+ *
+ * The fanotify events include a handle to the directory in which the
+ * event occurred. This function opens that handle and reads the
+ * corresponding path. The result is cached.
+ *
+ * \param[in] fsid  The filesystem identifier (two integers).
+ * \param[in] handle  The file handle of the directory.
+ *
+ * \return The path to the directory or an empty string if the handle
+ * cannot be opened (i.e. the directory was already deleted).
+ */
+std::string file_changed::fanotify_directory(int const * fsid, void const * handle)
+{
+    auto const mount_fd(f_mount_fds.find(std::make_pair(fsid[0], fsid[1])));
+    if(mount_fd == f_mount_fds.end())
+    {
+        return std::string();
+    }
+
+    struct file_handle const * fh(static_cast<struct file_handle const *>(handle));
+    std::string const key(
+              std::to_string(fsid[0])
+            + ':'
+            + std::to_string(fsid[1])
+            + ':'
+            + std::to_string(fh->handle_type)
+            + ':'
+            + std::string(reinterpret_cast<char const *>(fh->f_handle), fh->handle_bytes));
+    auto const cached(f_directory_cache.find(key));
+    if(cached != f_directory_cache.end())
+    {
+        return cached->second;
+    }
+
+    int const fd(open_by_handle_at(
+              mount_fd->second
+            , const_cast<struct file_handle *>(fh)
+            , O_PATH | O_CLOEXEC));
+    if(fd == -1)
+    {
+        return std::string();
+    }
+
+    char buf[PATH_MAX + 1];
+    std::string const link("/proc/self/fd/" + std::to_string(fd));
+    ssize_t const len(readlink(link.c_str(), buf, sizeof(buf) - 1));
+    close(fd);
+    if(len <= 0)
+    {
+        return std::string();
+    }
+
+    if(f_directory_cache.size() >= g_max_directory_cache)
+    {
+        f_directory_cache.clear();
+        f_directory_paths.clear();
+    }
+    std::string const path(buf, len);
+    f_directory_cache[key] = path;
+    f_directory_paths[path] = key;
+    return path;
+}
+
+
+/** \brief Remove a directory and its sub-directories from the cache.
+ *
+ * When a directory gets moved or deleted, the paths cached for it and
+ * for all of its sub-directories are not valid anymore. The paths are
+ * kept sorted so the sub-directories directly follow their parent.
+ *
+ * \param[in] path  The path of the directory that was moved or deleted.
+ */
+void file_changed::forget_fanotify_directory(std::string const & path)
+{
+    std::string const prefix(path + '/');
+    auto it(f_directory_paths.lower_bound(path));
+    while(it != f_directory_paths.end()
+       && (it->first == path
+           || it->first.compare(0, prefix.length(), prefix) == 0))
+    {
+        f_directory_cache.erase(it->second);
+        it = f_directory_paths.erase(it);
+    }
+}
+
+
+/** \brief Send a fanotify event to the matching watches.
+ *
+ * The fanotify mark covers an entire filesystem so the events are
+ * matched against the watches here. An event matches a watch if the
+ * object is the watched path itself or is in the watched directory
+ * (or any of its sub-directories for a recursive watch) and its name
+ * matches the watch patterns.
+ *
+ * The events are reported with the same paths as the inotify backend
+ * would use.
+ *
+ * \param[in] mask  The fanotify event mask.
+ * \param[in] path  The full path of the object the event is about.
+ */
+void file_changed::fanotify_event(std::uint64_t mask, std::string const & path)
+{
+    file_event_mask_t const events(mask_to_events(static_cast<std::uint32_t>(mask)));
+    if(events == SNAP_FILE_CHANGED_EVENT_NO_EVENTS)
+    {
+        return;
+    }
+
+    std::string const dirname(snapdev::pathinfo::dirname(path));
+    std::string const basename(snapdev::pathinfo::basename(path));
+
+    // the mark mask is the union of all the watches, ignore events
+    // a watch did not ask for
+    //
+    auto const wants_event([mask](watch_t::pointer_t const & w)
+        {
+            if((mask & w->f_mask & g_fanotify_events) == 0)
+            {
+                return false;
+            }
+            return (w->f_mask & IN_ONLYDIR) == 0
+                || (mask & FAN_ONDIR) != 0;
+        });
+
+    // the callback may add or remove watches so first gather the events
+    //
+    std::vector<file_event> found;
+
+    // the object itself is watched
+    //
+    auto const self(f_fanotify_watches.equal_range(path));
+    for(auto it(self.first); it != self.second; ++it)
+    {
+        if(wants_event(it->second))
+        {
+            found.push_back(file_event(it->second->f_watched_path, events, std::string()));
+        }
+    }
+
+    // its directory is watched, or one of the parents of that directory
+    // is watched recursively
+    //
+    std::string directory(dirname);
+    for(bool parent(true);; parent = false)
+    {
+        auto const range(f_fanotify_watches.equal_range(directory));
+        for(auto it(range.first); it != range.second; ++it)
+        {
+            watch_t::pointer_t const & w(it->second);
+            if((parent || (w->f_events & SNAP_FILE_CHANGED_EVENT_RECURSIVE) != 0)
+            && wants_event(w)
+            && w->match_patterns(basename))
+            {
+                found.push_back(file_event(
+                          w->f_watched_path + dirname.substr(directory.length())
+                        , events
+                        , basename));
+            }
+        }
+
+        std::string::size_type const pos(directory.rfind('/'));
+        if(pos == std::string::npos
+        || directory.length() <= 1)
+        {
+            break;
+        }
+        directory = pos == 0 ? std::string("/") : directory.substr(0, pos);
+    }
+
+    for(auto const & e : found)
+    {
+        emit_event(e);
+    }
+}
+
+
+/** \brief Read the events from the fanotify file descriptor.
+ *
+ * This function is the fanotify equivalent of the inotify loop found
+ * in process_read().
+ */
+void file_changed::process_fanotify_read()
+{
+    if(f_fanotify == -1)
+    {
+        return;
+    }
+
+    alignas(struct fanotify_event_metadata) char buffer[16 * 1024];
+
+    for(;;)
+    {
+        ssize_t len(read(f_fanotify, buffer, sizeof(buffer)));
+        if(len <= 0)
+        {
+            if(len == 0
+            || errno == EAGAIN)
+            {
+                return;
+            }
+
+            int const e(errno);
+            SNAP_LOG_ERROR
+                << "an error occurred while reading from fanotify (errno: "
+                << e
+                << " -- "
+                << strerror(e)
+                << ")."
+                << SNAP_LOG_SEND;
+            process_error();
+            return;
+        }
+
+        struct fanotify_event_metadata * metadata(reinterpret_cast<struct fanotify_event_metadata *>(buffer));
+        for(; FAN_EVENT_OK(metadata, len); metadata = FAN_EVENT_NEXT(metadata, len))
+        {
+            if(metadata->vers != FANOTIFY_METADATA_VERSION)
+            {
+                SNAP_LOG_ERROR
+                    << "fanotify metadata version mismatch ("
+                    << static_cast<int>(metadata->vers)
+                    << " instead of "
+                    << FANOTIFY_METADATA_VERSION
+                    << ")."
+                    << SNAP_LOG_SEND;
+                process_error();
+                return;
+            }
+
+            if(metadata->fd >= 0)
+            {
+                // we use file handles, this should not happen
+                //
+                close(metadata->fd);
+            }
+
+            if((metadata->mask & FAN_Q_OVERFLOW) != 0)
+            {
+                SNAP_LOG_RECOVERABLE_ERROR
+                    << "Received an event queue overflow error."
+                    << SNAP_LOG_SEND;
+
+                file_event const watch_event(
+                          g_no_path
+                        , SNAP_FILE_CHANGED_EVENT_LOST_SYNC
+                        , std::string());
+                process_event(watch_event);
+                continue;
+            }
+
+            std::string path;
+            char const * info(reinterpret_cast<char const *>(metadata) + metadata->metadata_len);
+            char const * end(reinterpret_cast<char const *>(metadata) + metadata->event_len);
+            while(info + sizeof(struct fanotify_event_info_header) <= end)
+            {
+                struct fanotify_event_info_header const * header(
+                        reinterpret_cast<struct fanotify_event_info_header const *>(info));
+                if(header->len == 0)
+                {
+                    break;
+                }
+                if(header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME
+                || header->info_type == FAN_EVENT_INFO_TYPE_DFID)
+                {
+                    struct fanotify_event_info_fid const * fid(
+                            reinterpret_cast<struct fanotify_event_info_fid const *>(info));
+                    struct file_handle const * handle(
+                            reinterpret_cast<struct file_handle const *>(fid->handle));
+                    path = fanotify_directory(fid->fsid.val, handle);
+                    if(!path.empty()
+                    && header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME)
+                    {
+                        // events about a directory itself use "."
+                        //
+                        char const * name(reinterpret_cast<char const *>(handle->f_handle) + handle->handle_bytes);
+                        if(strcmp(name, ".") != 0)
+                        {
+                            path += '/';
+                            path += name;
+                        }
+                    }
+                    break;
+                }
+                info += header->len;
+            }
+
+            if(!path.empty())
+            {
+                fanotify_event(metadata->mask, path);
+
+                // a directory moved or deleted invalidates its cached
+                // path and the paths of its sub-directories
+                //
+                if((metadata->mask & FAN_ONDIR) != 0
+                && (metadata->mask & (FAN_MOVED_FROM | FAN_MOVED_TO | FAN_DELETE | FAN_DELETE_SELF)) != 0)
+                {
+                    forget_fanotify_directory(path);
+                }
+            }
+        }
+    }
+}
+
+
 uint32_t file_changed::events_to_mask(file_event_mask_t const events)
 {
     uint32_t mask(0);
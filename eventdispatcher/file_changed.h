@@ -107,26 +107,47 @@ private:
 
 
 
+enum class file_changed_backend_t
+{
+    FILE_CHANGED_BACKEND_INOTIFY,                   // one watch per directory
+    FILE_CHANGED_BACKEND_FANOTIFY_FILESYSTEM,       // one mark per filesystem (requires CAP_SYS_ADMIN)
+    FILE_CHANGED_BACKEND_FANOTIFY_MOUNT,            // one mark per mount point, no create/delete/move events (requires CAP_SYS_ADMIN)
+};
+
+
+namespace detail
+{
+class file_changed_timer;
+}
+
+
 class file_changed
     : public connection
 {
 public:
     typedef std::shared_ptr<file_changed>           pointer_t;
 
-                                file_changed();
+                                file_changed(file_changed_backend_t backend = file_changed_backend_t::FILE_CHANGED_BACKEND_INOTIFY);
     virtual                     ~file_changed() override;
 
+    file_changed_backend_t      get_backend() const;
+
     void                        watch_files(std::string const & watch_path, file_event_mask_t const events);
     void                        watch_symlinks(std::string const & watch_path, file_event_mask_t const events);
     void                        watch_directories(std::string const & watch_path, file_event_mask_t const events);
 
     void                        stop_watch(std::string watched_path);
 
+    std::int64_t                get_coalescing_window() const;
+    void                        set_coalescing_window(std::int64_t window_us);
+    void                        flush_coalesced_events(bool all);
+
     // connection implementation
     virtual bool                is_reader() const override;
     virtual int                 get_socket() const override;
     virtual void                set_enable(bool enabled);
     virtual void                process_read() override;
+    virtual void                connection_removed() override;
 
     // new callback
     virtual void                process_event(file_event const & watch_event) = 0;
@@ -138,6 +159,8 @@ private:
     {
         typedef std::shared_ptr<watch_t>        pointer_t;
         typedef std::map<int, pointer_t>        map_t;
+        typedef std::multimap<std::string, pointer_t>
+                                                path_map_t;
 
                                 watch_t();
                                 watch_t(
@@ -156,12 +179,23 @@ private:
         bool                    match_patterns(std::string const & filename);
 
         std::string             f_watched_path = std::string();
+        std::string             f_real_path    = std::string();
         std::set<std::string>   f_patterns     = std::set<std::string>();
         file_event_mask_t       f_events       = SNAP_FILE_CHANGED_EVENT_NO_EVENTS;
         std::uint32_t           f_mask         = 0;
         int                     f_watch        = -1;
+        bool                    f_child        = false;
     };
 
+    struct pending_event_t
+    {
+        file_event_mask_t       f_events       = SNAP_FILE_CHANGED_EVENT_NO_EVENTS;
+        std::int64_t            f_date         = 0;
+    };
+
+    typedef std::pair<std::string, std::string>            pending_key_t;
+    typedef std::map<pending_key_t, pending_event_t>        pending_events_t;
+
     void                        merge_watch(
                                       std::string watched_path
                                     , file_event_mask_t const events
@@ -169,9 +203,39 @@ private:
     static uint32_t             events_to_mask(file_event_mask_t const events);
     static file_event_mask_t    mask_to_events(uint32_t const mask);
     bool                        path_and_pattern(std::string & path, std::string & pattern);
-
+    watch_t::pointer_t          add_child_watch(
+                                      watch_t::pointer_t parent
+                                    , std::string const & path);
+    void                        remove_child_watches(std::string const & path);
+    void                        scan_directory(
+                                      watch_t::pointer_t watch
+                                    , file_event_mask_t report);
+    void                        emit_event(file_event const & watch_event);
+    bool                        is_fanotify() const;
+    void                        add_fanotify_mark(watch_t::pointer_t watch);
+    std::string                 fanotify_directory(int const * fsid, void const * handle);
+    void                        forget_fanotify_directory(std::string const & path);
+    void                        fanotify_event(
+                                      std::uint64_t mask
+                                    , std::string const & path);
+    void                        process_fanotify_read();
+
+    file_changed_backend_t      f_backend = file_changed_backend_t::FILE_CHANGED_BACKEND_INOTIFY;
     int                         f_inotify = -1;
+    int                         f_fanotify = -1;
+    int                         f_next_fanotify_id = 0;
+    std::map<std::pair<int, int>, int>
+                                f_mount_fds = std::map<std::pair<int, int>, int>();
+    std::map<std::string, std::string>
+                                f_directory_cache = std::map<std::string, std::string>();
+    std::map<std::string, std::string>
+                                f_directory_paths = std::map<std::string, std::string>();
     watch_t::map_t              f_watches = watch_t::map_t();
+    watch_t::path_map_t         f_fanotify_watches = watch_t::path_map_t();
+    std::int64_t                f_coalescing_window = 0;
+    pending_events_t            f_pending_events = pending_events_t();
+    std::shared_ptr<detail::file_changed_timer>
+                                f_coalescing_timer = std::shared_ptr<detail::file_changed_timer>();
 };
 
 
@@ -0,0 +1,485 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the credit based flow control.
+ *
+ * The protocol makes use of two messages:
+ *
+ * \li FLOW_CONTROL -- sent by the receiver to tell the sender that it
+ * wants flow control; the "credits" parameter is the number of messages
+ * the sender can send and the optional "byte_credits" the number of
+ * bytes; a "credits" of 0 turns off the flow control;
+ * \li CREDITS -- sent by the receiver once it processed a batch of
+ * messages; the sender subtracts the "credits" and "byte_credits" from
+ * the number of messages and bytes it has in flight.
+ *
+ * The sender counts the messages it sent and which were not yet given
+ * back with a CREDITS message. It sends a new message only while that
+ * count is under the window. A new FLOW_CONTROL message changes the
+ * window but the messages already in flight still count against it.
+ *
+ * Peers which do not enable the flow control never send a FLOW_CONTROL
+ * message so the sender never limits itself.
+ */
+
+// self
+//
+#include    "eventdispatcher/flow_control.h"
+
+#include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/names.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_used.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ed
+{
+
+
+
+/** \brief Clean up the flow control.
+ *
+ * Messages still held are lost.
+ */
+flow_control::~flow_control()
+{
+}
+
+
+/** \brief Ask the peer to use flow control.
+ *
+ * This function sends a FLOW_CONTROL message to the other side of the
+ * connection. From then on, the peer sends at most \p message_credits
+ * messages (and \p byte_credits bytes if not zero) before it receives
+ * more credits.
+ *
+ * Credits are given back in batches, once a quarter of the window was
+ * dispatched, to keep the control traffic low.
+ *
+ * Calling the function with \p message_credits set to 0 turns the flow
+ * control off.
+ *
+ * \exception invalid_parameter
+ * The credits cannot be negative.
+ *
+ * \param[in] message_credits  The maximum number of messages in flight.
+ * \param[in] byte_credits  The maximum number of bytes in flight or 0.
+ *
+ * \return true if the FLOW_CONTROL message was sent.
+ */
+bool flow_control::enable_flow_control(
+      std::int64_t message_credits
+    , std::int64_t byte_credits)
+{
+    if(message_credits < 0
+    || byte_credits < 0)
+    {
+        throw invalid_parameter("flow control credits cannot be negative.");
+    }
+
+    f_message_window = message_credits;
+    f_byte_window = message_credits == 0 ? 0 : byte_credits;
+    f_consumed_messages = 0;
+    f_consumed_bytes = 0;
+
+    message msg;
+    msg.set_command(g_name_ed_cmd_flow_control);
+    msg.add_parameter(g_name_ed_param_credits, f_message_window);
+    if(f_byte_window != 0)
+    {
+        msg.add_parameter(g_name_ed_param_byte_credits, f_byte_window);
+    }
+    return send_control_message(msg);
+}
+
+
+/** \brief Check whether we asked the peer to use flow control.
+ *
+ * \return true if enable_flow_control() was called with credits.
+ */
+bool flow_control::is_flow_control_enabled() const
+{
+    return f_message_window != 0;
+}
+
+
+/** \brief Check whether the peer asked us to use flow control.
+ *
+ * \return true if a FLOW_CONTROL message with credits was received.
+ */
+bool flow_control::is_flow_control_active() const
+{
+    return f_active;
+}
+
+
+/** \brief Check whether the sender ran out of credits.
+ *
+ * \return true if messages are currently held or rejected.
+ */
+bool flow_control::is_flow_blocked() const
+{
+    return f_blocked;
+}
+
+
+/** \brief Get the number of messages we can still send.
+ *
+ * This is the window the peer gave us minus the messages in flight.
+ *
+ * \return The current number of message credits.
+ */
+std::int64_t flow_control::get_message_credits() const
+{
+    return f_peer_message_window - f_messages_in_flight;
+}
+
+
+/** \brief Get the number of bytes we can still send.
+ *
+ * This value is only meaningful if the peer gave us byte credits.
+ * It may become negative since a message is sent as long as some
+ * byte credits remain.
+ *
+ * \return The current number of byte credits.
+ */
+std::int64_t flow_control::get_byte_credits() const
+{
+    return f_peer_byte_window - f_bytes_in_flight;
+}
+
+
+/** \brief Get the number of messages sent and not yet credited.
+ *
+ * \return The number of messages in flight.
+ */
+std::int64_t flow_control::get_messages_in_flight() const
+{
+    return f_messages_in_flight;
+}
+
+
+/** \brief Get the number of bytes sent and not yet credited.
+ *
+ * \return The number of bytes in flight.
+ */
+std::int64_t flow_control::get_bytes_in_flight() const
+{
+    return f_bytes_in_flight;
+}
+
+
+/** \brief Get the number of messages waiting for credits.
+ *
+ * \return The number of held messages.
+ */
+std::size_t flow_control::get_held_messages() const
+{
+    return f_held.size();
+}
+
+
+/** \brief Get the policy applied when credits run out.
+ *
+ * \return The current policy.
+ */
+flow_control_policy_t flow_control::get_flow_control_policy() const
+{
+    return f_policy;
+}
+
+
+/** \brief Define what happens when the sender runs out of credits.
+ *
+ * \li FLOW_CONTROL_POLICY_HOLD -- the messages are kept in memory and
+ * sent once credits are received; this is the default;
+ * \li FLOW_CONTROL_POLICY_REJECT -- the send_message() function returns
+ * false and the application is expected to try again later.
+ *
+ * \param[in] policy  The new policy.
+ */
+void flow_control::set_flow_control_policy(flow_control_policy_t policy)
+{
+    f_policy = policy;
+}
+
+
+/** \brief Get the maximum number of messages held.
+ *
+ * \return The maximum number of messages held while out of credits.
+ */
+std::size_t flow_control::get_max_held_messages() const
+{
+    return f_max_held;
+}
+
+
+/** \brief Set the maximum number of messages held.
+ *
+ * Once that many messages are held, send_message() returns false.
+ *
+ * \param[in] max  The new maximum.
+ */
+void flow_control::set_max_held_messages(std::size_t max)
+{
+    f_max_held = max;
+}
+
+
+/** \brief Called when the sender gets blocked or unblocked.
+ *
+ * The default implementation does nothing. Reimplement this function
+ * to stop and restart your producer.
+ *
+ * \param[in] blocked  true when the credits ran out, false once more
+ * credits were received.
+ */
+void flow_control::process_flow_blocked(bool blocked)
+{
+    snapdev::NOT_USED(blocked);
+}
+
+
+/** \brief Send a buffer if credits allow.
+ *
+ * \param[in] buf  The message to send, including its newline.
+ *
+ * \return true if the message was sent or held, false otherwise.
+ */
+bool flow_control::send_with_credits(std::string const & buf)
+{
+    if(!f_active)
+    {
+        return write_flow_buffer(buf);
+    }
+
+    if(f_held.empty()
+    && has_credits())
+    {
+        ++f_messages_in_flight;
+        f_bytes_in_flight += buf.length();
+        return write_flow_buffer(buf);
+    }
+
+    set_blocked(true);
+
+    if(f_policy == flow_control_policy_t::FLOW_CONTROL_POLICY_REJECT)
+    {
+        return false;
+    }
+
+    if(f_held.size() >= f_max_held)
+    {
+        SNAP_LOG_WARNING
+            << "flow control: too many messages held ("
+            << f_held.size()
+            << "), message dropped."
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    f_held.push_back(buf);
+    return true;
+}
+
+
+/** \brief Handle the flow control messages.
+ *
+ * The message connections call this function before dispatching a
+ * message.
+ *
+ * \param[in] msg  The message just received.
+ *
+ * \return true if \p msg was a flow control message.
+ */
+bool flow_control::process_flow_message(message & msg)
+{
+    if(msg.get_command() == g_name_ed_cmd_flow_control)
+    {
+        // the messages already in flight still count against the
+        // new window
+        //
+        f_peer_message_window = msg.has_parameter(g_name_ed_param_credits)
+                ? msg.get_integer_parameter(g_name_ed_param_credits)
+                : 0;
+        f_byte_limited = msg.has_parameter(g_name_ed_param_byte_credits);
+        f_peer_byte_window = f_byte_limited
+                ? msg.get_integer_parameter(g_name_ed_param_byte_credits)
+                : 0;
+        f_active = f_peer_message_window > 0;
+        if(!f_active)
+        {
+            f_peer_message_window = 0;
+            f_messages_in_flight = 0;
+            f_bytes_in_flight = 0;
+        }
+        flush_held_messages();
+        return true;
+    }
+
+    if(msg.get_command() == g_name_ed_cmd_credits)
+    {
+        // the peer may give back credits for messages sent before the
+        // flow control was active, never go below zero
+        //
+        if(msg.has_parameter(g_name_ed_param_credits))
+        {
+            f_messages_in_flight = std::max(
+                      f_messages_in_flight - msg.get_integer_parameter(g_name_ed_param_credits)
+                    , static_cast<std::int64_t>(0));
+        }
+        if(msg.has_parameter(g_name_ed_param_byte_credits))
+        {
+            f_bytes_in_flight = std::max(
+                      f_bytes_in_flight - msg.get_integer_parameter(g_name_ed_param_byte_credits)
+                    , static_cast<std::int64_t>(0));
+        }
+        flush_held_messages();
+        return true;
+    }
+
+    return false;
+}
+
+
+/** \brief Count a message which was dispatched.
+ *
+ * When the flow control is enabled, the dispatched messages are counted
+ * and once a quarter of the window was consumed, a CREDITS message is
+ * sent back to the peer.
+ *
+ * \param[in] size  The size of the message in bytes.
+ */
+void flow_control::message_consumed(std::size_t size)
+{
+    if(f_message_window == 0)
+    {
+        return;
+    }
+
+    ++f_consumed_messages;
+    f_consumed_bytes += size;
+
+    if(f_consumed_messages < std::max(f_message_window / 4, static_cast<std::int64_t>(1))
+    && (f_byte_window == 0
+        || f_consumed_bytes < std::max(f_byte_window / 4, static_cast<std::int64_t>(1))))
+    {
+        return;
+    }
+
+    message msg;
+    msg.set_command(g_name_ed_cmd_credits);
+    msg.add_parameter(g_name_ed_param_credits, f_consumed_messages);
+    if(f_byte_window != 0)
+    {
+        msg.add_parameter(g_name_ed_param_byte_credits, f_consumed_bytes);
+    }
+    f_consumed_messages = 0;
+    f_consumed_bytes = 0;
+    send_control_message(msg);
+}
+
+
+/** \brief Send a flow control message.
+ *
+ * The flow control messages do not use credits.
+ *
+ * \param[in] msg  The message to send.
+ *
+ * \return true if the message was written.
+ */
+bool flow_control::send_control_message(message & msg)
+{
+    return write_flow_buffer(msg.to_message() + '\n');
+}
+
+
+/** \brief Check whether the window allows one more message.
+ *
+ * A message is sent as long as fewer messages than the window are in
+ * flight and, if the peer limits the bytes, fewer bytes than the byte
+ * window are in flight.
+ *
+ * \return true if one more message can be sent.
+ */
+bool flow_control::has_credits() const
+{
+    return f_messages_in_flight < f_peer_message_window
+        && (!f_byte_limited || f_bytes_in_flight < f_peer_byte_window);
+}
+
+
+/** \brief Send the messages held while credits are available.
+ */
+void flow_control::flush_held_messages()
+{
+    while(!f_held.empty()
+       && (!f_active || has_credits()))
+    {
+        std::string const buf(std::move(f_held.front()));
+        f_held.pop_front();
+        if(f_active)
+        {
+            ++f_messages_in_flight;
+            f_bytes_in_flight += buf.length();
+        }
+        write_flow_buffer(buf);
+    }
+
+    set_blocked(!f_held.empty()
+        || (f_active && !has_credits()));
+}
+
+
+/** \brief Change the blocked state and tell the application.
+ *
+ * \param[in] blocked  The new state.
+ */
+void flow_control::set_blocked(bool blocked)
+{
+    if(f_blocked != blocked)
+    {
+        f_blocked = blocked;
+        process_flow_blocked(blocked);
+    }
+}
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
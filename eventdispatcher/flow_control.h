@@ -0,0 +1,115 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Credit based flow control between message connections.
+ *
+ * The receiver grants credits to the sender. The sender decrements
+ * its credits on each message it sends and holds or rejects messages
+ * once it runs out of credits.
+ */
+
+// self
+//
+#include    <eventdispatcher/message.h>
+
+
+// C++
+//
+#include    <deque>
+
+
+
+namespace ed
+{
+
+
+
+constexpr std::size_t const     DEFAULT_FLOW_CONTROL_MAX_HELD = 10'000;    // messages
+
+
+enum class flow_control_policy_t
+{
+    FLOW_CONTROL_POLICY_HOLD,       // keep messages until credits arrive
+    FLOW_CONTROL_POLICY_REJECT,     // send_message() returns false
+};
+
+
+class flow_control
+{
+public:
+    virtual                     ~flow_control();
+
+    // receiver side
+    bool                        enable_flow_control(
+                                      std::int64_t message_credits
+                                    , std::int64_t byte_credits = 0);
+    bool                        is_flow_control_enabled() const;
+
+    // sender side
+    bool                        is_flow_control_active() const;
+    bool                        is_flow_blocked() const;
+    std::int64_t                get_message_credits() const;
+    std::int64_t                get_byte_credits() const;
+    std::int64_t                get_messages_in_flight() const;
+    std::int64_t                get_bytes_in_flight() const;
+    std::size_t                 get_held_messages() const;
+    flow_control_policy_t       get_flow_control_policy() const;
+    void                        set_flow_control_policy(flow_control_policy_t policy);
+    std::size_t                 get_max_held_messages() const;
+    void                        set_max_held_messages(std::size_t max);
+
+    virtual void                process_flow_blocked(bool blocked);
+
+protected:
+    virtual bool                write_flow_buffer(std::string const & buf) = 0;
+
+    bool                        send_with_credits(std::string const & buf);
+    bool                        process_flow_message(message & msg);
+    void                        message_consumed(std::size_t size);
+
+private:
+    bool                        send_control_message(message & msg);
+    bool                        has_credits() const;
+    void                        flush_held_messages();
+    void                        set_blocked(bool blocked);
+
+    // receiver
+    std::int64_t                f_message_window = 0;
+    std::int64_t                f_byte_window = 0;
+    std::int64_t                f_consumed_messages = 0;
+    std::int64_t                f_consumed_bytes = 0;
+
+    // sender
+    bool                        f_active = false;
+    bool                        f_blocked = false;
+    bool                        f_byte_limited = false;
+    std::int64_t                f_peer_message_window = 0;
+    std::int64_t                f_peer_byte_window = 0;
+    std::int64_t                f_messages_in_flight = 0;
+    std::int64_t                f_bytes_in_flight = 0;
+    flow_control_policy_t       f_policy = flow_control_policy_t::FLOW_CONTROL_POLICY_HOLD;
+    std::size_t                 f_max_held = DEFAULT_FLOW_CONTROL_MAX_HELD;
+    std::deque<std::string>     f_held = std::deque<std::string>();
+};
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
@@ -166,6 +166,16 @@ bool local_stream_client_buffer_connection::is_writer() const
 }
 
 
+/** \brief Get the number of bytes waiting in the output buffer.
+ *
+ * \return The number of bytes not yet written to the socket.
+ */
+std::size_t local_stream_client_buffer_connection::get_output_size() const
+{
+    return f_output.size() - f_position;
+}
+
+
 /** \brief Instantiation of process_read().
  *
  * This function reads incoming data from a socket.
@@ -199,6 +209,7 @@ void local_stream_client_buffer_connection::process_read()
             ssize_t const r(read(&buffer[0], buffer.size()));
             if(r > 0)
             {
+                add_bytes_read(r);
                 for(ssize_t position(0); position < r; )
                 {
                     std::vector<char>::const_iterator it(std::find(buffer.begin() + position, buffer.begin() + r, '\n'));
@@ -293,6 +304,7 @@ void local_stream_client_buffer_connection::process_write()
         ssize_t const r(local_stream_client_connection::write(&f_output[f_position], f_output.size() - f_position));
         if(r > 0)
         {
+            add_bytes_written(r);
             // some data was written
             f_position += r;
             if(f_position >= f_output.size())
@@ -52,6 +52,7 @@ public:
     // connection implementation
     //
     virtual bool                is_writer() const override;
+    virtual std::size_t         get_output_size() const override;
     virtual void                process_read() override;
     virtual void                process_write() override;
     virtual void                process_hup() override;
@@ -35,6 +35,7 @@
 #include    "eventdispatcher/exception.h"
 #include    "eventdispatcher/local_stream_client_message_connection.h"
 #include    "eventdispatcher/thread_done_signal.h"
+#include    "eventdispatcher/utils.h"
 
 
 // snaplogger
@@ -145,6 +146,33 @@ public:
         local_stream_client_permanent_message_connection *  f_parent = nullptr;
     };
 
+    class replay_timer
+        : public timer
+    {
+    public:
+        typedef std::shared_ptr<replay_timer>   pointer_t;
+
+        replay_timer(local_stream_client_permanent_message_connection_impl * parent_impl)
+            : timer(-1)
+            , f_parent_impl(parent_impl)
+        {
+            set_name("local_stream_client_permanent_message_connection_impl::replay_timer");
+        }
+
+        replay_timer(replay_timer const & rhs) = delete;
+        replay_timer & operator = (replay_timer const & rhs) = delete;
+
+        /** \brief Time to send the next batch of cached messages.
+         */
+        virtual void process_timeout() override
+        {
+            f_parent_impl->replay();
+        }
+
+    private:
+        local_stream_client_permanent_message_connection_impl *  f_parent_impl = nullptr;
+    };
+
     class thread_signal_handler
         : public thread_done_signal
     {
@@ -430,6 +458,8 @@ public:
         //
         communicator::instance()->remove_connection(f_thread_done);
 
+        stop_replay();
+
         // although the f_messenger variable gets reset automatically in
         // the destructor, it would not get removed from the
         // communicator instance if we were not doing it explicitly
@@ -614,13 +644,9 @@ public:
             //
             communicator::instance()->add_connection(f_messenger);
 
-            // if some messages were cached, process them immediately
+            // if some messages were cached, start sending them
             //
-            while(!f_message_cache.empty())
-            {
-                f_messenger->send_message(f_message_cache[0]);
-                f_message_cache.erase(f_message_cache.begin());
-            }
+            start_replay();
 
             // let the client know we are now connected
             //
@@ -637,6 +663,11 @@ public:
      * Note that the message does not get cached if mark_done() was
      * called earlier since we are trying to close the whole connection.
      *
+     * \note
+     * While the cached messages get replayed, new messages with \p cache
+     * set to true are appended to the back of the cache so they are
+     * received after the older cached messages.
+     *
      * \param[in] msg  The message to send.
      * \param[in] cache  Whether to cache the message if the connection is
      *                   currently down.
@@ -648,12 +679,21 @@ public:
     {
         if(f_messenger != nullptr)
         {
+            if(cache
+            && !f_done
+            && !f_message_cache.empty())
+            {
+                // a replay is still draining, keep the order
+                //
+                f_message_cache.push(msg);
+                return false;
+            }
             return f_messenger->send_message(msg);
         }
 
         if(cache && !f_done)
         {
-            f_message_cache.push_back(msg);
+            f_message_cache.push(msg);
         }
 
         return false;
@@ -681,6 +721,8 @@ public:
      */
     void disconnect()
     {
+        stop_replay();
+
         if(f_messenger != nullptr)
         {
             communicator::instance()->remove_connection(f_messenger);
@@ -694,6 +736,95 @@ public:
     }
 
 
+    /** \brief Send the next batch of cached messages.
+     *
+     * The cached messages are sent in batches so a large cache does not
+     * block the communicator loop and does not starve the live traffic.
+     * A batch is skipped while the output buffer of the messenger is not
+     * yet empty.
+     */
+    void replay()
+    {
+        if(f_messenger != nullptr
+        && !f_messenger->has_output())
+        {
+            message msg;
+            for(std::size_t count(0); count < f_replay_count && f_message_cache.pop(msg); ++count)
+            {
+                f_messenger->send_message(msg);
+            }
+        }
+
+        if(f_messenger == nullptr
+        || f_message_cache.empty())
+        {
+            stop_replay();
+        }
+    }
+
+
+    /** \brief Start replaying the cached messages.
+     *
+     * The first batch is sent immediately, the following batches are
+     * sent by the replay timer.
+     */
+    void start_replay()
+    {
+        replay();
+        if(f_messenger != nullptr
+        && !f_message_cache.empty())
+        {
+            if(f_replay_timer == nullptr)
+            {
+                f_replay_timer = std::make_shared<replay_timer>(this);
+            }
+            f_replay_timer->set_timeout_delay(f_replay_interval);
+            communicator::instance()->add_connection(f_replay_timer);
+        }
+    }
+
+
+    /** \brief Stop replaying the cached messages.
+     *
+     * \note
+     * The call is safe even if the f_replay_timer is null.
+     */
+    void stop_replay()
+    {
+        communicator::instance()->remove_connection(f_replay_timer);
+    }
+
+
+    /** \brief Retrieve a reference to the message cache.
+     *
+     * \return The cache of messages waiting for the connection.
+     */
+    message_cache & get_message_cache()
+    {
+        return f_message_cache;
+    }
+
+
+    /** \brief Define the speed at which cached messages are replayed.
+     *
+     * \param[in] count  The number of messages sent per batch.
+     * \param[in] interval_us  The delay between two batches.
+     */
+    void set_replay_rate(std::size_t count, std::int64_t interval_us)
+    {
+        if(count == 0)
+        {
+            throw invalid_parameter("the replay count must be at least 1");
+        }
+        if(interval_us < 10)
+        {
+            throw invalid_parameter("the replay interval must be at least 10 microseconds");
+        }
+        f_replay_count = count;
+        f_replay_interval = interval_us;
+    }
+
+
     /** \brief Return the address and size of the remote computer.
      *
      * This function retrieve the socket address.
@@ -763,7 +894,10 @@ private:
     runner                              f_thread_runner;
     cppthread::thread                   f_thread;
     messenger::pointer_t                f_messenger = messenger::pointer_t();
-    message::vector_t                   f_message_cache = message::vector_t();
+    replay_timer::pointer_t             f_replay_timer = replay_timer::pointer_t();
+    message_cache                       f_message_cache = message_cache();
+    std::size_t                         f_replay_count = DEFAULT_MESSAGE_CACHE_REPLAY_COUNT;
+    std::int64_t                        f_replay_interval = DEFAULT_MESSAGE_CACHE_REPLAY_INTERVAL;
     bool                                f_done = false;
 };
 
@@ -864,6 +998,8 @@ local_stream_client_permanent_message_connection::~local_stream_client_permanent
  * specific order (For example, after a reconnection to snapcommunicator
  * you first need to REGISTER or CONNECT...)
  *
+ * The cache is bounded, see get_message_cache() for details.
+ *
  * \param[in] msg  The message to send to the connected server.
  * \param[in] cache  Whether the message should be cached.
  *
@@ -876,6 +1012,35 @@ bool local_stream_client_permanent_message_connection::send_message(message & ms
 }
 
 
+/** \brief Retrieve the cache of messages.
+ *
+ * While the connection is down, messages sent with the \p cache parameter
+ * set to true are saved in this cache. Use the returned reference to
+ * change the size of the cache, the time to live of the messages and the
+ * overflow policy (drop oldest, drop newest, or spill to file).
+ *
+ * \return A reference to the message cache.
+ */
+message_cache & local_stream_client_permanent_message_connection::get_message_cache()
+{
+    return f_impl->get_message_cache();
+}
+
+
+/** \brief Change the rate at which cached messages are sent.
+ *
+ * Once the connection is up again, the cached messages are sent by batch
+ * of \p count messages every \p interval_us microseconds.
+ *
+ * \param[in] count  The number of messages per batch.
+ * \param[in] interval_us  The number of microseconds between batches.
+ */
+void local_stream_client_permanent_message_connection::set_replay_rate(std::size_t count, std::int64_t interval_us)
+{
+    f_impl->set_replay_rate(count, interval_us);
+}
+
+
 /** \brief Check whether the connection is up.
  *
  * This function returns true if the connection is considered to be up.
@@ -916,6 +1081,7 @@ bool local_stream_client_permanent_message_connection::is_connected() const
 void local_stream_client_permanent_message_connection::disconnect()
 {
     f_impl->disconnect();
+    cancel_requests();
 }
 
 
@@ -998,6 +1164,16 @@ void local_stream_client_permanent_message_connection::process_timeout()
         return;
     }
 
+    // when the process limits the number of reconnect attempts per
+    // second and no token is available, try again once one is
+    //
+    std::int64_t const retry_date(pause_durations::acquire_reconnect_token(get_current_date()));
+    if(retry_date != 0)
+    {
+        set_timeout_date(retry_date);
+        return;
+    }
+
     // setup the next timeout; note that if we went through all the
     // entries in f_pause, then we stop calling the set_timeout_delay()
     // function; as a result, the last timeout remains in place and
@@ -1064,7 +1240,8 @@ void local_stream_client_permanent_message_connection::process_error()
     else
     {
         f_impl->disconnect();
-        set_enable(true);
+        cancel_requests();
+        restart_timer();
     }
 }
 
@@ -1091,7 +1268,8 @@ void local_stream_client_permanent_message_connection::process_hup()
     else
     {
         f_impl->disconnect();
-        set_enable(true);
+        cancel_requests();
+        restart_timer();
     }
 }
 
@@ -1118,7 +1296,8 @@ void local_stream_client_permanent_message_connection::process_invalid()
     else
     {
         f_impl->disconnect();
-        set_enable(true);
+        cancel_requests();
+        restart_timer();
     }
 }
 
@@ -1174,6 +1353,23 @@ void local_stream_client_permanent_message_connection::process_connected()
 }
 
 
+/** \brief Restart the timer after the connection was lost.
+ *
+ * In the list mode, the timer is simply re-enabled. In the decorrelated
+ * jitter mode, the first attempt also waits a random delay so all the
+ * clients of a server which just went down do not all reconnect at the
+ * exact same time.
+ */
+void local_stream_client_permanent_message_connection::restart_timer()
+{
+    if(f_pause_durations.is_jittered())
+    {
+        set_timeout_delay(f_pause_durations.get_next_delay() * 1'000'000.0);
+    }
+    set_enable(true);
+}
+
+
 
 } // namespace ed
 // vim: ts=4 sw=4 et
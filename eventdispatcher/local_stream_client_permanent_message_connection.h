@@ -27,6 +27,7 @@
 //
 #include    <eventdispatcher/connection_with_send_message.h>
 #include    <eventdispatcher/dispatcher_support.h>
+#include    <eventdispatcher/message_cache.h>
 #include    <eventdispatcher/pause_durations.h>
 #include    <eventdispatcher/timer.h>
 
@@ -73,6 +74,8 @@ public:
     void                        mark_done();
     void                        mark_done(bool messenger);
     addr::addr_unix             get_address() const;
+    message_cache &             get_message_cache();
+    void                        set_replay_rate(std::size_t count, std::int64_t interval_us);
 
     // connection_with_send_message implementation
     virtual bool                send_message(message & msg, bool cache = false) override;
@@ -89,6 +92,8 @@ public:
     virtual void                process_connected();
 
 private:
+    void                        restart_timer();
+
     std::shared_ptr<detail::local_stream_client_permanent_message_connection_impl>
                                 f_impl = std::shared_ptr<detail::local_stream_client_permanent_message_connection_impl>();
     pause_durations             f_pause_durations = pause_durations(0);
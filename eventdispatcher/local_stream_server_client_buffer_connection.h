@@ -48,6 +48,7 @@ public:
     // connection implementation
     //
     virtual bool                is_writer() const override;
+    virtual std::size_t         get_output_size() const override;
 
     // local_stream_server_client_connection implementation
     //
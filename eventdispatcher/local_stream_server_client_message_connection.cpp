@@ -42,6 +42,8 @@
 //
 #include    "eventdispatcher/local_stream_server_client_message_connection.h"
 
+#include    "eventdispatcher/message_capture.h"
+
 
 // snaplogger
 //
@@ -131,6 +133,8 @@ bool local_stream_server_client_message_connection::send_message(
 {
     snapdev::NOT_USED(cache);
 
+    message_capture::capture(capture_direction_t::CAPTURE_DIRECTION_SENT, get_name(), msg);
+
     // transform the message to a string and write to the socket
     // the writing is asynchronous so the message is saved in a cache
     // and transferred only later when the run() loop is hit again
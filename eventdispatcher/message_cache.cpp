@@ -0,0 +1,613 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the message cache.
+ *
+ * The permanent connections cache messages sent while the connection is
+ * down. Without limits, the cache would grow until the process runs out
+ * of memory when the server is down for a while. The message_cache class
+ * bounds the number of messages kept in memory and offers a policy to
+ * apply when that limit is reached: drop the oldest message, drop the
+ * newest message, or spill the messages to a file.
+ *
+ * The messages can also be given a time to live, once expired, they get
+ * dropped instead of being sent.
+ */
+
+
+// self
+//
+#include    "eventdispatcher/message_cache.h"
+
+#include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/utils.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <cstdlib>
+#include    <cstring>
+
+
+// C
+//
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ed
+{
+
+
+
+/** \brief Initialize a message cache.
+ *
+ * The cache keeps at most \p max_size messages in memory. By default,
+ * the oldest message gets dropped when the cache is full.
+ *
+ * \param[in] max_size  The maximum number of messages kept in memory.
+ */
+message_cache::message_cache(std::size_t max_size)
+{
+    set_max_size(max_size);
+}
+
+
+/** \brief Clean up the message cache.
+ *
+ * The destructor closes the spill file. If messages were still spilled
+ * in that file, it is not deleted. The next time a message_cache is
+ * given that filename, these messages get reloaded.
+ */
+message_cache::~message_cache()
+{
+}
+
+
+/** \brief Get the maximum number of messages kept in memory.
+ *
+ * \return The maximum number of messages in memory.
+ */
+std::size_t message_cache::get_max_size() const
+{
+    return f_max_size;
+}
+
+
+/** \brief Change the maximum number of messages kept in memory.
+ *
+ * If the cache already holds more messages, nothing happens until the
+ * next push() at which point the overflow policy applies to that one
+ * new message.
+ *
+ * \exception invalid_parameter
+ * The \p max_size parameter must be at least 1.
+ *
+ * \param[in] max_size  The new maximum number of messages.
+ */
+void message_cache::set_max_size(std::size_t max_size)
+{
+    if(max_size == 0)
+    {
+        throw invalid_parameter("the message cache max_size must be at least 1");
+    }
+
+    f_max_size = max_size;
+}
+
+
+/** \brief Get the time to live of the cached messages.
+ *
+ * \return The time to live in microseconds or 0 if messages never expire.
+ */
+std::int64_t message_cache::get_ttl() const
+{
+    return f_ttl;
+}
+
+
+/** \brief Define how long a message can stay in the cache.
+ *
+ * Messages that stay in the cache for longer than \p ttl_us get dropped
+ * instead of being returned by pop(). This applies to messages in memory
+ * and to spilled messages.
+ *
+ * \param[in] ttl_us  The time to live in microseconds, 0 means forever.
+ */
+void message_cache::set_ttl(std::int64_t ttl_us)
+{
+    if(ttl_us < 0)
+    {
+        throw invalid_parameter("the message cache TTL cannot be negative");
+    }
+
+    f_ttl = ttl_us;
+}
+
+
+/** \brief Get the current overflow policy.
+ *
+ * \return The policy applied when the memory cache is full.
+ */
+cache_overflow_t message_cache::get_overflow_policy() const
+{
+    return f_overflow_policy;
+}
+
+
+/** \brief Define what happens when the cache is full.
+ *
+ * \li CACHE_OVERFLOW_DROP_OLDEST -- remove the oldest message to make
+ * room for the new message; this is the default;
+ * \li CACHE_OVERFLOW_DROP_NEWEST -- ignore the new message;
+ * \li CACHE_OVERFLOW_SPILL -- append the new message to the spill file
+ * (see set_spill_filename()); if no filename was defined or the file is
+ * full, the new message gets dropped.
+ *
+ * \param[in] policy  The new policy.
+ */
+void message_cache::set_overflow_policy(cache_overflow_t policy)
+{
+    f_overflow_policy = policy;
+}
+
+
+/** \brief Get the name of the spill file.
+ *
+ * \return The path to the spill file or an empty string.
+ */
+std::string const & message_cache::get_spill_filename() const
+{
+    return f_spill_filename;
+}
+
+
+/** \brief Define the file used to spill messages.
+ *
+ * When the overflow policy is set to CACHE_OVERFLOW_SPILL, the messages
+ * that do not fit in memory get appended to this file. They are read back
+ * in order once the messages in memory were sent.
+ *
+ * If the file already exists and is not empty, it is expected to be
+ * a spill file left behind by a previous run. Its messages get replayed
+ * after the messages currently in memory.
+ *
+ * \exception invalid_parameter
+ * The filename cannot be changed while messages are spilled.
+ *
+ * \param[in] filename  The path to the spill file.
+ */
+void message_cache::set_spill_filename(std::string const & filename)
+{
+    if(filename == f_spill_filename)
+    {
+        return;
+    }
+
+    if(f_spill_count != 0)
+    {
+        throw invalid_parameter("the message cache spill filename cannot be changed while messages are spilled");
+    }
+
+    f_spill_output.close();
+    f_spill_input.close();
+    f_spill_size = 0;
+    f_spill_filename = filename;
+
+    if(f_spill_filename.empty())
+    {
+        return;
+    }
+
+    // reload a spill file left behind by a previous run
+    //
+    std::ifstream in(f_spill_filename, std::ios::in | std::ios::binary);
+    if(in.is_open())
+    {
+        std::string line;
+        while(std::getline(in, line))
+        {
+            f_spill_size += line.length() + 1;
+            ++f_spill_count;
+        }
+    }
+}
+
+
+/** \brief Get the maximum size of the spill file.
+ *
+ * \return The maximum size of the spill file in bytes.
+ */
+std::size_t message_cache::get_max_spill_size() const
+{
+    return f_max_spill_size;
+}
+
+
+/** \brief Change the maximum size of the spill file.
+ *
+ * Once the spill file reaches this size, new messages get dropped.
+ *
+ * \param[in] max_size  The maximum size in bytes.
+ */
+void message_cache::set_max_spill_size(std::size_t max_size)
+{
+    f_max_spill_size = max_size;
+}
+
+
+/** \brief Add a message to the cache.
+ *
+ * The message is added at the end of the queue. If the queue is full,
+ * the overflow policy is applied.
+ *
+ * Once messages were spilled, all the following messages are also
+ * spilled until the file was fully read back. This way the order in
+ * which the messages are returned by pop() is always preserved.
+ *
+ * \param[in] msg  The message to cache.
+ *
+ * \return true if the message was cached, false if it was dropped.
+ */
+bool message_cache::push(message const & msg)
+{
+    cached_message_t cached{ get_current_date(), msg };
+
+    if(f_spill_count > 0)
+    {
+        return spill(cached);
+    }
+
+    if(f_queue.size() >= f_max_size)
+    {
+        // expired messages would get dropped anyway
+        //
+        while(!f_queue.empty()
+           && is_expired(f_queue.front().f_date))
+        {
+            f_queue.pop_front();
+            ++f_expired;
+        }
+    }
+
+    if(f_queue.size() >= f_max_size)
+    {
+        switch(f_overflow_policy)
+        {
+        case cache_overflow_t::CACHE_OVERFLOW_DROP_OLDEST:
+            f_queue.pop_front();
+            ++f_dropped;
+            break;
+
+        case cache_overflow_t::CACHE_OVERFLOW_DROP_NEWEST:
+            ++f_dropped;
+            return false;
+
+        case cache_overflow_t::CACHE_OVERFLOW_SPILL:
+            return spill(cached);
+
+        }
+    }
+
+    f_queue.push_back(std::move(cached));
+    return true;
+}
+
+
+/** \brief Retrieve the next message.
+ *
+ * This function retrieves the oldest message from the cache. Messages
+ * which expired are skipped.
+ *
+ * \param[out] msg  The message retrieved from the cache.
+ *
+ * \return true if a message was returned, false if the cache is empty.
+ */
+bool message_cache::pop(message & msg)
+{
+    while(!f_queue.empty())
+    {
+        cached_message_t cached(std::move(f_queue.front()));
+        f_queue.pop_front();
+        if(is_expired(cached.f_date))
+        {
+            ++f_expired;
+            continue;
+        }
+        msg = std::move(cached.f_message);
+        return true;
+    }
+
+    cached_message_t cached;
+    while(unspill(cached))
+    {
+        if(is_expired(cached.f_date))
+        {
+            ++f_expired;
+            continue;
+        }
+        msg = std::move(cached.f_message);
+        return true;
+    }
+
+    return false;
+}
+
+
+/** \brief Check whether the cache is empty.
+ *
+ * \note
+ * The cache may include expired messages in which case this function
+ * returns false even though pop() would not return any message.
+ *
+ * \return true if no messages are cached.
+ */
+bool message_cache::empty() const
+{
+    return f_queue.empty() && f_spill_count == 0;
+}
+
+
+/** \brief Get the number of messages in the cache.
+ *
+ * This number includes the spilled messages.
+ *
+ * \return The number of cached messages.
+ */
+std::size_t message_cache::size() const
+{
+    return f_queue.size() + f_spill_count;
+}
+
+
+/** \brief Remove all the messages from the cache.
+ *
+ * This function clears the cache and deletes the spill file.
+ */
+void message_cache::clear()
+{
+    f_queue.clear();
+    remove_spill_file();
+}
+
+
+/** \brief Get the number of messages dropped because of an overflow.
+ *
+ * \return The number of dropped messages.
+ */
+std::size_t message_cache::get_dropped() const
+{
+    return f_dropped;
+}
+
+
+/** \brief Get the number of messages dropped because they expired.
+ *
+ * \return The number of expired messages.
+ */
+std::size_t message_cache::get_expired() const
+{
+    return f_expired;
+}
+
+
+/** \brief Get the number of messages that were spilled to file.
+ *
+ * \return The total number of spilled messages.
+ */
+std::size_t message_cache::get_spilled() const
+{
+    return f_spilled;
+}
+
+
+/** \brief Check whether a message cached on \p date expired.
+ *
+ * \param[in] date  The date when the message was cached.
+ *
+ * \return true if the message expired.
+ */
+bool message_cache::is_expired(std::int64_t date) const
+{
+    return f_ttl > 0
+        && get_current_date() - date > f_ttl;
+}
+
+
+/** \brief Append a message to the spill file.
+ *
+ * Each message is saved on one line: the date when it was cached, a tab,
+ * and the message as generated by message::to_message().
+ *
+ * \param[in] cached  The message to spill.
+ *
+ * \return true if the message was saved, false if it was dropped.
+ */
+bool message_cache::spill(cached_message_t const & cached)
+{
+    if(f_spill_filename.empty())
+    {
+        ++f_dropped;
+        return false;
+    }
+
+    std::string const line(
+              std::to_string(cached.f_date)
+            + '\t'
+            + cached.f_message.to_message()
+            + '\n');
+    if(f_spill_size + line.length() > f_max_spill_size)
+    {
+        ++f_dropped;
+        return false;
+    }
+
+    if(!f_spill_output.is_open())
+    {
+        f_spill_output.open(f_spill_filename, std::ios::out | std::ios::app | std::ios::binary);
+        if(!f_spill_output.is_open())
+        {
+            int const e(errno);
+            SNAP_LOG_ERROR
+                << "could not open message cache spill file \""
+                << f_spill_filename
+                << "\" (errno: "
+                << e
+                << " -- "
+                << strerror(e)
+                << ")."
+                << SNAP_LOG_SEND;
+            ++f_dropped;
+            return false;
+        }
+    }
+
+    f_spill_output << line;
+    if(!f_spill_output)
+    {
+        SNAP_LOG_ERROR
+            << "could not write to message cache spill file \""
+            << f_spill_filename
+            << "\"."
+            << SNAP_LOG_SEND;
+        f_spill_output.clear();
+        ++f_dropped;
+        return false;
+    }
+
+    f_spill_size += line.length();
+    ++f_spill_count;
+    ++f_spilled;
+
+    return true;
+}
+
+
+/** \brief Read the next message from the spill file.
+ *
+ * Once all the messages were read back, the spill file gets deleted.
+ *
+ * \param[out] cached  The message read back.
+ *
+ * \return true if a message was read, false if no more messages are
+ * available.
+ */
+bool message_cache::unspill(cached_message_t & cached)
+{
+    while(f_spill_count > 0)
+    {
+        // make sure the reader sees everything we wrote so far
+        //
+        f_spill_output.flush();
+
+        if(!f_spill_input.is_open())
+        {
+            f_spill_input.open(f_spill_filename, std::ios::in | std::ios::binary);
+            if(!f_spill_input.is_open())
+            {
+                SNAP_LOG_ERROR
+                    << "could not open message cache spill file \""
+                    << f_spill_filename
+                    << "\" for reading; "
+                    << f_spill_count
+                    << " messages lost."
+                    << SNAP_LOG_SEND;
+                f_dropped += f_spill_count;
+                remove_spill_file();
+                return false;
+            }
+        }
+
+        // the writer may have appended data since we hit the end of file
+        //
+        f_spill_input.clear();
+
+        std::string line;
+        if(!std::getline(f_spill_input, line))
+        {
+            SNAP_LOG_ERROR
+                << "message cache spill file \""
+                << f_spill_filename
+                << "\" is shorter than expected; "
+                << f_spill_count
+                << " messages lost."
+                << SNAP_LOG_SEND;
+            f_dropped += f_spill_count;
+            remove_spill_file();
+            return false;
+        }
+
+        --f_spill_count;
+        if(f_spill_count == 0)
+        {
+            remove_spill_file();
+        }
+
+        std::string::size_type const pos(line.find('\t'));
+        if(pos != std::string::npos
+        && cached.f_message.from_message(line.substr(pos + 1)))
+        {
+            cached.f_date = std::strtoll(line.c_str(), nullptr, 10);
+            return true;
+        }
+
+        SNAP_LOG_ERROR
+            << "invalid message found in message cache spill file \""
+            << f_spill_filename
+            << "\"; message dropped."
+            << SNAP_LOG_SEND;
+        ++f_dropped;
+    }
+
+    return false;
+}
+
+
+/** \brief Delete the spill file.
+ *
+ * This function closes the spill file and deletes it. It is called once
+ * all the messages were read back.
+ */
+void message_cache::remove_spill_file()
+{
+    f_spill_output.close();
+    f_spill_input.close();
+    f_spill_size = 0;
+    f_spill_count = 0;
+
+    if(!f_spill_filename.empty())
+    {
+        unlink(f_spill_filename.c_str());
+    }
+}
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
@@ -0,0 +1,120 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Cache of messages waiting for a connection.
+ *
+ * The permanent connections cache messages while disconnected. This
+ * class defines a bounded queue used for that purpose with an overflow
+ * policy and an optional time to live.
+ */
+
+// self
+//
+#include    <eventdispatcher/message.h>
+
+
+// C++
+//
+#include    <deque>
+#include    <fstream>
+
+
+
+namespace ed
+{
+
+
+
+constexpr std::size_t const     DEFAULT_MESSAGE_CACHE_SIZE = 10'000;                    // messages
+constexpr std::size_t const     DEFAULT_MESSAGE_CACHE_SPILL_SIZE = 100 * 1024 * 1024;   // bytes
+constexpr std::size_t const     DEFAULT_MESSAGE_CACHE_REPLAY_COUNT = 100;               // messages per tick
+constexpr std::int64_t const    DEFAULT_MESSAGE_CACHE_REPLAY_INTERVAL = 10'000;         // 10ms
+
+
+enum class cache_overflow_t
+{
+    CACHE_OVERFLOW_DROP_OLDEST,     // make room for the new message
+    CACHE_OVERFLOW_DROP_NEWEST,     // ignore the new message
+    CACHE_OVERFLOW_SPILL,           // save the new message in a file
+};
+
+
+class message_cache
+{
+public:
+                                message_cache(std::size_t max_size = DEFAULT_MESSAGE_CACHE_SIZE);
+                                message_cache(message_cache const &) = delete;
+                                ~message_cache();
+
+    message_cache &             operator = (message_cache const &) = delete;
+
+    std::size_t                 get_max_size() const;
+    void                        set_max_size(std::size_t max_size);
+    std::int64_t                get_ttl() const;
+    void                        set_ttl(std::int64_t ttl_us);
+    cache_overflow_t            get_overflow_policy() const;
+    void                        set_overflow_policy(cache_overflow_t policy);
+    std::string const &         get_spill_filename() const;
+    void                        set_spill_filename(std::string const & filename);
+    std::size_t                 get_max_spill_size() const;
+    void                        set_max_spill_size(std::size_t max_size);
+
+    bool                        push(message const & msg);
+    bool                        pop(message & msg);
+    bool                        empty() const;
+    std::size_t                 size() const;
+    void                        clear();
+
+    std::size_t                 get_dropped() const;
+    std::size_t                 get_expired() const;
+    std::size_t                 get_spilled() const;
+
+private:
+    struct cached_message_t
+    {
+        std::int64_t            f_date = 0;
+        message                 f_message = message();
+    };
+    typedef std::deque<cached_message_t>    queue_t;
+
+    bool                        is_expired(std::int64_t date) const;
+    bool                        spill(cached_message_t const & cached);
+    bool                        unspill(cached_message_t & cached);
+    void                        remove_spill_file();
+
+    queue_t                     f_queue = queue_t();
+    std::size_t                 f_max_size = DEFAULT_MESSAGE_CACHE_SIZE;
+    std::int64_t                f_ttl = 0;
+    cache_overflow_t            f_overflow_policy = cache_overflow_t::CACHE_OVERFLOW_DROP_OLDEST;
+    std::string                 f_spill_filename = std::string();
+    std::size_t                 f_max_spill_size = DEFAULT_MESSAGE_CACHE_SPILL_SIZE;
+    std::ofstream               f_spill_output = std::ofstream();
+    std::ifstream               f_spill_input = std::ifstream();
+    std::size_t                 f_spill_size = 0;
+    std::size_t                 f_spill_count = 0;
+    std::size_t                 f_dropped = 0;
+    std::size_t                 f_expired = 0;
+    std::size_t                 f_spilled = 0;
+};
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
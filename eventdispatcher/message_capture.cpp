@@ -0,0 +1,286 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the message capture.
+ *
+ * The capture file starts with an 8 byte magic ("EDCAP\0\0\1"). Then each
+ * record is written as:
+ *
+ * \code
+ *     uint32_t     size;           // size of the rest of the record
+ *     int64_t      timestamp;      // CLOCK_MONOTONIC in nanoseconds
+ *     uint8_t      direction;      // 0 -- received, 1 -- sent
+ *     uint8_t      name_length;    // length of the connection name
+ *     char         name[name_length];
+ *     char         message[size - 10 - name_length];
+ * \endcode
+ *
+ * The numbers are saved in little endian. The message is the output
+ * of message::to_message() without the newline.
+ *
+ * While active, the capture is shared by all the message connections of
+ * the process. The connections call capture() when they send a message
+ * and the dispatcher_support calls it on each message it receives. When
+ * the capture is not active, the cost is one atomic load.
+ *
+ * \code
+ *     ed::message_capture::start("/tmp/service.edcap");
+ *     ...
+ *     ed::message_capture::stop();
+ * \endcode
+ */
+
+// self
+//
+#include    "eventdispatcher/message_capture.h"
+
+#include    "eventdispatcher/exception.h"
+
+
+// cppthread
+//
+#include    <cppthread/guard.h>
+#include    <cppthread/mutex.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <atomic>
+#include    <cstring>
+
+
+// C
+//
+#include    <endian.h>
+#include    <time.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ed
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief Whether the capture is active.
+ *
+ * This flag is checked without locking the mutex.
+ */
+std::atomic<bool>               g_active = false;
+
+
+/** \brief Protect the capture file.
+ *
+ * Connections in different threads may capture messages at the same time.
+ */
+cppthread::mutex                g_mutex;
+
+
+/** \brief The capture output.
+ */
+std::ofstream                   g_out;
+
+
+/** \brief Size of the fixed part of a record, after the size field.
+ */
+constexpr std::size_t const     RECORD_HEADER_SIZE = sizeof(std::int64_t) + 2;
+
+
+
+} // no name namespace
+
+
+
+char const message_capture::MAGIC[8] = { 'E', 'D', 'C', 'A', 'P', '\0', '\0', '\1' };
+
+
+
+/** \brief Start capturing the messages.
+ *
+ * The file is truncated if it already exists.
+ *
+ * \exception runtime_error
+ * The file could not be created.
+ *
+ * \param[in] filename  The name of the capture file.
+ */
+void message_capture::start(std::string const & filename)
+{
+    cppthread::guard lock(g_mutex);
+
+    if(g_active)
+    {
+        g_active = false;
+        g_out.close();
+    }
+
+    g_out.open(filename, std::ios::binary | std::ios::trunc);
+    if(!g_out.is_open())
+    {
+        throw runtime_error("could not create capture file \"" + filename + "\".");
+    }
+    g_out.write(MAGIC, sizeof(MAGIC));
+    g_active = true;
+}
+
+
+/** \brief Stop capturing the messages.
+ *
+ * The capture file gets flushed and closed.
+ */
+void message_capture::stop()
+{
+    cppthread::guard lock(g_mutex);
+
+    if(g_active)
+    {
+        g_active = false;
+        g_out.close();
+    }
+}
+
+
+/** \brief Check whether the capture is active.
+ *
+ * \return true between calls to start() and stop().
+ */
+bool message_capture::is_active()
+{
+    return g_active.load(std::memory_order_relaxed);
+}
+
+
+/** \brief Save one message in the capture file.
+ *
+ * Connection names longer than 255 characters are truncated.
+ *
+ * \param[in] direction  Whether the message was received or sent.
+ * \param[in] connection_name  The name of the connection.
+ * \param[in] msg  The message.
+ */
+void message_capture::capture(
+      capture_direction_t direction
+    , std::string const & connection_name
+    , message const & msg)
+{
+    if(!is_active())
+    {
+        return;
+    }
+
+    timespec now = timespec();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    std::int64_t const timestamp(now.tv_sec * 1'000'000'000LL + now.tv_nsec);
+    std::string const buf(msg.to_message());
+    std::uint8_t const name_length(std::min(connection_name.length(), static_cast<std::size_t>(255)));
+
+    char header[sizeof(std::uint32_t) + RECORD_HEADER_SIZE];
+    std::uint32_t const size(htole32(RECORD_HEADER_SIZE + name_length + buf.length()));
+    std::int64_t const ts(htole64(timestamp));
+    memcpy(header, &size, sizeof(size));
+    memcpy(header + sizeof(size), &ts, sizeof(ts));
+    header[sizeof(size) + sizeof(ts)] = static_cast<char>(direction);
+    header[sizeof(size) + sizeof(ts) + 1] = static_cast<char>(name_length);
+
+    cppthread::guard lock(g_mutex);
+    if(!g_active)
+    {
+        return;
+    }
+    g_out.write(header, sizeof(header));
+    g_out.write(connection_name.data(), name_length);
+    g_out.write(buf.data(), buf.length());
+}
+
+
+
+/** \brief Open a capture file for reading.
+ *
+ * \exception runtime_error
+ * The file cannot be opened or is not a capture file.
+ *
+ * \param[in] filename  The name of the capture file.
+ */
+message_capture_reader::message_capture_reader(std::string const & filename)
+    : f_in(filename, std::ios::binary)
+    , f_filename(filename)
+{
+    char magic[sizeof(message_capture::MAGIC)];
+    if(!f_in.read(magic, sizeof(magic))
+    || memcmp(magic, message_capture::MAGIC, sizeof(magic)) != 0)
+    {
+        throw runtime_error("\"" + filename + "\" is not a message capture file.");
+    }
+}
+
+
+/** \brief Read the next record.
+ *
+ * \exception runtime_error
+ * The record is invalid or truncated.
+ *
+ * \param[out] record  The record read from the file.
+ *
+ * \return true if a record was read, false at the end of the file.
+ */
+bool message_capture_reader::next(capture_record_t & record)
+{
+    std::uint32_t size(0);
+    if(!f_in.read(reinterpret_cast<char *>(&size), sizeof(size)))
+    {
+        return false;
+    }
+    size = le32toh(size);
+
+    std::string data(size, '\0');
+    if(size < RECORD_HEADER_SIZE
+    || !f_in.read(data.data(), size))
+    {
+        throw runtime_error("capture file \"" + f_filename + "\" is truncated or corrupted.");
+    }
+
+    std::int64_t ts(0);
+    memcpy(&ts, data.data(), sizeof(ts));
+    record.f_timestamp = le64toh(ts);
+    record.f_direction = static_cast<capture_direction_t>(data[sizeof(ts)]);
+    std::size_t const name_length(static_cast<std::uint8_t>(data[sizeof(ts) + 1]));
+    if(RECORD_HEADER_SIZE + name_length > size)
+    {
+        throw runtime_error("capture file \"" + f_filename + "\" has an invalid record.");
+    }
+    record.f_connection_name = data.substr(RECORD_HEADER_SIZE, name_length);
+    record.f_message = data.substr(RECORD_HEADER_SIZE + name_length);
+
+    return true;
+}
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
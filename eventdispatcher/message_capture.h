@@ -0,0 +1,89 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Capture the messages sent and received by a service.
+ *
+ * The capture file is used to replay real traffic against a service
+ * (see the ed-replay tool).
+ */
+
+// self
+//
+#include    <eventdispatcher/message.h>
+
+
+// C++
+//
+#include    <fstream>
+
+
+
+namespace ed
+{
+
+
+
+enum class capture_direction_t : std::uint8_t
+{
+    CAPTURE_DIRECTION_RECEIVED = 0,
+    CAPTURE_DIRECTION_SENT = 1,
+};
+
+
+struct capture_record_t
+{
+    std::int64_t            f_timestamp = 0;    // monotonic, in nanoseconds
+    capture_direction_t     f_direction = capture_direction_t::CAPTURE_DIRECTION_RECEIVED;
+    std::string             f_connection_name = std::string();
+    std::string             f_message = std::string();
+};
+
+
+class message_capture
+{
+public:
+    static char const       MAGIC[8];
+
+    static void             start(std::string const & filename);
+    static void             stop();
+    static bool             is_active();
+    static void             capture(
+                                  capture_direction_t direction
+                                , std::string const & connection_name
+                                , message const & msg);
+};
+
+
+class message_capture_reader
+{
+public:
+                            message_capture_reader(std::string const & filename);
+
+    bool                    next(capture_record_t & record);
+
+private:
+    std::ifstream           f_in = std::ifstream();
+    std::string             f_filename = std::string();
+};
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
@@ -0,0 +1,336 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the metrics registry.
+ *
+ * The metrics are kept per thread. The thread running the
+ * communicator::run() loop is the one that sees the loop, connection
+ * and dispatcher metrics. The registry is never locked so it must only
+ * be accessed from its own thread. Code on the hot path is expected to
+ * retrieve a reference to its counters and histograms once and then
+ * update them directly.
+ *
+ * The to_prometheus() function generates the registry in the
+ * Prometheus text format (version 0.0.4). It also includes statistics
+ * about each connection currently in the communicator. These are
+ * labelled with the connection identifier since the names are not
+ * unique.
+ */
+
+// self
+//
+#include    "eventdispatcher/metrics.h"
+
+#include    "eventdispatcher/communicator.h"
+
+
+// C++
+//
+#include    <algorithm>
+#include    <sstream>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ed
+{
+
+
+
+/** \brief The upper bounds of the histogram buckets.
+ *
+ * The histograms are used to record durations in microseconds. The
+ * buckets go from 10us to 5s. A last bucket (+Inf) catches anything
+ * larger.
+ */
+std::array<std::int64_t, metrics_histogram::BUCKET_COUNT> const metrics_histogram::g_bounds =
+{
+    10,
+    50,
+    100,
+    500,
+    1'000,
+    5'000,
+    10'000,
+    50'000,
+    100'000,
+    500'000,
+    1'000'000,
+    5'000'000,
+};
+
+
+/** \brief Record one value in this histogram.
+ *
+ * \param[in] value  The value to record, generally in microseconds.
+ */
+void metrics_histogram::record(std::int64_t value)
+{
+    auto const it(std::lower_bound(g_bounds.begin(), g_bounds.end(), value));
+    ++f_buckets[it - g_bounds.begin()];
+    ++f_count;
+    f_sum += value;
+}
+
+
+/** \brief Get the number of values recorded.
+ *
+ * \return The number of times record() was called.
+ */
+std::uint64_t metrics_histogram::get_count() const
+{
+    return f_count;
+}
+
+
+/** \brief Get the sum of the values recorded.
+ *
+ * \return The sum of all the values passed to record().
+ */
+std::int64_t metrics_histogram::get_sum() const
+{
+    return f_sum;
+}
+
+
+/** \brief Get the number of values that landed in a bucket.
+ *
+ * The counts are not cumulative. The bucket at index BUCKET_COUNT
+ * is the +Inf bucket.
+ *
+ * \param[in] idx  The index of the bucket.
+ *
+ * \return The number of values in that bucket.
+ */
+std::uint64_t metrics_histogram::get_bucket(std::size_t idx) const
+{
+    if(idx >= f_buckets.size())
+    {
+        return 0;
+    }
+    return f_buckets[idx];
+}
+
+
+/** \brief Get the registry of the current thread.
+ *
+ * \return A reference to this thread metrics registry.
+ */
+metrics & metrics::instance()
+{
+    thread_local metrics g_metrics;
+    return g_metrics;
+}
+
+
+/** \brief Get a counter.
+ *
+ * The counter is created on the first call. The returned reference
+ * remains valid for the lifetime of the thread.
+ *
+ * \param[in] name  The name of the counter (i.e. "ed_loop_iterations_total").
+ * \param[in] labels  The labels as generated by label(), comma separated.
+ *
+ * \return A reference to the counter.
+ */
+metrics_counter & metrics::get_counter(
+      std::string const & name
+    , std::string const & labels)
+{
+    return f_counters[name][labels];
+}
+
+
+/** \brief Get a histogram.
+ *
+ * The histogram is created on the first call. The returned reference
+ * remains valid for the lifetime of the thread.
+ *
+ * \param[in] name  The name of the histogram.
+ * \param[in] labels  The labels as generated by label(), comma separated.
+ *
+ * \return A reference to the histogram.
+ */
+metrics_histogram & metrics::get_histogram(
+      std::string const & name
+    , std::string const & labels)
+{
+    return f_histograms[name][labels];
+}
+
+
+/** \brief Reset all the metrics to zero.
+ *
+ * The metrics are not removed so the references returned by
+ * get_counter() and get_histogram() remain valid.
+ */
+void metrics::reset()
+{
+    for(auto & c : f_counters)
+    {
+        for(auto & l : c.second)
+        {
+            l.second = metrics_counter();
+        }
+    }
+    for(auto & h : f_histograms)
+    {
+        for(auto & l : h.second)
+        {
+            l.second = metrics_histogram();
+        }
+    }
+}
+
+
+/** \brief Generate a label.
+ *
+ * This function generates a label with its value properly escaped.
+ *
+ * \param[in] name  The name of the label.
+ * \param[in] value  The value of the label.
+ *
+ * \return The label in the form `name="value"`.
+ */
+std::string metrics::label(std::string const & name, std::string const & value)
+{
+    std::string result(name);
+    result += "=\"";
+    for(char const c : value)
+    {
+        switch(c)
+        {
+        case '\\':
+            result += "\\\\";
+            break;
+
+        case '"':
+            result += "\\\"";
+            break;
+
+        case '\n':
+            result += "\\n";
+            break;
+
+        default:
+            result += c;
+            break;
+
+        }
+    }
+    result += '"';
+    return result;
+}
+
+
+/** \brief Export the metrics in the Prometheus text format.
+ *
+ * \return The metrics of this thread and the statistics of the
+ * connections found in the communicator.
+ */
+std::string metrics::to_prometheus() const
+{
+    std::stringstream out;
+
+    for(auto const & c : f_counters)
+    {
+        out << "# TYPE " << c.first << " counter\n";
+        for(auto const & l : c.second)
+        {
+            out << c.first;
+            if(!l.first.empty())
+            {
+                out << '{' << l.first << '}';
+            }
+            out << ' ' << l.second.get_value() << '\n';
+        }
+    }
+
+    for(auto const & h : f_histograms)
+    {
+        out << "# TYPE " << h.first << " histogram\n";
+        for(auto const & l : h.second)
+        {
+            std::string const sep(l.first.empty() ? "" : ",");
+            std::uint64_t total(0);
+            for(std::size_t idx(0); idx <= metrics_histogram::BUCKET_COUNT; ++idx)
+            {
+                total += l.second.get_bucket(idx);
+                out << h.first << "_bucket{" << l.first << sep << "le=\"";
+                if(idx == metrics_histogram::BUCKET_COUNT)
+                {
+                    out << "+Inf";
+                }
+                else
+                {
+                    out << metrics_histogram::g_bounds[idx];
+                }
+                out << "\"} " << total << '\n';
+            }
+            std::string const labels(l.first.empty() ? std::string() : '{' + l.first + '}');
+            out << h.first << "_sum" << labels << ' ' << l.second.get_sum() << '\n';
+            out << h.first << "_count" << labels << ' ' << l.second.get_count() << '\n';
+        }
+    }
+
+    communicator::pointer_t c(communicator::instance());
+    out << "# TYPE ed_loop_idle_seconds_total counter\n"
+        << "ed_loop_idle_seconds_total " << c->get_idle().to_timestamp() << '\n';
+
+    connection::vector_t const & connections(c->get_connections());
+    struct connection_metric_t
+    {
+        char const *    f_name = nullptr;
+        char const *    f_type = nullptr;
+        std::uint64_t   (*f_get)(connection const & c) = nullptr;
+    };
+    connection_metric_t const connection_metrics[] =
+    {
+        { "ed_connection_bytes_read_total",         "counter",  [](connection const & c) -> std::uint64_t { return c.get_bytes_read(); } },
+        { "ed_connection_bytes_written_total",      "counter",  [](connection const & c) -> std::uint64_t { return c.get_bytes_written(); } },
+        { "ed_connection_output_queue_bytes",       "gauge",    [](connection const & c) -> std::uint64_t { return c.get_output_size(); } },
+        { "ed_connection_timeouts_total",           "counter",  [](connection const & c) -> std::uint64_t { return c.get_timeouts(); } },
+        { "ed_connection_events_total",             "counter",  [](connection const & c) -> std::uint64_t { return c.get_scheduled_events(); } },
+        { "ed_connection_deferred_events_total",    "counter",  [](connection const & c) -> std::uint64_t { return c.get_deferred_events(); } },
+        { "ed_connection_processing_us_total",      "counter",  [](connection const & c) -> std::uint64_t { return c.get_processing_time(); } },
+    };
+    for(auto const & m : connection_metrics)
+    {
+        out << "# TYPE " << m.f_name << ' ' << m.f_type << '\n';
+        for(auto const & conn : connections)
+        {
+            out << m.f_name
+                << '{' << label("connection", conn->get_name())
+                << ',' << label("id", std::to_string(conn->get_id())) << "} "
+                << m.f_get(*conn)
+                << '\n';
+        }
+    }
+
+    return out.str();
+}
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
@@ -0,0 +1,101 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Metrics of the event loop.
+ *
+ * The metrics registry holds counters and histograms updated by the
+ * communicator, the dispatcher and your own code. There is one registry
+ * per thread so updating a metric never requires a lock.
+ */
+
+// C++
+//
+#include    <array>
+#include    <cstdint>
+#include    <map>
+#include    <string>
+
+
+
+namespace ed
+{
+
+
+
+class metrics_counter
+{
+public:
+    void                        increment(std::uint64_t count = 1) { f_value += count; }
+    std::uint64_t               get_value() const { return f_value; }
+
+private:
+    std::uint64_t               f_value = 0;
+};
+
+
+class metrics_histogram
+{
+public:
+    static constexpr std::size_t const  BUCKET_COUNT = 12;
+    static std::array<std::int64_t, BUCKET_COUNT> const g_bounds;   // in microseconds
+
+    void                        record(std::int64_t value);
+    std::uint64_t               get_count() const;
+    std::int64_t                get_sum() const;
+    std::uint64_t               get_bucket(std::size_t idx) const;
+
+private:
+    std::array<std::uint64_t, BUCKET_COUNT + 1>
+                                f_buckets = std::array<std::uint64_t, BUCKET_COUNT + 1>();
+    std::uint64_t               f_count = 0;
+    std::int64_t                f_sum = 0;
+};
+
+
+class metrics
+{
+public:
+    static metrics &            instance();
+
+    metrics_counter &           get_counter(
+                                      std::string const & name
+                                    , std::string const & labels = std::string());
+    metrics_histogram &         get_histogram(
+                                      std::string const & name
+                                    , std::string const & labels = std::string());
+    void                        reset();
+
+    std::string                 to_prometheus() const;
+
+    static std::string          label(std::string const & name, std::string const & value);
+
+private:
+                                metrics() = default;
+
+    std::map<std::string, std::map<std::string, metrics_counter>>
+                                f_counters = std::map<std::string, std::map<std::string, metrics_counter>>();
+    std::map<std::string, std::map<std::string, metrics_histogram>>
+                                f_histograms = std::map<std::string, std::map<std::string, metrics_histogram>>();
+};
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
@@ -0,0 +1,157 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the metrics server.
+ *
+ * The server only implements the bare minimum of HTTP/1.0: it reads
+ * the request header up to the empty line, ignores it, sends the
+ * metrics, and closes the connection.
+ */
+
+// self
+//
+#include    "eventdispatcher/metrics_server.h"
+
+#include    "eventdispatcher/communicator.h"
+#include    "eventdispatcher/local_stream_server_client_buffer_connection.h"
+#include    "eventdispatcher/metrics.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C
+//
+#include    <string.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ed
+{
+
+
+
+namespace
+{
+
+
+
+class metrics_client
+    : public local_stream_server_client_buffer_connection
+{
+public:
+    metrics_client(snapdev::raii_fd_t client)
+        : local_stream_server_client_buffer_connection(std::move(client))
+    {
+        set_name("metrics_client");
+    }
+
+    virtual void process_line(std::string const & line) override
+    {
+        if(f_replied)
+        {
+            return;
+        }
+
+        // the header ends with an empty line ("\r\n")
+        //
+        if(!line.empty()
+        && line != "\r")
+        {
+            return;
+        }
+
+        f_replied = true;
+
+        std::string const body(metrics::instance().to_prometheus());
+        std::string const reply(
+                  "HTTP/1.0 200 OK\r\n"
+                  "Content-Type: text/plain; version=0.0.4\r\n"
+                  "Content-Length: " + std::to_string(body.length()) + "\r\n"
+                  "Connection: close\r\n"
+                  "\r\n"
+                + body);
+        write(reply.c_str(), reply.length());
+    }
+
+    virtual void process_empty_buffer() override
+    {
+        if(f_replied)
+        {
+            remove_from_communicator();
+        }
+    }
+
+private:
+    bool                f_replied = false;
+};
+
+
+
+} // no name namespace
+
+
+
+/** \brief Create the metrics server.
+ *
+ * Add the server to the communicator to start answering requests.
+ *
+ * \param[in] address  The path to the Unix socket.
+ */
+metrics_server::metrics_server(addr::addr_unix const & address)
+    : local_stream_server_connection(address, MAX_CONNECTIONS, true)
+{
+    set_name("metrics_server");
+}
+
+
+/** \brief Accept a new client.
+ *
+ * The client reads the HTTP request and replies with the metrics.
+ */
+void metrics_server::process_accept()
+{
+    snapdev::raii_fd_t s(accept());
+    if(s == nullptr)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "accept() of a metrics client failed (errno: "
+            << e
+            << " -- "
+            << strerror(e)
+            << ")."
+            << SNAP_LOG_SEND;
+        return;
+    }
+
+    communicator::instance()->add_connection(std::make_shared<metrics_client>(std::move(s)));
+}
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
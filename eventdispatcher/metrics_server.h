@@ -0,0 +1,58 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Serve the metrics over HTTP on a Unix socket.
+ *
+ * This server answers any HTTP request with the metrics of the
+ * communicator thread in the Prometheus text format. For example:
+ *
+ * \code
+ *     curl --unix-socket /run/myservice/metrics.sock http://localhost/metrics
+ * \endcode
+ */
+
+// self
+//
+#include    <eventdispatcher/local_stream_server_connection.h>
+
+
+
+namespace ed
+{
+
+
+
+class metrics_server
+    : public local_stream_server_connection
+{
+public:
+    typedef std::shared_ptr<metrics_server>     pointer_t;
+
+                        metrics_server(addr::addr_unix const & address);
+
+    // connection implementation
+    //
+    virtual void        process_accept() override;
+};
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
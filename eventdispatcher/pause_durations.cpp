@@ -22,6 +22,11 @@
  * The pause_durations class is used to define a set of delays to wait for
  * a permanent connection to reconnect. The idea is to have a series of
  * increasing values.
+ *
+ * The class also supports a decorrelated jitter mode where each delay is
+ * a random value between a base and three times the previous delay,
+ * capped to a maximum. That way many clients losing the same server do
+ * not all try to reconnect at the exact same time.
  */
 
 
@@ -61,7 +66,9 @@
 
 // C++
 //
+#include    <algorithm>
 #include    <cmath>
+#include    <random>
 
 
 // C
@@ -80,6 +87,43 @@ namespace ed
 
 
 
+namespace
+{
+
+
+
+/** \brief The random generator used by the jitter mode.
+ *
+ * The generator is not part of the pause_durations object because the
+ * object gets copied by the permanent connections. Copies would then
+ * generate the exact same sequence of delays which is exactly what the
+ * jitter is expected to avoid.
+ */
+thread_local std::minstd_rand   g_random(std::random_device{}());
+
+
+/** \brief Reconnect rate limit.
+ *
+ * The permanent connections of a process share a token bucket used to
+ * limit the number of reconnect attempts per second. A rate of 0 means
+ * that the number of attempts is not limited.
+ *
+ * These variables are only accessed from the communicator::run() loop
+ * which runs in a single thread.
+ *
+ * \sa pause_durations::set_reconnect_rate_limit()
+ */
+double                          g_reconnect_rate = 0.0;
+double                          g_reconnect_burst = 1.0;
+double                          g_reconnect_tokens = 1.0;
+std::int64_t                    g_reconnect_last_refill = 0;
+
+
+
+} // no name namespace
+
+
+
 pause_durations::pause_durations(std::int64_t value)
 {
     f_pause.push_back(static_cast<double>(value) / 1'000'000.0);
@@ -89,11 +133,127 @@ pause_durations::pause_durations(std::int64_t value)
 
 pause_durations::pause_durations(std::string const & value)
 {
-    parse_pause_list(value);
+    if(value.compare(0, 6, "jitter") == 0)
+    {
+        parse_jitter(value);
+    }
+    else
+    {
+        parse_pause_list(value);
+    }
+    restart();
+}
+
+
+/** \brief Create a decorrelated jitter pause.
+ *
+ * This constructor sets up the pause in the decorrelated jitter mode.
+ * The first delay is \p base and each following delay is a random
+ * value between \p base and three times the previous delay, never
+ * more than \p cap.
+ *
+ * The same mode can be selected with a string such as "jitter:1s:5min"
+ * which is useful when the durations come from a configuration file.
+ *
+ * \exception invalid_parameter
+ * The \p base must be at least 10 microseconds and \p cap cannot be
+ * smaller than \p base.
+ *
+ * \param[in] base  The smallest delay in microseconds.
+ * \param[in] cap  The largest delay in microseconds.
+ */
+pause_durations::pause_durations(std::int64_t base, std::int64_t cap)
+    : f_mode(pause_mode_t::PAUSE_MODE_DECORRELATED_JITTER)
+    , f_base(static_cast<double>(base) / 1'000'000.0)
+    , f_cap(static_cast<double>(cap) / 1'000'000.0)
+{
+    if(base < 10)
+    {
+        throw invalid_parameter(
+              "the jitter base pause ("
+            + std::to_string(base)
+            + "us) must be at least 10us.");
+    }
+    if(cap < base)
+    {
+        throw invalid_parameter(
+              "the jitter cap ("
+            + std::to_string(cap)
+            + "us) cannot be smaller than the base ("
+            + std::to_string(base)
+            + "us).");
+    }
+
+    // the list is not used in this mode, but keep one entry to avoid
+    // special cases
+    //
+    f_pause.push_back(f_cap);
     restart();
 }
 
 
+double pause_durations::parse_duration(std::string const & duration)
+{
+    double seconds(0);
+    if(!advgetopt::validator_duration::convert_string(
+              duration
+            , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+            , 1.0
+            , seconds))
+    {
+        throw invalid_parameter(
+              "pause duration \""
+            + duration
+            + "\" is not valid.");
+    }
+    return seconds;
+}
+
+
+/** \brief Parse a "jitter[:<base>[:<cap>]]" specification.
+ *
+ * The base defaults to 1 second and the cap to the default pause
+ * before reconnecting (1 minute).
+ *
+ * \param[in] jitter  The string to parse.
+ */
+void pause_durations::parse_jitter(std::string const & jitter)
+{
+    advgetopt::string_list_t parts;
+    advgetopt::split_string(jitter, parts, {{":"}});
+    if(parts.empty()
+    || parts[0] != "jitter"
+    || parts.size() > 3)
+    {
+        throw invalid_parameter(
+              "jitter pause \""
+            + jitter
+            + "\" is not valid, expected \"jitter[:<base>[:<cap>]]\".");
+    }
+
+    f_mode = pause_mode_t::PAUSE_MODE_DECORRELATED_JITTER;
+    f_base = parts.size() >= 2 ? parse_duration(parts[1]) : 1.0;
+    f_cap = parts.size() >= 3
+                ? parse_duration(parts[2])
+                : std::max(f_base, static_cast<double>(DEFAULT_PAUSE_BEFORE_RECONNECTING) / 1'000'000.0);
+    if(f_base < 0.00001)
+    {
+        throw invalid_parameter(
+              "the jitter base pause in \""
+            + jitter
+            + "\" must be at least 10us.");
+    }
+    if(f_cap < f_base)
+    {
+        throw invalid_parameter(
+              "the jitter cap in \""
+            + jitter
+            + "\" cannot be smaller than the base.");
+    }
+    f_pause.push_back(f_cap);
+}
+
+
 void pause_durations::parse_pause_list(std::string const & pause)
 {
     advgetopt::string_list_t durations;
@@ -105,19 +265,7 @@ void pause_durations::parse_pause_list(std::string const & pause)
             throw invalid_parameter("too many pause durations, limit is 255.");
         }
 
-        double seconds(0);
-        if(!advgetopt::validator_duration::convert_string(
-                  d
-                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
-                , 1.0
-                , seconds))
-        {
-            throw invalid_parameter(
-                  "pause duration \""
-                + d
-                + "\" is not valid.");
-        }
-        f_pause.push_back(seconds);
+        f_pause.push_back(parse_duration(d));
     }
 
     // get at least one entry to make it simpler to handle
@@ -129,14 +277,50 @@ void pause_durations::parse_pause_list(std::string const & pause)
 }
 
 
+pause_mode_t pause_durations::get_mode() const
+{
+    return f_mode;
+}
+
+
+bool pause_durations::is_jittered() const
+{
+    return f_mode == pause_mode_t::PAUSE_MODE_DECORRELATED_JITTER;
+}
+
+
 double pause_durations::initial_timer_value() const
 {
+    if(is_jittered())
+    {
+        return 0.0;
+    }
+
     return f_pause[0] < 0.0 ? -f_pause[0] : 0.0;
 }
 
 
+/** \brief Get the next delay in seconds.
+ *
+ * In the list mode, this function returns the next delay in the list
+ * and -1.0 once the end of the list was reached, meaning that the
+ * last delay remains in place.
+ *
+ * In the decorrelated jitter mode, this function always returns a
+ * new delay: a random value between the base and three times the
+ * previous delay, capped.
+ *
+ * \return The next delay in seconds or -1.0.
+ */
 double pause_durations::get_next_delay()
 {
+    if(is_jittered())
+    {
+        std::uniform_real_distribution<double> range(f_base, std::max(f_base, f_previous * 3.0));
+        f_previous = std::min(f_cap, range(g_random));
+        return f_previous;
+    }
+
     if(f_pause_pos < f_pause.size())
     {
         double const delay(fabs(f_pause[f_pause_pos]));
@@ -150,6 +334,8 @@ double pause_durations::get_next_delay()
 
 void pause_durations::restart()
 {
+    f_previous = f_base;
+
     if(f_pause.size() == 1
     || f_pause[0] > 0.0)
     {
@@ -163,5 +349,95 @@ void pause_durations::restart()
 
 
 
+/** \brief Limit the number of reconnect attempts per second.
+ *
+ * When a server restarts, all of its clients lose their connection at
+ * the same time. The jitter spreads the attempts of each client but a
+ * process with many permanent connections may still generate a burst.
+ * This function sets up a token bucket shared by all the permanent
+ * connections of the process: each attempt takes one token, tokens get
+ * added at \p rate per second, up to \p burst tokens.
+ *
+ * A \p rate of 0.0 removes the limit (the default).
+ *
+ * \exception invalid_parameter
+ * The \p rate cannot be negative and \p burst must be at least 1.
+ *
+ * \param[in] rate  The number of attempts per second or 0.0.
+ * \param[in] burst  The maximum number of attempts in a burst.
+ */
+void pause_durations::set_reconnect_rate_limit(double rate, double burst)
+{
+    if(rate < 0.0)
+    {
+        throw invalid_parameter("the reconnect rate limit cannot be negative.");
+    }
+    if(burst < 1.0)
+    {
+        throw invalid_parameter("the reconnect burst must be at least 1.");
+    }
+
+    g_reconnect_rate = rate;
+    g_reconnect_burst = burst;
+    g_reconnect_tokens = burst;
+    g_reconnect_last_refill = 0;
+}
+
+
+/** \brief Get the current reconnect rate limit.
+ *
+ * \return The number of attempts per second or 0.0 if not limited.
+ */
+double pause_durations::get_reconnect_rate_limit()
+{
+    return g_reconnect_rate;
+}
+
+
+/** \brief Take a token to attempt a reconnect.
+ *
+ * This function is called by the permanent connections just before
+ * they attempt to connect. If the rate is not limited or a token is
+ * available, the function returns 0 and the attempt can go on.
+ *
+ * Otherwise the function returns the date, in microseconds, when the
+ * next token becomes available. The connection is expected to try
+ * again at that time.
+ *
+ * \param[in] now  The current date in microseconds.
+ *
+ * \return 0 if the attempt can proceed, the date to retry otherwise.
+ */
+std::int64_t pause_durations::acquire_reconnect_token(std::int64_t now)
+{
+    if(g_reconnect_rate <= 0.0)
+    {
+        return 0;
+    }
+
+    if(g_reconnect_last_refill != 0
+    && now > g_reconnect_last_refill)
+    {
+        g_reconnect_tokens = std::min(
+                  g_reconnect_burst
+                , g_reconnect_tokens
+                    + static_cast<double>(now - g_reconnect_last_refill)
+                        * g_reconnect_rate / 1'000'000.0);
+    }
+    g_reconnect_last_refill = now;
+
+    if(g_reconnect_tokens >= 1.0)
+    {
+        g_reconnect_tokens -= 1.0;
+        return 0;
+    }
+
+    return now
+        + static_cast<std::int64_t>(
+                std::ceil((1.0 - g_reconnect_tokens) * 1'000'000.0 / g_reconnect_rate));
+}
+
+
+
 } // namespace ed
 // vim: ts=4 sw=4 et
@@ -41,23 +41,43 @@ constexpr std::int64_t const   DEFAULT_PAUSE_BEFORE_RECONNECTING = 60LL * 1'000'
 constexpr char const * const   DEFAULT_PAUSE_BEFORE_RECONNECTING_STRING = "60";         // 1 minute in seconds as a string (could have multiple entries comma separated)
 
 
+enum class pause_mode_t
+{
+    PAUSE_MODE_LIST,                    // use the list of durations as is
+    PAUSE_MODE_DECORRELATED_JITTER,     // random exponential backoff between base and cap
+};
+
+
 class pause_durations
 {
 public:
                                 pause_durations(std::int64_t value);
                                 pause_durations(std::string const & value);
+                                pause_durations(std::int64_t base, std::int64_t cap);
 
+    pause_mode_t                get_mode() const;
+    bool                        is_jittered() const;
     double                      initial_timer_value() const;
     double                      get_next_delay();
     void                        restart();
 
+    static void                 set_reconnect_rate_limit(double rate, double burst);
+    static double               get_reconnect_rate_limit();
+    static std::int64_t         acquire_reconnect_token(std::int64_t now);
+
 private:
     typedef std::vector<double> pause_t;
 
     void                        parse_pause_list(std::string const & pause);
+    void                        parse_jitter(std::string const & jitter);
+    double                      parse_duration(std::string const & duration);
 
+    pause_mode_t                f_mode = pause_mode_t::PAUSE_MODE_LIST;
     pause_t                     f_pause = pause_t();
     std::uint8_t                f_pause_pos = 1;
+    double                      f_base = 0.0;
+    double                      f_cap = 0.0;
+    double                      f_previous = 0.0;
 };
 
 
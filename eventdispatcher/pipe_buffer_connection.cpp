@@ -97,6 +97,16 @@ bool pipe_buffer_connection::is_writer() const
 }
 
 
+/** \brief Get the number of bytes waiting in the output buffer.
+ *
+ * \return The number of bytes not yet written to the socket.
+ */
+std::size_t pipe_buffer_connection::get_output_size() const
+{
+    return f_output.size() - f_position;
+}
+
+
 /** \brief Write the specified data to the pipe buffer.
  *
  * This function writes the data specified by \p data to the pipe buffer.
@@ -158,6 +168,7 @@ void pipe_buffer_connection::process_read()
             ssize_t const r(read(&buffer[0], buffer.size()));
             if(r > 0)
             {
+                add_bytes_read(r);
                 for(ssize_t position(0); position < r; )
                 {
                     std::vector<char>::const_iterator it(std::find(buffer.begin() + position, buffer.begin() + r, '\n'));
@@ -251,6 +262,7 @@ void pipe_buffer_connection::process_write()
         ssize_t const r(pipe_connection::write(&f_output[f_position], f_output.size() - f_position));
         if(r > 0)
         {
+            add_bytes_written(r);
             // some data was written
             f_position += r;
             if(f_position >= f_output.size())
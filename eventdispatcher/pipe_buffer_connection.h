@@ -44,6 +44,7 @@ public:
 
     // connection
     virtual bool                is_writer() const override;
+    virtual std::size_t         get_output_size() const override;
 
     // pipe_connection implementation
     virtual ssize_t             write(void const * data, size_t length) override;
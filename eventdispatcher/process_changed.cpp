@@ -30,6 +30,11 @@
  *
  * Based on code found here:
  * http://bewareofgeek.livejournal.com/2945.html
+ *
+ * The proc connector sends all the events of the whole system. To avoid
+ * waking up for events we are not interested in, the filters defined on
+ * the connection get compiled into a classic BPF program attached to
+ * the socket so the kernel drops the other events.
  */
 
 // self
@@ -47,8 +52,10 @@
 
 // C
 //
+#include    <arpa/inet.h>
 #include    <linux/connector.h>
 #include    <linux/cn_proc.h>
+#include    <linux/filter.h>
 #include    <linux/netlink.h>
 #include    <linux/version.h>
 #include    <sys/socket.h>
@@ -60,6 +67,17 @@
 
 
 
+// in newer versions of Linux the PROC_EVENT_... are not defined inside the
+// proc_event structure
+//
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,1)
+#define proc_event_namespace
+#else
+#define proc_event_namespace proc_event::
+#endif
+
+
+
 namespace ed
 {
 namespace
@@ -87,10 +105,283 @@ constexpr char const * const g_process_event_to_string[] =
 
 
 
+/** \brief Offsets of the proc connector fields in a netlink message.
+ *
+ * The BPF program sees the whole netlink message: the nlmsghdr, then
+ * the cn_msg and finally the proc_event.
+ */
+constexpr std::uint32_t const   g_cn_msg_offset = NLMSG_HDRLEN;
+constexpr std::uint32_t const   g_proc_event_offset = g_cn_msg_offset + sizeof(cn_msg);
+constexpr std::uint32_t const   g_what_offset = g_proc_event_offset + offsetof(proc_event, what);
+
+
+/** \brief Tiny classic BPF assembler.
+ *
+ * The conditional jumps of classic BPF are limited to 255 instructions.
+ * With large sets of PIDs, the targets can be further than that, so all
+ * the jumps to a label use a BPF_JA which has a 32 bit offset. The
+ * offsets get fixed once the program is complete.
+ */
+class bpf_builder
+{
+public:
+    enum label_t
+    {
+        LABEL_PID,
+        LABEL_PID_PROCESS,
+        LABEL_UID,
+        LABEL_PASS,
+        LABEL_DROP,
+
+        LABEL_MAX
+    };
+
+    void load_word(std::uint32_t offset)
+    {
+        f_program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset));
+    }
+
+    void load_half(std::uint32_t offset)
+    {
+        f_program.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offset));
+    }
+
+    // note: BPF_ABS loads are done in network byte order
+    //
+    void jump_if(std::uint32_t value, label_t label)
+    {
+        f_program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, value, 0, 1));
+        go(label);
+    }
+
+    void jump_if_not(std::uint32_t value, label_t label)
+    {
+        f_program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, value, 1, 0));
+        go(label);
+    }
+
+    void go(label_t label)
+    {
+        f_fixups.emplace_back(f_program.size(), label);
+        f_program.push_back(BPF_STMT(BPF_JMP | BPF_JA, 0));
+    }
+
+    void mark(label_t label)
+    {
+        f_labels[label] = f_program.size();
+    }
+
+    void ret(std::uint32_t value)
+    {
+        f_program.push_back(BPF_STMT(BPF_RET | BPF_K, value));
+    }
+
+    std::vector<sock_filter> & finish()
+    {
+        for(auto const & f : f_fixups)
+        {
+            f_program[f.first].k = f_labels[f.second] - f.first - 1;
+        }
+        return f_program;
+    }
+
+private:
+    std::vector<sock_filter>    f_program = std::vector<sock_filter>();
+    std::vector<std::pair<std::size_t, label_t>>
+                                f_fixups = std::vector<std::pair<std::size_t, label_t>>();
+    std::size_t                 f_labels[LABEL_MAX] = {};
+};
+
+
+/** \brief Convert one of our event types to the kernel value.
+ *
+ * \param[in] event  The event to convert.
+ *
+ * \return The PROC_EVENT_... value or -1 if the event has no equivalent.
+ */
+std::int64_t event_to_kernel(process_event_t event)
+{
+    switch(event)
+    {
+    case process_event_t::PROCESS_EVENT_FORK:
+        return proc_event_namespace PROC_EVENT_FORK;
+
+    case process_event_t::PROCESS_EVENT_EXEC:
+        return proc_event_namespace PROC_EVENT_EXEC;
+
+    case process_event_t::PROCESS_EVENT_UID:
+        return proc_event_namespace PROC_EVENT_UID;
+
+    case process_event_t::PROCESS_EVENT_GID:
+        return proc_event_namespace PROC_EVENT_GID;
+
+    case process_event_t::PROCESS_EVENT_SESSION:
+        return proc_event_namespace PROC_EVENT_SID;
+
+    case process_event_t::PROCESS_EVENT_PTRACE:
+        return proc_event_namespace PROC_EVENT_PTRACE;
+
+    case process_event_t::PROCESS_EVENT_COMMAND:
+        return proc_event_namespace PROC_EVENT_COMM;
+
+    case process_event_t::PROCESS_EVENT_COREDUMP:
+        return proc_event_namespace PROC_EVENT_COREDUMP;
+
+    case process_event_t::PROCESS_EVENT_EXIT:
+        return proc_event_namespace PROC_EVENT_EXIT;
+
+    default:
+        return -1;
+
+    }
+}
+
+
+
 } // no name namespace
 
 
 
+namespace detail
+{
+
+
+
+/** \brief Compile the process filters in a classic BPF program.
+ *
+ * The program accepts any message which is not a proc connector event
+ * and the acknowledgements. Then it checks the event type, the PIDs
+ * and finally the UID.
+ *
+ * If the program would be too large (i.e. too many PIDs), the PIDs are
+ * not included and only get checked in user space.
+ *
+ * \param[in] events  The events to accept, all of them if empty.
+ * \param[in] pids  The PIDs to accept, all of them if empty.
+ * \param[in] uid  The UID to accept in UID events or snapdev::NO_UID.
+ *
+ * \return The program or an empty vector if nothing gets filtered.
+ */
+std::vector<sock_filter> build_process_filter(
+      process_event_set_t const & events
+    , pid_set_t const & pids
+    , uid_t uid)
+{
+    if(events.empty()
+    && pids.empty()
+    && uid == snapdev::NO_UID)
+    {
+        return std::vector<sock_filter>();
+    }
+
+    // each PID is checked against up to 6 fields with 2 instructions
+    //
+    bool const kernel_pids(pids.size() * 12 + 64 < BPF_MAXINSNS);
+
+    bpf_builder b;
+
+    // let other messages through (errors, other connectors)
+    //
+    b.load_half(offsetof(nlmsghdr, nlmsg_type));
+    b.jump_if_not(htons(NLMSG_DONE), bpf_builder::LABEL_PASS);
+    b.load_word(g_cn_msg_offset + offsetof(cn_msg, id.idx));
+    b.jump_if_not(htonl(CN_IDX_PROC), bpf_builder::LABEL_PASS);
+    b.load_word(g_cn_msg_offset + offsetof(cn_msg, id.val));
+    b.jump_if_not(htonl(CN_VAL_PROC), bpf_builder::LABEL_PASS);
+
+    // acknowledgements are always accepted
+    //
+    b.load_word(g_what_offset);
+    b.jump_if(htonl(proc_event_namespace PROC_EVENT_NONE), bpf_builder::LABEL_PASS);
+
+    // event types
+    //
+    bool all_events(events.empty());
+    for(auto const & e : events)
+    {
+        if(event_to_kernel(e) < 0)
+        {
+            // UNKNOWN cannot be checked by the kernel
+            //
+            all_events = true;
+        }
+    }
+    if(!all_events)
+    {
+        for(auto const & e : events)
+        {
+            b.jump_if(htonl(static_cast<std::uint32_t>(event_to_kernel(e))), bpf_builder::LABEL_PID);
+        }
+        b.go(bpf_builder::LABEL_DROP);
+    }
+
+    // process identifiers
+    //
+    b.mark(bpf_builder::LABEL_PID);
+    if(kernel_pids
+    && !pids.empty())
+    {
+        b.load_word(g_what_offset);
+        b.jump_if_not(htonl(proc_event_namespace PROC_EVENT_FORK), bpf_builder::LABEL_PID_PROCESS);
+        for(std::uint32_t const offset : {
+                      offsetof(proc_event, event_data.fork.parent_pid)
+                    , offsetof(proc_event, event_data.fork.parent_tgid)
+                    , offsetof(proc_event, event_data.fork.child_pid)
+                    , offsetof(proc_event, event_data.fork.child_tgid) })
+        {
+            b.load_word(g_proc_event_offset + offset);
+            for(auto const pid : pids)
+            {
+                b.jump_if(htonl(static_cast<std::uint32_t>(pid)), bpf_builder::LABEL_UID);
+            }
+        }
+        b.go(bpf_builder::LABEL_DROP);
+
+        // all the other events start with the process_pid & process_tgid
+        //
+        b.mark(bpf_builder::LABEL_PID_PROCESS);
+        for(std::uint32_t const offset : {
+                      offsetof(proc_event, event_data.exit.process_pid)
+                    , offsetof(proc_event, event_data.exit.process_tgid) })
+        {
+            b.load_word(g_proc_event_offset + offset);
+            for(auto const pid : pids)
+            {
+                b.jump_if(htonl(static_cast<std::uint32_t>(pid)), bpf_builder::LABEL_UID);
+            }
+        }
+        b.go(bpf_builder::LABEL_DROP);
+    }
+
+    // user identifier
+    //
+    b.mark(bpf_builder::LABEL_UID);
+    if(uid != snapdev::NO_UID)
+    {
+        b.load_word(g_what_offset);
+        b.jump_if_not(htonl(proc_event_namespace PROC_EVENT_UID), bpf_builder::LABEL_PASS);
+        b.load_word(g_proc_event_offset + offsetof(proc_event, event_data.id.r.ruid));
+        b.jump_if(htonl(uid), bpf_builder::LABEL_PASS);
+        b.load_word(g_proc_event_offset + offsetof(proc_event, event_data.id.e.euid));
+        b.jump_if(htonl(uid), bpf_builder::LABEL_PASS);
+        b.go(bpf_builder::LABEL_DROP);
+    }
+
+    b.mark(bpf_builder::LABEL_PASS);
+    b.ret(0xFFFFFFFF);
+
+    b.mark(bpf_builder::LABEL_DROP);
+    b.ret(0);
+
+    return b.finish();
+}
+
+
+
+} // namespace detail
+
+
+
 /** \brief Convert a process event number to a string.
  *
  * This function transforms a process event to a human readable string.
@@ -918,14 +1209,6 @@ void process_changed::process_read()
             event.set_cpu(proc_ev->cpu);
             event.set_timestamp(proc_ev->timestamp_ns);
 
-// in newer versions of Linux the PROC_EVENT_... are not defined inside the
-// proc_event structure
-//
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,1)
-#define proc_event_namespace
-#else
-#define proc_event_namespace proc_event::
-#endif
             switch(proc_ev->what)
             {
             case proc_event_namespace PROC_EVENT_NONE:
@@ -1021,7 +1304,10 @@ void process_changed::process_read()
                 break;
 
             }
-            process_event(event);
+            if(match_filter(event))
+            {
+                process_event(event);
+            }
         }
         else if(r == 0 || errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
         {
@@ -1051,6 +1337,227 @@ void process_changed::process_read()
 }
 
 
+/** \brief Only receive events of the specified types.
+ *
+ * By default, all the events are sent to the process_event() callback.
+ * This function limits the events to the specified types. An empty set
+ * means all the events. The PROCESS_EVENT_NONE (acknowledgement) events
+ * are always sent.
+ *
+ * The filter is compiled into a BPF program attached to the socket so
+ * the kernel drops the other events without waking us up.
+ *
+ * \param[in] events  The set of events to receive.
+ */
+void process_changed::set_event_filter(process_event_set_t const & events)
+{
+    f_filter_events = events;
+    update_filter();
+}
+
+
+/** \brief Get the set of events currently being filtered.
+ *
+ * \return The set of events, empty if all the events get sent.
+ */
+process_event_set_t const & process_changed::get_event_filter() const
+{
+    return f_filter_events;
+}
+
+
+/** \brief Only receive events about the specified process.
+ *
+ * Once at least one PID was added, only the events where the process
+ * identifier or the thread group identifier is one of the PIDs get sent.
+ * For the FORK event, the parent identifiers are also checked so you
+ * get notified when one of your processes creates a child.
+ *
+ * The kernel filter gets updated each time the set changes.
+ *
+ * \param[in] pid  The PID to add to the filter.
+ */
+void process_changed::add_pid_filter(pid_t pid)
+{
+    if(f_filter_pids.insert(pid).second)
+    {
+        update_filter();
+    }
+}
+
+
+/** \brief Remove a PID from the filter.
+ *
+ * Once the last PID is removed, the events of all the processes get
+ * sent again.
+ *
+ * \param[in] pid  The PID to remove from the filter.
+ */
+void process_changed::remove_pid_filter(pid_t pid)
+{
+    if(f_filter_pids.erase(pid) != 0)
+    {
+        update_filter();
+    }
+}
+
+
+/** \brief Remove all the PIDs from the filter.
+ */
+void process_changed::clear_pid_filter()
+{
+    if(!f_filter_pids.empty())
+    {
+        f_filter_pids.clear();
+        update_filter();
+    }
+}
+
+
+/** \brief Get the set of PIDs being filtered.
+ *
+ * \return The set of PIDs, empty if all the processes are accepted.
+ */
+pid_set_t const & process_changed::get_pid_filter() const
+{
+    return f_filter_pids;
+}
+
+
+/** \brief Filter the UID events.
+ *
+ * The UID is only available in the PROCESS_EVENT_UID events. When a UID
+ * is specified, only the UID events where the real or effective UID
+ * becomes \p uid are sent. The other types of events are not affected.
+ *
+ * Use snapdev::NO_UID to remove this filter.
+ *
+ * \param[in] uid  The UID to filter on.
+ */
+void process_changed::set_uid_filter(uid_t uid)
+{
+    f_filter_uid = uid;
+    update_filter();
+}
+
+
+/** \brief Get the UID filter.
+ *
+ * \return The UID or snapdev::NO_UID.
+ */
+uid_t process_changed::get_uid_filter() const
+{
+    return f_filter_uid;
+}
+
+
+/** \brief Check whether the filter is applied by the kernel.
+ *
+ * If attaching the BPF program fails, the events are still filtered,
+ * but in user space. This function returns true when the kernel
+ * does the filtering.
+ *
+ * \return true if a BPF program is attached to the socket.
+ */
+bool process_changed::has_kernel_filter() const
+{
+    return f_kernel_filter;
+}
+
+
+/** \brief Compile the filters and attach the BPF program.
+ *
+ * The program is built by detail::build_process_filter(). When no
+ * filter is defined, the program gets detached from the socket.
+ */
+void process_changed::update_filter()
+{
+    if(f_socket == nullptr)
+    {
+        return;
+    }
+
+    std::vector<sock_filter> program(detail::build_process_filter(
+              f_filter_events
+            , f_filter_pids
+            , f_filter_uid));
+    if(program.empty())
+    {
+        if(f_kernel_filter)
+        {
+            int dummy(0);
+            setsockopt(f_socket.get(), SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+            f_kernel_filter = false;
+        }
+        return;
+    }
+
+    sock_fprog fprog = {};
+    fprog.len = static_cast<unsigned short>(program.size());
+    fprog.filter = program.data();
+    if(setsockopt(f_socket.get(), SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) != 0)
+    {
+        int const e(errno);
+        SNAP_LOG_WARNING
+            << "setsockopt() failed to attach the BPF filter to the NETLINK process socket (errno: "
+            << std::to_string(e)
+            << " -- "
+            << strerror(e)
+            << "); events will be filtered in user space."
+            << SNAP_LOG_SEND;
+        f_kernel_filter = false;
+        return;
+    }
+
+    f_kernel_filter = true;
+}
+
+
+/** \brief Check whether an event matches the filters.
+ *
+ * The kernel filter may not be attached or may not include the PIDs.
+ * Also, events received before the filter got updated are still in
+ * the socket buffer. So the filters are also applied in user space.
+ *
+ * \param[in] event  The event to check.
+ *
+ * \return true if the event is to be sent to process_event().
+ */
+bool process_changed::match_filter(process_changed_event const & event) const
+{
+    if(event.get_event() == process_event_t::PROCESS_EVENT_NONE)
+    {
+        return true;
+    }
+
+    if(!f_filter_events.empty()
+    && f_filter_events.find(event.get_event()) == f_filter_events.end())
+    {
+        return false;
+    }
+
+    if(!f_filter_pids.empty()
+    && f_filter_pids.find(event.get_pid()) == f_filter_pids.end()
+    && f_filter_pids.find(event.get_tgid()) == f_filter_pids.end()
+    && (event.get_event() != process_event_t::PROCESS_EVENT_FORK
+        || (f_filter_pids.find(event.get_parent_pid()) == f_filter_pids.end()
+            && f_filter_pids.find(event.get_parent_tgid()) == f_filter_pids.end())))
+    {
+        return false;
+    }
+
+    if(f_filter_uid != snapdev::NO_UID
+    && event.get_event() == process_event_t::PROCESS_EVENT_UID
+    && event.get_ruid() != f_filter_uid
+    && event.get_euid() != f_filter_uid)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
 /** \fn process_changed::process_event()
  * \brief New callback used to process one event.
  *
@@ -36,6 +36,17 @@
 #include    <snapdev/raii_generic_deleter.h>
 
 
+// C++
+//
+#include    <set>
+#include    <vector>
+
+
+// C
+//
+#include    <linux/filter.h>
+
+
 
 namespace ed
 {
@@ -58,6 +69,10 @@ enum class process_event_t
 };
 
 
+typedef std::set<process_event_t>       process_event_set_t;
+typedef std::set<pid_t>                 pid_set_t;
+
+
 char const * process_event_to_string(process_event_t event);
 
 inline std::ostream & operator << (std::ostream & out, process_event_t event)
@@ -147,16 +162,42 @@ public:
     virtual void                set_enable(bool enabled) override;
     virtual void                process_read() override;
 
+    // filters
+    void                        set_event_filter(process_event_set_t const & events);
+    process_event_set_t const & get_event_filter() const;
+    void                        add_pid_filter(pid_t pid);
+    void                        remove_pid_filter(pid_t pid);
+    void                        clear_pid_filter();
+    pid_set_t const &           get_pid_filter() const;
+    void                        set_uid_filter(uid_t uid);
+    uid_t                       get_uid_filter() const;
+    bool                        has_kernel_filter() const;
+
     // new callback
     virtual void                process_event(process_changed_event const & event) = 0;
 
 private:
     void                        listen_for_events();
+    void                        update_filter();
+    bool                        match_filter(process_changed_event const & event) const;
 
     snapdev::raii_fd_t          f_socket = snapdev::raii_fd_t();
+    process_event_set_t         f_filter_events = process_event_set_t();
+    pid_set_t                   f_filter_pids = pid_set_t();
+    uid_t                       f_filter_uid = snapdev::NO_UID;
+    bool                        f_kernel_filter = false;
 };
 
 
+namespace detail
+{
+std::vector<sock_filter>        build_process_filter(
+                                      process_event_set_t const & events
+                                    , pid_set_t const & pids
+                                    , uid_t uid);
+}
+
+
 
 } // namespace ed
 // vim: ts=4 sw=4 et
@@ -21,6 +21,10 @@
  *
  * The Signal class listens for Unix signals to happen. This wakes us
  * up when the signal happens.
+ *
+ * The signal_child can also work without the SIGCHLD signal by polling
+ * one pidfd per child. This avoids the waitid() scan of all the children
+ * and calling all the listeners on each SIGCHLD.
  */
 
 // self
@@ -55,6 +59,8 @@
 // C
 //
 #include    <string.h>
+#include    <sys/syscall.h>
+#include    <unistd.h>
 
 
 // last include
@@ -64,6 +70,12 @@
 
 
 
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+
+
 namespace ed
 {
 
@@ -90,6 +102,62 @@ signal_child::pointer_t    g_signal_child = signal_child::pointer_t();
 
 
 
+namespace detail
+{
+
+
+/** \brief Connection used to wait on one child with a pidfd.
+ *
+ * In the pidfd mode, each child gets a pidfd which becomes readable
+ * once the child exits. That way only the listeners of that specific
+ * child get called.
+ */
+class child_pidfd
+    : public connection
+{
+public:
+    typedef std::shared_ptr<child_pidfd>    pointer_t;
+
+    child_pidfd(pid_t child, int pidfd)
+        : f_child(child)
+        , f_pidfd(pidfd)
+    {
+        set_name("signal_child::pidfd");
+    }
+
+    child_pidfd(child_pidfd const &) = delete;
+    child_pidfd & operator = (child_pidfd const &) = delete;
+
+    virtual ~child_pidfd() override
+    {
+        close(f_pidfd);
+    }
+
+    virtual bool is_reader() const override
+    {
+        return true;
+    }
+
+    virtual int get_socket() const override
+    {
+        return f_pidfd;
+    }
+
+    virtual void process_read() override
+    {
+        signal_child::get_instance()->process_pidfd(f_child, f_pidfd);
+    }
+
+private:
+    pid_t           f_child = -1;
+    int             f_pidfd = -1;
+};
+
+
+} // namespace detail
+
+
+
 
 /** \brief Initialize a child_status object.
  *
@@ -565,6 +633,149 @@ void signal_child::process_signal()
 }
 
 
+/** \brief Process the exit of a child in pidfd mode.
+ *
+ * This function is called once the pidfd of \p child becomes readable,
+ * which means the child exited. Only the listeners of that child are
+ * called. Then the zombie is released and the listeners removed.
+ *
+ * \param[in] child  The child which exited.
+ * \param[in] pidfd  The pidfd of the child.
+ */
+void signal_child::process_pidfd(pid_t child, int pidfd)
+{
+    siginfo_t info = {};
+    int const r(waitid(
+              static_cast<idtype_t>(P_PIDFD)
+            , pidfd
+            , &info
+            , WEXITED | WNOHANG | WNOWAIT));
+    if(r != 0)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "waitid() failed to wait for child "
+            << child
+            << " with its pidfd: "
+            << e
+            << ", "
+            << strerror(e)
+            << SNAP_LOG_SEND;
+        remove_listener(child);
+        return;
+    }
+
+    child_status const status(info);
+    if(status.child_pid() == 0)
+    {
+        // not exited yet
+        //
+        return;
+    }
+
+    callback_t::list_t listeners;
+    {
+        cppthread::guard lock(f_mutex);
+        auto const it(f_pidfds.find(child));
+        if(it != f_pidfds.end())
+        {
+            listeners = it->second.f_listeners;
+        }
+    }
+
+    flag_t const mask(status.status_mask());
+    for(auto & listener : listeners)
+    {
+        if((listener.f_flags & mask) != 0)
+        {
+            listener.f_callback(status);
+        }
+    }
+
+    // release the zombie, we're done
+    //
+    siginfo_t ignore = {};
+    snapdev::NOT_USED(waitid(static_cast<idtype_t>(P_PIDFD), pidfd, &ignore, WEXITED));
+
+    remove_listener(child);
+}
+
+
+/** \brief Check whether the pidfd mode is available.
+ *
+ * The pidfd_open() system call was added in Linux 5.3 and the P_PIDFD
+ * support of waitid() in Linux 5.4.
+ *
+ * \return true if pidfd_open() works on this system.
+ */
+bool signal_child::is_pidfd_supported()
+{
+    int const pidfd(static_cast<int>(syscall(SYS_pidfd_open, getpid(), 0)));
+    if(pidfd == -1)
+    {
+        return false;
+    }
+    close(pidfd);
+    return true;
+}
+
+
+/** \brief Use one pidfd per child instead of the SIGCHLD signal.
+ *
+ * By default, the signal_child listens to the SIGCHLD signal. Each time
+ * that signal occurs, all the children get checked with waitid() and all
+ * the listeners get checked for each child status change. With many
+ * short lived children, that gets expensive and since signals get
+ * coalesced, it is also fragile.
+ *
+ * In the pidfd mode, each child added with add_listener() gets a pidfd
+ * polled by the communicator. When a child exits, only its own
+ * listeners get called.
+ *
+ * \note
+ * A pidfd only becomes readable when the child exits. So in this mode
+ * the SIGNAL_CHILD_FLAG_STOPPED and SIGNAL_CHILD_FLAG_CONTINUED flags
+ * are not supported.
+ *
+ * \exception invalid_parameter
+ * The mode cannot be changed while listeners are registered and the
+ * pidfd mode cannot be used if the kernel does not support pidfd_open().
+ *
+ * \param[in] pidfd  Whether to use the pidfd mode.
+ */
+void signal_child::set_pidfd_mode(bool pidfd)
+{
+    cppthread::guard lock(f_mutex);
+
+    if(pidfd == f_pidfd_mode)
+    {
+        return;
+    }
+    if(!f_listeners.empty()
+    || !f_pidfds.empty())
+    {
+        throw invalid_parameter("the signal_child mode cannot be changed while listeners are registered.");
+    }
+    if(pidfd
+    && !is_pidfd_supported())
+    {
+        throw invalid_parameter("pidfd_open() is not supported on this system.");
+    }
+
+    f_pidfd_mode = pidfd;
+}
+
+
+/** \brief Check whether the pidfd mode is in use.
+ *
+ * \return true if the pidfd mode is in use.
+ */
+bool signal_child::get_pidfd_mode() const
+{
+    return f_pidfd_mode;
+}
+
+
 /** \brief The connection was added to the communicator.
  *
  * The connection was added, make sure it was by us (through our own
@@ -665,6 +876,38 @@ void signal_child::add_listener(
     }
 
     cppthread::guard lock(f_mutex);
+
+    if(f_pidfd_mode)
+    {
+        if((mask & (SIGNAL_CHILD_FLAG_STOPPED | SIGNAL_CHILD_FLAG_CONTINUED)) != 0)
+        {
+            throw invalid_parameter("the stopped and continued flags are not supported in pidfd mode.");
+        }
+
+        pidfd_t & entry(f_pidfds[child]);
+        if(entry.f_connection == nullptr)
+        {
+            int const pidfd(static_cast<int>(syscall(SYS_pidfd_open, child, 0)));
+            if(pidfd == -1)
+            {
+                int const e(errno);
+                f_pidfds.erase(child);
+                throw runtime_error(
+                      "pidfd_open() failed for child "
+                    + std::to_string(child)
+                    + " (errno: "
+                    + std::to_string(e)
+                    + ", "
+                    + strerror(e)
+                    + ").");
+            }
+            entry.f_connection = std::make_shared<detail::child_pidfd>(child, pidfd);
+            ed::communicator::instance()->add_connection(entry.f_connection);
+        }
+        entry.f_listeners.emplace(entry.f_listeners.end(), callback_t{ child, callback, mask });
+        return;
+    }
+
     f_listeners.emplace(f_listeners.end(), callback_t{ child, callback, mask });
     add_connection();
 }
@@ -700,6 +943,18 @@ void signal_child::remove_listener(pid_t child)
 {
     cppthread::guard lock(f_mutex);
 
+    if(f_pidfd_mode)
+    {
+        auto const it(f_pidfds.find(child));
+        if(it != f_pidfds.end())
+        {
+            detail::child_pidfd::pointer_t c(it->second.f_connection);
+            f_pidfds.erase(it);
+            ed::communicator::instance()->remove_connection(c);
+        }
+        return;
+    }
+
     for(auto it(f_listeners.begin()); it != f_listeners.end(); )
     {
         if(it->f_child == child)
@@ -30,6 +30,9 @@
  * Once you get called with a child that exited or was signaled, that
  * listener is automatically removed from the list of listeners (since
  * the child is gone, there is really no need for that listener).
+ *
+ * In the pidfd mode, each child gets its own pidfd connection instead
+ * and only the listeners of that child get called when it exits.
  */
 
 // self
@@ -46,6 +49,7 @@
 //
 #include    <functional>
 #include    <list>
+#include    <unordered_map>
 
 
 // C
@@ -94,6 +98,12 @@ private:
 };
 
 
+namespace detail
+{
+class child_pidfd;
+}
+
+
 class signal_child
     : public signal
 {
@@ -117,7 +127,13 @@ public:
                                     , flag_t mask = SIGNAL_CHILD_FLAG_EXITED | SIGNAL_CHILD_FLAG_SIGNALED);
     void                        remove_listener(pid_t child);
 
+    static bool                 is_pidfd_supported();
+    void                        set_pidfd_mode(bool pidfd);
+    bool                        get_pidfd_mode() const;
+
 private:
+    friend class detail::child_pidfd;
+
     struct callback_t
     {
         typedef std::list<callback_t>     list_t;
@@ -127,12 +143,25 @@ private:
         flag_t          f_flags = 0;
     };
 
+    struct pidfd_t
+    {
+        typedef std::unordered_map<pid_t, pidfd_t>  map_t;
+
+        std::shared_ptr<detail::child_pidfd>
+                        f_connection = std::shared_ptr<detail::child_pidfd>();
+        callback_t::list_t
+                        f_listeners = callback_t::list_t();
+    };
+
     explicit                    signal_child();
 
     void                        add_connection();
     void                        remove_connection();
+    void                        process_pidfd(pid_t child, int pidfd);
 
     callback_t::list_t          f_listeners = callback_t::list_t();
+    pidfd_t::map_t              f_pidfds = pidfd_t::map_t();
+    bool                        f_pidfd_mode = false;
     cppthread::mutex            f_mutex = cppthread::mutex();
     std::uint32_t               f_count = 0;
     bool                        f_adding_to_communicator = false;
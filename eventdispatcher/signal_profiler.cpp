@@ -19,22 +19,75 @@
 /** \file
  * \brief Implementation of the Signal Profiler class.
  *
- * The Signal Profiler class is at attempt to implement the SIGPROF without
- * stopping system functions such as poll(). At this point, this doesn't
- * work.
+ * The profiler sets up an ITIMER_PROF interval timer. The kernel sends
+ * a SIGPROF to the thread consuming CPU each time the timer expires.
+ * The signal handler saves the stack with backtrace() and copies the
+ * name of the connection and the command found in the thread callback
+ * context (see callback_context.h) in a lock-free ring buffer. Nothing
+ * else happens in the signal handler: no memory allocation, no lock.
  *
- * To test with the profiler, use the `-pg` command line option on your g++
- * command line. See the g++ docs for more info.
+ * The profiler is also a timer connection. Once per second, it collects
+ * the samples from the ring, converts the addresses to function names
+ * and counts each unique stack. When the duration is reached, it stops
+ * and saves the stacks to the specified file.
+ *
+ * The output uses the collapsed stack format: one line per unique
+ * stack, frames separated by semicolons from the root to the leaf,
+ * followed by a space and the number of samples. The first two frames
+ * are the connection and the command tags:
+ *
+ * \code
+ *     [connection:messenger];[command:PING];main;ed::communicator::run();... 12
+ * \endcode
+ *
+ * which can directly be used with the flamegraph.pl tool:
+ *
+ * \code
+ *     flamegraph.pl /tmp/profile.folded > profile.svg
+ * \endcode
+ *
+ * The profiler can be started and stopped by sending a PROFILE message
+ * to a service using the dispatcher (see add_communicator_commands()).
+ * The profile is only saved to a file if the service defined a profile
+ * directory (see set_profile_directory()).
  */
 
 // self
 //
 #include    "eventdispatcher/signal_profiler.h"
 
+#include    "eventdispatcher/callback_context.h"
+#include    "eventdispatcher/communicator.h"
+#include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/utils.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_used.h>
+#include    <snapdev/raii_generic_deleter.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <cerrno>
+#include    <cstring>
+#include    <sstream>
+
 
 // C
 //
-#include    <ucontext.h>
+#include    <cxxabi.h>
+#include    <execinfo.h>
+#include    <fcntl.h>
+#include    <sys/time.h>
+#include    <unistd.h>
 
 
 // last include
@@ -46,81 +99,566 @@
 namespace ed
 {
 
-/** \brief Initialize the profiler signal objects.
+
+
+namespace
+{
+
+
+
+/** \brief The profiler receiving the samples.
+ *
+ * The signal handler uses this pointer to find the ring buffer.
+ */
+std::atomic<signal_profiler *>  g_profiler = nullptr;
+
+
+/** \brief The process profiler.
+ *
+ * The one created by get_instance().
+ */
+signal_profiler::pointer_t      g_instance = signal_profiler::pointer_t();
+
+
+/** \brief The directory where the PROFILE message saves profiles.
+ *
+ * By default this is empty and the PROFILE message does not save the
+ * profile to a file.
+ */
+std::string                     g_profile_directory = std::string();
+
+
+/** \brief Number of frames to skip in each sample.
+ *
+ * The first frames are the signal handler and the signal trampoline.
+ */
+constexpr int const             SKIP_FRAMES = 2;
+
+
+/** \brief Copy a tag in a sample.
+ *
+ * This function is called from the signal handler so it only uses
+ * a plain copy.
+ *
+ * \param[out] tag  The destination buffer.
+ * \param[in] value  The string to copy.
+ */
+void copy_tag(char (&tag)[PROFILER_TAG_SIZE], std::string const * value)
+{
+    std::size_t len(0);
+    if(value != nullptr)
+    {
+        len = std::min(value->length(), PROFILER_TAG_SIZE - 1);
+        memcpy(tag, value->data(), len);
+    }
+    tag[len] = '\0';
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Initialize the profiler.
+ *
+ * The profiler is a timer which gets added to the communicator while
+ * running. It is not started by default.
+ *
+ * \exception invalid_parameter
+ * The ring size must be a power of two.
+ *
+ * \param[in] ring_size  The number of samples the ring buffer can hold.
+ */
+signal_profiler::signal_profiler(std::size_t ring_size)
+    : timer(-1)
+    , f_ring_size(ring_size)
+{
+    if(ring_size < 2
+    || (ring_size & (ring_size - 1)) != 0)
+    {
+        throw invalid_parameter("the signal_profiler ring size must be a power of 2.");
+    }
+
+    set_name("signal_profiler");
+    f_ring = std::make_unique<sample_t[]>(f_ring_size);
+}
+
+
+/** \brief Make sure the profiler is stopped.
+ */
+signal_profiler::~signal_profiler()
+{
+    if(f_running)
+    {
+        try
+        {
+            stop();
+        }
+        catch(...)
+        {
+        }
+    }
+}
+
+
+/** \brief Get the process profiler.
  *
- * This constructor sets up the signal within the event dispatcher
- * environment and then it retrieves the pointer to the gcc SIGPROF
- * function which is used to collect the necessary data.
+ * Only one profiler can run at a time since SIGPROF is process wide.
+ * This function returns the profiler used by the PROFILE message.
  *
- * \todo
- * Make this whole thing work. It is very likely that the stack trace
- * is going to be wrong if the handler doesn't use the newer scheme
- * (i.e. the one where the context gets saved at the time the event
- * occurs and not at the time we're handling it here). At the moment,
- * Linux does it properly, so no worries here. That being said, so
- * far I've not been able to make it work properly.
+ * \return The process profiler.
  */
-signal_profiler::signal_profiler()
-    : signal(SIGPROF)
+signal_profiler::pointer_t signal_profiler::get_instance()
 {
-    // retrieve the handler so we can call it whenever the signal occurs
+    if(g_instance == nullptr)
+    {
+        g_instance = std::make_shared<signal_profiler>();
+    }
+    return g_instance;
+}
+
+
+/** \brief Define the directory where the PROFILE message saves profiles.
+ *
+ * The PROFILE message only accepts a basename. The file gets created
+ * in this directory. By default, no directory is defined and the
+ * PROFILE message does not save the profile to a file.
+ *
+ * The directory should only be writable by the user running the
+ * service.
+ *
+ * \param[in] directory  The directory or an empty string to turn off
+ * saving profiles with the PROFILE message.
+ */
+void signal_profiler::set_profile_directory(std::string const & directory)
+{
+    g_profile_directory = directory;
+    while(g_profile_directory.length() > 1
+       && g_profile_directory.back() == '/')
+    {
+        g_profile_directory.pop_back();
+    }
+}
+
+
+/** \brief Get the directory where the PROFILE message saves profiles.
+ *
+ * \return The directory or an empty string.
+ */
+std::string const & signal_profiler::get_profile_directory()
+{
+    return g_profile_directory;
+}
+
+
+/** \brief Check whether a profiler is currently running.
+ *
+ * The communicator uses this function to ignore EINTR errors from poll().
+ *
+ * \return true if some profiler is running.
+ */
+bool signal_profiler::is_profiling()
+{
+    return g_profiler.load() != nullptr;
+}
+
+
+/** \brief Start profiling.
+ *
+ * The profiler installs its SIGPROF handler, starts the profiling timer
+ * and adds itself to the communicator to collect the samples.
+ *
+ * \exception invalid_parameter
+ * The frequency must be between 1 and 10,000 Hz.
+ *
+ * \param[in] frequency  The number of samples per second of CPU time.
+ * \param[in] duration  The number of microseconds to profile, or 0 to
+ * profile until stop() gets called.
+ * \param[in] filename  The file where the collapsed stacks get saved on
+ * stop(), or an empty string.
+ *
+ * \return true if the profiler started, false if a profiler is already
+ * running.
+ */
+bool signal_profiler::start(
+      std::int64_t frequency
+    , std::int64_t duration
+    , std::string const & filename)
+{
+    if(frequency < 1
+    || frequency > 10'000)
+    {
+        throw invalid_parameter("the signal_profiler frequency must be between 1 and 10000.");
+    }
+
+    signal_profiler * expected(nullptr);
+    if(!g_profiler.compare_exchange_strong(expected, this))
+    {
+        return false;
+    }
+
+    // the first call to backtrace() may load libgcc which allocates
+    // memory; do it now and not in the signal handler
     //
-    sigaction(SIGPROF, nullptr, &f_action);
+    void * preload[1];
+    backtrace(preload, 1);
+
+    for(std::size_t idx(0); idx < f_ring_size; ++idx)
+    {
+        f_ring[idx].f_sequence.store(idx, std::memory_order_relaxed);
+    }
+    f_enqueue.store(0);
+    f_dequeue = 0;
+    f_samples.store(0);
+    f_dropped.store(0);
+    f_stacks.clear();
+    f_filename = filename;
+    f_end_date = duration > 0 ? get_current_date() + duration : 0;
+    f_running = true;
+
+    sigaction_t action = sigaction_t();
+    action.sa_sigaction = sigprof_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &f_previous_action);
+
+    std::int64_t const interval(1'000'000 / frequency);
+    itimerval timer_value = itimerval();
+    timer_value.it_interval.tv_sec = interval / 1'000'000;
+    timer_value.it_interval.tv_usec = interval % 1'000'000;
+    timer_value.it_value = timer_value.it_interval;
+    setitimer(ITIMER_PROF, &timer_value, nullptr);
+
+    set_timeout_delay(1'000'000);
+    communicator::instance()->add_connection(
+                std::static_pointer_cast<signal_profiler>(shared_from_this()));
+
+    return true;
+}
+
+
+/** \brief Stop profiling.
+ *
+ * The profiling timer is stopped, the remaining samples collected and,
+ * if a filename was specified in start(), the collapsed stacks get saved.
+ */
+void signal_profiler::stop()
+{
+    if(!f_running)
+    {
+        return;
+    }
+    f_running = false;
+
+    itimerval timer_value = itimerval();
+    setitimer(ITIMER_PROF, &timer_value, nullptr);
+    sigaction(SIGPROF, &f_previous_action, nullptr);
+    g_profiler.store(nullptr);
+
+    collect();
+
+    if(!f_filename.empty())
+    {
+        write_collapsed_stacks(f_filename);
+    }
+
+    communicator::instance()->remove_connection(shared_from_this());
+}
+
+
+/** \brief Check whether this profiler is running.
+ *
+ * \return true between start() and stop().
+ */
+bool signal_profiler::is_running() const
+{
+    return f_running;
+}
+
+
+/** \brief Get the name of the output file.
+ *
+ * \return The filename passed to start().
+ */
+std::string const & signal_profiler::get_filename() const
+{
+    return f_filename;
+}
+
+
+/** \brief Get the number of samples recorded.
+ *
+ * \return The number of samples saved in the ring buffer.
+ */
+std::uint64_t signal_profiler::get_samples() const
+{
+    return f_samples.load(std::memory_order_relaxed);
+}
+
+
+/** \brief Get the number of samples lost.
+ *
+ * Samples are lost when the ring buffer is full.
+ *
+ * \return The number of samples dropped.
+ */
+std::uint64_t signal_profiler::get_dropped() const
+{
+    return f_dropped.load(std::memory_order_relaxed);
+}
+
+
+/** \brief Collect the samples from the ring buffer.
+ *
+ * This function converts the samples in collapsed stacks and counts
+ * them. It is called once per second while the profiler runs and once
+ * more when it stops.
+ */
+void signal_profiler::collect()
+{
+    for(;;)
+    {
+        sample_t & s(f_ring[f_dequeue & (f_ring_size - 1)]);
+        if(s.f_sequence.load(std::memory_order_acquire) != f_dequeue + 1)
+        {
+            break;
+        }
+
+        std::string stack("[connection:");
+        stack += s.f_connection[0] == '\0' ? "none" : s.f_connection;
+        stack += "];[command:";
+        stack += s.f_command[0] == '\0' ? "none" : s.f_command;
+        stack += ']';
+        for(int idx(s.f_depth - 1); idx >= SKIP_FRAMES; --idx)
+        {
+            stack += ';';
+            stack += symbol(s.f_frames[idx]);
+        }
+        ++f_stacks[stack];
+
+        s.f_sequence.store(f_dequeue + f_ring_size, std::memory_order_release);
+        ++f_dequeue;
+    }
+}
+
+
+/** \brief Get the stacks collected so far.
+ *
+ * \return A map of collapsed stacks with their number of samples.
+ */
+signal_profiler::stacks_t const & signal_profiler::get_stacks() const
+{
+    return f_stacks;
+}
+
+
+/** \brief Generate the collapsed stacks.
+ *
+ * \return The stacks in the collapsed format, one per line.
+ */
+std::string signal_profiler::get_collapsed_stacks() const
+{
+    std::stringstream out;
+    for(auto const & s : f_stacks)
+    {
+        out << s.first << ' ' << s.second << '\n';
+    }
+    return out.str();
 }
 
-void signal_profiler::process_signal()
+
+/** \brief Save the collapsed stacks to a file.
+ *
+ * The file is created with O_EXCL and O_NOFOLLOW and it is only
+ * readable by the owner. An existing file, or a symbolic link, is
+ * never overwritten.
+ *
+ * \param[in] filename  The name of the output file.
+ *
+ * \return true if the file was written.
+ */
+bool signal_profiler::write_collapsed_stacks(std::string const & filename) const
 {
-    if((f_action.sa_flags & SA_SIGINFO) != 0)
+    snapdev::raii_fd_t fd(open(
+              filename.c_str()
+            , O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC
+            , 0600));
+    if(fd == nullptr)
     {
-        if(f_action.sa_handler != SIG_IGN
-        && f_action.sa_handler != SIG_DFL
-        && f_action.sa_handler != nullptr)
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "signal_profiler: could not create \""
+            << filename
+            << "\" to save the profile (errno: "
+            << e
+            << ", "
+            << strerror(e)
+            << ")."
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    std::string const stacks(get_collapsed_stacks());
+    char const * data(stacks.data());
+    std::size_t size(stacks.length());
+    while(size > 0)
+    {
+        ssize_t const r(write(fd.get(), data, size));
+        if(r < 0)
         {
-            (*f_action.sa_handler)(SIGPROF);
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
         }
+        data += r;
+        size -= r;
     }
-    else
+    return true;
+}
+
+
+/** \brief Collect the samples and stop once the duration is reached.
+ */
+void signal_profiler::process_timeout()
+{
+    if(f_end_date != 0
+    && get_current_date() >= f_end_date)
     {
-        if(f_action.sa_sigaction != nullptr)
+        stop();
+        return;
+    }
+
+    collect();
+}
+
+
+/** \brief Save one sample.
+ *
+ * This is the SIGPROF handler. It runs in the thread which was
+ * interrupted so the callback context is the one of that thread.
+ *
+ * The ring buffer uses one sequence number per slot so several threads
+ * can save samples at the same time without a lock.
+ *
+ * \param[in] sig  The signal number (SIGPROF).
+ * \param[in] info  The signal information.
+ * \param[in] context  The interrupted context.
+ */
+void signal_profiler::sigprof_handler(int sig, siginfo_t * info, void * context)
+{
+    snapdev::NOT_USED(sig, info, context);
+
+    signal_profiler * p(g_profiler.load(std::memory_order_acquire));
+    if(p == nullptr)
+    {
+        return;
+    }
+
+    int const saved_errno(errno);
+
+    std::size_t const mask(p->f_ring_size - 1);
+    std::size_t pos(p->f_enqueue.load(std::memory_order_relaxed));
+    sample_t * s(nullptr);
+    for(;;)
+    {
+        s = &p->f_ring[pos & mask];
+        std::size_t const seq(s->f_sequence.load(std::memory_order_acquire));
+        std::intptr_t const diff(static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos));
+        if(diff == 0)
+        {
+            if(p->f_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            // ring is full
+            //
+            p->f_dropped.fetch_add(1, std::memory_order_relaxed);
+            errno = saved_errno;
+            return;
+        }
+        else
+        {
+            pos = p->f_enqueue.load(std::memory_order_relaxed);
+        }
+    }
+
+    s->f_depth = backtrace(s->f_frames, PROFILER_MAX_DEPTH);
+
+    callback_context_t & ctx(get_callback_context());
+    connection * c(ctx.f_connection.load(std::memory_order_relaxed));
+    copy_tag(s->f_connection, c == nullptr ? nullptr : &c->get_name());
+    copy_tag(s->f_command, ctx.f_command.load(std::memory_order_relaxed));
+
+    s->f_sequence.store(pos + 1, std::memory_order_release);
+    p->f_samples.fetch_add(1, std::memory_order_relaxed);
+
+    errno = saved_errno;
+}
+
+
+/** \brief Convert an address to a function name.
+ *
+ * The names are cached since the same addresses appear in most samples.
+ *
+ * \param[in] address  The address of a frame.
+ *
+ * \return The demangled name of the function or the address in hexadecimal.
+ */
+std::string const & signal_profiler::symbol(void * address)
+{
+    auto it(f_symbols.find(address));
+    if(it != f_symbols.end())
+    {
+        return it->second;
+    }
+
+    std::string name;
+    char ** symbols(backtrace_symbols(&address, 1));
+    if(symbols != nullptr)
+    {
+        // format is "binary(mangled+0x12) [0x1234]"
+        //
+        char const * start(strchr(symbols[0], '('));
+        char const * end(start == nullptr ? nullptr : strpbrk(start, "+)"));
+        if(end != nullptr
+        && end > start + 1)
         {
-            signalfd_siginfo const * fdinfo(get_signal_info());
-            siginfo_t info = siginfo_t();
-            info.si_signo       = fdinfo->ssi_signo;
-            info.si_errno       = fdinfo->ssi_errno;
-            info.si_code        = fdinfo->ssi_code;
-            //info.si_trapno      = fdinfo->ssi_trapno; // not defined on all machines
-            info.si_pid         = fdinfo->ssi_pid;
-            info.si_uid         = fdinfo->ssi_uid;
-            info.si_status      = fdinfo->ssi_status;
-            info.si_utime       = fdinfo->ssi_utime;
-            info.si_stime       = fdinfo->ssi_stime;
-            info.si_value.sival_int = 0;
-            info.si_int         = fdinfo->ssi_int;
-            info.si_ptr         = reinterpret_cast<void *>(fdinfo->ssi_ptr);
-            info.si_overrun     = fdinfo->ssi_overrun;
-            info.si_timerid     = 0;
-            info.si_addr        = reinterpret_cast<void *>(fdinfo->ssi_addr);
-            info.si_band        = fdinfo->ssi_band;
-            info.si_fd          = fdinfo->ssi_fd;
-            info.si_addr_lsb    = 0; //fdinfo->ssi_addr_lsb; // not on arch64 and doesn't help at this point
-
-            // the following fields don't exist in 16.04, keep commented until we stop support
-            //info.si_lower       = 0;
-            //info.si_upper       = 0;
-            //info.si_pkey        = 0;
-
-            info.si_call_addr   = 0;
-            info.si_syscall     = 0;
-            info.si_arch        = 0;
-
-            ucontext_t uc;
-            getcontext(&uc);
-
-            (*f_action.sa_sigaction)(SIGPROF, &info, &uc);
+            std::string const mangled(start + 1, end - start - 1);
+            int status(0);
+            char * demangled(abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status));
+            if(status == 0 && demangled != nullptr)
+            {
+                name = demangled;
+            }
+            else
+            {
+                name = mangled;
+            }
+            free(demangled);
         }
+        free(symbols);
+    }
+    if(name.empty())
+    {
+        std::stringstream ss;
+        ss << address;
+        name = ss.str();
     }
+
+    // the collapsed format uses ';' as the frame separator
+    //
+    std::replace(name.begin(), name.end(), ';', ':');
+
+    return f_symbols[address] = name;
 }
 
 
+
 } // namespace ed
 // vim: ts=4 sw=4 et
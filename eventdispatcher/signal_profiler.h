@@ -18,15 +18,31 @@
 #pragma once
 
 /** \file
- * \brief Event dispatch class handling SIGPROF signals.
+ * \brief In-process sampling profiler.
  *
- * A class used to simplify the handling of SIGPROF in an application.
+ * The signal_profiler uses SIGPROF to sample the stack of the threads
+ * consuming CPU. Each sample is tagged with the connection and the
+ * command being processed by the event loop at the time. The result
+ * is saved in the collapsed stack format used by flamegraph tools.
+ *
+ * \note
+ * Up to version 1.x, the signal_profiler derived from ed::signal. Since
+ * version 2.0, it derives from ed::timer and installs its own SIGPROF
+ * handler since an ed::signal blocks the signal and reads it through a
+ * signalfd(), which does not give access to the interrupted thread.
  */
 
 
 // self
 //
-#include    <eventdispatcher/signal.h>
+#include    <eventdispatcher/timer.h>
+
+
+// C++
+//
+#include    <atomic>
+#include    <map>
+#include    <memory>
 
 
 // C
@@ -39,22 +55,79 @@ namespace ed
 {
 
 
+
+constexpr std::int64_t const        DEFAULT_PROFILER_FREQUENCY = 99;            // samples per second
+constexpr std::size_t const         DEFAULT_PROFILER_RING_SIZE = 16'384;        // samples (power of 2)
+constexpr std::size_t const         PROFILER_MAX_DEPTH = 64;                    // frames per sample
+constexpr std::size_t const         PROFILER_TAG_SIZE = 48;                     // characters per tag
+
+
 class signal_profiler
-    : public ed::signal
+    : public timer
 {
 public:
-    typedef struct sigaction    sigaction_t;
-    typedef void                (*sa_sigaction_t)(int, siginfo_t *, void *);
+    typedef std::shared_ptr<signal_profiler>    pointer_t;
+    typedef struct sigaction                    sigaction_t;
+    typedef std::map<std::string, std::uint64_t>
+                                                stacks_t;
 
-                                signal_profiler();
+                                signal_profiler(std::size_t ring_size = DEFAULT_PROFILER_RING_SIZE);
+                                signal_profiler(signal_profiler const &) = delete;
+    virtual                     ~signal_profiler() override;
+
+    signal_profiler &           operator = (signal_profiler const &) = delete;
+
+    static pointer_t            get_instance();
+    static bool                 is_profiling();
+    static void                 set_profile_directory(std::string const & directory);
+    static std::string const &  get_profile_directory();
+
+    bool                        start(
+                                      std::int64_t frequency = DEFAULT_PROFILER_FREQUENCY
+                                    , std::int64_t duration = 0
+                                    , std::string const & filename = std::string());
+    void                        stop();
+    bool                        is_running() const;
+    std::string const &         get_filename() const;
+    std::uint64_t               get_samples() const;
+    std::uint64_t               get_dropped() const;
+    void                        collect();
+    stacks_t const &            get_stacks() const;
+    std::string                 get_collapsed_stacks() const;
+    bool                        write_collapsed_stacks(std::string const & filename) const;
 
     // implementation of ed::connection
-    virtual void                process_signal() override;
+    virtual void                process_timeout() override;
 
 private:
-    sigaction_t                 f_action = sigaction_t();
+    struct sample_t
+    {
+        std::atomic<std::size_t>    f_sequence = 0;
+        int                         f_depth = 0;
+        void *                      f_frames[PROFILER_MAX_DEPTH] = {};
+        char                        f_connection[PROFILER_TAG_SIZE] = {};
+        char                        f_command[PROFILER_TAG_SIZE] = {};
+    };
+
+    static void                 sigprof_handler(int sig, siginfo_t * info, void * context);
+    std::string const &         symbol(void * address);
+
+    std::size_t                 f_ring_size = DEFAULT_PROFILER_RING_SIZE;
+    std::unique_ptr<sample_t[]> f_ring = std::unique_ptr<sample_t[]>();
+    std::atomic<std::size_t>    f_enqueue = 0;
+    std::size_t                 f_dequeue = 0;
+    std::atomic<std::uint64_t>  f_samples = 0;
+    std::atomic<std::uint64_t>  f_dropped = 0;
+    bool                        f_running = false;
+    std::int64_t                f_end_date = 0;
+    std::string                 f_filename = std::string();
+    sigaction_t                 f_previous_action = sigaction_t();
+    stacks_t                    f_stacks = stacks_t();
+    std::map<void *, std::string>
+                                f_symbols = std::map<void *, std::string>();
 };
 
 
+
 } // namespace ed
 // vim: ts=4 sw=4 et
@@ -28,6 +28,11 @@
  * We can make use of a single NETLINK, so we have an internal class which
  * is doing the heavy work. The socket_events connections you create actually
  * listen through that internal class.
+ *
+ * Each poll sends one single dump request for all the addresses we are
+ * still waiting on. That request includes an INET_DIAG_REQ_BYTECODE
+ * program so the kernel only returns the listening sockets matching one
+ * of those addresses instead of the entire table of sockets.
  */
 
 
@@ -65,12 +70,14 @@
 //
 #include    <algorithm>
 #include    <deque>
+#include    <unordered_map>
 
 
 // C
 //
 #include    <linux/inet_diag.h>
 #include    <linux/netlink.h>
+#include    <linux/rtnetlink.h>
 #include    <linux/sock_diag.h>
 
 
@@ -105,12 +112,91 @@ struct socket_evt
 {
     typedef std::shared_ptr<socket_evt>     pointer_t;
     typedef std::deque<pointer_t>           deque_t;
+    typedef std::unordered_map<std::uint64_t, deque_t>
+                                            index_t;
 
     bool                        f_listening = false;
     socket_events *             f_socket_events = nullptr;
+    std::uint64_t               f_key = 0;
 };
 
 
+/** \brief Compute the key used to index the socket_evt objects.
+ *
+ * The socket_listener indexes its socket_evt objects by IPv4 address and
+ * port so the sockets returned by the kernel can be matched in O(1). Both
+ * parameters are expected in network byte order, which is what the
+ * inet_diag_msg structure uses.
+ *
+ * \param[in] address  The IPv4 address in network byte order.
+ * \param[in] port  The port in network byte order.
+ *
+ * \return The key to use with the socket_evt::index_t map.
+ */
+std::uint64_t index_key(std::uint32_t address, std::uint16_t port)
+{
+    return (static_cast<std::uint64_t>(address) << 16) | port;
+}
+
+
+/** \brief Generate the bytecode filtering the listening sockets.
+ *
+ * The kernel runs this program against each socket. The program is a
+ * list of blocks, one per address, each one composed of an
+ * INET_DIAG_BC_S_COND checking the source address and port followed by
+ * an INET_DIAG_BC_JMP to the end of the program. The kernel accepts
+ * the socket when the program ends exactly at its last byte. When the
+ * condition fails, we skip the JMP and try the next block. The last
+ * condition jumps 4 bytes past the end, which means "reject".
+ *
+ * The jump offsets are 16 bit numbers so the number of addresses is
+ * limited (see socket_listener::MAX_BYTECODE_ADDRESSES).
+ *
+ * \param[in] addresses  The list of addresses to accept.
+ *
+ * \return The bytecode to attach to the INET_DIAG_REQ_BYTECODE attribute.
+ */
+std::vector<std::uint8_t> listen_bytecode(std::vector<sockaddr_in> const & addresses)
+{
+    std::size_t const cond_size(sizeof(inet_diag_bc_op) + sizeof(inet_diag_hostcond) + sizeof(std::uint32_t));
+    std::size_t const block_size(cond_size + sizeof(inet_diag_bc_op));
+
+    std::vector<std::uint8_t> bytecode(addresses.size() * block_size);
+    std::uint8_t * ptr(bytecode.data());
+    std::size_t remaining(bytecode.size());
+    for(auto const & in : addresses)
+    {
+        inet_diag_bc_op cond = {};
+        cond.code = INET_DIAG_BC_S_COND;
+        cond.yes = static_cast<std::uint8_t>(cond_size);
+        cond.no = static_cast<std::uint16_t>(remaining == block_size ? remaining + 4 : block_size);
+        memcpy(ptr, &cond, sizeof(cond));
+        ptr += sizeof(cond);
+
+        inet_diag_hostcond host = {};
+        host.family = AF_INET;
+        host.prefix_len = 32;
+        host.port = ntohs(in.sin_port);
+        memcpy(ptr, &host, sizeof(host));
+        ptr += sizeof(host);
+
+        memcpy(ptr, &in.sin_addr.s_addr, sizeof(std::uint32_t));
+        ptr += sizeof(std::uint32_t);
+
+        inet_diag_bc_op jump = {};
+        jump.code = INET_DIAG_BC_JMP;
+        jump.yes = static_cast<std::uint8_t>(sizeof(inet_diag_bc_op));
+        jump.no = static_cast<std::uint16_t>(remaining - cond_size);
+        memcpy(ptr, &jump, sizeof(jump));
+        ptr += sizeof(jump);
+
+        remaining -= block_size;
+    }
+
+    return bytecode;
+}
+
+
 
 
 /** \brief Internal class used to handle the NETLINK socket.
@@ -129,6 +215,7 @@ public:
 
     static constexpr std::size_t const  RECEIVE_BUFFER_SIZE = 1'000 * (sizeof(nlmsghdr) + sizeof(inet_diag_msg));
     static constexpr int                TCP_LISTEN_STATE = 10;
+    static constexpr std::size_t const  MAX_BYTECODE_ADDRESSES = 1'000;
 
                                 socket_listener(cppthread::mutex & socket_mutex);
     virtual                     ~socket_listener();
@@ -154,6 +241,7 @@ private:
     cppthread::mutex &          f_socket_mutex;
     snapdev::raii_fd_t          f_netlink_socket = snapdev::raii_fd_t();
     socket_evt::deque_t         f_socket_events = socket_evt::deque_t();
+    socket_evt::index_t         f_index = socket_evt::index_t();
 };
 
 
@@ -291,12 +379,17 @@ void socket_listener::add_socket_events(socket_events * evts)
         throw invalid_parameter("at this time, the socket listener is limited to IPv4 addresses.");
     }
 
+    sockaddr_in in = {};
+    evts->get_addr().get_ipv4(in);
+
     cppthread::guard g(f_socket_mutex);
 
     socket_evt::pointer_t evt(std::make_shared<socket_evt>());
     evt->f_socket_events = evts;
+    evt->f_key = index_key(in.sin_addr.s_addr, in.sin_port);
 
     f_socket_events.push_back(evt);
+    f_index[evt->f_key].push_back(evt);
 
     set_enable(true);
 }
@@ -356,6 +449,20 @@ void socket_listener::remove_socket_events(socket_events * evts)
             }));
     if(it != f_socket_events.end())
     {
+        auto entry(f_index.find((*it)->f_key));
+        if(entry != f_index.end())
+        {
+            entry->second.erase(std::remove(
+                      entry->second.begin()
+                    , entry->second.end()
+                    , *it)
+                , entry->second.end());
+            if(entry->second.empty())
+            {
+                f_index.erase(entry);
+            }
+        }
+
         f_socket_events.erase(it);
 
         if(f_socket_events.empty())
@@ -452,9 +559,9 @@ void socket_listener::process_timeout()
  * This function reads those messages one by one and processes them.
  *
  * The event of interest is SOCK_DIAG_BY_FAMILY. This includes an IP address
- * and a port which are checked against the IP address and port of each of
- * the socket_events object. If there is a match, then the
- * socket_events::process_listening() function gets called.
+ * and a port which are used to search the socket_events objects in our
+ * index. If there is a match, then the socket_events::process_listening()
+ * function gets called.
  *
  * The function returns once it receives the NLMSG_DONE message or the last
  * recvmsg() call returns 0, and of course on errors.
@@ -483,6 +590,12 @@ void socket_listener::process_read()
         if(size < 0)
         {
             int const e(errno);
+            if(e == EAGAIN)
+            {
+                // the rest of the dump is not available yet
+                //
+                return;
+            }
             SNAP_LOG_ERROR
                 << "recvmsg() returned with an error: "
                 << e
@@ -550,31 +663,25 @@ void socket_listener::process_read()
                     inet_diag_msg const * diag(reinterpret_cast<inet_diag_msg const *>(NLMSG_DATA(h)));
                     if(diag->idiag_state == TCP_LISTEN_STATE)
                     {
-                        // got a listen(), look for which connection this is
-                        // and mark it as valid (open/listening)
+                        // got a listen(), look for which connections this
+                        // is and mark them as valid (open/listening)
                         //
-                        for(auto it : f_socket_events)
+                        cppthread::guard g(f_socket_mutex);
+
+                        auto const entry(f_index.find(index_key(
+                                              diag->id.idiag_src[0]
+                                            , diag->id.idiag_sport)));
+                        if(entry != f_index.end())
                         {
-                            if(!it->f_listening)
+                            // the callbacks may remove entries
+                            //
+                            socket_evt::deque_t const evts(entry->second);
+                            for(auto it : evts)
                             {
-                                addr::addr a(it->f_socket_events->get_addr());
-                                if(a.get_port() == diag->id.idiag_sport)
+                                if(!it->f_listening)
                                 {
-                                    sockaddr_in in = {};
-                                    a.get_ipv4(in);
-                                    if(in.sin_addr.s_addr == diag->id.idiag_src[0])
-                                    {
-                                        // got it!
-                                        //
-                                        it->f_socket_events->process_listening();
-                                        it->f_listening = true;
-
-                                        // TBD: if we add two connections with the same IP:port combo,
-                                        //      we get two separate socket_events but I do not know
-                                        //      whether we'll get one or two replies... so at this
-                                        //      time do not break this loop
-                                        //break;
-                                    }
+                                    it->f_listening = true;
+                                    it->f_socket_events->process_listening();
                                 }
                             }
                         }
@@ -595,19 +702,52 @@ void socket_listener::process_read()
 }
 
 
+/** \brief Send the request for the sockets we are waiting on.
+ *
+ * This function sends one single SOCK_DIAG_BY_FAMILY dump request
+ * covering all the addresses which are not yet listening. The kernel
+ * filters the sockets by state (LISTEN only) and by running the bytecode
+ * generated by listen_bytecode() so only the sockets of interest are
+ * returned.
+ *
+ * When more than MAX_BYTECODE_ADDRESSES distinct addresses are being
+ * watched, the bytecode would overflow its jump offsets. In that case, the
+ * request only filters by state and the index is used to ignore the
+ * other listening sockets.
+ */
 void socket_listener::process_write()
 {
     cppthread::guard g(f_socket_mutex);
 
-    // count the number of requests we have to send
+    // gather the distinct addresses still to be checked
     //
-    int const count(std::count_if(
-              f_socket_events.begin()
-            , f_socket_events.end()
-            , [](auto const & evt)
-            {
-                return !evt->f_listening;
-            }));
+    std::vector<sockaddr_in> addresses;
+    for(auto const & entry : f_index)
+    {
+        auto const waiting(std::find_if(
+                  entry.second.begin()
+                , entry.second.end()
+                , [](auto const & evt)
+                {
+                    return !evt->f_listening;
+                }));
+        if(waiting != entry.second.end())
+        {
+            sockaddr_in in = {};
+            (*waiting)->f_socket_events->get_addr().get_ipv4(in);
+            addresses.push_back(in);
+        }
+    }
+    if(addresses.empty())
+    {
+        return;
+    }
+
+    std::vector<std::uint8_t> bytecode;
+    if(addresses.size() <= MAX_BYTECODE_ADDRESSES)
+    {
+        bytecode = listen_bytecode(addresses);
+    }
 
     struct nl_request
     {
@@ -615,52 +755,33 @@ void socket_listener::process_write()
         struct inet_diag_req_v2 f_inet;
     };
 
-    // preallocation means that the pointers won't change
-    // which is important here
-    //
-    std::vector<nl_request> req(count);
-    std::vector<iovec> vec(count);
-
-    int idx(0);
-    for(auto it : f_socket_events)
+    nl_request req = {};
+    req.f_nlh.nlmsg_len = sizeof(nl_request);
+    req.f_nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    req.f_nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.f_inet.sdiag_family = AF_INET;
+    req.f_inet.sdiag_protocol = IPPROTO_TCP;
+    req.f_inet.idiag_states = 1 << TCP_LISTEN_STATE;
+    req.f_inet.id.idiag_cookie[0] = INET_DIAG_NOCOOKIE;
+    req.f_inet.id.idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+
+    rtattr attr = {};
+    attr.rta_type = INET_DIAG_REQ_BYTECODE;
+    attr.rta_len = static_cast<std::uint16_t>(RTA_LENGTH(bytecode.size()));
+
+    iovec vec[3] = {};
+    vec[0].iov_base = &req;
+    vec[0].iov_len = sizeof(req);
+    int count(1);
+    if(!bytecode.empty())
     {
-        if(!it->f_listening)
-        {
-            addr::addr const & a(it->f_socket_events->get_addr());
+        req.f_nlh.nlmsg_len += RTA_ALIGN(attr.rta_len);
 
-            sockaddr_in in = {};
-            a.get_ipv4(in);
-
-            req[idx].f_nlh.nlmsg_len = sizeof(nl_request);
-            req[idx].f_nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
-            req[idx].f_nlh.nlmsg_flags = NLM_F_REQUEST;
-            req[idx].f_inet.sdiag_family = AF_INET;
-            req[idx].f_inet.sdiag_protocol = IPPROTO_TCP;
-            req[idx].f_inet.idiag_ext = 0;
-            req[idx].f_inet.pad = 0;
-            req[idx].f_inet.idiag_states = 0;
-            req[idx].f_inet.id.idiag_sport = in.sin_port;
-            req[idx].f_inet.id.idiag_dport = 0;
-            req[idx].f_inet.id.idiag_src[0] = in.sin_addr.s_addr;
-            req[idx].f_inet.id.idiag_dst[0] = 0;
-            req[idx].f_inet.id.idiag_if = 0;
-            req[idx].f_inet.id.idiag_cookie[0] = INET_DIAG_NOCOOKIE;
-            req[idx].f_inet.id.idiag_cookie[1] = INET_DIAG_NOCOOKIE;
-
-            vec[idx].iov_base = &req[idx];
-            vec[idx].iov_len = sizeof(nl_request);
-
-            ++idx;
-        }
-    }
-    if(idx != count)
-    {
-        throw implementation_error(
-                  "somehow the number of requests counted ("
-                + std::to_string(count)
-                + ") did not match the number of requests created ("
-                + std::to_string(idx)
-                + ").");
+        vec[1].iov_base = &attr;
+        vec[1].iov_len = sizeof(attr);
+        vec[2].iov_base = bytecode.data();
+        vec[2].iov_len = bytecode.size();
+        count = 3;
     }
 
     sockaddr_nl nladdr = {};
@@ -671,7 +792,7 @@ void socket_listener::process_write()
 
     msg.msg_name = &nladdr;
     msg.msg_namelen = sizeof(nladdr);
-    msg.msg_iov = vec.data();
+    msg.msg_iov = vec;
     msg.msg_iovlen = count;
 
     int const r(sendmsg(f_netlink_socket.get(), &msg, 0));
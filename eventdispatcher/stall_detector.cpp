@@ -0,0 +1,505 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the stall detector.
+ *
+ * The loop thread only saves a timestamp, a connection pointer and a
+ * command pointer in its callback context (see callback_context.h) on
+ * each callback. The monitor thread reads that context.
+ *
+ * The monitor thread wakes up a few times per threshold period and
+ * compares the current date with the start date of the current callback.
+ * When the callback runs for too long, it sends a signal to the loop
+ * thread. The signal is caught by the signal_handler which calls our
+ * callback in the context of the loop thread. This is what allows us to
+ * capture the stack of the stalled callback and to safely read the name
+ * of the connection since the connection cannot be destroyed while its
+ * callback is running.
+ *
+ * The signal callback only does async-signal-safe work: it saves the raw
+ * frames with backtrace() and copies the names in preallocated buffers,
+ * then sets an atomic flag. The monitor thread converts the frames to
+ * symbols and calls process_stall().
+ *
+ * \code
+ *     ed::stall_detector::pointer_t detector(std::make_shared<ed::stall_detector>(300'000));
+ *     detector->start();      // must be called from the loop thread
+ *     ed::communicator::instance()->run();
+ * \endcode
+ *
+ * \warning
+ * The signal may interrupt a blocking system call made by the stalled
+ * callback which then returns EINTR. Callbacks should not block anyway.
+ */
+
+// self
+//
+#include    "eventdispatcher/stall_detector.h"
+
+#include    "eventdispatcher/connection.h"
+#include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/utils.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_used.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <cerrno>
+#include    <cstring>
+
+
+// C
+//
+#include    <execinfo.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ed
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The stall detector of the current thread.
+ *
+ * Only the thread which called start() has this pointer set. It is used
+ * to know whether an EINTR was caused by our signal.
+ */
+thread_local stall_detector *   g_current_detector = nullptr;
+
+
+/** \brief Copy a name in a fixed buffer.
+ *
+ * This function is called from the signal handler so it cannot allocate
+ * memory. Names which are too long get truncated.
+ *
+ * \param[out] tag  The destination buffer.
+ * \param[in] value  The string to copy.
+ */
+void copy_tag(char (&tag)[STALL_TAG_SIZE], std::string const * value)
+{
+    std::size_t len(0);
+    if(value != nullptr)
+    {
+        len = std::min(value->length(), STALL_TAG_SIZE - 1);
+        memcpy(tag, value->data(), len);
+    }
+    tag[len] = '\0';
+}
+
+
+
+} // no name namespace
+
+
+
+class stall_detector::monitor
+    : public cppthread::runner
+{
+public:
+    monitor(stall_detector * detector)
+        : runner("stall_detector")
+        , f_detector(detector)
+    {
+    }
+
+    monitor(monitor const &) = delete;
+    monitor & operator = (monitor const &) = delete;
+
+    virtual void run() override
+    {
+        while(continue_running())
+        {
+            // wake up often enough to catch a stall at about the
+            // threshold without spending time when all is well
+            //
+            std::int64_t const threshold(f_detector->get_threshold());
+            usleep(std::clamp(threshold / 4, static_cast<std::int64_t>(1'000), static_cast<std::int64_t>(50'000)));
+
+            f_detector->check_stall();
+        }
+    }
+
+private:
+    stall_detector *    f_detector = nullptr;
+};
+
+
+
+/** \brief Initialize a stall detector.
+ *
+ * \param[in] threshold  The number of microseconds a callback can run
+ * before it is considered stalled.
+ * \param[in] sig  The signal used to interrupt the loop thread.
+ * \param[in] callback_id  The identifier used with the signal_handler.
+ */
+stall_detector::stall_detector(
+          std::int64_t threshold
+        , int sig
+        , signal_handler::callback_id_t callback_id)
+    : f_signal(sig)
+    , f_callback_id(callback_id)
+{
+    set_threshold(threshold);
+}
+
+
+/** \brief Stop the monitor thread.
+ */
+stall_detector::~stall_detector()
+{
+    try
+    {
+        stop();
+    }
+    catch(...)
+    {
+    }
+}
+
+
+/** \brief Start monitoring the current thread.
+ *
+ * This function must be called from the thread running the
+ * communicator::run() loop. It installs the signal callback and starts
+ * the monitor thread.
+ *
+ * \exception implementation_error
+ * Another stall detector is already monitoring this thread.
+ */
+void stall_detector::start()
+{
+    if(f_thread != nullptr)
+    {
+        return;
+    }
+    if(g_current_detector != nullptr)
+    {
+        throw implementation_error("another stall_detector is already running in this thread.");
+    }
+
+    f_loop_thread = pthread_self();
+    f_context = &get_callback_context();
+    f_reported_date = 0;
+    f_pending.store(false);
+    f_captured.store(false);
+
+    // the first call to backtrace() may load libgcc which allocates
+    // memory; do it now and not in the signal handler
+    //
+    void * preload[1];
+    backtrace(preload, 1);
+
+    signal_handler::pointer_t sh(signal_handler::get_instance());
+    f_added_signals = sh->add_terminal_signals(1UL << f_signal);
+    sh->add_callback(
+              f_callback_id
+            , f_signal
+            , [this](
+                      signal_handler::callback_id_t callback_id
+                    , int callback_sig
+                    , siginfo_t const * info
+                    , ucontext_t const * ucontext)
+            {
+                snapdev::NOT_USED(callback_id, info, ucontext);
+                return signal_received(callback_sig);
+            });
+
+    g_current_detector = this;
+
+    f_monitor = std::make_shared<monitor>(this);
+    f_thread = std::make_shared<cppthread::thread>("stall_detector", f_monitor);
+    f_thread->start();
+}
+
+
+/** \brief Stop monitoring.
+ *
+ * This function must be called from the loop thread.
+ */
+void stall_detector::stop()
+{
+    if(f_thread == nullptr)
+    {
+        return;
+    }
+
+    f_thread->stop();
+    f_thread.reset();
+    f_monitor.reset();
+
+    // the monitor may have stopped before it processed the last capture
+    //
+    report_stall();
+
+    if(g_current_detector == this)
+    {
+        g_current_detector = nullptr;
+    }
+
+    signal_handler::pointer_t sh(signal_handler::get_instance());
+    sh->remove_callback(f_callback_id);
+    sh->remove_signals(f_added_signals);
+    f_added_signals = 0;
+}
+
+
+/** \brief Check whether the monitor is running.
+ *
+ * \return true between calls to start() and stop().
+ */
+bool stall_detector::is_running() const
+{
+    return f_thread != nullptr;
+}
+
+
+/** \brief Get the stall threshold.
+ *
+ * \return The threshold in microseconds.
+ */
+std::int64_t stall_detector::get_threshold() const
+{
+    return f_threshold;
+}
+
+
+/** \brief Change the stall threshold.
+ *
+ * \exception invalid_parameter
+ * The threshold must be at least 1ms.
+ *
+ * \param[in] threshold  The new threshold in microseconds.
+ */
+void stall_detector::set_threshold(std::int64_t threshold)
+{
+    if(threshold < 1'000)
+    {
+        throw invalid_parameter("the stall_detector threshold must be at least 1ms.");
+    }
+    f_threshold = threshold;
+}
+
+
+/** \brief Get the signal used to interrupt the loop thread.
+ *
+ * \return The signal number.
+ */
+int stall_detector::get_signal() const
+{
+    return f_signal;
+}
+
+
+/** \brief Get the number of stalls detected so far.
+ *
+ * \return The number of stalls.
+ */
+std::uint64_t stall_detector::get_stall_count() const
+{
+    return f_stall_count.load(std::memory_order_relaxed);
+}
+
+
+/** \brief Check whether the stall signal interrupted a system call.
+ *
+ * If the signal arrives just after the callback returned, it may
+ * interrupt the poll() of the communicator::run() loop. The loop calls
+ * this function to know whether it can ignore that EINTR error.
+ *
+ * \return true once after the stall detector signal was received.
+ */
+bool stall_detector::interrupted()
+{
+    return g_current_detector != nullptr
+        && g_current_detector->f_interrupted.exchange(false);
+}
+
+
+/** \brief Report a stall.
+ *
+ * The default implementation logs the report as a warning. It runs
+ * in the monitor thread (or in the thread calling stop() for the last
+ * report) so it must not access the loop thread data without locking.
+ *
+ * \param[in] report  The details about the stall.
+ */
+void stall_detector::process_stall(stall_report_t const & report)
+{
+    SNAP_LOG_WARNING
+        << "stall_detector: callback of connection \""
+        << report.f_connection_name
+        << "\""
+        << (report.f_command.empty() ? std::string() : " dispatching \"" + report.f_command + "\"")
+        << " running for "
+        << report.f_duration
+        << "us."
+        << SNAP_LOG_SEND;
+
+    for(auto const & stack_line : report.f_stack_trace)
+    {
+        SNAP_LOG_WARNING
+            << "stall_detector: backtrace="
+            << stack_line
+            << SNAP_LOG_SEND;
+    }
+}
+
+
+/** \brief Check whether the current callback stalls the loop.
+ *
+ * This function runs in the monitor thread. It first reports the stall
+ * captured by the signal handler, if any. Then it checks the current
+ * callback. Each stall is reported once.
+ *
+ * A new signal is not sent while the previous one was not yet handled
+ * or its capture not yet reported since the signal handler reuses the
+ * same buffers.
+ */
+void stall_detector::check_stall()
+{
+    report_stall();
+
+    if(f_pending.load()
+    || f_captured.load())
+    {
+        return;
+    }
+
+    std::int64_t const start_date(f_context->f_start_date.load(std::memory_order_acquire));
+    if(start_date == 0
+    || start_date == f_reported_date
+    || get_current_date() - start_date < f_threshold)
+    {
+        return;
+    }
+
+    f_reported_date = start_date;
+    f_stall_count.fetch_add(1, std::memory_order_relaxed);
+    f_pending.store(true);
+    pthread_kill(f_loop_thread, f_signal);
+}
+
+
+/** \brief Build the report of a captured stall and process it.
+ *
+ * This function converts the frames saved by the signal handler to
+ * symbols and calls process_stall(). It does nothing if no capture is
+ * waiting.
+ */
+void stall_detector::report_stall()
+{
+    if(!f_captured.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    stall_report_t report;
+    report.f_connection_name = f_connection_name;
+    report.f_command = f_command;
+    report.f_duration = f_duration;
+    char ** symbols(backtrace_symbols(f_frames, f_depth));
+    if(symbols != nullptr)
+    {
+        for(int idx(0); idx < f_depth; ++idx)
+        {
+            report.f_stack_trace.push_back(symbols[idx]);
+        }
+        free(symbols);
+    }
+
+    f_captured.store(false, std::memory_order_release);
+
+    process_stall(report);
+}
+
+
+/** \brief Handle the signal in the loop thread.
+ *
+ * This function runs from within a signal handler so it only does
+ * async-signal-safe work: it saves the frames and copies the names
+ * in preallocated buffers and sets the f_captured flag. The monitor
+ * thread does the rest.
+ *
+ * A signal which was not sent by our monitor thread is ignored.
+ *
+ * \param[in] sig  The signal received.
+ *
+ * \return Always true, the signal must not terminate the process.
+ */
+bool stall_detector::signal_received(int sig)
+{
+    if(sig != f_signal
+    || pthread_self() != f_loop_thread
+    || !f_pending.load())
+    {
+        return true;
+    }
+
+    int const saved_errno(errno);
+
+    std::int64_t const start_date(f_context->f_start_date.load(std::memory_order_acquire));
+    if(start_date == 0)
+    {
+        // the callback returned in between, we may have interrupted
+        // the poll() instead
+        //
+        f_interrupted.store(true);
+        f_pending.store(false);
+        errno = saved_errno;
+        return true;
+    }
+
+    f_duration = get_current_date() - start_date;
+    connection * c(f_context->f_connection.load(std::memory_order_relaxed));
+    copy_tag(f_connection_name, c == nullptr ? nullptr : &c->get_name());
+    copy_tag(f_command, f_context->f_command.load(std::memory_order_relaxed));
+    f_depth = backtrace(f_frames, STALL_MAX_DEPTH);
+
+    f_captured.store(true, std::memory_order_release);
+    f_pending.store(false);
+
+    errno = saved_errno;
+    return true;
+}
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
@@ -0,0 +1,139 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Detect callbacks which stall the event loop.
+ *
+ * The stall detector runs a small monitor thread which checks how long
+ * the current callback of the communicator::run() loop has been running.
+ * When that duration goes over a threshold, the loop thread is sent a
+ * signal and a report with the name of the connection, the command being
+ * dispatched and a stack trace gets generated.
+ *
+ * The signal handler only captures raw data in preallocated buffers. The
+ * report is built and processed in the monitor thread.
+ */
+
+// self
+//
+#include    <eventdispatcher/callback_context.h>
+#include    <eventdispatcher/signal_handler.h>
+
+
+// cppthread
+//
+#include    <cppthread/runner.h>
+#include    <cppthread/thread.h>
+
+
+// libexcept
+//
+#include    <libexcept/stack_trace.h>
+
+
+// C++
+//
+#include    <atomic>
+#include    <string>
+
+
+// C
+//
+#include    <pthread.h>
+
+
+
+namespace ed
+{
+
+
+
+constexpr std::int64_t const        DEFAULT_STALL_THRESHOLD = 100'000;     // 100ms in microseconds
+constexpr signal_handler::callback_id_t const
+                                    STALL_DETECTOR_CALLBACK_ID = 0x5354414C; // "STAL"
+constexpr std::size_t const         STALL_MAX_DEPTH = 64;                   // frames
+constexpr std::size_t const         STALL_TAG_SIZE = 128;                   // characters per name
+
+
+struct stall_report_t
+{
+    std::string                     f_connection_name = std::string();
+    std::string                     f_command = std::string();
+    std::int64_t                    f_duration = 0;     // in microseconds
+    libexcept::stack_trace_t        f_stack_trace = libexcept::stack_trace_t();
+};
+
+
+class stall_detector
+{
+public:
+    typedef std::shared_ptr<stall_detector>     pointer_t;
+
+                                    stall_detector(
+                                          std::int64_t threshold = DEFAULT_STALL_THRESHOLD
+                                        , int sig = SIGUSR2
+                                        , signal_handler::callback_id_t callback_id = STALL_DETECTOR_CALLBACK_ID);
+                                    stall_detector(stall_detector const &) = delete;
+    virtual                         ~stall_detector();
+
+    stall_detector &                operator = (stall_detector const &) = delete;
+
+    void                            start();
+    void                            stop();
+    bool                            is_running() const;
+    std::int64_t                    get_threshold() const;
+    void                            set_threshold(std::int64_t threshold);
+    int                             get_signal() const;
+    std::uint64_t                   get_stall_count() const;
+
+    static bool                     interrupted();
+
+    virtual void                    process_stall(stall_report_t const & report);
+
+private:
+    class monitor;
+
+    void                            check_stall();
+    void                            report_stall();
+    bool                            signal_received(int sig);
+
+    std::int64_t                    f_threshold = DEFAULT_STALL_THRESHOLD;
+    int                             f_signal = SIGUSR2;
+    signal_handler::callback_id_t   f_callback_id = STALL_DETECTOR_CALLBACK_ID;
+    signal_handler::signal_mask_t   f_added_signals = 0;
+    pthread_t                       f_loop_thread = pthread_t();
+    callback_context_t *            f_context = nullptr;
+    std::atomic<bool>               f_pending = false;
+    std::atomic<bool>               f_captured = false;
+    std::atomic<bool>               f_interrupted = false;
+    void *                          f_frames[STALL_MAX_DEPTH] = {};
+    int                             f_depth = 0;
+    char                            f_connection_name[STALL_TAG_SIZE] = {};
+    char                            f_command[STALL_TAG_SIZE] = {};
+    std::int64_t                    f_duration = 0;
+    std::atomic<std::uint64_t>      f_stall_count = 0;
+    std::int64_t                    f_reported_date = 0;
+    std::shared_ptr<monitor>        f_monitor = std::shared_ptr<monitor>();
+    cppthread::thread::pointer_t    f_thread = cppthread::thread::pointer_t();
+};
+
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
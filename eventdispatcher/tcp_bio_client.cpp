@@ -42,6 +42,7 @@
 // snapdev
 //
 #include    <snapdev/not_reached.h>
+#include    <snapdev/not_used.h>
 
 
 // OpenSSL
@@ -53,6 +54,7 @@
 
 // C
 //
+#include    <fcntl.h>
 #include    <netdb.h>
 #include    <arpa/inet.h>
 
@@ -290,12 +292,249 @@ void ssl_trace(
 
 
 
+namespace
+{
+
+
+
+/** \brief Create the SSL context used by a client connection.
+ *
+ * This function allocates and initializes an SSL_CTX object as expected
+ * by a client connection with the specified \p mode and options.
+ *
+ * \exception initialization_error
+ * This exception is raised if the context cannot be allocated or the
+ * verification certificates cannot be loaded.
+ *
+ * \param[in] mode  The security mode (MODE_SECURE or MODE_ALWAYS_SECURE).
+ * \param[in] opt  Additional options.
+ *
+ * \return A shared pointer to the new SSL context.
+ */
+std::shared_ptr<SSL_CTX> create_client_ssl_ctx(mode_t mode, tcp_bio_options const & opt)
+{
+    // Use TLS v1 only as all versions of SSL are flawed...
+    // (see below the SSL_CTX_set_options() for additional details
+    // about that since here it does indeed say SSLv23...)
+    //
+    std::shared_ptr<SSL_CTX> ssl_ctx; // use a reset(), see SNAP-507
+    ssl_ctx.reset(SSL_CTX_new(SSLv23_client_method()), detail::ssl_ctx_deleter);
+    if(ssl_ctx == nullptr)
+    {
+        detail::bio_log_errors();
+        throw initialization_error("failed creating an SSL_CTX object");
+    }
+
+    // allow up to `depth` certificates in the chain otherwise fail
+    // (this is not a very strong security feature though); the depth
+    // can be changed before calling this function using a
+    // tcp_bio_options object
+    //
+    SSL_CTX_set_verify_depth(ssl_ctx.get(), opt.get_verification_depth());
+
+    // make sure SSL v2/3 is not used, also compression in SSL is
+    // known to have security issues
+    //
+    SSL_CTX_set_options(ssl_ctx.get(), opt.get_ssl_options());
+
+    // limit the number of ciphers the connection can use
+    if(mode == mode_t::MODE_SECURE)
+    {
+        // this is used by local connections and we get a very strong
+        // algorithm anyway, but at this point I do not know why it
+        // does not work with the limited list below...
+        //
+        // TODO: test with adding DH support in the server then
+        //       maybe (probably) that the "HIGH" will work for
+        //       this entry too...
+        //
+        SSL_CTX_set_cipher_list(ssl_ctx.get(), "ALL");
+    }
+    else
+    {
+        SSL_CTX_set_cipher_list(ssl_ctx.get(), "HIGH:!aNULL:!kRSA:!PSK:!SRP:!MD5:!RC4");
+    }
+
+    // load root certificates (correct path for Ubuntu?)
+    // TODO: allow client to set the path to certificates
+    if(SSL_CTX_load_verify_locations(ssl_ctx.get(), nullptr, "/etc/ssl/certs") != 1)
+    {
+        detail::bio_log_errors();
+        throw initialization_error("failed loading verification certificates in an SSL_CTX object");
+    }
 
+    return ssl_ctx;
+}
 
 
+/** \brief Setup the Server Name Indication (SNI).
+ *
+ * If the options request the use of the SNI, then the name of the host
+ * is saved in the SSL Hello message. The host is taken from the options
+ * or from the \p address when it was specified as a hostname.
+ *
+ * \param[in] ssl  The SSL object to setup.
+ * \param[in] address  The address of the server.
+ * \param[in] opt  Additional options.
+ *
+ * \return true if the SNI was set, false otherwise.
+ */
+bool setup_sni(SSL * ssl, addr::addr const & address, tcp_bio_options const & opt)
+{
+    if(opt.get_sni())
+    {
+        std::string host(opt.get_host());
+        if(host.empty()
+        && !address.is_hostname_an_ip())
+        {
+            // addr is not an IP address written as is,
+            // it must be a hostname
+            //
+            host = address.get_hostname();
+        }
+        if(!host.empty())
+        {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+            // not only old style cast (but it's C, so expected)
+            // but they want a non-constant pointer!?
+            //
+            SSL_set_tlsext_host_name(ssl, const_cast<char *>(host.c_str()));
+#pragma GCC diagnostic pop
+            return true;
+        }
+    }
 
+    return false;
+}
 
 
+/** \brief Warn about the SNI being turned off.
+ *
+ * Many failures to connect with SSL happen because the SNI is missing.
+ * This function emits a warning when that feature was not used.
+ *
+ * \param[in] using_sni  Whether the SNI was set.
+ */
+void sni_warning(bool using_sni)
+{
+    if(!using_sni)
+    {
+        SNAP_LOG_WARNING
+            << "the SNI feature is turned off,"
+               " often failure to connect with SSL is because the"
+               " SSL Hello message is missing the SNI (Server Name In)."
+               " See the tcp_bio_options::set_sni()."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
+/** \brief Verify the certificate presented by the peer.
+ *
+ * This function makes sure that the peer presented a certificate and
+ * that this certificate was signed by a recognized root authority.
+ *
+ * \exception initialization_error
+ * This exception is raised if the certificate is missing or, in
+ * MODE_ALWAYS_SECURE, if it cannot be verified.
+ *
+ * \param[in] ssl  The SSL object of the connection once the handshake
+ * succeeded.
+ * \param[in] mode  The security mode.
+ */
+void verify_peer(SSL * ssl, mode_t mode)
+{
+    // verify that the peer certificate was signed by a
+    // recognized root authority
+    //
+    if(SSL_get_peer_certificate(ssl) == nullptr)
+    {
+        detail::bio_log_errors();
+        throw initialization_error("peer failed presenting a certificate for security verification");
+    }
+
+    // XXX: check that the call below is similar to the example
+    //      usage of SSL_CTX_set_verify() which checks the name
+    //      of the certificate, etc.
+    //
+    if(SSL_get_verify_result(ssl) != X509_V_OK)
+    {
+        if(mode != mode_t::MODE_SECURE)
+        {
+            detail::bio_log_errors();
+            throw initialization_error("peer certificate could not be verified");
+        }
+        SNAP_LOG_WARNING
+            << "connecting with SSL but certificate verification failed."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
+/** \brief Log the cipher used by the secure connection.
+ *
+ * \param[in] ssl  The SSL object of the connection.
+ */
+void log_cipher(SSL * ssl)
+{
+    char const * cipher_name(SSL_get_cipher(ssl));
+    int cipher_bits(0);
+    SSL_get_cipher_bits(ssl, &cipher_bits);
+    SNAP_LOG_DEBUG
+        << "connected with SSL cipher \""
+        << cipher_name
+        << "\" representing "
+        << cipher_bits
+        << " bits of encryption."
+        << SNAP_LOG_SEND;
+}
+
+
+
+/** \brief Make the socket blocking.
+ *
+ * The BIO read and write functions expect a blocking socket.
+ *
+ * \param[in] socket  The socket to change.
+ */
+void make_blocking(int socket)
+{
+    int const flags(fcntl(socket, F_GETFL, 0));
+    if(flags != -1
+    && (flags & O_NONBLOCK) != 0)
+    {
+        fcntl(socket, F_SETFL, flags & ~O_NONBLOCK);
+    }
+}
+
+
+
+/** \brief Mark the client socket with SO_KEEPALIVE.
+ *
+ * If the call fails, the error is ignored, but it still gets logged.
+ *
+ * \param[in] socket  The socket to mark.
+ */
+void mark_keepalive(int socket)
+{
+    if(socket >= 0)
+    {
+        int optval(1);
+        socklen_t const optlen(sizeof(optval));
+        if(setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen) != 0)
+        {
+            SNAP_LOG_WARNING
+                << "an error occurred trying to mark client socket with SO_KEEPALIVE."
+                << SNAP_LOG_SEND;
+        }
+    }
+}
+
+
+
+} // no name namespace
+
 
 
 /** \brief Construct a tcp_bio_client object.
@@ -308,10 +547,6 @@ void ssl_trace(
  * the connection to the server can be obtained even if a secure
  * connection was not available.
  *
- * \todo
- * Create another client with BIO_new_socket() so one can create an SSL
- * connection with a socket retrieved from an accept() call.
- *
  * \exception tcp_client_server_parameter_error
  * This exception is raised if the \p port parameter is out of range or the
  * IP address is an empty string or otherwise an invalid address.
@@ -343,55 +578,7 @@ tcp_bio_client::tcp_bio_client(
     case mode_t::MODE_SECURE:
     case mode_t::MODE_ALWAYS_SECURE:
         {
-            // Use TLS v1 only as all versions of SSL are flawed...
-            // (see below the SSL_CTX_set_options() for additional details
-            // about that since here it does indeed say SSLv23...)
-            //
-            std::shared_ptr<SSL_CTX> ssl_ctx; // use a reset(), see SNAP-507
-            ssl_ctx.reset(SSL_CTX_new(SSLv23_client_method()), detail::ssl_ctx_deleter);
-            if(ssl_ctx == nullptr)
-            {
-                detail::bio_log_errors();
-                throw initialization_error("failed creating an SSL_CTX object");
-            }
-
-            // allow up to `depth` certificates in the chain otherwise fail
-            // (this is not a very strong security feature though); the depth
-            // can be changed before calling this function using a
-            // tcp_bio_options object
-            //
-            SSL_CTX_set_verify_depth(ssl_ctx.get(), opt.get_verification_depth());
-
-            // make sure SSL v2/3 is not used, also compression in SSL is
-            // known to have security issues
-            //
-            SSL_CTX_set_options(ssl_ctx.get(), opt.get_ssl_options());
-
-            // limit the number of ciphers the connection can use
-            if(mode == mode_t::MODE_SECURE)
-            {
-                // this is used by local connections and we get a very strong
-                // algorithm anyway, but at this point I do not know why it
-                // does not work with the limited list below...
-                //
-                // TODO: test with adding DH support in the server then
-                //       maybe (probably) that the "HIGH" will work for
-                //       this entry too...
-                //
-                SSL_CTX_set_cipher_list(ssl_ctx.get(), "ALL");
-            }
-            else
-            {
-                SSL_CTX_set_cipher_list(ssl_ctx.get(), "HIGH:!aNULL:!kRSA:!PSK:!SRP:!MD5:!RC4");
-            }
-
-            // load root certificates (correct path for Ubuntu?)
-            // TODO: allow client to set the path to certificates
-            if(SSL_CTX_load_verify_locations(ssl_ctx.get(), nullptr, "/etc/ssl/certs") != 1)
-            {
-                detail::bio_log_errors();
-                throw initialization_error("failed loading verification certificates in an SSL_CTX object");
-            }
+            std::shared_ptr<SSL_CTX> ssl_ctx(create_client_ssl_ctx(mode, opt));
             //SSL_CTX_set_msg_callback(ssl_ctx.get(), ssl_trace);
             //SSL_CTX_set_msg_callback_arg(ssl_ctx.get(), this);
 
@@ -427,30 +614,7 @@ tcp_bio_client::tcp_bio_client(
 
             // setup the Server Name Indication (SNI)
             //
-            bool using_sni(false);
-            if(opt.get_sni())
-            {
-                std::string host(opt.get_host());
-                if(host.empty()
-                && !address.is_hostname_an_ip())
-                {
-                    // addr is not an IP address written as is,
-                    // it must be a hostname
-                    //
-                    host = address.get_hostname();
-                }
-                if(!host.empty())
-                {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wold-style-cast"
-                    // not only old style cast (but it's C, so expected)
-                    // but they want a non-constant pointer!?
-                    //
-                    SSL_set_tlsext_host_name(ssl, const_cast<char *>(host.c_str()));
-#pragma GCC diagnostic pop
-                    using_sni = true;
-                }
-            }
+            bool const using_sni(setup_sni(ssl, address, opt));
 
             // TODO: other SSL initialization?
 
@@ -464,15 +628,7 @@ tcp_bio_client::tcp_bio_client(
             //
             if(BIO_do_connect(bio.get()) <= 0)
             {
-                if(!using_sni)
-                {
-                    SNAP_LOG_WARNING
-                        << "the SNI feature is turned off,"
-                           " often failure to connect with SSL is because the"
-                           " SSL Hello message is missing the SNI (Server Name In)."
-                           " See the tcp_bio_options::set_sni()."
-                        << SNAP_LOG_SEND;
-                }
+                sni_warning(using_sni);
                 detail::bio_log_errors();
                 throw failed_connecting("SSL BIO_do_connect() failed connecting BIO object to server");
             }
@@ -481,45 +637,14 @@ tcp_bio_client::tcp_bio_client(
             //
             if(BIO_do_handshake(bio.get()) != 1)
             {
-                if(!using_sni)
-                {
-                    SNAP_LOG_WARNING
-                        << "the SNI feature is turned off,"
-                           " often failure to connect with SSL is because the"
-                           " SSL Hello message is missing the SNI (Server Name In)."
-                           " See the tcp_bio_options::set_sni()."
-                        << SNAP_LOG_SEND;
-                }
+                sni_warning(using_sni);
                 detail::bio_log_errors();
                 throw initialization_error("failed establishing a secure BIO connection with server, handshake failed."
                             " Often such failures to process SSL is because the SSL Hello message is missing the SNI (Server Name In)."
                             " See the tcp_bio_options::set_sni().");
             }
 
-            // verify that the peer certificate was signed by a
-            // recognized root authority
-            //
-            if(SSL_get_peer_certificate(ssl) == nullptr)
-            {
-                detail::bio_log_errors();
-                throw initialization_error("peer failed presenting a certificate for security verification");
-            }
-
-            // XXX: check that the call below is similar to the example
-            //      usage of SSL_CTX_set_verify() which checks the name
-            //      of the certificate, etc.
-            //
-            if(SSL_get_verify_result(ssl) != X509_V_OK)
-            {
-                if(mode != mode_t::MODE_SECURE)
-                {
-                    detail::bio_log_errors();
-                    throw initialization_error("peer certificate could not be verified");
-                }
-                SNAP_LOG_WARNING
-                    << "connecting with SSL but certificate verification failed."
-                    << SNAP_LOG_SEND;
-            }
+            verify_peer(ssl, mode);
 
             // it worked, save the results
             //
@@ -528,16 +653,7 @@ tcp_bio_client::tcp_bio_client(
 
             // secure connection ready
             //
-            char const * cipher_name(SSL_get_cipher(ssl));
-            int cipher_bits(0);
-            SSL_get_cipher_bits(ssl, &cipher_bits);
-            SNAP_LOG_DEBUG
-                << "connected with SSL cipher \""
-                << cipher_name
-                << "\" representing "
-                << cipher_bits
-                << " bits of encryption."
-                << SNAP_LOG_SEND;
+            log_cipher(ssl);
         }
         break;
 
@@ -587,19 +703,132 @@ tcp_bio_client::tcp_bio_client(
 #pragma GCC diagnostic ignored "-Wold-style-cast"
         BIO_get_fd(f_impl->f_bio.get(), &socket);
 #pragma GCC diagnostic pop
-        if(socket >= 0)
+        mark_keepalive(socket);
+    }
+}
+
+
+/** \brief Construct a tcp_bio_client object from a connected socket.
+ *
+ * This constructor is used when the TCP connection was established by
+ * someone else, in most cases using a non-blocking connect() so the
+ * event loop does not get blocked while the kernel sends the SYN packets.
+ * The object takes ownership of the \p socket.
+ *
+ * When the \p mode is MODE_SECURE or MODE_ALWAYS_SECURE, the TLS handshake
+ * does not happen in this constructor. The socket is expected to be
+ * non-blocking and the caller has to call continue_handshake() each
+ * time the socket is ready until it returns HANDSHAKE_DONE. This way
+ * a slow peer does not block the event loop. In MODE_PLAIN, the socket
+ * is made blocking again immediately since the rest of the BIO client
+ * expects a blocking socket.
+ *
+ * \exception invalid_parameter
+ * This exception is raised if the \p socket is not valid or the
+ * \p address is the default address.
+ *
+ * \exception initialization_error
+ * This exception is raised if the BIO or SSL objects cannot be created.
+ *
+ * \param[in] socket  The connected socket; this object becomes its owner.
+ * \param[in] address  The address of the server we are connected to.
+ * \param[in] mode  Whether to use SSL on this connection.
+ * \param[in] opt  Additional options.
+ */
+tcp_bio_client::tcp_bio_client(
+              snapdev::raii_fd_t socket
+            , addr::addr const & address
+            , mode_t mode
+            , tcp_bio_options const & opt)
+    : f_address(address)
+    , f_impl(std::make_shared<detail::tcp_bio_client_impl>())
+{
+    if(socket == nullptr)
+    {
+        throw invalid_parameter("a valid socket is required to create a tcp_bio_client from a connected socket");
+    }
+    if(address.is_default())
+    {
+        throw invalid_parameter("the default address is not valid for a client socket");
+    }
+
+    detail::bio_initialize();
+
+    // the BIO read/write functions expect a blocking socket; in secure
+    // modes this happens once the handshake is done
+    //
+    if(mode == mode_t::MODE_PLAIN)
+    {
+        make_blocking(socket.get());
+    }
+
+    if(opt.get_keepalive())
+    {
+        mark_keepalive(socket.get());
+    }
+
+    std::unique_ptr<BIO, void (*)(BIO *)> socket_bio(BIO_new_socket(socket.get(), BIO_CLOSE), detail::bio_deleter);
+    if(socket_bio == nullptr)
+    {
+        detail::bio_log_errors();
+        throw initialization_error("failed initializing a socket BIO object");
+    }
+
+    // the BIO is now responsible for closing the socket
+    //
+    snapdev::NOT_USED(socket.release());
+
+    switch(mode)
+    {
+    case mode_t::MODE_SECURE:
+    case mode_t::MODE_ALWAYS_SECURE:
         {
-            // if this call fails, we ignore the error, but still log the event
-            //
-            int optval(1);
-            socklen_t const optlen(sizeof(optval));
-            if(setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen) != 0)
+            std::shared_ptr<SSL_CTX> ssl_ctx(create_client_ssl_ctx(mode, opt));
+
+            std::shared_ptr<BIO> bio;
+            bio.reset(BIO_new_ssl(ssl_ctx.get(), 1), detail::bio_deleter);
+            if(bio == nullptr)
+            {
+                detail::bio_log_errors();
+                throw initialization_error("failed initializing an SSL BIO object");
+            }
+
+            SSL * ssl(nullptr);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+            BIO_get_ssl(bio.get(), &ssl);
+#pragma GCC diagnostic pop
+            if(ssl == nullptr)
             {
-                SNAP_LOG_WARNING
-                    << "an error occurred trying to mark client socket with SO_KEEPALIVE."
-                    << SNAP_LOG_SEND;
+                detail::bio_log_errors();
+                throw initialization_error("failed retrieving the SSL contact from BIO object");
             }
+
+            SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY);
+
+            f_using_sni = setup_sni(ssl, address, opt);
+
+            // WARNING: once pushed, the SSL BIO chain takes ownership of
+            //          the socket BIO so we have to make sure that we
+            //          do not keep it in our unique_ptr<>().
+            //
+            BIO_push(bio.get(), socket_bio.get());
+            snapdev::NOT_USED(socket_bio.release());
+
+            // the handshake happens in continue_handshake()
+            //
+            f_handshake_mode = mode;
+            f_handshake_pending = true;
+
+            f_impl->f_ssl_ctx.swap(ssl_ctx);
+            f_impl->f_bio.swap(bio);
         }
+        break;
+
+    case mode_t::MODE_PLAIN:
+        f_impl->f_bio.reset(socket_bio.release(), detail::bio_deleter);
+        break;
+
     }
 }
 
@@ -644,6 +873,79 @@ void tcp_bio_client::close()
 }
 
 
+/** \brief Continue the TLS handshake.
+ *
+ * When the client was created from a connected socket in MODE_SECURE or
+ * MODE_ALWAYS_SECURE, the TLS handshake happens over the non-blocking
+ * socket. Call this function until it returns HANDSHAKE_DONE. The other
+ * values tell you whether to wait for the socket to be readable or
+ * writable before calling it again.
+ *
+ * Once the handshake is done, the peer certificate gets verified and
+ * the socket is made blocking since the read() and write() functions
+ * expect a blocking socket.
+ *
+ * In all the other cases, the function returns HANDSHAKE_DONE
+ * immediately.
+ *
+ * \exception initialization_error
+ * This exception is raised if the handshake fails or the peer certificate
+ * cannot be verified.
+ *
+ * \return The status of the handshake.
+ */
+handshake_t tcp_bio_client::continue_handshake()
+{
+    if(!f_handshake_pending)
+    {
+        return handshake_t::HANDSHAKE_DONE;
+    }
+    if(f_impl->f_bio == nullptr)
+    {
+        throw initialization_error("the connection was closed before the handshake was done");
+    }
+
+    BIO * bio(f_impl->f_bio.get());
+    if(BIO_do_handshake(bio) != 1)
+    {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+        if(BIO_should_retry(bio))
+        {
+            return BIO_should_read(bio)
+                        ? handshake_t::HANDSHAKE_WANT_READ
+                        : handshake_t::HANDSHAKE_WANT_WRITE;
+        }
+#pragma GCC diagnostic pop
+
+        sni_warning(f_using_sni);
+        detail::bio_log_errors();
+        throw initialization_error("failed establishing a secure BIO connection with server, handshake failed."
+                    " Often such failures to process SSL is because the SSL Hello message is missing the SNI (Server Name In)."
+                    " See the tcp_bio_options::set_sni().");
+    }
+
+    SSL * ssl(nullptr);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+    BIO_get_ssl(bio, &ssl);
+#pragma GCC diagnostic pop
+    if(ssl == nullptr)
+    {
+        detail::bio_log_errors();
+        throw initialization_error("failed retrieving the SSL contact from BIO object");
+    }
+
+    verify_peer(ssl, f_handshake_mode);
+    log_cipher(ssl);
+
+    make_blocking(get_socket());
+    f_handshake_pending = false;
+
+    return handshake_t::HANDSHAKE_DONE;
+}
+
+
 /** \brief Get the socket descriptor.
  *
  * This function returns the TCP client socket descriptor. This can be
@@ -56,6 +56,15 @@ class tcp_bio_server;
 
 
 
+enum class handshake_t
+{
+    HANDSHAKE_DONE,
+    HANDSHAKE_WANT_READ,
+    HANDSHAKE_WANT_WRITE,
+};
+
+
+
 // Create/manage certificates details:
 // https://help.ubuntu.com/lts/serverguide/certificates-and-security.html
 //
@@ -68,12 +77,18 @@ public:
                                   addr::addr const & address
                                 , mode_t mode = mode_t::MODE_PLAIN
                                 , tcp_bio_options const & opt = tcp_bio_options());
+                        tcp_bio_client(
+                                  snapdev::raii_fd_t socket
+                                , addr::addr const & address
+                                , mode_t mode = mode_t::MODE_PLAIN
+                                , tcp_bio_options const & opt = tcp_bio_options());
                         tcp_bio_client(tcp_bio_client const & src) = delete;
     virtual             ~tcp_bio_client();
 
     tcp_bio_client &    operator = (tcp_bio_client const & rhs) = delete;
 
     void                close();
+    handshake_t         continue_handshake();
 
     int                 get_socket() const;
     addr::addr const &  get_remote_address() const;
@@ -96,6 +111,9 @@ private:
                         f_impl = std::shared_ptr<detail::tcp_bio_client_impl>();
     std::size_t         f_sent_bytes = 0;
     std::size_t         f_received_bytes = 0;
+    mode_t              f_handshake_mode = mode_t::MODE_PLAIN;
+    bool                f_handshake_pending = false;
+    bool                f_using_sni = false;
 };
 
 
@@ -52,6 +52,7 @@ public:
     // ed::tcp_client_connection implementation
     virtual ssize_t             write(void const * buf, std::size_t count) override;
     virtual bool                is_writer() const override;
+    virtual std::size_t         get_output_size() const override;
     virtual void                process_read() override;
     virtual void                process_write() override;
     virtual void                process_hup() override;
@@ -43,6 +43,8 @@
 //
 #include    "eventdispatcher/tcp_client_message_connection.h"
 
+#include    "eventdispatcher/message_capture.h"
+
 
 // snaplogger
 //
@@ -102,7 +104,11 @@ void tcp_client_message_connection::process_line(std::string const & line)
     message msg;
     if(msg.from_message(line))
     {
-        dispatch_message(msg);
+        if(!process_flow_message(msg))
+        {
+            dispatch_message(msg);
+            message_consumed(line.length() + 1);
+        }
     }
     else
     {
@@ -134,6 +140,8 @@ bool tcp_client_message_connection::send_message(
 {
     snapdev::NOT_USED(cache);
 
+    message_capture::capture(capture_direction_t::CAPTURE_DIRECTION_SENT, get_name(), msg);
+
     // transform the message to a string and write to the socket
     // the writing is asynchronous so the message is saved in a cache
     // and transferred only later when the run() loop is hit again
@@ -149,6 +157,21 @@ bool tcp_client_message_connection::send_message(
             << SNAP_LOG_SEND;
 
     buf += '\n';
+    return send_with_credits(buf);
+}
+
+
+/** \brief Write a buffer to the socket.
+ *
+ * This function is used by the flow control to write messages once
+ * credits allow it.
+ *
+ * \param[in] buf  The buffer to write.
+ *
+ * \return true if the whole buffer was written.
+ */
+bool tcp_client_message_connection::write_flow_buffer(std::string const & buf)
+{
     return write(buf.c_str(), buf.length()) == static_cast<ssize_t>(buf.length());
 }
 
@@ -27,6 +27,7 @@
 //
 #include    <eventdispatcher/connection_with_send_message.h>
 #include    <eventdispatcher/dispatcher_support.h>
+#include    <eventdispatcher/flow_control.h>
 #include    <eventdispatcher/tcp_client_buffer_connection.h>
 
 
@@ -40,6 +41,7 @@ class tcp_client_message_connection
     : public tcp_client_buffer_connection
     , public dispatcher_support
     , public connection_with_send_message
+    , public flow_control
 {
 public:
     typedef std::shared_ptr<tcp_client_message_connection>    pointer_t;
@@ -54,6 +56,10 @@ public:
 
     // tcp_client_buffer_connection implementation
     virtual void                process_line(std::string const & line) override;
+
+protected:
+    // flow_control implementation
+    virtual bool                write_flow_buffer(std::string const & buf) override;
 };
 
 
@@ -24,7 +24,9 @@
  * try to reconnect if the connection drops.
  *
  * The class will also try to connect with the next address if more than one
- * is available.
+ * is available. By default, the connection is attempted using a
+ * non-blocking connect() managed by the communicator and multiple
+ * addresses are raced against each other (Happy Eyeballs).
  */
 
 
@@ -35,7 +37,7 @@
 #include    "eventdispatcher/communicator.h"
 #include    "eventdispatcher/exception.h"
 #include    "eventdispatcher/tcp_server_client_message_connection.h"
-#include    "eventdispatcher/thread_done_signal.h"
+#include    "eventdispatcher/utils.h"
 
 
 // snaplogger
@@ -54,16 +56,9 @@
 #include    <advgetopt/validator_duration.h>
 
 
-// cppthread
-//
-#include    <cppthread/exception.h>
-#include    <cppthread/guard.h>
-#include    <cppthread/runner.h>
-#include    <cppthread/thread.h>
-
-
 // C++
 //
+#include    <algorithm>
 #include    <cstring>
 
 
@@ -83,26 +78,77 @@ namespace ed
 
 
 
+namespace
+{
+
+
+
+/** \brief Delay between two connection attempts.
+ *
+ * When several addresses are available, the next one is tried if the
+ * previous attempt did not succeed within this delay (RFC 8305).
+ */
+constexpr std::int64_t const   CONNECTION_ATTEMPT_DELAY = 250'000;
+
+
+/** \brief Maximum duration of one connection attempt.
+ *
+ * This includes the TCP connect() and, in secure modes, the TLS handshake.
+ */
+constexpr std::int64_t const   CONNECT_TIMEOUT = 30LL * 1'000'000LL;
+
+
+/** \brief Number of connect() currently in flight.
+ *
+ * All the permanent connections of a process share this counter so the
+ * number of non-blocking connect() started at the same time can be
+ * capped. This is important when the server goes down and hundreds of
+ * permanent connections all try to reconnect at once.
+ *
+ * These variables are only accessed from the communicator::run() loop
+ * which runs in a single thread.
+ */
+std::size_t         g_connects_in_flight = 0;
+
+
+/** \brief Maximum number of connect() in flight.
+ *
+ * \sa tcp_client_permanent_message_connection::set_max_connects_in_flight()
+ */
+std::size_t         g_max_connects_in_flight = DEFAULT_MAX_CONNECTS_IN_FLIGHT;
+
+
+
+} // no name namespace
+
+
+
 namespace detail
 {
 
 
 /** \brief Internal implementation of the tcp_client_permanent_message_connection class.
  *
- * This class is used to handle a thread that will process a connection for
- * us. This allows us to connect in any amount of time required by the
- * Unix system to obtain the connection with the remote server.
+ * This class is used to handle the connection process for us. Since
+ * the connect() call may take a long time (the kernel retries the SYN
+ * for about 2 minutes before giving up), the socket is made non-blocking
+ * and the communicator tells us once the connection is ready (writable)
+ * or failed.
  *
- * \todo
- * Having threads at the time we do a fork() is not safe. We may
- * want to reconsider offering this functionality here. Because at
- * this time we would have no control of when the thread is created
- * and thus a way to make sure that no such thread is running when
- * we call fork().
+ * When the permanent connection was given multiple addresses, these
+ * are raced against each other: the first one is attempted immediately,
+ * then the next one after a short delay if the first did not yet
+ * succeed, etc. The addresses are sorted so IPv6 and IPv4 alternate
+ * (see RFC 8305, Happy Eyeballs). The first connection to succeed
+ * wins and all the others are cancelled.
  */
 class tcp_client_permanent_message_connection_impl
+    : public std::enable_shared_from_this<tcp_client_permanent_message_connection_impl>
 {
 public:
+    typedef std::shared_ptr<tcp_client_permanent_message_connection_impl>   pointer_t;
+    typedef std::weak_ptr<tcp_client_permanent_message_connection_impl>     weak_pointer_t;
+
     class messenger
         : public tcp_server_client_message_connection
     {
@@ -156,277 +202,379 @@ public:
             f_parent->dispatch_message(msg);
         }
 
+        // flow_control implementation
+        virtual void process_flow_blocked(bool blocked) override
+        {
+            f_parent->process_flow_blocked(blocked);
+        }
+
     private:
         tcp_client_permanent_message_connection *  f_parent = nullptr;
     };
 
-    class thread_signal_handler
-        : public thread_done_signal
+    class connect_attempt
+        : public connection
     {
     public:
-        typedef std::shared_ptr<thread_signal_handler>   pointer_t;
+        typedef std::shared_ptr<connect_attempt>    pointer_t;
+        typedef std::vector<pointer_t>              vector_t;
 
-        thread_signal_handler(tcp_client_permanent_message_connection_impl * parent_impl)
+        connect_attempt(
+                  weak_pointer_t parent_impl
+                , addr::addr const & address)
             : f_parent_impl(parent_impl)
+            , f_address(address)
         {
-            set_name("tcp_client_permanent_message_connection_impl::thread_signal_handler");
+            set_name("tcp_client_permanent_message_connection_impl::connect_attempt");
         }
 
-        thread_signal_handler(thread_signal_handler const &) = delete;
-        thread_signal_handler & operator = (thread_signal_handler const &) = delete;
+        connect_attempt(connect_attempt const &) = delete;
+        connect_attempt & operator = (connect_attempt const &) = delete;
 
-        /** \brief This signal was emitted.
+        /** \brief Start the non-blocking connect().
          *
-         * This function gets called whenever the thread is just about to
-         * quit. Calling f_thread.is_running() may still return true when
-         * you get in the 'thread_done()' callback. However, an
-         * f_thread.stop() will return very quickly.
+         * This function creates a non-blocking socket and calls connect().
+         *
+         * \return 0 if the connection succeeded immediately, EINPROGRESS
+         * if the connection is on its way, or the errno of the error
+         * that occurred.
          */
-        virtual void process_read()
+        int start()
+        {
+            f_socket.reset(f_address.create_socket(
+                      addr::addr::SOCKET_FLAG_NONBLOCK
+                    | addr::addr::SOCKET_FLAG_CLOEXEC));
+            if(f_socket == nullptr)
+            {
+                return errno;
+            }
+
+            if(f_address.connect(f_socket.get()) == 0)
+            {
+                return 0;
+            }
+
+            int const e(errno);
+            if(e != EINPROGRESS)
+            {
+                f_socket.reset();
+            }
+            return e;
+        }
+
+        addr::addr const & get_address() const
         {
-            thread_done_signal::process_read();
+            return f_address;
+        }
 
-            f_parent_impl->thread_done();
+        snapdev::raii_fd_t release_socket()
+        {
+            return std::move(f_socket);
         }
 
-    private:
-        tcp_client_permanent_message_connection_impl *  f_parent_impl = nullptr;
-    };
+        // connection implementation
+        virtual int get_socket() const override
+        {
+            return f_socket.get();
+        }
 
-    class runner
-        : public cppthread::runner
-    {
-    public:
-        runner(
-                      tcp_client_permanent_message_connection_impl * parent_impl
-                    , addr::addr::vector_t const & addresses
-                    , mode_t mode)
-            : cppthread::runner("background tcp_client_permanent_message_connection for asynchronous connections")
-            , f_parent_impl(parent_impl)
-            , f_addresses(addresses)
-            , f_mode(mode)
+        // connection implementation
+        virtual bool is_writer() const override
         {
+            return true;
         }
 
-        runner(runner const &) = delete;
-        runner & operator = (runner const &) = delete;
+        // connection implementation
+        virtual void process_write() override
+        {
+            finish(0);
+        }
 
+        // connection implementation
+        virtual void process_error() override
+        {
+            finish(ECONNREFUSED);
+        }
 
-        /** \brief This is the actual function run by the thread.
-         *
-         * This function calls the connect() function and then
-         * tells the main thread we are done.
-         */
-        virtual void run()
+        // connection implementation
+        virtual void process_hup() override
         {
-            connect();
+            finish(ECONNRESET);
+        }
 
-            // tell the main thread that we are done
-            //
-            f_parent_impl->trigger_thread_done();
+        // connection implementation
+        virtual void process_invalid() override
+        {
+            finish(EBADF);
         }
 
+        // connection implementation
+        virtual void process_timeout() override
+        {
+            if(!f_finished)
+            {
+                f_finished = true;
+                auto parent_impl(f_parent_impl.lock());
+                if(parent_impl != nullptr)
+                {
+                    parent_impl->attempt_done(
+                              std::static_pointer_cast<connect_attempt>(shared_from_this())
+                            , ETIMEDOUT);
+                }
+            }
+        }
 
-        /** \brief This function attempts to connect.
+    private:
+        /** \brief Report the result of the connect() to the parent.
          *
-         * This function attempts a connection to the specified address
-         * and port with the specified mode (i.e. plain or encrypted.)
+         * The poll() may return multiple events at once (i.e. POLLOUT and
+         * POLLERR); only the first one is reported.
          *
-         * The function may take a long time to succeed connecting with
-         * the server. The main thread will be awaken whenever this
-         * thread dies.
+         * The result of the connect() is found in the SO_ERROR of the
+         * socket. If the socket has no error but we received an error
+         * event, then \p default_error is reported instead.
          *
-         * If an error occurs, then the f_socket variable member will
-         * be set to -1. Otherwise it represents the socket that we
-         * just connected with.
+         * \param[in] default_error  The error to report if SO_ERROR is 0,
+         * use 0 when the socket became writable.
          */
-        void connect()
+        void finish(int default_error)
         {
-            char const * error_name(nullptr);
-            try
+            if(f_finished)
             {
-                // create a socket using the bio_client class,
-                // but then just create a duplicate that we will
-                // use in a server-client TCP object (because
-                // we cannot directly create the right type of
-                // object otherwise...)
-                //
-                f_tcp_connection = std::make_shared<tcp_bio_client>(f_addresses[f_index], f_mode);
                 return;
             }
-            catch(failed_connecting const & e)
-            {
-                error_name = "ed::failed_connecting";
-                f_last_error = e.what();
-            }
-            catch(initialization_error const & e)
-            {
-                error_name = "ed::initialization_error";
-                f_last_error = e.what();
-            }
-            catch(runtime_error const & e)
+            f_finished = true;
+
+            int err(0);
+            socklen_t len(sizeof(err));
+            if(getsockopt(f_socket.get(), SOL_SOCKET, SO_ERROR, &err, &len) != 0)
             {
-                error_name = "ed::runtime_error";
-                f_last_error = e.what();
+                err = errno;
             }
-            catch(std::exception const & e)
+            else if(err == 0)
             {
-                error_name = "std::exception";
-                f_last_error = e.what();
+                err = default_error;
             }
-            catch(...)
+
+            auto parent_impl(f_parent_impl.lock());
+            if(parent_impl != nullptr)
             {
-                error_name = "a non-standard exception";
-                f_last_error = "Unknown exception";
+                parent_impl->attempt_done(
+                          std::static_pointer_cast<connect_attempt>(shared_from_this())
+                        , err);
             }
-            f_tcp_connection.reset();
+        }
 
-            // on an error, we want to try the next address
-            //
-            ++f_index;
-            if(f_index >= f_addresses.size())
+        weak_pointer_t                                  f_parent_impl = weak_pointer_t();
+        addr::addr const                                f_address;
+        snapdev::raii_fd_t                              f_socket = snapdev::raii_fd_t();
+        bool                                            f_finished = false;
+    };
+
+    class replay_timer
+        : public timer
+    {
+    public:
+        typedef std::shared_ptr<replay_timer>   pointer_t;
+
+        replay_timer(weak_pointer_t parent_impl)
+            : timer(-1)
+            , f_parent_impl(parent_impl)
+        {
+            set_name("tcp_client_permanent_message_connection_impl::replay_timer");
+        }
+
+        replay_timer(replay_timer const &) = delete;
+        replay_timer & operator = (replay_timer const &) = delete;
+
+        /** \brief Time to send the next batch of cached messages.
+         */
+        virtual void process_timeout() override
+        {
+            auto parent_impl(f_parent_impl.lock());
+            if(parent_impl != nullptr)
             {
-                f_index = 0;
+                parent_impl->replay();
             }
+        }
 
-            // connection failed... we will have to try again later
-            //
-            SNAP_LOG_ERROR
-                << "connection to "
-                << addr::setaddrmode(addr::STRING_IP_BRACKET_ADDRESS | addr::STRING_IP_PORT)
-                << f_addresses
-                << " failed with: "
-                << f_last_error
-                << " ("
-                << error_name
-                << ")."
-                << SNAP_LOG_SEND;
+    private:
+        weak_pointer_t                                  f_parent_impl = weak_pointer_t();
+    };
+
+    class attempt_timer
+        : public timer
+    {
+    public:
+        typedef std::shared_ptr<attempt_timer>  pointer_t;
+
+        attempt_timer(weak_pointer_t parent_impl)
+            : timer(-1)
+            , f_parent_impl(parent_impl)
+        {
+            set_name("tcp_client_permanent_message_connection_impl::attempt_timer");
         }
 
+        attempt_timer(attempt_timer const &) = delete;
+        attempt_timer & operator = (attempt_timer const &) = delete;
 
-        /** \brief Retrieve the address to connect to.
-         *
-         * This function returns the address we connected to or, if not
-         * connected, the one that we will attempt to connect to next.
+        /** \brief The connection attempt delay elapsed.
          *
-         * \note
-         * Since the variable is constant, it is likely to never change.
-         * However, the c_str() function may change the buffer pointer.
-         * Hence, to be 100% safe, you cannot call this function until
-         * you make sure that the thread is fully stopped.
-         *
-         * \return The destination address.
+         * The previous attempts did not yet succeed (or too many
+         * connect() were in flight) so we start the next one.
          */
-        addr::addr const & get_address() const
+        virtual void process_timeout() override
         {
-            return f_addresses[f_index];
+            auto parent_impl(f_parent_impl.lock());
+            if(parent_impl != nullptr)
+            {
+                parent_impl->start_next_attempt();
+            }
         }
 
+    private:
+        weak_pointer_t                                  f_parent_impl = weak_pointer_t();
+    };
+
+    class tls_handshake
+        : public connection
+    {
+    public:
+        typedef std::shared_ptr<tls_handshake>  pointer_t;
 
-        /** \brief Retrieve the vector of addresses to connect to.
-         *
-         * This function returns the addresses passed in on creation.
-         *
-         * \note
-         * Since the variable is constant, it is likely to never change.
-         * However, the c_str() function may change the buffer pointer.
-         * Hence, to be 100% safe, you cannot call this function until
-         * you make sure that the thread is fully stopped.
-         *
-         * \return The destination addresses.
-         */
-        addr::addr::vector_t const & get_addresses() const
+        tls_handshake(
+                  weak_pointer_t parent_impl
+                , tcp_bio_client::pointer_t client)
+            : f_parent_impl(parent_impl)
+            , f_client(client)
         {
-            return f_addresses;
+            set_name("tcp_client_permanent_message_connection_impl::tls_handshake");
         }
 
+        tls_handshake(tls_handshake const &) = delete;
+        tls_handshake & operator = (tls_handshake const &) = delete;
 
-        /** \brief Retrieve the client allocated and connected by the thread.
-         *
-         * This function returns the TCP connection object resulting from
-         * connection attempts of the background thread.
-         *
-         * If the pointer is null, then you may get the corresponding
-         * error message using the get_last_error() function.
-         *
-         * You can get the client TCP connection pointer once. After that
-         * you always get a null pointer.
-         *
-         * \note
-         * This function is guarded so the pointer and the object it
-         * points to will be valid in another thread that retrieves it.
+        tcp_bio_client::pointer_t get_client() const
+        {
+            return f_client;
+        }
+
+        /** \brief Move the handshake forward.
          *
-         * \return The connection pointer.
+         * This function calls the continue_handshake() function of the
+         * client and reports the result to the parent once done or
+         * if it failed. Otherwise it waits for the socket to be ready.
          */
-        tcp_bio_client::pointer_t release_client()
+        void step()
+        {
+            if(f_finished)
+            {
+                return;
+            }
+
+            try
+            {
+                f_state = f_client->continue_handshake();
+            }
+            catch(std::exception const & e)
+            {
+                finish(e.what());
+                return;
+            }
+
+            if(f_state == handshake_t::HANDSHAKE_DONE)
+            {
+                finish(std::string());
+            }
+        }
+
+        // connection implementation
+        virtual int get_socket() const override
+        {
+            return f_client->get_socket();
+        }
+
+        // connection implementation
+        virtual bool is_reader() const override
         {
-            cppthread::guard g(f_mutex);
-            tcp_bio_client::pointer_t tcp_connection;
-            tcp_connection.swap(f_tcp_connection);
-            return tcp_connection;
+            return f_state == handshake_t::HANDSHAKE_WANT_READ;
         }
 
+        // connection implementation
+        virtual bool is_writer() const override
+        {
+            return f_state == handshake_t::HANDSHAKE_WANT_WRITE;
+        }
 
-        /** \brief Retrieve the last error message that happened.
-         *
-         * This function returns the last error message that was captured
-         * when trying to connect to the socket. The message is the
-         * e.what() message from the exception we captured.
-         *
-         * The message does not get cleared so the function can be called
-         * any number of times. To know whether an error was generated
-         * on the last attempt, make sure to first get the get_socket()
-         * and if it returns -1, then this message is significant,
-         * otherwise it is from a previous error.
-         *
-         * \warning
-         * Remember that if the background thread was used the error will
-         * NOT be available in the main thread until a full memory barrier
-         * was executed. For that reason we make sure that the thread
-         * was stopped when we detect an error.
-         *
-         * \return The last error message.
-         */
-        std::string const & get_last_error() const
+        // connection implementation
+        virtual void process_read() override
         {
-            return f_last_error;
+            step();
         }
 
+        // connection implementation
+        virtual void process_write() override
+        {
+            step();
+        }
 
-        /** \brief Close the connection.
-         *
-         * This function closes the connection. Since the f_tcp_connection
-         * holds the socket to the remote server, we have get this function
-         * called in order to completely disconnect.
-         *
-         * \note
-         * This function does not clear the f_last_error parameter so it
-         * can be read later.
-         */
-        void close()
+        // connection implementation
+        virtual void process_error() override
+        {
+            finish("TLS handshake failed: socket error");
+        }
+
+        // connection implementation
+        virtual void process_hup() override
         {
-            f_tcp_connection.reset();
+            finish("TLS handshake failed: connection closed by peer");
         }
 
+        // connection implementation
+        virtual void process_invalid() override
+        {
+            finish("TLS handshake failed: invalid socket");
+        }
+
+        // connection implementation
+        virtual void process_timeout() override
+        {
+            finish("TLS handshake failed: timed out");
+        }
 
     private:
-        tcp_client_permanent_message_connection_impl *  f_parent_impl = nullptr;
-        std::size_t                                     f_index = 0;
-        addr::addr::vector_t const                      f_addresses;
-        mode_t const                                    f_mode;
-        tcp_bio_client::pointer_t                       f_tcp_connection = tcp_bio_client::pointer_t();
-        std::string                                     f_last_error = std::string();
+        /** \brief Report the result of the handshake to the parent.
+         *
+         * \param[in] error  The error message or an empty string on success.
+         */
+        void finish(std::string const & error)
+        {
+            if(f_finished)
+            {
+                return;
+            }
+            f_finished = true;
+
+            auto parent_impl(f_parent_impl.lock());
+            if(parent_impl != nullptr)
+            {
+                parent_impl->handshake_done(
+                          std::static_pointer_cast<tls_handshake>(shared_from_this())
+                        , error);
+            }
+        }
+
+        weak_pointer_t                                  f_parent_impl = weak_pointer_t();
+        tcp_bio_client::pointer_t                       f_client = tcp_bio_client::pointer_t();
+        handshake_t                                     f_state = handshake_t::HANDSHAKE_WANT_WRITE;
+        bool                                            f_finished = false;
     };
 
 
     /** \brief Initialize a permanent message connection implementation object.
      *
-     * This object manages the thread used to asynchronically connect to
-     * the specified address and port.
-     *
-     * This class and its sub-classes may end up executing callbacks
-     * of the tcp_client_permanent_message_connection object.
-     * However, in all cases these are never run from the thread.
+     * This object manages the non-blocking connect() used to connect to
+     * the specified addresses asynchronously.
      *
      * \param[in] parent  A pointer to the owner of this
      * tcp_client_permanent_message_connection_impl object.
@@ -438,9 +586,13 @@ public:
                 , addr::addr::vector_t const & addresses
                 , mode_t mode)
         : f_parent(parent)
-        , f_thread_runner(this, addresses, mode)
-        , f_thread("background connection handler thread", &f_thread_runner)
+        , f_addresses(addresses)
+        , f_mode(mode)
     {
+        if(f_addresses.empty())
+        {
+            throw invalid_parameter("a permanent connection requires at least one address");
+        }
     }
 
 
@@ -449,30 +601,13 @@ public:
 
     /** \brief Destroy the permanent message connection.
      *
-     * This function makes sure that the messenger was lost.
+     * This function makes sure that the messenger and the connection
+     * attempts were lost.
      */
     ~tcp_client_permanent_message_connection_impl()
     {
-        // to make sure we can lose the messenger, first we want to be sure
-        // that we do not have a thread running
-        //
-        try
-        {
-            f_thread.stop();
-        }
-        catch(cppthread::mutex_failed const &)
-        {
-        }
-        catch(cppthread::invalid_error const &)
-        {
-        }
-
-        // in this case we may still have an instance of the f_thread_done
-        // which linger around, we want it out
-        //
-        // Note: the call is safe even if the f_thread_done is null
-        //
-        communicator::instance()->remove_connection(f_thread_done);
+        cancel_attempts();
+        stop_replay();
 
         // although the f_messenger variable gets reset automatically in
         // the destructor, it would not get removed from the
@@ -484,9 +619,8 @@ public:
 
     /** \brief Direct connect to the messenger.
      *
-     * In this case we try to connect without the thread. This allows
-     * us to avoid the thread problems, but we are blocked until the
-     * OS decides to time out or the connection worked.
+     * In this case we try to connect using a blocking connect(). We are
+     * blocked until the OS decides to time out or the connection worked.
      */
     void connect()
     {
@@ -498,13 +632,57 @@ public:
             return;
         }
 
-        // call the thread connect() function from the main thread
-        //
-        f_thread_runner.connect();
+        char const * error_name(nullptr);
+        try
+        {
+            connected(std::make_shared<tcp_bio_client>(f_addresses[f_index], f_mode));
+            return;
+        }
+        catch(failed_connecting const & e)
+        {
+            error_name = "ed::failed_connecting";
+            f_last_error = e.what();
+        }
+        catch(initialization_error const & e)
+        {
+            error_name = "ed::initialization_error";
+            f_last_error = e.what();
+        }
+        catch(runtime_error const & e)
+        {
+            error_name = "ed::runtime_error";
+            f_last_error = e.what();
+        }
+        catch(std::exception const & e)
+        {
+            error_name = "std::exception";
+            f_last_error = e.what();
+        }
+        catch(...)
+        {
+            error_name = "a non-standard exception";
+            f_last_error = "Unknown exception";
+        }
 
-        // simulate receiving the thread_done() signal
+        SNAP_LOG_ERROR
+            << "connection to "
+            << f_addresses[f_index].to_ipv4or6_string(addr::STRING_IP_BRACKET_ADDRESS | addr::STRING_IP_PORT)
+            << " failed with: "
+            << f_last_error
+            << " ("
+            << error_name
+            << ")."
+            << SNAP_LOG_SEND;
+
+        // on an error, we want to try the next address
         //
-        thread_done();
+        ++f_index;
+        if(f_index >= f_addresses.size())
+        {
+            f_index = 0;
+        }
+
+        f_parent->process_connection_failed(f_last_error);
     }
 
 
@@ -521,154 +699,248 @@ public:
     }
 
 
-    /** \brief Try to start the thread runner.
-     *
-     * This function tries to start the thread runner in order to initiate
-     * a connection in the background. If the thread could not be started,
-     * then the function returns false.
+    /** \brief Start an asynchronous connection.
      *
-     * If the thread started, then the function returns true. This does
-     * not mean that the connection was obtained. This is known once
-     * the process_connected() function is called.
+     * This function starts a non-blocking connect() with the first address.
+     * The other addresses, if any, get used if the first connect() does not
+     * succeed quickly or fails.
      *
-     * \return true if the thread was successfully started.
+     * The result is known once the process_connected() or
+     * process_connection_failed() callback gets called. Note that
+     * in some cases (i.e. connecting to the loopback address or all the
+     * addresses are unreachable) the callback is called before this
+     * function returns.
      */
-    bool background_connect()
+    void async_connect()
     {
         if(f_done)
         {
             SNAP_LOG_ERROR
                 << "Permanent connection marked done. Cannot attempt to reconnect."
                 << SNAP_LOG_SEND;
-            return false;
+            return;
         }
 
-        if(f_thread.is_running())
+        if(f_connecting)
         {
             SNAP_LOG_ERROR
                 << "A background connection attempt is already in progress. Further requests are ignored."
                 << SNAP_LOG_SEND;
-            return false;
+            return;
         }
 
-        // create the f_thread_done only when required
+        // sort the addresses for this race: we start with the address
+        // that worked last and then alternate between the address families
+        // (IPv6 and IPv4) as defined in RFC 8305
         //
-        if(f_thread_done == nullptr)
+        addr::addr::vector_t ipv6;
+        addr::addr::vector_t ipv4;
+        std::size_t const max(f_addresses.size());
+        for(std::size_t idx(0); idx < max; ++idx)
+        {
+            addr::addr const & a(f_addresses[(f_index + idx) % max]);
+            if(a.is_ipv4())
+            {
+                ipv4.push_back(a);
+            }
+            else
+            {
+                ipv6.push_back(a);
+            }
+        }
+        addr::addr::vector_t const & first(f_addresses[f_index].is_ipv4() ? ipv4 : ipv6);
+        addr::addr::vector_t const & second(f_addresses[f_index].is_ipv4() ? ipv6 : ipv4);
+        f_candidates.clear();
+        for(std::size_t idx(0); idx < first.size() || idx < second.size(); ++idx)
+        {
+            if(idx < first.size())
+            {
+                f_candidates.push_back(first[idx]);
+            }
+            if(idx < second.size())
+            {
+                f_candidates.push_back(second[idx]);
+            }
+        }
+        f_next_candidate = 0;
+        f_connecting = true;
+
+        start_next_attempt();
+    }
+
+
+    /** \brief Start the next connection attempt.
+     *
+     * This function starts a non-blocking connect() with the next candidate
+     * address. If that connect() does not complete within the connection
+     * attempt delay, the attempt timer is used to start the following
+     * candidate in parallel.
+     *
+     * If the process already has the maximum number of connect() in
+     * flight, then the attempt is postponed using the same timer.
+     *
+     * When no more candidates are available and none of the attempts
+     * are still in flight, the connection is considered failed.
+     */
+    void start_next_attempt()
+    {
+        stop_attempt_timer();
+
+        if(f_done
+        || !f_connecting)
+        {
+            return;
+        }
+
+        while(f_next_candidate < f_candidates.size())
+        {
+            if(g_connects_in_flight >= g_max_connects_in_flight)
+            {
+                // too many connect() in flight in this process, try again
+                // a little later
+                //
+                start_attempt_timer();
+                return;
+            }
+
+            connect_attempt::pointer_t attempt(std::make_shared<connect_attempt>(
+                                  weak_from_this()
+                                , f_candidates[f_next_candidate]));
+            ++f_next_candidate;
+
+            int const e(attempt->start());
+            if(e == 0)
+            {
+                succeeded(attempt);
+                return;
+            }
+
+            if(e == EINPROGRESS)
+            {
+                attempt->set_timeout_date(get_current_date() + CONNECT_TIMEOUT);
+                f_attempts.push_back(attempt);
+                ++g_connects_in_flight;
+                communicator::instance()->add_connection(attempt);
+
+                if(f_next_candidate < f_candidates.size())
+                {
+                    start_attempt_timer();
+                }
+                return;
+            }
+
+            attempt_failed(attempt->get_address(), e);
+        }
+
+        if(f_attempts.empty())
         {
-            f_thread_done = std::make_shared<thread_signal_handler>(this);
+            failed();
         }
+    }
+
+
+    /** \brief A connection attempt ended.
+     *
+     * This function is called by a connect_attempt once its connect()
+     * succeeded or failed.
+     *
+     * On a success, all the other attempts get cancelled and the
+     * connection is used to create the messenger.
+     *
+     * On a failure, the next candidate gets started immediately (we
+     * do not need to wait for the attempt delay in this case).
+     *
+     * \param[in] attempt  The attempt that just ended.
+     * \param[in] error  The errno of the connect() or 0 on success.
+     */
+    void attempt_done(connect_attempt::pointer_t attempt, int error)
+    {
+        auto it(std::find(f_attempts.begin(), f_attempts.end(), attempt));
+        if(it == f_attempts.end())
+        {
+            return;
+        }
+        f_attempts.erase(it);
+        --g_connects_in_flight;
+        communicator::instance()->remove_connection(attempt);
 
-        communicator::instance()->add_connection(f_thread_done);
+        if(error == 0)
+        {
+            succeeded(attempt);
+            return;
+        }
+
+        attempt_failed(attempt->get_address(), error);
 
-        if(!f_thread.start())
+        if(f_next_candidate < f_candidates.size())
+        {
+            start_next_attempt();
+        }
+        else if(f_attempts.empty())
         {
-            SNAP_LOG_ERROR
-                << "The thread used to run the background connection process did not start."
-                << SNAP_LOG_SEND;
-            return false;
+            stop_attempt_timer();
+            failed();
         }
-
-        return true;
     }
 
 
-    /** \brief Tell the main thread that the background thread is done.
+    /** \brief Cancel all the connection attempts in flight.
      *
-     * This function is called by the thread so the thread_done()
-     * function of the thread done object gets called. Only the
-     * thread should call this function.
+     * This function removes all the connection attempts and the TLS
+     * handshake, if any, from the communicator and closes their sockets.
      *
-     * As a result the thread_done() function of this class will be
-     * called by the main thread.
+     * \return true if a connection attempt was in progress.
      */
-    void trigger_thread_done()
+    bool cancel_attempts()
     {
-        f_thread_done->thread_done();
+        bool const connecting(f_connecting);
+        f_connecting = false;
+
+        stop_attempt_timer();
+
+        for(auto const & a : f_attempts)
+        {
+            --g_connects_in_flight;
+            communicator::instance()->remove_connection(a);
+        }
+        f_attempts.clear();
+
+        communicator::instance()->remove_connection(f_handshake);
+        f_handshake.reset();
+
+        return connecting;
     }
 
 
-    /** \brief Signal that the background thread is done.
-     *
-     * This callback is called whenever the background thread sends
-     * a signal to us. This is used to avoid calling end user functions
-     * that would certainly cause a lot of problem if called from the
-     * thread.
+    /** \brief The TLS handshake ended.
      *
-     * The function calls the process_connection_failed() if the
-     * connection did not happen.
+     * This function is called by the tls_handshake connection once the
+     * handshake succeeded or failed.
      *
-     * The function calls the process_connected() if the connection
-     * did happen.
-     *
-     * \note
-     * This is used only if the user requested that the connection
-     * happen in the background (i.e. use_thread was set to true
-     * in the tcp_client_permanent_message_connection object
-     * constructor.)
+     * \param[in] handshake  The handshake that just ended.
+     * \param[in] error  The error message or an empty string on success.
      */
-    void thread_done()
+    void handshake_done(tls_handshake::pointer_t handshake, std::string const & error)
     {
-        // if we used the thread we have to remove the signal used
-        // to know that the thread was done
-        //
-        communicator::instance()->remove_connection(f_thread_done);
-
-        // we will access the f_last_error member of the thread runner
-        // which may not be available to the main thread yet, calling
-        // stop forces a memory barrier so we are all good.
-        //
-        // calling stop() has no effect if we did not use the thread,
-        // however, not calling stop() when we did use the thread
-        // causes all sorts of other problems (especially, the thread
-        // never gets joined)
-        //
-        f_thread.stop();
-
-        tcp_bio_client::pointer_t client(f_thread_runner.release_client());
-        if(f_done)
+        if(handshake != f_handshake)
         {
-            // already marked done, ignore the result and lose the
-            // connection immediately
-            //
-            //f_thread_running.close(); -- not necessary, 'client' is the connection
             return;
         }
+        communicator::instance()->remove_connection(f_handshake);
+        f_handshake.reset();
 
-        if(client == nullptr)
+        if(!error.empty())
         {
-            SNAP_LOG_ERROR
-                << "connection to "
-                << f_thread_runner.get_address().to_ipv4or6_string(addr::STRING_IP_BRACKET_ADDRESS | addr::STRING_IP_PORT)
-                << " failed with: "
-                << f_thread_runner.get_last_error()
-                << SNAP_LOG_SEND;
-
-            // signal that an error occurred
-            //
-            f_parent->process_connection_failed(f_thread_runner.get_last_error());
+            f_last_error = error;
+            failed();
+            return;
         }
-        else
-        {
-            f_messenger = std::make_shared<messenger>(f_parent, client);
-
-            // add the messenger to the communicator
-            //
-            communicator::instance()->add_connection(f_messenger);
-
-            // if some messages were cached, process them immediately
-            //
-            while(!f_message_cache.empty())
-            {
-                f_messenger->send_message(f_message_cache[0]);
-                f_message_cache.erase(f_message_cache.begin());
-            }
 
-            // let the client know we are now connected
-            //
-            f_parent->process_connected();
-        }
+        f_connecting = false;
+        connected(handshake->get_client());
     }
 
+
     /** \brief Send a message to the connection.
      *
      * This implementation function actually sends the message to the
@@ -678,6 +950,13 @@ public:
      * Note that the message does not get cached if mark_done() was
      * called earlier since we are trying to close the whole connection.
      *
+     * \note
+     * While the cached messages get replayed, new messages with \p cache
+     * set to true are appended to the back of the cache so they are
+     * received after the older cached messages. Messages with \p cache
+     * set to false are sent immediately and may be received before
+     * the older cached messages.
+     *
      * \param[in] msg  The message to send.
      * \param[in] cache  Whether to cache the message if the connection is
      *                   currently down.
@@ -689,12 +968,21 @@ public:
     {
         if(f_messenger != nullptr)
         {
+            if(cache
+            && !f_done
+            && !f_message_cache.empty())
+            {
+                // a replay is still draining, keep the order
+                //
+                f_message_cache.push(msg);
+                return false;
+            }
             return f_messenger->send_message(msg);
         }
 
         if(cache && !f_done)
         {
-            f_message_cache.push_back(msg);
+            f_message_cache.push(msg);
         }
 
         return false;
@@ -705,10 +993,9 @@ public:
      *
      * This function is used to fully disconnect from the messenger.
      *
-     * If there is a messenger, this means:
-     *
-     * \li Removing the messenger from the communicator instance.
-     * \li Closing the connection in the thread object.
+     * If there is a messenger, this means removing the messenger from the
+     * communicator instance. The messenger owns the TCP connection so
+     * losing it closes the socket.
      *
      * In most cases, it is called when an error occur, also it happens
      * that we call it explicitly through the disconnect() function
@@ -722,16 +1009,91 @@ public:
      */
     void disconnect()
     {
+        stop_replay();
+
         if(f_messenger != nullptr)
         {
+            // the next messenger starts without flow control
+            //
+            bool const blocked(f_messenger->is_flow_blocked());
+
             communicator::instance()->remove_connection(f_messenger);
             f_messenger.reset();
 
-            // just the messenger does not close the TCP connection because
-            // we may have another in the thread runner
-            //
-            f_thread_runner.close();
+            if(blocked)
+            {
+                f_parent->process_flow_blocked(false);
+            }
+        }
+    }
+
+
+    /** \brief Send the next batch of cached messages.
+     *
+     * Once reconnected, the cached messages are sent in batches of
+     * f_replay_count messages every f_replay_interval microseconds.
+     * If the output buffer of the messenger was not yet emptied, the
+     * batch is skipped. This way the replay does not starve the live
+     * traffic and does not grow the output buffer without bounds.
+     */
+    void replay()
+    {
+        if(f_messenger != nullptr
+        && !f_messenger->has_output())
+        {
+            message msg;
+            for(std::size_t count(0); count < f_replay_count && f_message_cache.pop(msg); ++count)
+            {
+                f_messenger->send_message(msg);
+            }
+        }
+
+        if(f_messenger == nullptr
+        || f_message_cache.empty())
+        {
+            stop_replay();
+        }
+    }
+
+
+    /** \brief Retrieve a reference to the message cache.
+     *
+     * \return The cache of messages waiting for the connection.
+     */
+    message_cache & get_message_cache()
+    {
+        return f_message_cache;
+    }
+
+
+    /** \brief Define the speed at which cached messages are replayed.
+     *
+     * \param[in] count  The number of messages sent per batch.
+     * \param[in] interval_us  The delay between two batches.
+     */
+    void set_replay_rate(std::size_t count, std::int64_t interval_us)
+    {
+        if(count == 0)
+        {
+            throw invalid_parameter("the replay count must be at least 1");
+        }
+        if(interval_us < 10)
+        {
+            throw invalid_parameter("the replay interval must be at least 10 microseconds");
         }
+        f_replay_count = count;
+        f_replay_interval = interval_us;
+    }
+
+
+    /** \brief Check whether the messenger ran out of flow control credits.
+     *
+     * \return true if the messenger exists and is blocked.
+     */
+    bool is_flow_blocked() const
+    {
+        return f_messenger != nullptr
+            && f_messenger->is_flow_blocked();
     }
 
 
@@ -762,6 +1124,8 @@ public:
      * will get removed from the communicator instance as soon as it
      * is done with its current write buffer if there is one.
      *
+     * Any connection attempt still in flight gets cancelled.
+     *
      * You may also want to call the disconnection() function to actually
      * reset the pointer along the way.
      */
@@ -769,6 +1133,8 @@ public:
     {
         f_done = true;
 
+        cancel_attempts();
+
         // once done we don't attempt to reconnect so we can as well
         // get rid of our existing cache immediately to save some
         // memory
@@ -783,12 +1149,208 @@ public:
 
 
 private:
+    /** \brief Start the timer used to stagger the connection attempts.
+     *
+     * The timer gets added to the communicator only while a race is
+     * going on.
+     */
+    void start_attempt_timer()
+    {
+        if(f_attempt_timer == nullptr)
+        {
+            f_attempt_timer = std::make_shared<attempt_timer>(weak_from_this());
+        }
+        f_attempt_timer->set_timeout_date(get_current_date() + CONNECTION_ATTEMPT_DELAY);
+        communicator::instance()->add_connection(f_attempt_timer);
+    }
+
+
+    /** \brief Start replaying the cached messages.
+     *
+     * The first batch is sent immediately, the following batches are
+     * sent by the replay timer.
+     */
+    void start_replay()
+    {
+        replay();
+        if(f_messenger != nullptr
+        && !f_message_cache.empty())
+        {
+            if(f_replay_timer == nullptr)
+            {
+                f_replay_timer = std::make_shared<replay_timer>(weak_from_this());
+            }
+            f_replay_timer->set_timeout_delay(f_replay_interval);
+            communicator::instance()->add_connection(f_replay_timer);
+        }
+    }
+
+
+    /** \brief Stop replaying the cached messages.
+     *
+     * \note
+     * The call is safe even if the f_replay_timer is null.
+     */
+    void stop_replay()
+    {
+        communicator::instance()->remove_connection(f_replay_timer);
+    }
+
+
+    /** \brief Stop the connection attempt timer.
+     *
+     * This function removes the timer from the communicator.
+     *
+     * \note
+     * The call is safe even if the f_attempt_timer is null.
+     */
+    void stop_attempt_timer()
+    {
+        communicator::instance()->remove_connection(f_attempt_timer);
+    }
+
+
+    /** \brief Record the error of a failed connection attempt.
+     *
+     * \param[in] address  The address which could not be reached.
+     * \param[in] error  The errno describing the error.
+     */
+    void attempt_failed(addr::addr const & address, int error)
+    {
+        f_last_error = "connect() to "
+                     + address.to_ipv4or6_string(addr::STRING_IP_BRACKET_ADDRESS | addr::STRING_IP_PORT)
+                     + " failed with errno "
+                     + std::to_string(error)
+                     + " -- "
+                     + strerror(error);
+
+        SNAP_LOG_DEBUG
+            << f_last_error
+            << SNAP_LOG_SEND;
+    }
+
+
+    /** \brief One of the connection attempts succeeded.
+     *
+     * This function cancels the other attempts, remembers which address
+     * worked (it gets used first on the next reconnect) and wraps the
+     * socket in a tcp_bio_client object. In secure mode, the TLS handshake
+     * then runs from the communicator loop through a tls_handshake
+     * connection which times out after CONNECT_TIMEOUT.
+     *
+     * \param[in] attempt  The attempt that succeeded.
+     */
+    void succeeded(connect_attempt::pointer_t attempt)
+    {
+        cancel_attempts();
+
+        auto const it(std::find(f_addresses.begin(), f_addresses.end(), attempt->get_address()));
+        if(it != f_addresses.end())
+        {
+            f_index = it - f_addresses.begin();
+        }
+
+        tcp_bio_client::pointer_t client;
+        try
+        {
+            client = std::make_shared<tcp_bio_client>(
+                              attempt->release_socket()
+                            , attempt->get_address()
+                            , f_mode);
+        }
+        catch(std::exception const & e)
+        {
+            f_last_error = e.what();
+            failed();
+            return;
+        }
+
+        if(f_mode != mode_t::MODE_PLAIN)
+        {
+            f_connecting = true;
+            f_handshake = std::make_shared<tls_handshake>(weak_from_this(), client);
+            f_handshake->set_timeout_date(get_current_date() + CONNECT_TIMEOUT);
+            communicator::instance()->add_connection(f_handshake);
+            f_handshake->step();
+            return;
+        }
+
+        connected(client);
+    }
+
+
+    /** \brief All the connection attempts failed.
+     *
+     * This function logs the last error and calls the
+     * process_connection_failed() callback.
+     */
+    void failed()
+    {
+        f_connecting = false;
+
+        SNAP_LOG_ERROR
+            << "connection to "
+            << addr::setaddrmode(addr::STRING_IP_BRACKET_ADDRESS | addr::STRING_IP_PORT)
+            << f_addresses
+            << " failed with: "
+            << f_last_error
+            << SNAP_LOG_SEND;
+
+        // signal that an error occurred
+        //
+        f_parent->process_connection_failed(f_last_error);
+    }
+
+
+    /** \brief The connection is up.
+     *
+     * This function creates the messenger, sends the cached messages
+     * and calls the process_connected() callback.
+     *
+     * \param[in] client  The connected client.
+     */
+    void connected(tcp_bio_client::pointer_t client)
+    {
+        if(f_done)
+        {
+            // already marked done, ignore the result and lose the
+            // connection immediately
+            //
+            return;
+        }
+
+        f_messenger = std::make_shared<messenger>(f_parent, client);
+
+        // add the messenger to the communicator
+        //
+        communicator::instance()->add_connection(f_messenger);
+
+        // if some messages were cached, start sending them
+        //
+        start_replay();
+
+        // let the client know we are now connected
+        //
+        f_parent->process_connected();
+    }
+
+
     tcp_client_permanent_message_connection *   f_parent = nullptr;
-    thread_signal_handler::pointer_t            f_thread_done = thread_signal_handler::pointer_t();
-    runner                                      f_thread_runner;
-    cppthread::thread                           f_thread;
+    addr::addr::vector_t const                  f_addresses;
+    mode_t const                                f_mode;
+    std::size_t                                 f_index = 0;
+    addr::addr::vector_t                        f_candidates = addr::addr::vector_t();
+    std::size_t                                 f_next_candidate = 0;
+    connect_attempt::vector_t                   f_attempts = connect_attempt::vector_t();
+    attempt_timer::pointer_t                    f_attempt_timer = attempt_timer::pointer_t();
+    replay_timer::pointer_t                     f_replay_timer = replay_timer::pointer_t();
+    tls_handshake::pointer_t                    f_handshake = tls_handshake::pointer_t();
+    std::string                                 f_last_error = std::string();
     messenger::pointer_t                        f_messenger = messenger::pointer_t();
-    message::vector_t                           f_message_cache = message::vector_t();
+    message_cache                               f_message_cache = message_cache();
+    std::size_t                                 f_replay_count = DEFAULT_MESSAGE_CACHE_REPLAY_COUNT;
+    std::int64_t                                f_replay_interval = DEFAULT_MESSAGE_CACHE_REPLAY_INTERVAL;
+    bool                                        f_connecting = false;
     bool                                        f_done = false;
 };
 
@@ -834,18 +1396,21 @@ private:
  * -5'000'000LL as the pause parameter.
  *
  * The \p use_thread parameter determines whether the connection should
- * be attempted in a thread (asynchronously) or immediately (which means
- * the timeout callback may block for a while.) If the connection is to
- * a local server with an IP address specified as numbers (i.e. 127.0.0.1),
- * the thread is probably not required. For connections to a remote
- * computer, though, it certainly is important.
+ * be attempted asynchronously or immediately (which means the timeout
+ * callback may block for a while.) The asynchronous connection uses a
+ * non-blocking connect() which gets completed by the communicator; the
+ * name of the parameter is historical, no thread gets created. If the
+ * connection is to a local server with an IP address specified as
+ * numbers (i.e. 127.0.0.1), the asynchronous connection is probably
+ * not required. For connections to a remote computer, though, it
+ * certainly is important.
  *
  * \param[in] address  The address and port to connect to.
  * \param[in] mode  The mode to use to open the connection.
  * \param[in] durations  The amount of time to wait before attempting a new
  *                       connection after a failure, in microseconds, or 0.
- * \param[in] use_thread  Whether a thread is used to connect to the
- *                        server.
+ * \param[in] use_thread  Whether the connection to the server is
+ *                        attempted asynchronously.
  * \param[in] service_name  The name of your daemon service. Only use once
  *                          on your permanent connection to communicator.
  */
@@ -884,8 +1449,8 @@ tcp_client_permanent_message_connection::tcp_client_permanent_message_connection
  * \param[in] mode  The mode to use to open the connection.
  * \param[in] durations  The amount of time to wait before attempting a new
  *                       connection after a failure, in microseconds, or 0.
- * \param[in] use_thread  Whether a thread is used to connect to the
- *                        server.
+ * \param[in] use_thread  Whether the connection to the server is
+ *                        attempted asynchronously.
  * \param[in] service_name  The name of your daemon service. Only use once
  *                          on your permanent connection to communicator.
  */
@@ -920,8 +1485,8 @@ tcp_client_permanent_message_connection::tcp_client_permanent_message_connection
  * \param[in] mode  The mode to use to open the connection.
  * \param[in] durations  The amount of time to wait before attempting a new
  *                       connection after a failure, in microseconds, or 0.
- * \param[in] use_thread  Whether a thread is used to connect to the
- *                        server.
+ * \param[in] use_thread  Whether the connection to the server is
+ *                        attempted asynchronously.
  * \param[in] service_name  The name of your daemon service. Only use once
  *                          on your permanent connection to communicator.
  */
@@ -962,6 +1527,8 @@ tcp_client_permanent_message_connection::~tcp_client_permanent_message_connectio
  * specific order (For example, after a reconnection to communicator
  * you first need to REGISTER or CONNECT...)
  *
+ * The cache is bounded, see get_message_cache() for details.
+ *
  * \param[in] msg  The message to send to the connected server.
  * \param[in] cache  Whether the message should be cached.
  *
@@ -976,6 +1543,36 @@ bool tcp_client_permanent_message_connection::send_message(
 }
 
 
+/** \brief Retrieve the cache of messages.
+ *
+ * While the connection is down, messages sent with the \p cache parameter
+ * set to true are saved in this cache. Use the returned reference to
+ * change the size of the cache, the time to live of the messages and the
+ * overflow policy (drop oldest, drop newest, or spill to file).
+ *
+ * \return A reference to the message cache.
+ */
+message_cache & tcp_client_permanent_message_connection::get_message_cache()
+{
+    return f_impl->get_message_cache();
+}
+
+
+/** \brief Change the rate at which cached messages are sent.
+ *
+ * Once the connection is up again, the cached messages are sent by batch
+ * of \p count messages every \p interval_us microseconds. A batch is
+ * skipped if the previous data was not yet sent.
+ *
+ * \param[in] count  The number of messages per batch.
+ * \param[in] interval_us  The number of microseconds between batches.
+ */
+void tcp_client_permanent_message_connection::set_replay_rate(std::size_t count, std::int64_t interval_us)
+{
+    f_impl->set_replay_rate(count, interval_us);
+}
+
+
 /** \brief Check whether the connection is up.
  *
  * This function returns true if the connection is considered to be up.
@@ -1016,6 +1613,7 @@ bool tcp_client_permanent_message_connection::is_connected() const
 void tcp_client_permanent_message_connection::disconnect()
 {
     f_impl->disconnect();
+    cancel_requests();
 }
 
 
@@ -1069,11 +1667,27 @@ addr::addr tcp_client_permanent_message_connection::get_client_address() const
 }
 
 
+/** \brief Check whether the connection ran out of flow control credits.
+ *
+ * When the server asks for flow control (see ed::flow_control) and all
+ * the credits were used, this function returns true. It returns false
+ * if the connection is currently down.
+ *
+ * \return true if the connection is blocked by the flow control.
+ *
+ * \sa process_flow_blocked()
+ */
+bool tcp_client_permanent_message_connection::is_flow_blocked() const
+{
+    return f_impl->is_flow_blocked();
+}
+
+
 /** \brief Internal timeout callback implementation.
  *
  * This callback implements the guts of this class: it attempts to connect
- * to the specified address and port, optionally after creating a thread
- * so the attempt can happen asynchronously.
+ * to the specified address and port, optionally using a non-blocking
+ * connect() so the attempt can happen asynchronously.
  *
  * When the connection fails, the timer is used to try again pause
  * microseconds later (pause as specified in the constructor).
@@ -1099,6 +1713,16 @@ void tcp_client_permanent_message_connection::process_timeout()
         return;
     }
 
+    // when the process limits the number of reconnect attempts per
+    // second and no token is available, try again once one is
+    //
+    std::int64_t const retry_date(pause_durations::acquire_reconnect_token(get_current_date()));
+    if(retry_date != 0)
+    {
+        set_timeout_date(retry_date);
+        return;
+    }
+
     // setup the next timeout; note that if we went through all the
     // entries in f_pause, then we stop calling the set_timeout_delay()
     // function; as a result, the last timeout remains in place and
@@ -1115,22 +1739,17 @@ void tcp_client_permanent_message_connection::process_timeout()
 
     if(f_use_thread)
     {
-        // in this case we create a thread, run it and know whether the
-        // connection succeeded only when the thread tells us it did
+        // in this case we start a non-blocking connect() and know whether
+        // the connection succeeded only when the communicator tells us
+        // the socket is writable; block the timer until then
         //
-        // TODO: the background_connect() may return false in two situations:
-        //       1) when the thread is already running and then the behavior
-        //          we have below is INCORRECT
-        //       2) when the thread cannot be started (i.e. could not
-        //          allocate the stack?) in which case the if() below
-        //          is the correct behavior
+        // note: the result may be known immediately in which case the
+        //       process_connected() or process_connection_failed() get
+        //       called before async_connect() returns and they manage
+        //       the timer state themselves
         //
-        if(f_impl->background_connect())
-        {
-            // we started the thread successfully, so block the timer
-            //
-            set_enable(false);
-        }
+        set_enable(false);
+        f_impl->async_connect();
     }
     else
     {
@@ -1165,7 +1784,8 @@ void tcp_client_permanent_message_connection::process_error()
     else
     {
         f_impl->disconnect();
-        set_enable(true);
+        cancel_requests();
+        restart_timer();
     }
 }
 
@@ -1192,7 +1812,8 @@ void tcp_client_permanent_message_connection::process_hup()
     else
     {
         f_impl->disconnect();
-        set_enable(true);
+        cancel_requests();
+        restart_timer();
     }
 }
 
@@ -1219,21 +1840,32 @@ void tcp_client_permanent_message_connection::process_invalid()
     else
     {
         f_impl->disconnect();
-        set_enable(true);
+        cancel_requests();
+        restart_timer();
     }
 }
 
 
 /** \brief Make sure that the messenger connection gets removed.
  *
- * This function makes sure that the messenger sub-connection also gets
- * removed from the communicator. Otherwise it would lock the system
+ * This function makes sure that the messenger sub-connection and the
+ * connection attempts in flight also get removed from the communicator.
+ * Otherwise it would lock the system
  * since connections are saved in the communicator object as shared
  * pointers.
  */
 void tcp_client_permanent_message_connection::connection_removed()
 {
     f_impl->disconnect();
+
+    // if we were still trying to connect, make sure the timer restarts
+    // the process in case this connection gets added back later
+    //
+    if(f_impl->cancel_attempts()
+    && !is_done())
+    {
+        set_enable(true);
+    }
 }
 
 
@@ -1274,6 +1906,88 @@ void tcp_client_permanent_message_connection::process_connected()
 }
 
 
+/** \brief The flow control blocked or unblocked the connection.
+ *
+ * The internal connection forwards its flow_control::process_flow_blocked()
+ * callback to this function. When the connection is lost while blocked,
+ * the function is called with false since the next connection starts
+ * without flow control.
+ *
+ * The default implementation does nothing. Reimplement this function
+ * to stop and restart your producer.
+ *
+ * \param[in] blocked  true when the credits ran out, false once more
+ * credits were received.
+ */
+void tcp_client_permanent_message_connection::process_flow_blocked(bool blocked)
+{
+    snapdev::NOT_USED(blocked);
+}
+
+
+/** \brief Restart the timer after the connection was lost.
+ *
+ * In the list mode, the timer is simply re-enabled. In the decorrelated
+ * jitter mode, the first attempt also waits a random delay so all the
+ * clients of a server which just went down do not all reconnect at the
+ * exact same time.
+ */
+void tcp_client_permanent_message_connection::restart_timer()
+{
+    if(f_pause_durations.is_jittered())
+    {
+        set_timeout_delay(f_pause_durations.get_next_delay() * 1'000'000.0);
+    }
+    set_enable(true);
+}
+
+
+
+/** \brief Change the maximum number of connect() in flight.
+ *
+ * When a server goes down, all the permanent connections of a process
+ * try to reconnect. To avoid creating a burst of connect(), the number
+ * of non-blocking connect() in flight is limited process wide. The
+ * connections that reach this limit wait for a little while and try
+ * again.
+ *
+ * \param[in] max_connects  The new maximum, must be at least 1.
+ */
+void tcp_client_permanent_message_connection::set_max_connects_in_flight(std::size_t max_connects)
+{
+    if(max_connects == 0)
+    {
+        throw invalid_parameter("the maximum number of connects in flight must be at least 1");
+    }
+    g_max_connects_in_flight = max_connects;
+}
+
+
+/** \brief Retrieve the maximum number of connect() in flight.
+ *
+ * \return The maximum number of connect() in flight in this process.
+ *
+ * \sa set_max_connects_in_flight()
+ */
+std::size_t tcp_client_permanent_message_connection::get_max_connects_in_flight()
+{
+    return g_max_connects_in_flight;
+}
+
+
+/** \brief Retrieve the number of connect() currently in flight.
+ *
+ * This function returns the number of non-blocking connect() currently
+ * waiting for the communicator to tell us whether they succeeded.
+ *
+ * \return The number of connect() in flight in this process.
+ */
+std::size_t tcp_client_permanent_message_connection::get_connects_in_flight()
+{
+    return g_connects_in_flight;
+}
+
+
 
 } // namespace ed
 // vim: ts=4 sw=4 et
@@ -24,7 +24,8 @@
  * "forever".
  *
  * The main class is actually just a timer. It creates a TCP connection
- * as a sub-object and tries to connect to a server. If the connection
+ * as a sub-object and tries to connect to a server using a non-blocking
+ * connect(). If the connection
  * fails, the timer is used to try again a little later. If the
  * connection succeeds for a while and then dies, the timer is restarted
  * and a new connection is restarted while we process the timeout.
@@ -34,6 +35,7 @@
 //
 #include    <eventdispatcher/connection_with_send_message.h>
 #include    <eventdispatcher/dispatcher_support.h>
+#include    <eventdispatcher/message_cache.h>
 #include    <eventdispatcher/pause_durations.h>
 #include    <eventdispatcher/tcp_bio_client.h>
 #include    <eventdispatcher/timer.h>
@@ -49,6 +51,9 @@ namespace ed
 {
 
 
+constexpr std::size_t const    DEFAULT_MAX_CONNECTS_IN_FLIGHT = 64;
+
+
 namespace detail
 {
 class tcp_client_permanent_message_connection_impl;
@@ -91,6 +96,13 @@ public:
     void                        mark_done();
     void                        mark_done(bool messenger);
     addr::addr                  get_client_address() const;
+    bool                        is_flow_blocked() const;
+    message_cache &             get_message_cache();
+    void                        set_replay_rate(std::size_t count, std::int64_t interval_us);
+
+    static void                 set_max_connects_in_flight(std::size_t max_connects);
+    static std::size_t          get_max_connects_in_flight();
+    static std::size_t          get_connects_in_flight();
 
     // connection_with_send_message implementation
     //
@@ -108,8 +120,11 @@ public:
     //
     virtual void                process_connection_failed(std::string const & error_message);
     virtual void                process_connected();
+    virtual void                process_flow_blocked(bool blocked);
 
 private:
+    void                        restart_timer();
+
     std::shared_ptr<detail::tcp_client_permanent_message_connection_impl>
                                 f_impl = std::shared_ptr<detail::tcp_client_permanent_message_connection_impl>();
     pause_durations             f_pause_durations = pause_durations(0);
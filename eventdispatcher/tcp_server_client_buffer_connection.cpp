@@ -136,6 +136,16 @@ bool tcp_server_client_buffer_connection::is_writer() const
 }
 
 
+/** \brief Get the number of bytes waiting in the output buffer.
+ *
+ * \return The number of bytes not yet written to the socket.
+ */
+std::size_t tcp_server_client_buffer_connection::get_output_size() const
+{
+    return f_output.size() - f_position;
+}
+
+
 /** \brief Write data to the connection.
  *
  * This function can be used to send data to this TCP/IP connection.
@@ -180,6 +190,7 @@ ssize_t tcp_server_client_buffer_connection::write(void const * data, size_t con
             ssize_t const r(tcp_server_client_connection::write(d, l));
             if(r > 0)
             {
+                add_bytes_written(r);
                 l -= r;
                 if(l == 0)
                 {
@@ -245,6 +256,7 @@ void tcp_server_client_buffer_connection::process_read()
             ssize_t const r(read(&buffer[0], buffer.size()));
             if(r > 0)
             {
+                add_bytes_read(r);
                 for(ssize_t position(0); position < r; )
                 {
                     std::vector<char>::const_iterator it(std::find(buffer.begin() + position, buffer.begin() + r, '\n'));
@@ -332,6 +344,7 @@ void tcp_server_client_buffer_connection::process_write()
         ssize_t const r(tcp_server_client_connection::write(&f_output[f_position], f_output.size() - f_position));
         if(r > 0)
         {
+            add_bytes_written(r);
             // some data was written
             f_position += r;
             if(f_position >= f_output.size())
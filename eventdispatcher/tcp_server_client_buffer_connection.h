@@ -47,6 +47,7 @@ public:
 
     // connection implementation
     virtual bool                is_writer() const override;
+    virtual std::size_t         get_output_size() const override;
 
     // tcp_server_client_connection implementation
     virtual ssize_t             write(void const * data, size_t const length) override;
@@ -19,6 +19,7 @@
 // self
 //
 #include    "eventdispatcher_qt/qt_connection.h"
+#include    "eventdispatcher_qt/qt_event_loop.h"
 
 
 // eventdispatcher
@@ -67,6 +68,12 @@
  * you look at using a thread for your eventdispatcher loop in such a
  * situation (i.e. if you're using OpenGL and expect realtime updates,
  * this class is definitely not a good solution).
+ *
+ * The qt_event_loop does the opposite: the Qt loop drives the
+ * communicator through its poll descriptor, which avoids the timer.
+ * Prefer that class in new code.
+ *
+ * \sa qt_event_loop
  */
 
 namespace ed
@@ -179,10 +186,7 @@ qt_connection::qt_connection()
         throw no_connection_found("qt_connection was not able to find a file descriptor to poll() on");
     }
 
-    // Qt has many internal functionality which doesn't get awaken by
-    // the X11 socket so we have always be checking for messages...
-    //
-    set_timeout_delay(100'000);
+    set_polling(!qt_event_loop::is_active());
 }
 
 
@@ -198,6 +202,24 @@ qt_connection::~qt_connection()
 }
 
 
+/** \brief Turn the Qt events timer on or off.
+ *
+ * Many Qt events do not go through the X11 socket so, when the
+ * communicator drives the loop, this connection wakes up every 100ms
+ * to process them.
+ *
+ * When a qt_event_loop exists, the Qt loop drives the communicator and
+ * the timer is not necessary. The qt_event_loop turns it off while it
+ * exists.
+ *
+ * \param[in] polling  Whether to wake up every 100ms.
+ */
+void qt_connection::set_polling(bool polling)
+{
+    set_timeout_delay(polling ? QT_CONNECTION_POLLING_DELAY : -1);
+}
+
+
 /** \brief Retrieve the X11 socket.
  *
  * This function returns the X11 socket. It may return -1 although by
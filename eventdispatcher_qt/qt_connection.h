@@ -27,6 +27,9 @@ namespace ed
 {
 
 
+constexpr std::int64_t const    QT_CONNECTION_POLLING_DELAY = 100'000;  // 100ms
+
+
 class qt_connection
     : public connection
 {
@@ -36,6 +39,8 @@ public:
                                 qt_connection();
     virtual                     ~qt_connection() override;
 
+    void                        set_polling(bool polling);
+
     // implements connection
     virtual int                 get_socket() const override;
     virtual bool                is_reader() const override;
@@ -0,0 +1,380 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "eventdispatcher_qt/qt_event_loop.h"
+#include    "eventdispatcher_qt/qt_connection.h"
+
+
+// eventdispatcher
+//
+#include    "eventdispatcher/communicator.h"
+#include    "eventdispatcher/exception.h"
+#include    "eventdispatcher/utils.h"
+
+
+// snapdev
+//
+#include    <snapdev/safe_variable.h>
+
+
+// Qt
+//
+#include    <QAbstractEventDispatcher>
+#include    <QCoreApplication>
+#include    <QSocketNotifier>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+/** \file
+ * \brief Implementation of the Qt event loop integration.
+ *
+ * This object lets the Qt event loop drive the communicator. You
+ * create your QApplication, add your connections to the communicator,
+ * create a qt_event_loop, and then call the usual app.exec().
+ *
+ * The communicator exposes an epoll descriptor which becomes readable
+ * whenever one of its connections has an event. That descriptor is
+ * watched by a QSocketNotifier and the next communicator timeout is
+ * handled by a Qt timer. As a result, the communicator callbacks run
+ * as soon as an event happens and the process sleeps when idle, unlike
+ * the qt_connection which wakes up every 100ms.
+ */
+
+namespace ed
+{
+namespace
+{
+
+
+/** \brief A global variable to check unicity.
+ *
+ * Only one qt_event_loop can drive the communicator. This flag is used
+ * to detect attempts at creating a second one.
+ */
+bool g_qt_event_loop_created = false;
+
+
+} // no name namespace
+
+
+
+namespace detail
+{
+
+
+/** \brief The Qt side of the qt_event_loop.
+ *
+ * This object is a QSocketNotifier on the communicator poll descriptor.
+ * It also handles the Qt timer used for the communicator timeouts.
+ *
+ * It overrides the event() and timerEvent() functions instead of using
+ * signals and slots so the library does not need to go through the
+ * Qt meta object compiler.
+ */
+class qt_notifier
+    : public QSocketNotifier
+{
+public:
+                        qt_notifier(qt_event_loop * loop, int fd)
+                            : QSocketNotifier(fd, QSocketNotifier::Read)
+                            , f_loop(loop)
+                        {
+                            // Qt callbacks may change the communicator
+                            // timeouts, make sure the timer follows
+                            //
+                            f_about_to_block = QObject::connect(
+                                      QAbstractEventDispatcher::instance()
+                                    , &QAbstractEventDispatcher::aboutToBlock
+                                    , [this]()
+                                    {
+                                        f_loop->update_timeout();
+                                    });
+                        }
+
+    virtual             ~qt_notifier() override
+                        {
+                            QObject::disconnect(f_about_to_block);
+                        }
+
+    void                set_timeout(std::int64_t timeout_ms)
+                        {
+                            std::int64_t deadline(-1);
+                            if(timeout_ms >= 0)
+                            {
+                                deadline = get_current_date() + timeout_ms * 1'000;
+                            }
+                            set_deadline(deadline);
+                        }
+
+    std::int64_t        get_deadline() const
+                        {
+                            return f_deadline;
+                        }
+
+    void                set_deadline(std::int64_t deadline_us)
+                        {
+                            if(deadline_us == f_deadline)
+                            {
+                                return;
+                            }
+                            f_deadline = deadline_us;
+
+                            if(f_timer_id != 0)
+                            {
+                                killTimer(f_timer_id);
+                                f_timer_id = 0;
+                            }
+                            if(deadline_us >= 0)
+                            {
+                                std::int64_t const delay((deadline_us - get_current_date() + 999) / 1'000);
+                                f_timer_id = startTimer(static_cast<int>(std::max(delay, static_cast<std::int64_t>(0))), Qt::PreciseTimer);
+                            }
+                        }
+
+protected:
+    virtual bool        event(QEvent * e) override
+                        {
+                            if(e->type() == QEvent::SockAct)
+                            {
+                                f_loop->process_events();
+                                return true;
+                            }
+                            return QSocketNotifier::event(e);
+                        }
+
+    virtual void        timerEvent(QTimerEvent * e) override
+                        {
+                            if(e->timerId() == f_timer_id)
+                            {
+                                f_loop->process_events();
+                            }
+                        }
+
+private:
+    qt_event_loop *     f_loop = nullptr;
+    int                 f_timer_id = 0;
+    std::int64_t        f_deadline = -1;
+    QMetaObject::Connection
+                        f_about_to_block = QMetaObject::Connection();
+};
+
+
+} // namespace detail
+
+
+
+/** \class qt_event_loop
+ * \brief Run the communicator from the Qt event loop.
+ *
+ * This class is used when the Qt event loop is the main loop of your
+ * application. You can only create one of them. Attempting to create
+ * a second one throws an exception.
+ *
+ * The communicator::run() function must not be called while this object
+ * exists. Instead, call app.exec() and the communicator callbacks get
+ * called from within the Qt loop whenever their connections are ready
+ * or time out.
+ *
+ * While this object exists, the qt_connection does not need its timer
+ * and it gets turned off.
+ */
+
+
+
+/** \brief Initializes the Qt event loop integration.
+ *
+ * The QApplication (or QCoreApplication) must exist before you create
+ * this object since the Qt event dispatcher is required.
+ *
+ * The constructor runs a first non-blocking iteration of the
+ * communicator so connections which are already ready get processed
+ * and the poll descriptor and timer get set up.
+ *
+ * \exception implementation_error
+ * If a qt_event_loop already exists, this exception is raised.
+ *
+ * \exception no_connection_found
+ * If no Qt event dispatcher exists yet, this exception is raised.
+ */
+qt_event_loop::qt_event_loop()
+{
+    if(g_qt_event_loop_created)
+    {
+        throw implementation_error("you cannot create more than one qt_event_loop, make sure to delete the previous one before creating a new one.");
+    }
+
+    if(QAbstractEventDispatcher::instance() == nullptr)
+    {
+        throw no_connection_found("qt_event_loop requires a Qt event dispatcher, create your QApplication first.");
+    }
+
+    g_qt_event_loop_created = true;
+    set_qt_connection_polling(false);
+
+    f_notifier = std::make_unique<detail::qt_notifier>(
+                          this
+                        , communicator::instance()->get_poll_fd());
+
+    process_events();
+}
+
+
+/** \brief Clean up the Qt event loop integration.
+ *
+ * This function stops listening to the communicator. After this call,
+ * you can create a new qt_event_loop again.
+ */
+qt_event_loop::~qt_event_loop()
+{
+    f_notifier.reset();
+
+    g_qt_event_loop_created = false;
+    set_qt_connection_polling(true);
+}
+
+
+/** \brief Check whether a qt_event_loop exists.
+ *
+ * \return true if the Qt loop currently drives the communicator.
+ */
+bool qt_event_loop::is_active()
+{
+    return g_qt_event_loop_created;
+}
+
+
+/** \brief Run one iteration of the communicator.
+ *
+ * This function calls communicator::process_events() and then arms
+ * the Qt timer with the delay until the next communicator timeout.
+ *
+ * It gets called whenever the communicator poll descriptor becomes
+ * readable and when the timer fires.
+ *
+ * If a communicator callback runs a nested Qt event loop (i.e. a modal
+ * dialog), the communicator is not processed again until that callback
+ * returns.
+ */
+void qt_event_loop::process_events()
+{
+    if(f_processing)
+    {
+        return;
+    }
+    snapdev::safe_variable processing(f_processing, true);
+
+    communicator::pointer_t c(communicator::instance());
+    c->process_events();
+    f_connection_count = c->get_connections().size();
+    f_notifier->set_timeout(c->get_poll_timeout());
+}
+
+
+/** \brief Re-arm the Qt timer without dispatching.
+ *
+ * This function is called each time the Qt loop is about to block.
+ * The Qt callbacks may have changed the timeout of a connection so
+ * the Qt timer is moved earlier if one of the connections now times
+ * out before it. A timeout moved later only causes one extra call to
+ * process_events(). This function does not poll nor call any
+ * communicator callback.
+ *
+ * If a connection was added or removed, the poll descriptor is not
+ * up to date so the timer gets set to fire immediately.
+ */
+void qt_event_loop::update_timeout()
+{
+    if(f_processing)
+    {
+        return;
+    }
+
+    connection::vector_t const & connections(communicator::instance()->get_connections());
+    if(connections.size() != f_connection_count)
+    {
+        f_notifier->set_deadline(0);
+        return;
+    }
+
+    std::int64_t deadline(-1);
+    for(auto const & c : connections)
+    {
+        if(!c->is_enabled())
+        {
+            continue;
+        }
+        std::int64_t const timestamp(c->get_timeout_timestamp());
+        if(timestamp == -1)
+        {
+            continue;
+        }
+        std::int64_t const latest(timestamp + c->get_timeout_slack());
+        if(deadline == -1
+        || latest < deadline)
+        {
+            deadline = latest;
+        }
+    }
+
+    // the timer was armed with a delay in milliseconds, ignore the
+    // rounding
+    //
+    std::int64_t const current(f_notifier->get_deadline());
+    if(deadline != -1
+    && (current == -1 || deadline < current - 1'000))
+    {
+        f_notifier->set_deadline(deadline);
+    }
+}
+
+
+/** \brief Turn the qt_connection timer on or off.
+ *
+ * The qt_connection wakes up every 100ms to process the Qt events when
+ * the communicator drives the loop. When Qt drives the loop, that timer
+ * is useless.
+ *
+ * \param[in] polling  Whether the qt_connection timer is used.
+ */
+void qt_event_loop::set_qt_connection_polling(bool polling)
+{
+    for(auto const & c : communicator::instance()->get_connections())
+    {
+        qt_connection::pointer_t qt(std::dynamic_pointer_cast<qt_connection>(c));
+        if(qt != nullptr)
+        {
+            qt->set_polling(polling);
+        }
+    }
+}
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
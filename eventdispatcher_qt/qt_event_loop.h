@@ -0,0 +1,70 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Declaration of the Qt event loop integration.
+ *
+ * The qt_event_loop lets the Qt event loop drive the communicator.
+ */
+
+// C++
+//
+#include    <cstddef>
+#include    <memory>
+
+
+
+namespace ed
+{
+
+
+namespace detail
+{
+class qt_notifier;
+} // namespace detail
+
+
+class qt_event_loop
+{
+public:
+    typedef std::shared_ptr<qt_event_loop> pointer_t;
+
+                                qt_event_loop();
+                                qt_event_loop(qt_event_loop const &) = delete;
+                                ~qt_event_loop();
+
+    qt_event_loop &             operator = (qt_event_loop const &) = delete;
+
+    static bool                 is_active();
+
+    void                        process_events();
+    void                        update_timeout();
+
+private:
+    void                        set_qt_connection_polling(bool polling);
+
+    std::unique_ptr<detail::qt_notifier>
+                                f_notifier;
+    std::size_t                 f_connection_count = 0;
+    bool                        f_processing = false;
+};
+
+
+} // namespace ed
+// vim: ts=4 sw=4 et
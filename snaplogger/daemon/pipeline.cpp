@@ -0,0 +1,486 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the ingestion pipeline.
+ *
+ * The pipeline has three stages:
+ *
+ * 1. the network connections receive the data in the communicator thread
+ *    and push it, unparsed, to the pipeline;
+ * 2. a pool of worker threads parses the data and creates the snaplogger
+ *    messages;
+ * 3. a writer thread sends the messages to the appenders and, if one
+ *    is defined, saves them in the log store.
+ *
+ * The data of one source (a TCP connection or a UDP sender) always goes
+ * to the same worker so its messages remain in order.
+ *
+ * Each worker has a queue. When a queue reaches its size, the source
+ * which pushed the data is paused: it stops reading its socket and the
+ * TCP clients are sent a PAUSE message. The worker signals the
+ * communicator thread once its queue is down to half its size and the
+ * sources get resumed. The workers wait for the writer when its queue
+ * is full, which in turn fills the worker queues.
+ */
+
+// self
+//
+#include    "snaplogger/daemon/pipeline.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/thread_done_signal.h>
+
+
+// cppthread
+//
+#include    <cppthread/guard.h>
+#include    <cppthread/mutex.h>
+#include    <cppthread/runner.h>
+
+
+// C++
+//
+#include    <atomic>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace snaplogger_daemon
+{
+
+
+
+namespace detail
+{
+
+
+
+struct pipeline_item
+{
+    pipeline_source::pointer_t  f_source = pipeline_source::pointer_t();
+    std::string                 f_data = std::string();
+};
+
+
+class resume_signal
+    : public ed::thread_done_signal
+{
+public:
+    resume_signal(pipeline * p)
+        : f_pipeline(p)
+    {
+        set_name("snaploggerd-resume-signal");
+    }
+
+    // thread_done_signal implementation
+    //
+    virtual void process_read() override
+    {
+        thread_done_signal::process_read();
+
+        f_pipeline->resume_sources();
+    }
+
+private:
+    pipeline *                  f_pipeline = nullptr;
+};
+
+
+
+class pipeline_writer
+    : public cppthread::runner
+{
+public:
+    pipeline_writer()
+        : runner("snaploggerd-writer")
+    {
+    }
+
+    std::size_t size() const
+    {
+        return f_queue.size();
+    }
+
+    /** \brief Push a message once the queue is under \p limit.
+     *
+     * The calling worker sleeps until the writer thread pops messages
+     * and the queue size goes under \p limit.
+     */
+    void push(snaplogger::message::pointer_t msg, std::size_t limit)
+    {
+        {
+            cppthread::guard lock(f_room_mutex);
+
+            ++f_room_waiters;
+            while(f_queue.size() >= limit)
+            {
+                f_room_mutex.wait();
+            }
+            --f_room_waiters;
+        }
+        f_queue.push_back(msg);
+    }
+
+    void done()
+    {
+        f_queue.done(false);
+    }
+
+    void set_store(snaplogger_network::log_store_writer::pointer_t store)
+    {
+        f_store = store;
+    }
+
+    virtual void run() override
+    {
+        for(;;)
+        {
+            snaplogger::message::pointer_t msg;
+            if(!f_queue.pop_front(msg, f_store == nullptr ? -1 : 1'000'000))
+            {
+                if(f_queue.is_done())
+                {
+                    break;
+                }
+
+                // idle, do not keep the last messages in memory
+                //
+                if(f_store != nullptr)
+                {
+                    f_store->flush();
+                }
+                continue;
+            }
+            if(f_room_waiters > 0)
+            {
+                cppthread::guard lock(f_room_mutex);
+                f_room_mutex.broadcast();
+            }
+            snaplogger::send_message(*msg);
+            if(f_store != nullptr)
+            {
+                f_store->append(*msg);
+            }
+        }
+
+        if(f_store != nullptr)
+        {
+            f_store->close();
+        }
+    }
+
+private:
+    snaplogger_network::log_store_writer::pointer_t
+                                f_store = snaplogger_network::log_store_writer::pointer_t();
+    cppthread::fifo<snaplogger::message::pointer_t>
+                                f_queue = cppthread::fifo<snaplogger::message::pointer_t>();
+    cppthread::mutex            f_room_mutex = cppthread::mutex();
+    std::atomic<std::size_t>    f_room_waiters = 0;
+};
+
+
+class pipeline_worker
+    : public cppthread::runner
+{
+public:
+    pipeline_worker(
+              std::shared_ptr<pipeline_writer> writer
+            , std::shared_ptr<resume_signal> signal
+            , std::size_t queue_size)
+        : runner("snaploggerd-worker")
+        , f_writer(writer)
+        , f_resume_signal(signal)
+        , f_queue_size(queue_size)
+    {
+    }
+
+    std::size_t size() const
+    {
+        return f_queue.size();
+    }
+
+    void push(pipeline_item const & item)
+    {
+        f_queue.push_back(item);
+    }
+
+    void done()
+    {
+        f_queue.done(false);
+    }
+
+    /** \brief Check whether the queue is down to half its size.
+     *
+     * \return true if paused sources can be resumed.
+     */
+    bool has_room() const
+    {
+        return f_queue.size() <= f_queue_size / 2;
+    }
+
+    /** \brief Request a signal once the queue is down to half its size.
+     */
+    void request_resume_signal()
+    {
+        f_sources_paused = true;
+    }
+
+    virtual void run() override
+    {
+        pipeline_source::output_t const output([this](snaplogger::message::pointer_t msg)
+            {
+                f_writer->push(msg, f_queue_size);
+            });
+
+        for(;;)
+        {
+            pipeline_item item;
+            if(!f_queue.pop_front(item, -1))
+            {
+                if(f_queue.is_done())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            try
+            {
+                item.f_source->parse(item.f_data, output);
+            }
+            catch(std::exception const & e)
+            {
+                SNAP_LOG_ERROR
+                    << "an exception occurred while parsing log data: "
+                    << e.what()
+                    << SNAP_LOG_SEND;
+            }
+
+            if(f_sources_paused
+            && f_queue.size() <= f_queue_size / 2
+            && f_sources_paused.exchange(false))
+            {
+                f_resume_signal->thread_done();
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<pipeline_writer>
+                                f_writer = std::shared_ptr<pipeline_writer>();
+    std::shared_ptr<resume_signal>
+                                f_resume_signal = std::shared_ptr<resume_signal>();
+    std::size_t                 f_queue_size = DEFAULT_QUEUE_SIZE;
+    std::atomic<bool>           f_sources_paused = false;
+    cppthread::fifo<pipeline_item>
+                                f_queue = cppthread::fifo<pipeline_item>();
+};
+
+
+} // namespace detail
+
+
+
+pipeline_source::~pipeline_source()
+{
+}
+
+
+
+/** \brief Initialize the pipeline.
+ *
+ * \param[in] workers  The number of worker threads parsing the data.
+ * \param[in] queue_size  The size of each queue before backpressure
+ * is applied.
+ */
+pipeline::pipeline(
+          std::size_t workers
+        , std::size_t queue_size)
+    : f_queue_size(std::max(static_cast<std::size_t>(2), queue_size))
+{
+    f_resume_signal = std::make_shared<detail::resume_signal>(this);
+    f_writer = std::make_shared<detail::pipeline_writer>();
+    for(std::size_t idx(0); idx < std::max(static_cast<std::size_t>(1), workers); ++idx)
+    {
+        f_workers.push_back(std::make_shared<detail::pipeline_worker>(
+                  f_writer
+                , f_resume_signal
+                , f_queue_size));
+    }
+}
+
+
+pipeline::~pipeline()
+{
+    stop();
+}
+
+
+/** \brief Save the messages in a log store.
+ *
+ * The writer thread appends each message to \p store after sending it
+ * to the appenders. This function must be called before start().
+ *
+ * \param[in] store  The log store.
+ */
+void pipeline::set_store(snaplogger_network::log_store_writer::pointer_t store)
+{
+    f_writer->set_store(store);
+}
+
+
+/** \brief Start the threads.
+ *
+ * \param[in] communicator  The communicator receiving the resume signal.
+ */
+void pipeline::start(ed::communicator::pointer_t communicator)
+{
+    if(f_writer_thread != nullptr)
+    {
+        return;
+    }
+
+    f_communicator = communicator;
+    f_communicator->add_connection(f_resume_signal);
+
+    f_writer_thread = std::make_shared<cppthread::thread>("snaploggerd-writer", f_writer);
+    f_writer_thread->start();
+
+    for(auto const & w : f_workers)
+    {
+        cppthread::thread::pointer_t t(std::make_shared<cppthread::thread>("snaploggerd-worker", w));
+        t->start();
+        f_threads.push_back(t);
+    }
+}
+
+
+/** \brief Stop the threads.
+ *
+ * The data already pushed gets processed before the threads exit.
+ */
+void pipeline::stop()
+{
+    if(f_writer_thread == nullptr)
+    {
+        return;
+    }
+
+    for(auto const & w : f_workers)
+    {
+        w->done();
+    }
+    for(auto const & t : f_threads)
+    {
+        t->stop();
+    }
+    f_threads.clear();
+
+    f_writer->done();
+    f_writer_thread->stop();
+    f_writer_thread.reset();
+
+    f_communicator->remove_connection(f_resume_signal);
+    f_paused.clear();
+}
+
+
+/** \brief Push data received by a source.
+ *
+ * This function is called from the communicator thread. It never blocks.
+ * Instead, when the queue of the worker gets full, the source is asked
+ * to pause its input until the worker catches up.
+ *
+ * \param[in] source  The source of the data, which also parses it.
+ * \param[in] key  A number identifying the sender; the data with the
+ * same key is processed in order.
+ * \param[in] data  The data to parse.
+ */
+void pipeline::push(
+      pipeline_source::pointer_t source
+    , std::size_t key
+    , std::string && data)
+{
+    std::size_t const idx(key % f_workers.size());
+
+    detail::pipeline_item item;
+    item.f_source = source;
+    item.f_data.swap(data);
+    f_workers[idx]->push(item);
+
+    if(f_workers[idx]->size() >= f_queue_size)
+    {
+        for(auto const & p : f_paused)
+        {
+            if(p.f_source == source)
+            {
+                return;
+            }
+        }
+        source->pause_input();
+        f_paused.push_back({ source, idx });
+
+        f_workers[idx]->request_resume_signal();
+        if(f_workers[idx]->has_room())
+        {
+            // the worker caught up in the meantime
+            //
+            resume_sources();
+        }
+    }
+}
+
+
+/** \brief Resume the sources for which the worker has room again.
+ *
+ * This function is called from the communicator thread whenever a
+ * worker signals that its queue is down to half its size.
+ */
+void pipeline::resume_sources()
+{
+    for(auto it(f_paused.begin()); it != f_paused.end(); )
+    {
+        std::shared_ptr<detail::pipeline_worker> const & w(f_workers[it->f_worker]);
+        if(!w->has_room())
+        {
+            // the other sources of that worker filled its queue again
+            // since it sent the signal, wait for the next one
+            //
+            w->request_resume_signal();
+            if(!w->has_room())
+            {
+                ++it;
+                continue;
+            }
+        }
+        it->f_source->resume_input();
+        it = f_paused.erase(it);
+    }
+}
+
+
+
+} // snaplogger_daemon namespace
+// vim: ts=4 sw=4 et
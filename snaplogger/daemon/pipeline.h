@@ -0,0 +1,144 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief The ingestion pipeline of the daemon.
+ *
+ * This file declares the pipeline moving the data received by the
+ * network connections to the worker threads parsing it and then to the
+ * writer thread sending the messages to the appenders.
+ */
+
+// snaplogger_network
+//
+#include    "snaplogger/network/log_store.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+
+
+// cppthread
+//
+#include    <cppthread/fifo.h>
+#include    <cppthread/thread.h>
+
+
+// C++
+//
+#include    <functional>
+#include    <vector>
+
+
+
+namespace snaplogger_daemon
+{
+
+
+
+constexpr std::size_t const         DEFAULT_WORKERS = 4;
+constexpr std::size_t const         DEFAULT_QUEUE_SIZE = 10'000;
+
+
+class pipeline_source
+{
+public:
+    typedef std::shared_ptr<pipeline_source>
+                                    pointer_t;
+    typedef std::function<void(snaplogger::message::pointer_t msg)>
+                                    output_t;
+
+    virtual                         ~pipeline_source();
+
+    // called from a worker thread
+    //
+    virtual void                    parse(
+                                          std::string const & data
+                                        , output_t const & output) = 0;
+
+    // called from the communicator thread
+    //
+    virtual void                    pause_input() = 0;
+    virtual void                    resume_input() = 0;
+};
+
+
+namespace detail
+{
+class pipeline_worker;
+class pipeline_writer;
+class resume_signal;
+}
+
+
+class pipeline
+{
+public:
+    typedef std::shared_ptr<pipeline>
+                                    pointer_t;
+
+                                    pipeline(
+                                          std::size_t workers
+                                        , std::size_t queue_size);
+                                    pipeline(pipeline const &) = delete;
+                                    ~pipeline();
+    pipeline &                      operator = (pipeline const &) = delete;
+
+    void                            set_store(snaplogger_network::log_store_writer::pointer_t store);
+    void                            start(ed::communicator::pointer_t communicator);
+    void                            stop();
+
+    void                            push(
+                                          pipeline_source::pointer_t source
+                                        , std::size_t key
+                                        , std::string && data);
+
+    void                            resume_sources();
+
+private:
+    struct paused_t
+    {
+        pipeline_source::pointer_t  f_source = pipeline_source::pointer_t();
+        std::size_t                 f_worker = 0;
+    };
+
+    std::size_t                     f_queue_size = DEFAULT_QUEUE_SIZE;
+    ed::communicator::pointer_t     f_communicator = ed::communicator::pointer_t();
+    std::vector<std::shared_ptr<detail::pipeline_worker>>
+                                    f_workers = std::vector<std::shared_ptr<detail::pipeline_worker>>();
+    std::vector<cppthread::thread::pointer_t>
+                                    f_threads = std::vector<cppthread::thread::pointer_t>();
+    std::shared_ptr<detail::pipeline_writer>
+                                    f_writer = std::shared_ptr<detail::pipeline_writer>();
+    cppthread::thread::pointer_t    f_writer_thread = cppthread::thread::pointer_t();
+    std::shared_ptr<detail::resume_signal>
+                                    f_resume_signal = std::shared_ptr<detail::resume_signal>();
+    std::vector<paused_t>           f_paused = std::vector<paused_t>();
+};
+
+
+
+} // snaplogger_daemon namespace
+// vim: ts=4 sw=4 et
@@ -54,6 +54,7 @@
 
 // C++
 //
+#include    <algorithm>
 #include    <iostream>
 
 
@@ -120,6 +121,61 @@ const advgetopt::option g_options[] =
         , advgetopt::Help("a secret code to be used along the udp-listen option; use empty to not have to use a secret code")
         , advgetopt::EnvironmentVariableName("UDP_LISTEN_SECRET_CODE")
     ),
+    advgetopt::define_option(
+          advgetopt::Name("workers")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+            , advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+            , advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+            , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("4")
+        , advgetopt::Help("the number of threads parsing the incoming log messages.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("queue-size")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+            , advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+            , advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+            , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("10000")
+        , advgetopt::Help("the number of messages queued by each thread before the clients get paused.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("store-path")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+            , advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+            , advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+            , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("")
+        , advgetopt::Help("a directory where the messages get saved in an indexed store which the snaplog tool can query; use empty to not save the messages")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("store-segment-size")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+            , advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+            , advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+            , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("67108864")
+        , advgetopt::Help("the size, in bytes, at which a new segment of the store gets started.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("store-max-segments")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+            , advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+            , advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+            , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("0")
+        , advgetopt::Help("the number of segments kept in the store; the oldest segments get deleted; use 0 to keep all the segments.")
+    ),
     advgetopt::end_options()
 };
 
@@ -207,6 +263,25 @@ snaploggerd::snaploggerd(int argc, char * argv[])
 
 bool snaploggerd::init()
 {
+    long const workers(f_opts.get_long("workers"));
+    long const queue_size(f_opts.get_long("queue-size"));
+    f_pipeline = std::make_shared<pipeline>(
+              static_cast<std::size_t>(std::max(1L, workers))
+            , static_cast<std::size_t>(std::max(2L, queue_size)));
+
+    std::string const store_path(f_opts.get_string("store-path"));
+    if(!store_path.empty())
+    {
+        long const segment_size(f_opts.get_long("store-segment-size"));
+        long const max_segments(f_opts.get_long("store-max-segments"));
+        f_pipeline->set_store(std::make_shared<snaplogger_network::log_store_writer>(
+                  store_path
+                , static_cast<std::size_t>(std::max(0L, segment_size))
+                , static_cast<std::size_t>(std::max(0L, max_segments))));
+    }
+
+    f_pipeline->start(f_communicator);
+
     std::string const tcp_listen(f_opts.get_string("tcp-listen"));
     if(!tcp_listen.empty())
     {
@@ -215,7 +290,9 @@ bool snaploggerd::init()
             , "127.0.0.1"
             , DEFAULT_TCP_PORT
             , "tcp"));
-        f_tcp_server = std::make_shared<tcp_logger_server>(listen);
+        f_tcp_server = std::make_shared<tcp_logger_server>(
+              listen
+            , f_pipeline);
         f_communicator->add_connection(f_tcp_server);
     }
 
@@ -229,7 +306,8 @@ bool snaploggerd::init()
             , "udp"));
         f_udp_server = std::make_shared<udp_logger_server>(
               listen
-            , f_opts.get_string("udp-listen-secret-code"));
+            , f_opts.get_string("udp-listen-secret-code")
+            , f_pipeline);
         f_communicator->add_connection(f_udp_server);
     }
 
@@ -241,6 +319,13 @@ int snaploggerd::run()
 {
     f_communicator->run();
 
+    // process the messages still in the pipeline
+    //
+    if(f_pipeline != nullptr)
+    {
+        f_pipeline->stop();
+    }
+
     return 0;
 }
 
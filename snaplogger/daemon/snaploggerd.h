@@ -25,6 +25,7 @@
 
 // self
 //
+#include    "snaplogger/daemon/pipeline.h"
 #include    "snaplogger/daemon/tcp_logger_server.h"
 #include    "snaplogger/daemon/udp_logger_server.h"
 
@@ -68,6 +69,7 @@ private:
     advgetopt::getopt               f_opts;
     ed::communicator::pointer_t     f_communicator = ed::communicator::pointer_t();
     ed::logrotate_extension         f_logrotate;
+    pipeline::pointer_t             f_pipeline = pipeline::pointer_t();
     tcp_logger_server::pointer_t    f_tcp_server = tcp_logger_server::pointer_t();
     udp_logger_server::pointer_t    f_udp_server = udp_logger_server::pointer_t();
 };
@@ -40,6 +40,11 @@
 #include    <iostream>
 
 
+// C
+//
+#include    <sys/socket.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -52,34 +57,194 @@ namespace snaplogger_daemon
 
 
 
-tcp_logger_connection::tcp_logger_connection(ed::tcp_bio_client::pointer_t client)
+tcp_logger_connection::tcp_logger_connection(
+          ed::tcp_bio_client::pointer_t client
+        , pipeline::pointer_t p
+        , std::size_t key)
     : tcp_server_client_message_connection(client)
-    , f_dispatcher(std::make_shared<ed::dispatcher>(this))
+    , f_pipeline(p)
+    , f_key(key)
 {
-//#ifdef _DEBUG
-//    f_dispatcher->set_trace();
-//#endif
-    set_dispatcher(f_dispatcher);
+}
 
-    f_dispatcher->add_matches({
-        DISPATCHER_MATCH("LOGGER", &tcp_logger_connection::msg_logger_message),
 
-        // ALWAYS LAST
-        DISPATCHER_CATCH_ALL()
-    });
+tcp_logger_connection::~tcp_logger_connection()
+{
 }
 
 
-tcp_logger_connection::~tcp_logger_connection()
+/** \brief Stop reading while the pipeline is paused.
+ *
+ * \return false while the input is paused.
+ */
+bool tcp_logger_connection::is_reader() const
+{
+    return !f_input_paused
+        && tcp_server_client_message_connection::is_reader();
+}
+
+
+/** \brief Read the incoming data.
+ *
+ * Clients send either ed::message lines or binary log records (see
+ * snaplogger_network::log_record_encoder). The binary stream starts with
+ * the LOG_RECORD_MAGIC bytes. The first byte is not valid in a message
+ * so it is enough to detect the format on the first read.
+ *
+ * The data is not parsed here. It gets pushed to the pipeline and one
+ * of its workers parses it.
+ */
+void tcp_logger_connection::process_read()
+{
+    if(f_invalid)
+    {
+        process_error();
+        return;
+    }
+
+    if(f_format == format_t::FORMAT_UNKNOWN)
+    {
+        char c(0);
+        ssize_t const r(recv(get_socket(), &c, 1, MSG_PEEK));
+        if(r == 1)
+        {
+            f_format = c == snaplogger_network::LOG_RECORD_MAGIC[0]
+                            ? format_t::FORMAT_BINARY
+                            : format_t::FORMAT_TEXT;
+        }
+    }
+
+    if(f_format == format_t::FORMAT_BINARY)
+    {
+        process_binary_read();
+        return;
+    }
+
+    tcp_server_client_message_connection::process_read();
+}
+
+
+void tcp_logger_connection::process_line(std::string const & line)
+{
+    push(std::string(line));
+}
+
+
+void tcp_logger_connection::process_binary_read()
 {
+    char buffer[64 * 1024];
+    ssize_t const r(read(buffer, sizeof(buffer)));
+    if(r > 0)
+    {
+        push(std::string(buffer, static_cast<std::size_t>(r)));
+    }
+    else if(r == 0)
+    {
+        process_hup();
+    }
+    else if(errno != EAGAIN
+         && errno != EWOULDBLOCK
+         && errno != EINTR)
+    {
+        process_error();
+    }
 }
 
 
-void tcp_logger_connection::msg_logger_message(ed::message & m)
+void tcp_logger_connection::push(std::string && data)
 {
+    f_pipeline->push(
+              std::dynamic_pointer_cast<pipeline_source>(shared_from_this())
+            , f_key
+            , std::move(data));
+}
+
+
+/** \brief Parse a line or a block of binary log records.
+ *
+ * This function runs in a worker thread. All the data of this
+ * connection goes to the same worker so the decoder state is only
+ * accessed by that one thread.
+ *
+ * \param[in] data  A message line or a block of binary data.
+ * \param[in] output  The function receiving the resulting messages.
+ */
+void tcp_logger_connection::parse(std::string const & data, output_t const & output)
+{
+    if(f_invalid)
+    {
+        return;
+    }
+
+    if(f_format == format_t::FORMAT_BINARY)
+    {
+        if(!f_decoder.decode(
+                  data.data()
+                , data.length()
+                , [&output](snaplogger_network::log_record const & record)
+                {
+                    snaplogger::message::pointer_t msg(log_record_to_log_message(record));
+                    msg->add_component(g_tcp_component);
+                    output(msg);
+                }))
+        {
+            SNAP_LOG_ERROR
+                << snaplogger::section(snaplogger::g_normal_component)
+                << snaplogger::section(g_network_component)
+                << snaplogger::section(g_daemon_component)
+                << "invalid binary log record received; closing connection."
+                << SNAP_LOG_SEND;
+
+            // the connection gets closed on the next read
+            //
+            f_invalid = true;
+        }
+        return;
+    }
+
+    ed::message m;
+    if(!m.from_message(data))
+    {
+        SNAP_LOG_ERROR
+            << "tcp_logger_connection::parse() was asked"
+               " to process an invalid message ("
+            << data
+            << ")"
+            << SNAP_LOG_SEND;
+        return;
+    }
+    if(!is_log_message(m))
+    {
+        return;
+    }
+
     snaplogger::message::pointer_t msg(ed_message_to_log_message(m));
     msg->add_component(g_tcp_component);
-    snaplogger::send_message(*msg);
+    output(msg);
+}
+
+
+/** \brief Stop reading the client data.
+ *
+ * The client also receives a PAUSE message so it can stop sending.
+ */
+void tcp_logger_connection::pause_input()
+{
+    f_input_paused = true;
+
+    ed::message msg;
+    msg.set_command("PAUSE");
+    send_message(msg);
+}
+
+
+void tcp_logger_connection::resume_input()
+{
+    f_input_paused = false;
+
+    ed::message msg;
+    msg.set_command("UNPAUSE");
+    send_message(msg);
 }
 
 
@@ -23,12 +23,26 @@
  * This file declares the base appender class.
  */
 
+// self
+//
+#include    "snaplogger/daemon/pipeline.h"
+
+
+// snaplogger_network
+//
+#include    "snaplogger/network/log_record.h"
+
+
 // eventdispatcher
 //
-#include    <eventdispatcher/dispatcher.h>
 #include    <eventdispatcher/tcp_server_client_message_connection.h>
 
 
+// C++
+//
+#include    <atomic>
+
+
 
 namespace snaplogger_daemon
 {
@@ -36,18 +50,56 @@ namespace snaplogger_daemon
 
 class tcp_logger_connection
     : public ed::tcp_server_client_message_connection
+    , public pipeline_source
 {
 public:
     typedef std::shared_ptr<tcp_logger_connection>
                                 pointer_t;
 
-                                tcp_logger_connection(ed::tcp_bio_client::pointer_t client);
+                                tcp_logger_connection(
+                                          ed::tcp_bio_client::pointer_t client
+                                        , pipeline::pointer_t p
+                                        , std::size_t key);
     virtual                     ~tcp_logger_connection() override;
 
-    void                        msg_logger_message(ed::message & m);
+    // connection implementation
+    //
+    virtual bool                is_reader() const override;
+
+    // tcp_server_client_buffer_connection implementation
+    //
+    virtual void                process_read() override;
+    virtual void                process_line(std::string const & line) override;
+
+    // pipeline_source implementation
+    //
+    virtual void                parse(
+                                          std::string const & data
+                                        , output_t const & output) override;
+    virtual void                pause_input() override;
+    virtual void                resume_input() override;
 
 private:
-    ed::dispatcher::pointer_t   f_dispatcher = ed::dispatcher::pointer_t();
+    enum class format_t
+    {
+        FORMAT_UNKNOWN,
+        FORMAT_TEXT,
+        FORMAT_BINARY,
+    };
+
+    void                        process_binary_read();
+    void                        push(std::string && data);
+
+    pipeline::pointer_t         f_pipeline = pipeline::pointer_t();
+    std::size_t                 f_key = 0;
+    format_t                    f_format = format_t::FORMAT_UNKNOWN;
+    bool                        f_input_paused = false;
+    std::atomic<bool>           f_invalid = false;
+
+    // only used by the worker thread
+    //
+    snaplogger_network::log_record_decoder
+                                f_decoder = snaplogger_network::log_record_decoder();
 };
 
 
@@ -54,7 +54,9 @@ namespace snaplogger_daemon
 
 
 
-tcp_logger_server::tcp_logger_server(addr::addr const & listen)
+tcp_logger_server::tcp_logger_server(
+          addr::addr const & listen
+        , pipeline::pointer_t p)
     : tcp_server_connection(
               listen
             , std::string()
@@ -63,6 +65,7 @@ tcp_logger_server::tcp_logger_server(addr::addr const & listen)
             , -1
             , true)
     , f_communicator(ed::communicator::instance())
+    , f_pipeline(p)
 {
 }
 
@@ -91,7 +94,10 @@ void tcp_logger_server::process_accept()
         return;
     }
 
-    ed::connection::pointer_t client(std::make_shared<tcp_logger_connection>(new_client));
+    ed::connection::pointer_t client(std::make_shared<tcp_logger_connection>(
+              new_client
+            , f_pipeline
+            , ++f_next_key));
     client->set_name("client connection");
 
     if(!f_communicator->add_connection(client))
@@ -24,6 +24,11 @@
  * to connect and send us LOG_MESSAGE messages.
  */
 
+// self
+//
+#include    "snaplogger/daemon/pipeline.h"
+
+
 // eventdispatcher
 //
 #include    <eventdispatcher/communicator.h>
@@ -42,7 +47,9 @@ public:
     typedef std::shared_ptr<tcp_logger_server>
                                 pointer_t;
 
-                                tcp_logger_server(addr::addr const & listen);
+                                tcp_logger_server(
+                                          addr::addr const & listen
+                                        , pipeline::pointer_t p);
     virtual                     ~tcp_logger_server() override;
 
     // tcp_server_connection implementation
@@ -51,6 +58,8 @@ public:
 
 private:
     ed::communicator::pointer_t f_communicator;
+    pipeline::pointer_t         f_pipeline = pipeline::pointer_t();
+    std::size_t                 f_next_key = 0;
 };
 
 
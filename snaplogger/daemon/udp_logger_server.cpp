@@ -23,6 +23,11 @@
  * a local file. The UDP service can be used with one way messages
  * which may get lost along the way. Messages that make it will be
  * saved. Some message will receive an acknowledgement reply.
+ *
+ * The appender packs several log records in each datagram, either as
+ * ed::message separated by newlines or as binary log records. The
+ * server pushes the datagrams to the pipeline and its workers unpack
+ * them and handle each record separately.
  */
 
 // self
@@ -33,11 +38,24 @@
 #include    "snaplogger/daemon/utils.h"
 
 
+// snaplogger_network
+//
+#include    "snaplogger/network/log_record.h"
+
+
 // C++
 //
+#include    <algorithm>
+#include    <functional>
 #include    <iostream>
 
 
+// C
+//
+#include    <string.h>
+#include    <sys/socket.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -51,35 +69,223 @@ namespace snaplogger_daemon
 
 udp_logger_server::udp_logger_server(
           addr::addr const & listen
-        , std::string const & secret_code)
+        , std::string const & secret_code
+        , pipeline::pointer_t p)
     : udp_server_message_connection(listen)
-    , f_dispatcher(std::make_shared<ed::dispatcher>(this))
+    , f_pipeline(p)
 {
     set_secret_code(secret_code);
-//#ifdef _DEBUG
-//    f_dispatcher->set_trace();
-//#endif
-    set_dispatcher(f_dispatcher);
+}
 
-    f_dispatcher->add_matches({
-        DISPATCHER_MATCH("LOGGER", &udp_logger_server::msg_logger_message),
 
-        // ALWAYS LAST
-        DISPATCHER_CATCH_ALL()
-    });
+udp_logger_server::~udp_logger_server()
+{
 }
 
 
-udp_logger_server::~udp_logger_server()
+/** \brief Stop reading while the pipeline is paused.
+ *
+ * The datagrams accumulate in the kernel buffer and get dropped once
+ * it is full.
+ *
+ * \return false while the input is paused.
+ */
+bool udp_logger_server::is_reader() const
 {
+    return !f_input_paused
+        && udp_server_message_connection::is_reader();
 }
 
 
-void udp_logger_server::msg_logger_message(ed::message & m)
+/** \brief Read the incoming datagrams.
+ *
+ * This function replaces the default implementation which expects one
+ * message per datagram and is limited to DATAGRAM_MAX_SIZE bytes.
+ *
+ * The datagrams are pushed to the pipeline as is. The address of the
+ * sender is used as the key so the datagrams of one sender are parsed
+ * in order by the same worker.
+ */
+void udp_logger_server::process_read()
 {
-    snaplogger::message::pointer_t msg(ed_message_to_log_message(m));
-    msg->add_component(g_udp_component);
-    snaplogger::send_message(*msg);
+    while(!f_input_paused)
+    {
+        sockaddr_storage sender = {};
+        socklen_t sender_length(sizeof(sender));
+        ssize_t const r(recvfrom(
+                  get_socket()
+                , f_buffer.data()
+                , f_buffer.size()
+                , 0
+                , reinterpret_cast<sockaddr *>(&sender)
+                , &sender_length));
+        if(r <= 0)
+        {
+            break;
+        }
+
+        std::size_t const key(std::hash<std::string>()(std::string(
+                      reinterpret_cast<char const *>(&sender)
+                    , std::min(static_cast<std::size_t>(sender_length), sizeof(sender)))));
+        f_pipeline->push(
+                  std::dynamic_pointer_cast<pipeline_source>(shared_from_this())
+                , key
+                , std::string(f_buffer.data(), static_cast<std::size_t>(r)));
+    }
+}
+
+
+/** \brief Parse one datagram.
+ *
+ * This function runs in a worker thread. Datagrams starting with the
+ * LOG_RECORD_MAGIC bytes are binary log records, the others are
+ * ed::message lines.
+ *
+ * \param[in] data  The datagram.
+ * \param[in] output  The function receiving the resulting messages.
+ */
+void udp_logger_server::parse(std::string const & data, output_t const & output)
+{
+    if(data.length() >= sizeof(snaplogger_network::LOG_RECORD_MAGIC)
+    && memcmp(data.data(), snaplogger_network::LOG_RECORD_MAGIC, sizeof(snaplogger_network::LOG_RECORD_MAGIC)) == 0)
+    {
+        parse_binary_datagram(data, output);
+    }
+    else
+    {
+        parse_text_datagram(data, output);
+    }
+}
+
+
+void udp_logger_server::pause_input()
+{
+    f_input_paused = true;
+}
+
+
+void udp_logger_server::resume_input()
+{
+    f_input_paused = false;
+}
+
+
+void udp_logger_server::parse_text_datagram(std::string const & data, output_t const & output)
+{
+    std::string::size_type pos(0);
+    while(pos < data.length())
+    {
+        std::string::size_type eol(data.find('\n', pos));
+        if(eol == std::string::npos)
+        {
+            eol = data.length();
+        }
+        std::string const line(data, pos, eol - pos);
+        pos = eol + 1;
+        if(line.empty())
+        {
+            continue;
+        }
+
+        ed::message m;
+        if(!m.from_message(line))
+        {
+            SNAP_LOG_ERROR
+                << "udp_logger_server::parse_text_datagram() was asked"
+                   " to process an invalid message ("
+                << line
+                << ")"
+                << SNAP_LOG_SEND;
+            continue;
+        }
+
+        bool const has_secret_code(m.has_parameter("secret_code"));
+        if(!valid_secret_code(
+                  has_secret_code
+                , has_secret_code ? m.get_parameter("secret_code") : std::string())
+        || !is_log_message(m))
+        {
+            continue;
+        }
+
+        snaplogger::message::pointer_t msg(ed_message_to_log_message(m));
+        msg->add_component(g_udp_component);
+        output(msg);
+    }
+}
+
+
+void udp_logger_server::parse_binary_datagram(std::string const & data, output_t const & output)
+{
+    // each datagram is a stream on its own
+    //
+    snaplogger_network::log_record_decoder decoder;
+
+    int valid(0);
+    bool const success(decoder.decode(
+              data.data()
+            , data.length()
+            , [this, &decoder, &valid, &output](snaplogger_network::log_record const & record)
+            {
+                if(valid == 0)
+                {
+                    std::string const & secret_code(decoder.get_secret_code());
+                    valid = valid_secret_code(!secret_code.empty(), secret_code) ? 1 : -1;
+                }
+                if(valid > 0)
+                {
+                    snaplogger::message::pointer_t msg(log_record_to_log_message(record));
+                    msg->add_component(g_udp_component);
+                    output(msg);
+                }
+            }));
+    if(!success
+    || decoder.get_pending_size() != 0)
+    {
+        SNAP_LOG_ERROR
+            << "udp_logger_server::parse_binary_datagram() received an invalid datagram."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
+bool udp_logger_server::valid_secret_code(bool has_secret_code, std::string const & secret_code)
+{
+    std::string const expected(get_secret_code());
+    if(has_secret_code)
+    {
+        if(secret_code != expected)
+        {
+            if(!expected.empty())
+            {
+                // our secret code and the message secret code do not match
+                //
+                SNAP_LOG_ERROR
+                    << "the incoming message has an unexpected secret_code code, message ignored."
+                    << SNAP_LOG_SEND;
+                return false;
+            }
+
+            // the sender included a UDP secret code but we don't
+            // require it so we emit a warning but still accept
+            // the message
+            //
+            SNAP_LOG_WARNING
+                << "no secret_code=... parameter was expected (missing set_secret_code() call for this application?)"
+                << SNAP_LOG_SEND;
+        }
+    }
+    else if(!expected.empty())
+    {
+        // secret code is missing from incoming message
+        //
+        SNAP_LOG_ERROR
+            << "the incoming message was expected to have a secret_code parameter, message ignored."
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    return true;
 }
 
 
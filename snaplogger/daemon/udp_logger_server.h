@@ -23,6 +23,11 @@
  * This file declares the base appender class.
  */
 
+// self
+//
+#include    "snaplogger/daemon/pipeline.h"
+
+
 // libaddr
 //
 #include    <libaddr/addr.h>
@@ -32,10 +37,14 @@
 //
 #include    <eventdispatcher/communicator.h>
 #include    <eventdispatcher/connection_with_send_message.h>
-#include    <eventdispatcher/dispatcher.h>
 #include    <eventdispatcher/udp_server_message_connection.h>
 
 
+// C++
+//
+#include    <vector>
+
+
 
 namespace snaplogger_daemon
 {
@@ -43,6 +52,7 @@ namespace snaplogger_daemon
 
 class udp_logger_server
     : public ed::udp_server_message_connection
+    , public pipeline_source
 {
 public:
     typedef std::shared_ptr<udp_logger_server>
@@ -50,13 +60,34 @@ public:
 
                                 udp_logger_server(
                                           addr::addr const & listen
-                                        , std::string const & secret_code);
+                                        , std::string const & secret_code
+                                        , pipeline::pointer_t p);
     virtual                     ~udp_logger_server() override;
 
-    void                        msg_logger_message(ed::message & m);
+    // connection implementation
+    //
+    virtual bool                is_reader() const override;
+
+    // udp_server_message_connection implementation
+    //
+    virtual void                process_read() override;
+
+    // pipeline_source implementation
+    //
+    virtual void                parse(
+                                          std::string const & data
+                                        , output_t const & output) override;
+    virtual void                pause_input() override;
+    virtual void                resume_input() override;
 
 private:
-    ed::dispatcher::pointer_t   f_dispatcher = ed::dispatcher::pointer_t();
+    void                        parse_text_datagram(std::string const & data, output_t const & output);
+    void                        parse_binary_datagram(std::string const & data, output_t const & output);
+    bool                        valid_secret_code(bool has_secret_code, std::string const & secret_code);
+
+    pipeline::pointer_t         f_pipeline = pipeline::pointer_t();
+    std::vector<char>           f_buffer = std::vector<char>(64 * 1024);
+    bool                        f_input_paused = false;
 };
 
 
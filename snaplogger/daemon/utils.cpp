@@ -45,6 +45,23 @@ namespace snaplogger_daemon
 {
 
 
+/** \brief Check whether a message is a log message.
+ *
+ * The network appenders send LOG messages. Older versions of the daemon
+ * only accepted LOGGER messages so both are accepted.
+ *
+ * \param[in] message  The message to check.
+ *
+ * \return true if the message is a log message.
+ */
+bool is_log_message(ed::message const & message)
+{
+    std::string const & command(message.get_command());
+    return command == "LOG"
+        || command == "LOGGER";
+}
+
+
 snaplogger::message::pointer_t ed_message_to_log_message(ed::message const & message)
 {
     // TODO: let admin select the default severity in case it's not
@@ -216,5 +233,60 @@ snaplogger::message::pointer_t ed_message_to_log_message(ed::message const & mes
 }
 
 
+/** \brief Convert a binary log record to a snaplogger message.
+ *
+ * This function is the equivalent of ed_message_to_log_message() for
+ * the records received in the binary format. The record already has
+ * the severity as a number and the fields separated so there is
+ * nothing to parse.
+ *
+ * \param[in] record  The decoded log record.
+ *
+ * \return The corresponding snaplogger message.
+ */
+snaplogger::message::pointer_t log_record_to_log_message(snaplogger_network::log_record const & record)
+{
+    snaplogger::message::pointer_t msg(std::make_shared<snaplogger::message>(record.f_severity));
+    msg->set_timestamp(record.f_timestamp);
+    *msg << record.f_message;
+    msg->set_recursive_message(record.f_recursive);
+
+    bool is_local(false);
+    if(!record.f_components.empty())
+    {
+        for(auto const & c : record.f_components)
+        {
+            if(c.empty())
+            {
+                continue;
+            }
+            if(c == "local")
+            {
+                is_local = true;
+            }
+            msg->add_component(snaplogger::get_component(*msg, c));
+        }
+    }
+    else if(msg->can_add_component(snaplogger::g_normal_component))
+    {
+        // see ed_message_to_log_message()
+        //
+        msg->add_component(snaplogger::g_normal_component);
+    }
+    if(!is_local)
+    {
+        msg->add_component(g_remote_component);
+    }
+    msg->add_component(g_network_component);
+
+    for(auto const & f : record.f_fields)
+    {
+        msg->add_field(f.first, f.second);
+    }
+
+    return msg;
+}
+
+
 } // snaplogger_daemon namespace
 // vim: ts=4 sw=4 et
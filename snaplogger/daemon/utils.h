@@ -28,6 +28,11 @@
 #include    <snaplogger/message.h>
 
 
+// snaplogger_network
+//
+#include    "snaplogger/network/log_record.h"
+
+
 // eventdispatcher
 //
 #include    <eventdispatcher/message.h>
@@ -38,7 +43,9 @@ namespace snaplogger_daemon
 {
 
 
+bool is_log_message(ed::message const & message);
 snaplogger::message::pointer_t ed_message_to_log_message(ed::message const & message);
+snaplogger::message::pointer_t log_record_to_log_message(snaplogger_network::log_record const & record);
 
 
 } // snaplogger_daemon namespace
@@ -96,6 +96,22 @@ void base_network_appender::set_config(advgetopt::getopt const & opts)
                             , false);
     }
 
+    // FORMAT
+    //
+    std::string const format_field(get_name() + "::format");
+    if(opts.is_defined(format_field))
+    {
+        std::string const format(opts.get_string(format_field));
+        if(format == "binary")
+        {
+            f_format = format_t::FORMAT_BINARY;
+        }
+        else
+        {
+            f_format = format_t::FORMAT_TEXT;
+        }
+    }
+
     // ACKNOWLEDGE
     //
     std::string const acknowledge_field(get_name() + "::acknowledge");
@@ -52,6 +52,13 @@ enum class compression_t
 };
 
 
+enum class format_t
+{
+    FORMAT_TEXT,                // ed::message
+    FORMAT_BINARY,              // log_record frames
+};
+
+
 enum class acknowledge_t
 {
     ACKNOWLEDGE_NONE,
@@ -87,6 +94,7 @@ public:
 
 protected:
     addr::addr              f_server_address = addr::addr();
+    format_t                f_format = format_t::FORMAT_TEXT;
     acknowledge_t           f_acknowledge = acknowledge_t::ACKNOWLEDGE_ALL;
     snaplogger::severity_t  f_acknowledge_severity = snaplogger::severity_t::SEVERITY_ERROR;
     bool                    f_fallback_to_console = false;
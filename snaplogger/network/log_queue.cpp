@@ -0,0 +1,176 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the bounded lock-free queue of log records.
+ *
+ * The queue is an array of cells used as a ring. Each cell has a
+ * sequence number which tells the producers and consumers whether the
+ * cell is free or holds a record for the current lap around the ring.
+ * Pushing and popping only require a compare and swap on the position
+ * so a thread emitting a log never waits on a lock held by the
+ * shipping thread, and vice versa.
+ */
+
+// self
+//
+#include    "snaplogger/network/log_queue.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace snaplogger_network
+{
+
+
+
+/** \brief Initialize the queue.
+ *
+ * The size gets rounded up to the next power of two so positions can
+ * be converted to indexes with a mask.
+ *
+ * \param[in] size  The minimum number of records the queue can hold.
+ */
+log_queue::log_queue(std::size_t size)
+{
+    std::size_t capacity(2);
+    while(capacity < size)
+    {
+        capacity <<= 1;
+    }
+    f_mask = capacity - 1;
+
+    f_cells.reset(new cell_t[capacity]);
+    for(std::size_t idx(0); idx < capacity; ++idx)
+    {
+        f_cells[idx].f_sequence.store(idx, std::memory_order_relaxed);
+    }
+}
+
+
+/** \brief Get the number of records the queue can hold.
+ *
+ * \return The capacity of the queue.
+ */
+std::size_t log_queue::capacity() const
+{
+    return f_mask + 1;
+}
+
+
+/** \brief Get the number of records in the queue.
+ *
+ * The value is only approximate when other threads are pushing or
+ * popping records at the same time.
+ *
+ * \return The number of records waiting in the queue.
+ */
+std::size_t log_queue::size() const
+{
+    std::size_t const pop(f_pop_position.load(std::memory_order_relaxed));
+    std::size_t const push(f_push_position.load(std::memory_order_relaxed));
+    return push >= pop ? push - pop : 0;
+}
+
+
+/** \brief Add a record to the queue.
+ *
+ * On success, the \p record string gets swapped with the cell content
+ * so the buffer of a previously popped record can be reused.
+ *
+ * \param[in,out] record  The record to add.
+ *
+ * \return true if the record was added, false if the queue is full.
+ */
+bool log_queue::push(std::string & record)
+{
+    cell_t * cell(nullptr);
+    std::size_t pos(f_push_position.load(std::memory_order_relaxed));
+    for(;;)
+    {
+        cell = &f_cells[pos & f_mask];
+        std::size_t const sequence(cell->f_sequence.load(std::memory_order_acquire));
+        std::ptrdiff_t const diff(static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos));
+        if(diff == 0)
+        {
+            if(f_push_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = f_push_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->f_record.swap(record);
+    cell->f_sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+
+/** \brief Remove the oldest record from the queue.
+ *
+ * \param[out] record  The string receiving the record.
+ *
+ * \return true if a record was returned, false if the queue is empty.
+ */
+bool log_queue::pop(std::string & record)
+{
+    cell_t * cell(nullptr);
+    std::size_t pos(f_pop_position.load(std::memory_order_relaxed));
+    for(;;)
+    {
+        cell = &f_cells[pos & f_mask];
+        std::size_t const sequence(cell->f_sequence.load(std::memory_order_acquire));
+        std::ptrdiff_t const diff(static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1));
+        if(diff == 0)
+        {
+            if(f_pop_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = f_pop_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    record.swap(cell->f_record);
+    cell->f_sequence.store(pos + f_mask + 1, std::memory_order_release);
+    return true;
+}
+
+
+
+} // namespace snaplogger_network
+// vim: ts=4 sw=4 et
@@ -0,0 +1,75 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief A bounded lock-free queue of log records.
+ *
+ * The queue is used to hand records from the threads emitting logs to
+ * the thread shipping them to the server.
+ */
+
+// C++
+//
+#include    <atomic>
+#include    <memory>
+#include    <string>
+
+
+
+namespace snaplogger_network
+{
+
+
+
+class log_queue
+{
+public:
+    typedef std::shared_ptr<log_queue>      pointer_t;
+
+                                log_queue(std::size_t size);
+                                log_queue(log_queue const &) = delete;
+    log_queue &                 operator = (log_queue const &) = delete;
+
+    std::size_t                 capacity() const;
+    std::size_t                 size() const;
+    bool                        push(std::string & record);
+    bool                        pop(std::string & record);
+
+private:
+    struct cell_t
+    {
+        std::atomic<std::size_t>    f_sequence = 0;
+        std::string                 f_record = std::string();
+    };
+
+    std::unique_ptr<cell_t[]>   f_cells = std::unique_ptr<cell_t[]>();
+    std::size_t                 f_mask = 0;
+
+    // keep the producer and consumer positions on separate cache lines
+    //
+    alignas(64) std::atomic<std::size_t>
+                                f_push_position = 0;
+    alignas(64) std::atomic<std::size_t>
+                                f_pop_position = 0;
+};
+
+
+
+} // namespace snaplogger_network
+// vim: ts=4 sw=4 et
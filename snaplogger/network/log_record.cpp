@@ -0,0 +1,614 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the binary log record format.
+ *
+ * A stream starts with the LOG_RECORD_MAGIC bytes followed by frames.
+ * Each frame is a type byte, the size of the payload as a varint, and
+ * the payload.
+ *
+ * The file and function names, the component names, and the field names
+ * are interned: the first time one is used, a FRAME_STRING defines it
+ * and the records then refer to it by number (0 means "no string"). The
+ * FRAME_STRING payload is the varint number followed by the string.
+ * The table is per stream so each connection (or datagram) starts with
+ * an empty table. A number which was never defined is viewed as an empty
+ * string so a lost definition does not prevent the other records from
+ * being decoded.
+ *
+ * A FRAME_RECORD payload is composed of the following fields:
+ *
+ * \code
+ *     varint      severity
+ *     varint      timestamp seconds
+ *     varint      timestamp nanoseconds
+ *     varint      filename string number
+ *     varint      function string number
+ *     varint      line
+ *     varint      column
+ *     uint8_t     flags (bit 0: recursive)
+ *     varint      number of components
+ *     varint      component name string number (repeated)
+ *     varint      message size
+ *     char[]      message
+ *     varint      number of fields
+ *     varint      field name string number (repeated with the next 2)
+ *     varint      field value size
+ *     char[]      field value
+ * \endcode
+ *
+ * The varints are unsigned LEB128 numbers.
+ *
+ * The UDP appender sends datagrams which each are a stream on their own
+ * (magic, strings, records). The secret code used to authenticate them
+ * is sent in a FRAME_SECRET_CODE before the records.
+ */
+
+// self
+//
+#include    "snaplogger/network/log_record.h"
+
+
+// C
+//
+#include    <string.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace snaplogger_network
+{
+
+
+
+namespace
+{
+
+
+
+void append_varint(std::string & out, std::uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+
+bool read_varint(
+      char const * data
+    , std::size_t size
+    , std::size_t & pos
+    , std::uint64_t & value)
+{
+    value = 0;
+    for(int shift(0); shift < 64 && pos < size; shift += 7)
+    {
+        std::uint8_t const c(static_cast<std::uint8_t>(data[pos]));
+        ++pos;
+        value |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+        if((c & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void append_frame(std::string & out, frame_t type, std::string const & payload)
+{
+    out += static_cast<char>(type);
+    append_varint(out, payload.length());
+    out += payload;
+}
+
+
+
+}
+// no name namespace
+
+
+
+/** \brief Read the header of a frame.
+ *
+ * This function reads the type and size of the frame found at \p pos.
+ * On success, \p pos is moved to the start of the payload. The payload
+ * itself may not yet be available in \p data.
+ *
+ * \param[in] data  The buffer with the frames.
+ * \param[in] size  The number of bytes in \p data.
+ * \param[in,out] pos  The position of the frame in \p data.
+ * \param[out] type  The type of the frame.
+ * \param[out] length  The size of the payload.
+ *
+ * \return false if \p data does not include the whole header.
+ */
+bool get_frame(
+      char const * data
+    , std::size_t size
+    , std::size_t & pos
+    , frame_t & type
+    , std::size_t & length)
+{
+    if(pos >= size)
+    {
+        return false;
+    }
+    std::size_t p(pos + 1);
+    std::uint64_t value(0);
+    if(!read_varint(data, size, p, value))
+    {
+        return false;
+    }
+    type = static_cast<frame_t>(data[pos]);
+    length = value;
+    pos = p;
+    return true;
+}
+
+
+
+/** \brief Forget the interned strings.
+ *
+ * The next encode() starts with a FRAME_RESET so the receiver also
+ * forgets its strings. This happens automatically once the table is
+ * full.
+ */
+void log_record_encoder::reset()
+{
+    f_strings.clear();
+    f_new_strings.clear();
+    f_reset = true;
+}
+
+
+/** \brief Encode a log message.
+ *
+ * This function appends the frames representing \p msg to \p out. This
+ * includes the FRAME_STRING frames defining the strings this record is
+ * the first to use.
+ *
+ * \param[in] msg  The message to encode.
+ * \param[in,out] out  The buffer where the frames get appended.
+ * \param[in] extra_component  A component to add to the ones of \p msg.
+ */
+void log_record_encoder::encode(
+      snaplogger::message const & msg
+    , std::string & out
+    , snaplogger::component::pointer_t extra_component)
+{
+    snaplogger::component::set_t const & components(msg.get_components());
+    snaplogger::field_map_t const fields(msg.get_fields());
+
+    // make sure all the strings of this record fit in the table
+    //
+    std::size_t const max_new(2 + components.size() + fields.size() + (extra_component != nullptr ? 1 : 0));
+    if(f_strings.size() + max_new > LOG_RECORD_MAX_STRINGS)
+    {
+        reset();
+    }
+
+    f_new_strings.clear();
+    f_last_reset = f_reset;
+    if(f_reset)
+    {
+        f_reset = false;
+        out += static_cast<char>(frame_t::FRAME_RESET);
+        append_varint(out, 0);
+    }
+
+    f_payload.clear();
+
+    append_varint(f_payload, static_cast<std::uint64_t>(msg.get_severity()));
+
+    timespec const & timestamp(msg.get_timestamp());
+    append_varint(f_payload, static_cast<std::uint64_t>(timestamp.tv_sec));
+    append_varint(f_payload, static_cast<std::uint64_t>(timestamp.tv_nsec));
+
+    append_varint(f_payload, intern(msg.get_filename(), out));
+    append_varint(f_payload, intern(msg.get_function(), out));
+    append_varint(f_payload, static_cast<std::uint64_t>(msg.get_line()));
+    append_varint(f_payload, static_cast<std::uint64_t>(msg.get_column()));
+    f_payload += static_cast<char>(msg.get_recursive_message() ? 1 : 0);
+
+    append_varint(f_payload, components.size() + (extra_component != nullptr ? 1 : 0));
+    if(extra_component != nullptr)
+    {
+        append_varint(f_payload, intern(extra_component->get_name(), out));
+    }
+    for(auto const & c : components)
+    {
+        append_varint(f_payload, intern(c->get_name(), out));
+    }
+
+    std::string const message(msg.get_message());
+    append_varint(f_payload, message.length());
+    f_payload += message;
+
+    append_varint(f_payload, fields.size());
+    for(auto const & f : fields)
+    {
+        append_varint(f_payload, intern(f.first, out));
+        append_varint(f_payload, f.second.length());
+        f_payload += f.second;
+    }
+
+    append_frame(out, frame_t::FRAME_RECORD, f_payload);
+}
+
+
+/** \brief Cancel the last encode().
+ *
+ * When the frames generated by the last encode() do not get sent (i.e.
+ * the record is dropped), the strings it defined must be forgotten or
+ * the following records would refer to strings the receiver never got.
+ */
+void log_record_encoder::rollback()
+{
+    for(auto const & s : f_new_strings)
+    {
+        f_strings.erase(*s);
+    }
+    f_new_strings.clear();
+    f_reset = f_reset || f_last_reset;
+    f_last_reset = false;
+}
+
+
+/** \brief Add the secret code to a datagram.
+ *
+ * This function appends a FRAME_SECRET_CODE to \p out. It is expected
+ * to be added right after the magic so the receiver can verify the code
+ * before processing the records.
+ *
+ * \param[in] secret_code  The secret code to send.
+ * \param[in,out] out  The buffer where the frame gets appended.
+ */
+void log_record_encoder::encode_secret_code(
+      std::string const & secret_code
+    , std::string & out)
+{
+    append_frame(out, frame_t::FRAME_SECRET_CODE, secret_code);
+}
+
+
+std::uint32_t log_record_encoder::intern(std::string const & str, std::string & out)
+{
+    if(str.empty())
+    {
+        return 0;
+    }
+
+    auto it(f_strings.find(str));
+    if(it != f_strings.end())
+    {
+        return it->second;
+    }
+
+    std::uint32_t const id(static_cast<std::uint32_t>(f_strings.size() + 1));
+    it = f_strings.emplace(str, id).first;
+    f_new_strings.push_back(&it->first);
+
+    f_string_payload.clear();
+    append_varint(f_string_payload, id);
+    f_string_payload += str;
+    append_frame(out, frame_t::FRAME_STRING, f_string_payload);
+
+    return id;
+}
+
+
+
+/** \brief Restart with a new stream.
+ *
+ * The decoder expects the LOG_RECORD_MAGIC bytes first and starts with
+ * an empty table of strings. Call this function before decoding each
+ * datagram or after a new connection.
+ */
+void log_record_decoder::reset()
+{
+    f_header_received = false;
+    f_buffer.clear();
+    f_strings.clear();
+    f_secret_code.clear();
+}
+
+
+/** \brief Decode the frames found in \p data.
+ *
+ * The data may end with a partial frame. It is kept until the next
+ * call adds the rest of it.
+ *
+ * \param[in] data  The bytes received.
+ * \param[in] size  The number of bytes in \p data.
+ * \param[in] callback  The function called with each log record.
+ *
+ * \return false if the data is not a valid stream of log records.
+ */
+bool log_record_decoder::decode(
+      char const * data
+    , std::size_t size
+    , callback_t const & callback)
+{
+    // avoid a copy when there is nothing pending
+    //
+    char const * p(data);
+    std::size_t n(size);
+    if(!f_buffer.empty())
+    {
+        f_buffer.append(data, size);
+        p = f_buffer.data();
+        n = f_buffer.length();
+    }
+
+    std::size_t pos(0);
+    if(!f_header_received)
+    {
+        std::size_t const available(std::min(n, sizeof(LOG_RECORD_MAGIC)));
+        if(memcmp(p, LOG_RECORD_MAGIC, available) != 0)
+        {
+            return false;
+        }
+        if(available == sizeof(LOG_RECORD_MAGIC))
+        {
+            f_header_received = true;
+            pos = sizeof(LOG_RECORD_MAGIC);
+        }
+    }
+
+    while(f_header_received)
+    {
+        std::size_t start(pos);
+        frame_t type(frame_t::FRAME_RESET);
+        std::size_t length(0);
+        if(!get_frame(p, n, pos, type, length))
+        {
+            if(n - start > 16)
+            {
+                // invalid varint
+                //
+                return false;
+            }
+            pos = start;
+            break;
+        }
+        if(length > LOG_RECORD_MAX_FRAME_SIZE)
+        {
+            return false;
+        }
+        if(n - pos < length)
+        {
+            pos = start;
+            break;
+        }
+
+        switch(type)
+        {
+        case frame_t::FRAME_STRING:
+            {
+                std::size_t id_pos(pos);
+                std::uint64_t id(0);
+                if(!read_varint(p, pos + length, id_pos, id)
+                || id == 0
+                || id > LOG_RECORD_MAX_STRINGS)
+                {
+                    return false;
+                }
+                if(id > f_strings.size())
+                {
+                    f_strings.resize(id);
+                }
+                f_strings[id - 1].assign(p + id_pos, pos + length - id_pos);
+            }
+            break;
+
+        case frame_t::FRAME_RECORD:
+            if(!decode_record(p + pos, length))
+            {
+                return false;
+            }
+            callback(f_record);
+            break;
+
+        case frame_t::FRAME_RESET:
+            f_strings.clear();
+            break;
+
+        case frame_t::FRAME_SECRET_CODE:
+            f_secret_code.assign(p + pos, length);
+            break;
+
+        default:
+            return false;
+
+        }
+        pos += length;
+    }
+
+    // keep the partial frame, if any
+    //
+    if(p == data)
+    {
+        f_buffer.assign(data + pos, n - pos);
+    }
+    else
+    {
+        f_buffer.erase(0, pos);
+    }
+
+    return true;
+}
+
+
+/** \brief Get the number of bytes waiting for the rest of a frame.
+ *
+ * \return The size of the partial frame kept by the decoder.
+ */
+std::size_t log_record_decoder::get_pending_size() const
+{
+    return f_buffer.length();
+}
+
+
+/** \brief Get the secret code received in this stream.
+ *
+ * \return The secret code or an empty string if none was received.
+ */
+std::string const & log_record_decoder::get_secret_code() const
+{
+    return f_secret_code;
+}
+
+
+bool log_record_decoder::decode_record(char const * data, std::size_t size)
+{
+    std::size_t pos(0);
+    std::uint64_t value(0);
+
+    if(!read_varint(data, size, pos, value)
+    || value > 255)
+    {
+        return false;
+    }
+    f_record.f_severity = static_cast<snaplogger::severity_t>(value);
+
+    if(!read_varint(data, size, pos, value))
+    {
+        return false;
+    }
+    f_record.f_timestamp.tv_sec = static_cast<time_t>(value);
+    if(!read_varint(data, size, pos, value)
+    || value >= 1'000'000'000)
+    {
+        return false;
+    }
+    f_record.f_timestamp.tv_nsec = static_cast<long>(value);
+
+    if(!read_varint(data, size, pos, value)
+    || !get_string(value, f_record.f_filename))
+    {
+        return false;
+    }
+    if(!read_varint(data, size, pos, value)
+    || !get_string(value, f_record.f_function))
+    {
+        return false;
+    }
+
+    if(!read_varint(data, size, pos, value))
+    {
+        return false;
+    }
+    f_record.f_line = static_cast<std::uint32_t>(value);
+    if(!read_varint(data, size, pos, value))
+    {
+        return false;
+    }
+    f_record.f_column = static_cast<std::uint32_t>(value);
+
+    if(pos >= size)
+    {
+        return false;
+    }
+    f_record.f_recursive = (data[pos] & 1) != 0;
+    ++pos;
+
+    std::uint64_t count(0);
+    if(!read_varint(data, size, pos, count)
+    || count > size)
+    {
+        return false;
+    }
+    f_record.f_components.resize(count);
+    for(auto & c : f_record.f_components)
+    {
+        if(!read_varint(data, size, pos, value)
+        || !get_string(value, c))
+        {
+            return false;
+        }
+    }
+
+    if(!read_varint(data, size, pos, value)
+    || value > size - pos)
+    {
+        return false;
+    }
+    f_record.f_message.assign(data + pos, value);
+    pos += value;
+
+    if(!read_varint(data, size, pos, count)
+    || count > size)
+    {
+        return false;
+    }
+    f_record.f_fields.resize(count);
+    for(auto & f : f_record.f_fields)
+    {
+        if(!read_varint(data, size, pos, value)
+        || !get_string(value, f.first))
+        {
+            return false;
+        }
+        if(!read_varint(data, size, pos, value)
+        || value > size - pos)
+        {
+            return false;
+        }
+        f.second.assign(data + pos, value);
+        pos += value;
+    }
+
+    return pos == size;
+}
+
+
+bool log_record_decoder::get_string(std::uint64_t id, std::string & str) const
+{
+    if(id == 0)
+    {
+        str.clear();
+        return true;
+    }
+    if(id > LOG_RECORD_MAX_STRINGS)
+    {
+        return false;
+    }
+    if(id > f_strings.size())
+    {
+        // lost definition
+        //
+        str.clear();
+        return true;
+    }
+    str = f_strings[id - 1];
+    return true;
+}
+
+
+
+} // namespace snaplogger_network
+// vim: ts=4 sw=4 et
@@ -0,0 +1,144 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief The binary log record format.
+ *
+ * This file declares the encoder used by the network appenders and the
+ * decoder used by the snaplogger daemon to transmit log records in a
+ * compact binary format instead of an ed::message.
+ */
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <functional>
+#include    <string>
+#include    <unordered_map>
+#include    <vector>
+
+
+
+namespace snaplogger_network
+{
+
+
+
+constexpr char const            LOG_RECORD_MAGIC[4] = { '\xB1', 'L', 'R', '\x01' };
+constexpr std::size_t const     LOG_RECORD_MAX_STRINGS = 65'536;
+constexpr std::size_t const     LOG_RECORD_MAX_FRAME_SIZE = 1024 * 1024;
+
+
+enum class frame_t : std::uint8_t
+{
+    FRAME_STRING = 1,           // define the next interned string
+    FRAME_RECORD = 2,           // a log record
+    FRAME_RESET = 3,            // forget all the interned strings
+    FRAME_SECRET_CODE = 4,      // the secret code of a datagram
+};
+
+
+bool                            get_frame(
+                                      char const * data
+                                    , std::size_t size
+                                    , std::size_t & pos
+                                    , frame_t & type
+                                    , std::size_t & length);
+
+
+struct log_record
+{
+    snaplogger::severity_t      f_severity = snaplogger::severity_t::SEVERITY_ERROR;
+    timespec                    f_timestamp = timespec();
+    std::string                 f_filename = std::string();
+    std::string                 f_function = std::string();
+    std::uint32_t               f_line = 0;
+    std::uint32_t               f_column = 0;
+    bool                        f_recursive = false;
+    std::vector<std::string>    f_components = std::vector<std::string>();
+    std::string                 f_message = std::string();
+    std::vector<std::pair<std::string, std::string>>
+                                f_fields = std::vector<std::pair<std::string, std::string>>();
+};
+
+
+class log_record_encoder
+{
+public:
+    void                        reset();
+    void                        encode(
+                                      snaplogger::message const & msg
+                                    , std::string & out
+                                    , snaplogger::component::pointer_t extra_component = snaplogger::component::pointer_t());
+    void                        rollback();
+    void                        encode_secret_code(
+                                      std::string const & secret_code
+                                    , std::string & out);
+
+private:
+    std::uint32_t               intern(std::string const & str, std::string & out);
+
+    std::unordered_map<std::string, std::uint32_t>
+                                f_strings = std::unordered_map<std::string, std::uint32_t>();
+    std::vector<std::string const *>
+                                f_new_strings = std::vector<std::string const *>();
+    std::string                 f_payload = std::string();
+    std::string                 f_string_payload = std::string();
+    bool                        f_reset = false;
+    bool                        f_last_reset = false;
+};
+
+
+class log_record_decoder
+{
+public:
+    typedef std::function<void(log_record const & record)>
+                                callback_t;
+
+    void                        reset();
+    bool                        decode(
+                                      char const * data
+                                    , std::size_t size
+                                    , callback_t const & callback);
+    std::size_t                 get_pending_size() const;
+    std::string const &         get_secret_code() const;
+
+private:
+    bool                        decode_record(
+                                      char const * data
+                                    , std::size_t size);
+    bool                        get_string(
+                                      std::uint64_t id
+                                    , std::string & str) const;
+
+    bool                        f_header_received = false;
+    std::string                 f_buffer = std::string();
+    std::vector<std::string>    f_strings = std::vector<std::string>();
+    std::string                 f_secret_code = std::string();
+    log_record                  f_record = log_record();
+};
+
+
+
+} // namespace snaplogger_network
+// vim: ts=4 sw=4 et
@@ -0,0 +1,735 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the on-disk log store.
+ *
+ * The store is a directory of segments. Each segment is composed of two
+ * files named after the segment number:
+ *
+ * \li `<number>.seg` -- the LOG_STORE_SEGMENT_MAGIC followed by blocks;
+ * each block is a zlib compressed stream of binary log records (see
+ * log_record.cpp) which starts with its own magic and string table so
+ * it can be decoded without reading the blocks before it;
+ * \li `<number>.idx` -- the LOG_STORE_INDEX_MAGIC followed by one
+ * log_store_block per block, which is the sparse index of the segment:
+ * the time range of the block, a bitmap of the severities, and a bitmap
+ * of the component names it includes.
+ *
+ * Both files are append only. A block gets written once it reaches the
+ * block size or when it is LOG_STORE_FLUSH_DELAY seconds old. Its index
+ * entry is written after the block itself so a reader never sees an
+ * entry for a block which is not on disk yet. A new segment is started
+ * once the segment file reaches the segment size.
+ *
+ * A query first reads the small index files and only maps the segments
+ * and decompresses the blocks which may include matching records.
+ */
+
+// self
+//
+#include    "snaplogger/network/log_store.h"
+
+
+// snapdev
+//
+#include    <snapdev/mkdir_p.h>
+
+
+// zlib
+//
+#include    <zlib.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <iomanip>
+#include    <sstream>
+
+
+// C
+//
+#include    <dirent.h>
+#include    <fcntl.h>
+#include    <string.h>
+#include    <sys/mman.h>
+#include    <sys/stat.h>
+#include    <time.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace snaplogger_network
+{
+
+
+
+namespace
+{
+
+
+
+std::string segment_filename(
+      std::string const & path
+    , std::uint64_t segment
+    , char const * extension)
+{
+    std::stringstream ss;
+    ss << path << '/' << std::setw(16) << std::setfill('0') << segment << extension;
+    return ss.str();
+}
+
+
+/** \brief Get the sorted list of segment numbers found in \p path.
+ *
+ * A segment is listed if its index file exists.
+ */
+std::vector<std::uint64_t> list_segments(std::string const & path)
+{
+    std::vector<std::uint64_t> result;
+
+    DIR * dir(opendir(path.c_str()));
+    if(dir == nullptr)
+    {
+        return result;
+    }
+    for(;;)
+    {
+        dirent const * entry(readdir(dir));
+        if(entry == nullptr)
+        {
+            break;
+        }
+        std::string const name(entry->d_name);
+        if(name.length() != 16 + 4
+        || name.compare(16, 4, ".idx") != 0
+        || !std::all_of(name.begin(), name.begin() + 16, [](char c) { return c >= '0' && c <= '9'; }))
+        {
+            continue;
+        }
+        result.push_back(std::stoull(name.substr(0, 16)));
+    }
+    closedir(dir);
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+
+bool write_all(int fd, void const * data, std::size_t size)
+{
+    char const * p(reinterpret_cast<char const *>(data));
+    while(size > 0)
+    {
+        ssize_t const r(::write(fd, p, size));
+        if(r <= 0)
+        {
+            if(r < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        p += r;
+        size -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+
+std::int64_t monotonic_seconds()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+
+void set_bit(std::uint64_t (&bits)[4], std::size_t bit)
+{
+    bits[(bit >> 6) & 3] |= 1ULL << (bit & 63);
+}
+
+
+bool has_bit(std::uint64_t const (&bits)[4], std::size_t bit)
+{
+    return (bits[(bit >> 6) & 3] & (1ULL << (bit & 63))) != 0;
+}
+
+
+/** \brief A read-only memory mapping of a file.
+ *
+ * Files which are empty or cannot be mapped have a null data() pointer.
+ */
+class mapped_file
+{
+public:
+    mapped_file(std::string const & filename)
+    {
+        snapdev::raii_fd_t fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+        if(fd == nullptr)
+        {
+            return;
+        }
+        struct stat st = {};
+        if(fstat(fd.get(), &st) != 0
+        || st.st_size <= 0)
+        {
+            return;
+        }
+        void * ptr(mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd.get(), 0));
+        if(ptr == MAP_FAILED)
+        {
+            return;
+        }
+        f_data = reinterpret_cast<char const *>(ptr);
+        f_size = static_cast<std::size_t>(st.st_size);
+    }
+
+    mapped_file(mapped_file const &) = delete;
+
+    ~mapped_file()
+    {
+        if(f_data != nullptr)
+        {
+            munmap(const_cast<char *>(f_data), f_size);
+        }
+    }
+
+    mapped_file & operator = (mapped_file const &) = delete;
+
+    char const * data() const
+    {
+        return f_data;
+    }
+
+    std::size_t size() const
+    {
+        return f_size;
+    }
+
+private:
+    char const *        f_data = nullptr;
+    std::size_t         f_size = 0;
+};
+
+
+bool block_matches(log_store_block const & block, log_store_query const & q)
+{
+    if(block.f_count == 0
+    || block.f_max_time < q.f_start
+    || block.f_min_time >= q.f_end)
+    {
+        return false;
+    }
+
+    bool severity(false);
+    for(std::size_t s(static_cast<std::size_t>(q.f_min_severity)); s < 256; ++s)
+    {
+        if(has_bit(block.f_severities, s))
+        {
+            severity = true;
+            break;
+        }
+    }
+    if(!severity)
+    {
+        return false;
+    }
+
+    if(q.f_components.empty())
+    {
+        return true;
+    }
+    for(auto const & c : q.f_components)
+    {
+        if(has_bit(block.f_components, log_store_component_bit(c)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool record_matches(log_record const & record, log_store_query const & q)
+{
+    if(record.f_timestamp.tv_sec < q.f_start
+    || record.f_timestamp.tv_sec >= q.f_end
+    || record.f_severity < q.f_min_severity)
+    {
+        return false;
+    }
+
+    if(q.f_components.empty())
+    {
+        return true;
+    }
+    for(auto const & c : record.f_components)
+    {
+        if(std::find(q.f_components.begin(), q.f_components.end(), c) != q.f_components.end())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Get the bit representing a component in the block bitmaps.
+ *
+ * The component names are hashed (FNV-1a) to one of 256 bits. Two
+ * components may share the same bit, in which case a query reads a
+ * few more blocks than necessary, but the records are still filtered
+ * by name.
+ *
+ * \param[in] name  The name of the component.
+ *
+ * \return A number from 0 to 255.
+ */
+std::size_t log_store_component_bit(std::string const & name)
+{
+    std::uint64_t hash(14'695'981'039'346'656'037ULL);
+    for(auto const c : name)
+    {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 1'099'511'628'211ULL;
+    }
+    return static_cast<std::size_t>((hash ^ (hash >> 32)) & 255);
+}
+
+
+
+/** \brief Initialize the store writer.
+ *
+ * The directory gets created, if necessary, when the first block is
+ * written. Each time the writer starts, it creates a new segment.
+ *
+ * \param[in] path  The directory where the segments are saved.
+ * \param[in] segment_size  The size at which a segment file is closed
+ * and a new one started.
+ * \param[in] max_segments  The number of segments to keep; the oldest
+ * ones get deleted when a new segment is started; 0 keeps them all.
+ * \param[in] block_size  The size at which a block is compressed and
+ * written to the segment.
+ */
+log_store_writer::log_store_writer(
+          std::string const & path
+        , std::size_t segment_size
+        , std::size_t max_segments
+        , std::size_t block_size)
+    : f_path(path)
+    , f_segment_size(std::max(static_cast<std::size_t>(1024), segment_size))
+    , f_max_segments(max_segments)
+    , f_block_size(std::clamp(block_size, static_cast<std::size_t>(1024), static_cast<std::size_t>(16 * 1024 * 1024)))
+{
+}
+
+
+log_store_writer::~log_store_writer()
+{
+    close();
+}
+
+
+/** \brief Add a message to the store.
+ *
+ * The message is added to the current block which gets written once
+ * full or LOG_STORE_FLUSH_DELAY seconds after its first message.
+ *
+ * \param[in] msg  The message to save.
+ */
+void log_store_writer::append(snaplogger::message const & msg)
+{
+    if(f_block.empty())
+    {
+        // each block is a stream on its own
+        //
+        f_block.append(LOG_RECORD_MAGIC, sizeof(LOG_RECORD_MAGIC));
+        f_encoder.reset();
+        f_block_info = log_store_block();
+        f_block_started = monotonic_seconds();
+    }
+
+    f_encoder.encode(msg, f_block);
+
+    ++f_block_info.f_count;
+    std::int64_t const seconds(msg.get_timestamp().tv_sec);
+    f_block_info.f_min_time = std::min(f_block_info.f_min_time, seconds);
+    f_block_info.f_max_time = std::max(f_block_info.f_max_time, seconds);
+    set_bit(f_block_info.f_severities, static_cast<std::size_t>(msg.get_severity()));
+    for(auto const & c : msg.get_components())
+    {
+        set_bit(f_block_info.f_components, log_store_component_bit(c->get_name()));
+    }
+
+    if(f_block.length() >= f_block_size
+    || monotonic_seconds() - f_block_started >= LOG_STORE_FLUSH_DELAY)
+    {
+        write_block();
+    }
+}
+
+
+/** \brief Write the current block, if any.
+ *
+ * This function is expected to be called when no messages were received
+ * for a while so the last messages do not stay in memory.
+ */
+void log_store_writer::flush()
+{
+    write_block();
+}
+
+
+/** \brief Write the current block and close the segment.
+ */
+void log_store_writer::close()
+{
+    write_block();
+    close_segment();
+}
+
+
+std::size_t log_store_writer::get_record_count() const
+{
+    return f_record_count;
+}
+
+
+/** \brief Get the number of records lost because of I/O errors.
+ *
+ * \return The number of records which could not be saved.
+ */
+std::size_t log_store_writer::get_error_count() const
+{
+    return f_error_count;
+}
+
+
+bool log_store_writer::open_segment()
+{
+    if(f_next_segment == 0)
+    {
+        if(snapdev::mkdir_p(f_path) != 0)
+        {
+            return false;
+        }
+        std::vector<std::uint64_t> const segments(list_segments(f_path));
+        f_next_segment = segments.empty() ? 1 : segments.back() + 1;
+    }
+
+    // the index gets created last since readers look for it
+    //
+    std::string const segment_name(segment_filename(f_path, f_next_segment, ".seg"));
+    f_segment.reset(open(
+              segment_name.c_str()
+            , O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC
+            , 0640));
+    std::string const index_name(segment_filename(f_path, f_next_segment, ".idx"));
+    ++f_next_segment;
+    if(f_segment == nullptr
+    || !write_all(f_segment.get(), LOG_STORE_SEGMENT_MAGIC, sizeof(LOG_STORE_SEGMENT_MAGIC)))
+    {
+        f_segment.reset();
+        return false;
+    }
+    f_index.reset(open(
+              index_name.c_str()
+            , O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC
+            , 0640));
+    if(f_index == nullptr
+    || !write_all(f_index.get(), LOG_STORE_INDEX_MAGIC, sizeof(LOG_STORE_INDEX_MAGIC)))
+    {
+        f_index.reset();
+        f_segment.reset();
+        return false;
+    }
+    f_segment_offset = sizeof(LOG_STORE_SEGMENT_MAGIC);
+
+    remove_old_segments();
+
+    return true;
+}
+
+
+void log_store_writer::close_segment()
+{
+    f_index.reset();
+    f_segment.reset();
+}
+
+
+void log_store_writer::remove_old_segments()
+{
+    if(f_max_segments == 0)
+    {
+        return;
+    }
+
+    std::vector<std::uint64_t> const segments(list_segments(f_path));
+    if(segments.size() <= f_max_segments)
+    {
+        return;
+    }
+    std::size_t const max(segments.size() - f_max_segments);
+    for(std::size_t idx(0); idx < max; ++idx)
+    {
+        unlink(segment_filename(f_path, segments[idx], ".idx").c_str());
+        unlink(segment_filename(f_path, segments[idx], ".seg").c_str());
+    }
+}
+
+
+bool log_store_writer::write_block()
+{
+    if(f_block.empty())
+    {
+        return true;
+    }
+
+    std::size_t const count(f_block_info.f_count);
+    bool success(f_segment != nullptr || open_segment());
+    if(success)
+    {
+        uLongf size(compressBound(f_block.length()));
+        f_compressed.resize(size);
+        success = compress2(
+                      reinterpret_cast<Bytef *>(f_compressed.data())
+                    , &size
+                    , reinterpret_cast<Bytef const *>(f_block.data())
+                    , f_block.length()
+                    , Z_DEFAULT_COMPRESSION) == Z_OK;
+        if(success)
+        {
+            f_block_info.f_offset = f_segment_offset;
+            f_block_info.f_size = static_cast<std::uint32_t>(size);
+            f_block_info.f_raw_size = static_cast<std::uint32_t>(f_block.length());
+            success = write_all(f_segment.get(), f_compressed.data(), size)
+                   && write_all(f_index.get(), &f_block_info, sizeof(f_block_info));
+            f_segment_offset += size;
+        }
+        if(!success
+        || f_segment_offset >= f_segment_size)
+        {
+            // on an error, the offsets may be out of sync so we also
+            // want to start a new segment
+            //
+            close_segment();
+        }
+    }
+    f_block.clear();
+
+    if(!success)
+    {
+        f_error_count += count;
+        if(!f_failed)
+        {
+            f_failed = true;
+            SNAP_LOG_ERROR
+                << "could not save "
+                << count
+                << " log record(s) in \""
+                << f_path
+                << "\"."
+                << SNAP_LOG_SEND;
+        }
+        return false;
+    }
+
+    f_failed = false;
+    f_record_count += count;
+    return true;
+}
+
+
+
+/** \brief Initialize the store reader.
+ *
+ * \param[in] path  The directory where the segments are saved.
+ */
+log_store_reader::log_store_reader(std::string const & path)
+    : f_path(path)
+{
+}
+
+
+/** \brief Search the store for records.
+ *
+ * The segments are read in order and the \p callback is called with each
+ * record matching the query. Segments and blocks which, according to
+ * their index, cannot include a matching record are skipped.
+ *
+ * The store may be written to at the same time. Index entries referencing
+ * a part of the segment which is not yet visible are ignored.
+ *
+ * \param[in] q  The query parameters.
+ * \param[in] callback  The function called with each matching record.
+ *
+ * \return The number of matching records.
+ */
+std::size_t log_store_reader::query(
+      log_store_query const & q
+    , callback_t const & callback)
+{
+    f_matches = 0;
+    f_segments_scanned = 0;
+    f_segments_skipped = 0;
+    f_blocks_scanned = 0;
+    f_blocks_skipped = 0;
+
+    for(auto const s : list_segments(f_path))
+    {
+        query_segment(s, q, callback);
+    }
+
+    return f_matches;
+}
+
+
+std::size_t log_store_reader::get_segments_scanned() const
+{
+    return f_segments_scanned;
+}
+
+
+std::size_t log_store_reader::get_segments_skipped() const
+{
+    return f_segments_skipped;
+}
+
+
+std::size_t log_store_reader::get_blocks_scanned() const
+{
+    return f_blocks_scanned;
+}
+
+
+std::size_t log_store_reader::get_blocks_skipped() const
+{
+    return f_blocks_skipped;
+}
+
+
+void log_store_reader::query_segment(
+      std::uint64_t segment
+    , log_store_query const & q
+    , callback_t const & callback)
+{
+    mapped_file const index(segment_filename(f_path, segment, ".idx"));
+    if(index.size() < sizeof(LOG_STORE_INDEX_MAGIC)
+    || memcmp(index.data(), LOG_STORE_INDEX_MAGIC, sizeof(LOG_STORE_INDEX_MAGIC)) != 0)
+    {
+        ++f_segments_skipped;
+        return;
+    }
+
+    // the entries are not aligned in the file so we copy them
+    //
+    std::size_t const count((index.size() - sizeof(LOG_STORE_INDEX_MAGIC)) / sizeof(log_store_block));
+    std::vector<log_store_block> blocks(count);
+    if(count > 0)
+    {
+        memcpy(blocks.data(), index.data() + sizeof(LOG_STORE_INDEX_MAGIC), count * sizeof(log_store_block));
+    }
+
+    // the whole segment bitmaps
+    //
+    log_store_block summary;
+    for(auto const & b : blocks)
+    {
+        summary.f_count += b.f_count;
+        summary.f_min_time = std::min(summary.f_min_time, b.f_min_time);
+        summary.f_max_time = std::max(summary.f_max_time, b.f_max_time);
+        for(std::size_t idx(0); idx < 4; ++idx)
+        {
+            summary.f_severities[idx] |= b.f_severities[idx];
+            summary.f_components[idx] |= b.f_components[idx];
+        }
+    }
+    if(!block_matches(summary, q))
+    {
+        ++f_segments_skipped;
+        f_blocks_skipped += count;
+        return;
+    }
+
+    mapped_file const data(segment_filename(f_path, segment, ".seg"));
+    if(data.size() < sizeof(LOG_STORE_SEGMENT_MAGIC)
+    || memcmp(data.data(), LOG_STORE_SEGMENT_MAGIC, sizeof(LOG_STORE_SEGMENT_MAGIC)) != 0)
+    {
+        ++f_segments_skipped;
+        f_blocks_skipped += count;
+        return;
+    }
+    ++f_segments_scanned;
+
+    std::string buffer;
+    log_record_decoder decoder;
+    for(auto const & b : blocks)
+    {
+        if(!block_matches(b, q)
+        || b.f_offset + b.f_size > data.size())
+        {
+            ++f_blocks_skipped;
+            continue;
+        }
+        ++f_blocks_scanned;
+
+        buffer.resize(b.f_raw_size);
+        uLongf size(b.f_raw_size);
+        if(uncompress(
+                  reinterpret_cast<Bytef *>(buffer.data())
+                , &size
+                , reinterpret_cast<Bytef const *>(data.data() + b.f_offset)
+                , b.f_size) != Z_OK
+        || size != b.f_raw_size)
+        {
+            continue;
+        }
+
+        decoder.reset();
+        decoder.decode(
+                  buffer.data()
+                , buffer.length()
+                , [this, &q, &callback](log_record const & record)
+                {
+                    if(record_matches(record, q))
+                    {
+                        ++f_matches;
+                        callback(record);
+                    }
+                });
+    }
+}
+
+
+
+} // namespace snaplogger_network
+// vim: ts=4 sw=4 et
@@ -0,0 +1,172 @@
+// Copyright (c) 2021-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief The on-disk log store.
+ *
+ * This file declares the writer used by the snaplogger daemon to save
+ * the log records it receives in indexed segments and the reader used
+ * by the snaplog tool to query them.
+ */
+
+// self
+//
+#include    "snaplogger/network/log_record.h"
+
+
+// snapdev
+//
+#include    <snapdev/raii_generic_deleter.h>
+
+
+// C++
+//
+#include    <cstdint>
+#include    <limits>
+
+
+
+namespace snaplogger_network
+{
+
+
+
+constexpr char const            LOG_STORE_SEGMENT_MAGIC[4] = { '\xB1', 'L', 'S', '\x01' };
+constexpr char const            LOG_STORE_INDEX_MAGIC[4] = { '\xB1', 'L', 'I', '\x01' };
+constexpr std::size_t const     LOG_STORE_DEFAULT_SEGMENT_SIZE = 64 * 1024 * 1024;
+constexpr std::size_t const     LOG_STORE_DEFAULT_BLOCK_SIZE = 64 * 1024;
+constexpr std::int64_t const    LOG_STORE_FLUSH_DELAY = 1;      // in seconds
+
+
+/** \brief One entry of a segment index.
+ *
+ * The index file is the LOG_STORE_INDEX_MAGIC followed by one of these
+ * structures per block written to the segment file. The structure is
+ * saved as is (host byte order).
+ */
+struct log_store_block
+{
+    std::uint64_t               f_offset = 0;           // position in the segment file
+    std::uint32_t               f_size = 0;             // compressed size
+    std::uint32_t               f_raw_size = 0;         // uncompressed size
+    std::uint32_t               f_count = 0;            // number of records
+    std::uint32_t               f_reserved = 0;
+    std::int64_t                f_min_time = std::numeric_limits<std::int64_t>::max();
+    std::int64_t                f_max_time = std::numeric_limits<std::int64_t>::min();
+    std::uint64_t               f_severities[4] = {};   // one bit per severity
+    std::uint64_t               f_components[4] = {};   // one bit per component name hash
+};
+
+static_assert(sizeof(log_store_block) == 104, "log_store_block is saved as is in the index files");
+
+
+std::size_t                     log_store_component_bit(std::string const & name);
+
+
+class log_store_writer
+{
+public:
+    typedef std::shared_ptr<log_store_writer>
+                                pointer_t;
+
+                                log_store_writer(
+                                      std::string const & path
+                                    , std::size_t segment_size = LOG_STORE_DEFAULT_SEGMENT_SIZE
+                                    , std::size_t max_segments = 0
+                                    , std::size_t block_size = LOG_STORE_DEFAULT_BLOCK_SIZE);
+                                log_store_writer(log_store_writer const &) = delete;
+                                ~log_store_writer();
+    log_store_writer &          operator = (log_store_writer const &) = delete;
+
+    void                        append(snaplogger::message const & msg);
+    void                        flush();
+    void                        close();
+
+    std::size_t                 get_record_count() const;
+    std::size_t                 get_error_count() const;
+
+private:
+    bool                        open_segment();
+    void                        close_segment();
+    void                        remove_old_segments();
+    bool                        write_block();
+
+    std::string                 f_path = std::string();
+    std::size_t                 f_segment_size = LOG_STORE_DEFAULT_SEGMENT_SIZE;
+    std::size_t                 f_max_segments = 0;
+    std::size_t                 f_block_size = LOG_STORE_DEFAULT_BLOCK_SIZE;
+    std::uint64_t               f_next_segment = 0;
+    snapdev::raii_fd_t          f_segment = snapdev::raii_fd_t();
+    snapdev::raii_fd_t          f_index = snapdev::raii_fd_t();
+    std::uint64_t               f_segment_offset = 0;
+    log_record_encoder          f_encoder = log_record_encoder();
+    std::string                 f_block = std::string();
+    std::string                 f_compressed = std::string();
+    log_store_block             f_block_info = log_store_block();
+    std::int64_t                f_block_started = 0;
+    std::size_t                 f_record_count = 0;
+    std::size_t                 f_error_count = 0;
+    bool                        f_failed = false;
+};
+
+
+struct log_store_query
+{
+    std::int64_t                f_start = std::numeric_limits<std::int64_t>::min();    // seconds, inclusive
+    std::int64_t                f_end = std::numeric_limits<std::int64_t>::max();      // seconds, exclusive
+    snaplogger::severity_t      f_min_severity = snaplogger::severity_t::SEVERITY_ALL;
+    std::vector<std::string>    f_components = std::vector<std::string>();             // any of those
+};
+
+
+class log_store_reader
+{
+public:
+    typedef std::function<void(log_record const & record)>
+                                callback_t;
+
+                                log_store_reader(std::string const & path);
+
+    std::size_t                 query(
+                                      log_store_query const & q
+                                    , callback_t const & callback);
+
+    std::size_t                 get_segments_scanned() const;
+    std::size_t                 get_segments_skipped() const;
+    std::size_t                 get_blocks_scanned() const;
+    std::size_t                 get_blocks_skipped() const;
+
+private:
+    void                        query_segment(
+                                      std::uint64_t segment
+                                    , log_store_query const & q
+                                    , callback_t const & callback);
+
+    std::string                 f_path = std::string();
+    std::size_t                 f_matches = 0;
+    std::size_t                 f_segments_scanned = 0;
+    std::size_t                 f_segments_skipped = 0;
+    std::size_t                 f_blocks_scanned = 0;
+    std::size_t                 f_blocks_skipped = 0;
+};
+
+
+
+} // namespace snaplogger_network
+// vim: ts=4 sw=4 et
@@ -20,6 +20,12 @@
  * \brief The implementation of the TCP appender.
  *
  * This file implements the sending of log messages via TCP.
+ *
+ * By default, the messages are sent through a permanent connection added
+ * to the caller's communicator. With the "thread" shipping mode, the
+ * messages are serialized and pushed to a bounded lock-free queue
+ * instead. A dedicated thread pops them and writes them in batches so
+ * the code emitting logs never waits on the network.
  */
 
 // self
@@ -33,10 +39,23 @@
 #include    "snaplogger/guard.h"
 
 
+// cppthread
+//
+#include    <cppthread/guard.h>
+#include    <cppthread/runner.h>
+
+
 // eventdispatcher
 //
 #include    <eventdispatcher/dispatcher.h>
+#include    <eventdispatcher/pause_durations.h>
 #include    <eventdispatcher/tcp_client_permanent_message_connection.h>
+#include    <eventdispatcher/utils.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_used.h>
 
 
 // C++
@@ -44,6 +63,15 @@
 #include    <iostream>
 
 
+// C
+//
+#include    <fcntl.h>
+#include    <poll.h>
+#include    <sys/eventfd.h>
+#include    <sys/socket.h>
+#include    <unistd.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -61,6 +89,17 @@ namespace
 APPENDER_FACTORY(tcp);
 
 
+// the shipping thread must not hang on a server which does not answer,
+// especially while the appender is being stopped
+//
+constexpr int const             SHIPPER_CONNECT_TIMEOUT = 2'000;    // in ms
+constexpr time_t const          SHIPPER_WRITE_TIMEOUT = 5;          // in seconds
+
+// a caller waiting for room in the queue checks again after this delay
+//
+constexpr std::uint64_t const   ROOM_WAIT_DELAY = 100'000;          // in us
+
+
 
 class appender_connection
     : public ed::tcp_client_permanent_message_connection
@@ -139,6 +178,386 @@ bool appender_connection::is_paused() const
 
 
 
+/** \brief The runner shipping the queued records.
+ *
+ * This runner pops the records pushed to the queue by the
+ * tcp_appender::process_message() function and writes them to the
+ * server. Records are written in batches: once the batch size is reached
+ * or the batch delay elapsed since the first record of the batch was
+ * popped, whichever comes first. Each batch is sent with a single write.
+ *
+ * The runner also reads the replies of the server to handle the PAUSE
+ * and UNPAUSE messages. While paused or disconnected, the records stay
+ * in the queue and the overflow policy applies once it is full.
+ *
+ * The connection attempts and the writes are bounded by short timeouts.
+ * When the thread stops, what is left gets flushed only if the runner
+ * is still connected; it does not try to connect again.
+ *
+ * In the binary format, the records refer to strings defined by the
+ * records sent before them, possibly on a previous connection. The
+ * runner keeps these definitions in the appender dictionary and sends
+ * them first each time it connects. The batch not yet sent is also
+ * handed back to the appender when the thread stops so a new runner
+ * can send it.
+ *
+ * \warning
+ * The runner must not log anything. The thread emitting a log may hold
+ * the snaplogger guard while waiting for room in the queue.
+ */
+class tcp_appender::shipper
+    : public cppthread::runner
+{
+public:
+    shipper(tcp_appender * appender, addr::addr const & server_address)
+        : runner("tcp_appender")
+        , f_appender(appender)
+        , f_server_address(server_address)
+    {
+        f_batch.swap(f_appender->f_unsent);
+        f_batch_records = f_appender->f_unsent_records;
+        f_appender->f_unsent_records = 0;
+    }
+
+    shipper(shipper const &) = delete;
+    shipper & operator = (shipper const &) = delete;
+
+    virtual void run() override
+    {
+        while(continue_running())
+        {
+            // wait for records, server replies, or the end of the batch delay
+            //
+            std::int64_t wait(f_appender->f_batch_delay);
+            if(f_batch_records > 0)
+            {
+                wait = std::max(static_cast<std::int64_t>(0), f_batch_date + f_appender->f_batch_delay - ed::get_current_date());
+            }
+
+            struct pollfd fds[2] = {};
+            fds[0].fd = f_appender->f_wakeup.get();
+            fds[0].events = POLLIN;
+            nfds_t count(1);
+            if(f_socket != nullptr)
+            {
+                fds[1].fd = f_socket.get();
+                fds[1].events = POLLIN | POLLRDHUP;
+                count = 2;
+            }
+            int const r(poll(fds, count, static_cast<int>((wait + 999) / 1000)));
+            if(r > 0)
+            {
+                if((fds[0].revents & POLLIN) != 0)
+                {
+                    std::uint64_t value(0);
+                    snapdev::NOT_USED(read(fds[0].fd, &value, sizeof(value)));
+                }
+                if(count > 1
+                && fds[1].revents != 0)
+                {
+                    read_replies();
+                }
+            }
+
+            ship(false);
+        }
+
+        // try to send what is left before leaving, but only on the current
+        // connection, the appender is being stopped and cannot wait for
+        // a new one
+        //
+        if(f_socket != nullptr)
+        {
+            ship(true);
+        }
+        disconnect();
+
+        f_appender->f_unsent.swap(f_batch);
+        f_appender->f_unsent_records = f_batch_records;
+    }
+
+private:
+    bool connect()
+    {
+        if(f_socket != nullptr)
+        {
+            return true;
+        }
+
+        std::int64_t const now(ed::get_current_date());
+        if(now < f_reconnect_date)
+        {
+            return false;
+        }
+
+        if(!open_socket())
+        {
+            f_socket.reset();
+            f_reconnect_date = now + static_cast<std::int64_t>(f_pause.get_next_delay() * 1'000'000.0);
+            return false;
+        }
+
+        f_pause.restart();
+        f_paused = false;
+        f_replies.clear();
+
+        if(f_appender->f_format == format_t::FORMAT_BINARY)
+        {
+            f_preamble.assign(LOG_RECORD_MAGIC, sizeof(LOG_RECORD_MAGIC));
+            f_preamble += f_appender->f_dictionary;
+        }
+        return true;
+    }
+
+    /** \brief Connect to the server.
+     *
+     * The connect() is done on a non-blocking socket so it can be given
+     * up after SHIPPER_CONNECT_TIMEOUT. Once connected, the socket is
+     * made blocking with a send timeout of SHIPPER_WRITE_TIMEOUT.
+     *
+     * \note
+     * The ed::tcp_client class is not used because it blocks in connect()
+     * and logs its errors.
+     *
+     * \return true if the socket is connected.
+     */
+    bool open_socket()
+    {
+        f_socket.reset(f_server_address.create_socket(
+                  addr::addr::SOCKET_FLAG_NONBLOCK
+                | addr::addr::SOCKET_FLAG_CLOEXEC));
+        if(f_socket == nullptr)
+        {
+            return false;
+        }
+
+        if(f_server_address.connect(f_socket.get()) != 0)
+        {
+            if(errno != EINPROGRESS)
+            {
+                return false;
+            }
+
+            struct pollfd fd = {};
+            fd.fd = f_socket.get();
+            fd.events = POLLOUT;
+            if(poll(&fd, 1, SHIPPER_CONNECT_TIMEOUT) != 1)
+            {
+                return false;
+            }
+
+            int error(0);
+            socklen_t length(sizeof(error));
+            if(getsockopt(f_socket.get(), SOL_SOCKET, SO_ERROR, &error, &length) != 0
+            || error != 0)
+            {
+                return false;
+            }
+        }
+
+        int const flags(fcntl(f_socket.get(), F_GETFL));
+        if(flags == -1
+        || fcntl(f_socket.get(), F_SETFL, flags & ~O_NONBLOCK) != 0)
+        {
+            return false;
+        }
+
+        struct timeval const timeout = { SHIPPER_WRITE_TIMEOUT, 0 };
+        return setsockopt(f_socket.get(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0;
+    }
+
+    void disconnect()
+    {
+        f_socket.reset();
+    }
+
+    void read_replies()
+    {
+        char buf[1024];
+        ssize_t const r(read(f_socket.get(), buf, sizeof(buf)));
+        if(r <= 0)
+        {
+            disconnect();
+            return;
+        }
+        f_replies.append(buf, static_cast<std::size_t>(r));
+
+        for(;;)
+        {
+            std::string::size_type const pos(f_replies.find('\n'));
+            if(pos == std::string::npos)
+            {
+                break;
+            }
+            ed::message msg;
+            if(msg.from_message(f_replies.substr(0, pos)))
+            {
+                if(msg.get_command() == "PAUSE")
+                {
+                    f_paused = true;
+                }
+                else if(msg.get_command() == "UNPAUSE")
+                {
+                    f_paused = false;
+                }
+            }
+            f_replies.erase(0, pos + 1);
+        }
+    }
+
+    void ship(bool flush)
+    {
+        if(f_paused
+        || !connect())
+        {
+            return;
+        }
+
+        for(;;)
+        {
+            bool popped(false);
+            while(f_batch_records < f_appender->f_batch_size
+               && f_appender->f_queue->pop(f_record))
+            {
+                popped = true;
+                if(f_batch_records == 0)
+                {
+                    f_batch_date = ed::get_current_date();
+                }
+                f_batch += f_record;
+                if(f_appender->f_format == format_t::FORMAT_TEXT)
+                {
+                    f_batch += '\n';
+                }
+                ++f_batch_records;
+            }
+            if(popped
+            && f_appender->f_room_waiters > 0)
+            {
+                cppthread::guard lock(f_appender->f_room_mutex);
+                f_appender->f_room_mutex.broadcast();
+            }
+            if(f_batch_records == 0)
+            {
+                return;
+            }
+            if(!flush
+            && f_batch_records < f_appender->f_batch_size
+            && ed::get_current_date() < f_batch_date + f_appender->f_batch_delay)
+            {
+                // wait for more records
+                //
+                return;
+            }
+            if(!write_batch())
+            {
+                return;
+            }
+        }
+    }
+
+    bool write_data(std::string const & data)
+    {
+        std::size_t pos(0);
+        while(pos < data.length())
+        {
+            ssize_t const r(send(
+                      f_socket.get()
+                    , data.data() + pos
+                    , data.length() - pos
+                    , MSG_NOSIGNAL));
+            if(r < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                disconnect();
+                return false;
+            }
+            pos += static_cast<std::size_t>(r);
+        }
+        return true;
+    }
+
+    bool write_batch()
+    {
+        if(!f_preamble.empty())
+        {
+            if(!write_data(f_preamble))
+            {
+                return false;
+            }
+            f_preamble.clear();
+        }
+
+        // on failure, keep the batch, it gets sent once reconnected
+        //
+        // (the part already sent may be duplicated)
+        //
+        if(!write_data(f_batch))
+        {
+            return false;
+        }
+
+        if(f_appender->f_format == format_t::FORMAT_BINARY)
+        {
+            save_strings();
+        }
+
+        f_appender->f_sent += f_batch_records;
+        ++f_appender->f_batches;
+        f_batch.clear();
+        f_batch_records = 0;
+        return true;
+    }
+
+    void save_strings()
+    {
+        std::size_t pos(0);
+        for(;;)
+        {
+            std::size_t const start(pos);
+            frame_t type(frame_t::FRAME_RECORD);
+            std::size_t length(0);
+            if(!get_frame(f_batch.data(), f_batch.length(), pos, type, length))
+            {
+                break;
+            }
+            switch(type)
+            {
+            case frame_t::FRAME_STRING:
+                f_appender->f_dictionary.append(f_batch, start, pos + length - start);
+                break;
+
+            case frame_t::FRAME_RESET:
+                f_appender->f_dictionary.clear();
+                break;
+
+            default:
+                break;
+
+            }
+            pos += length;
+        }
+    }
+
+    tcp_appender *              f_appender = nullptr;
+    addr::addr                  f_server_address = addr::addr();
+    snapdev::raii_fd_t          f_socket = snapdev::raii_fd_t();
+    ed::pause_durations         f_pause = ed::pause_durations(1'000'000, 60'000'000);
+    std::int64_t                f_reconnect_date = 0;
+    bool                        f_paused = false;
+    std::string                 f_replies = std::string();
+    std::string                 f_preamble = std::string();
+    std::string                 f_record = std::string();
+    std::string                 f_batch = std::string();
+    std::size_t                 f_batch_records = 0;
+    std::int64_t                f_batch_date = 0;
+};
+
+
+
 tcp_appender::tcp_appender(std::string const & name)
     : base_network_appender(name, "tcp")
     , f_communicator(ed::communicator::instance())
@@ -148,6 +567,7 @@ tcp_appender::tcp_appender(std::string const & name)
 
 tcp_appender::~tcp_appender()
 {
+    stop_shipping();
 }
 
 
@@ -174,6 +594,62 @@ void tcp_appender::set_config(advgetopt::getopt const & opts)
             f_compression = compression_t::COMPRESSION_NONE;
         }
     }
+
+    // SHIPPING
+    //
+    std::string const shipping_field(get_name() + "::shipping");
+    if(opts.is_defined(shipping_field))
+    {
+        std::string const shipping(opts.get_string(shipping_field));
+        if(shipping == "thread")
+        {
+            f_shipping = shipping_t::SHIPPING_THREAD;
+        }
+        else
+        {
+            f_shipping = shipping_t::SHIPPING_COMMUNICATOR;
+        }
+    }
+
+    // OVERFLOW
+    //
+    std::string const overflow_field(get_name() + "::overflow");
+    if(opts.is_defined(overflow_field))
+    {
+        std::string const overflow(opts.get_string(overflow_field));
+        if(overflow == "block")
+        {
+            f_overflow = overflow_t::OVERFLOW_BLOCK;
+        }
+        else
+        {
+            f_overflow = overflow_t::OVERFLOW_DROP;
+        }
+    }
+
+    // QUEUE SIZE
+    //
+    std::string const queue_size_field(get_name() + "::queue_size");
+    if(opts.is_defined(queue_size_field))
+    {
+        f_queue_size = static_cast<std::size_t>(std::max(1L, opts.get_long(queue_size_field)));
+    }
+
+    // BATCH SIZE
+    //
+    std::string const batch_size_field(get_name() + "::batch_size");
+    if(opts.is_defined(batch_size_field))
+    {
+        f_batch_size = static_cast<std::size_t>(std::max(1L, opts.get_long(batch_size_field)));
+    }
+
+    // BATCH DELAY (in milliseconds)
+    //
+    std::string const batch_delay_field(get_name() + "::batch_delay");
+    if(opts.is_defined(batch_delay_field))
+    {
+        f_batch_delay = std::max(1L, opts.get_long(batch_delay_field)) * 1'000;
+    }
 }
 
 
@@ -181,6 +657,95 @@ void tcp_appender::server_address_changed()
 {
     f_communicator->remove_connection(f_connection);
     f_connection.reset();
+
+    // the thread gets restarted with the new address on the next message
+    // (the records already queued are kept)
+    //
+    stop_shipping();
+}
+
+
+/** \brief Get the shipping mode.
+ *
+ * The "<name>::shipping" parameter can be set to "thread" to send the
+ * messages from a dedicated thread. By default, the messages are sent
+ * through a connection added to the caller's communicator.
+ *
+ * \return The shipping mode.
+ */
+shipping_t tcp_appender::get_shipping() const
+{
+    return f_shipping;
+}
+
+
+/** \brief Get the overflow policy.
+ *
+ * In the "thread" shipping mode, this policy defines what happens when
+ * the queue is full. The "<name>::overflow" parameter can be set to
+ * "block" to wait for room in the queue. By default, the record is
+ * dropped.
+ *
+ * \return The overflow policy.
+ */
+overflow_t tcp_appender::get_overflow() const
+{
+    return f_overflow;
+}
+
+
+/** \brief Number of records pushed to the shipping queue.
+ *
+ * \return The number of records queued since the appender was created.
+ */
+std::uint64_t tcp_appender::get_queued_count() const
+{
+    return f_queued;
+}
+
+
+/** \brief Number of records dropped because the queue was full.
+ *
+ * \return The number of dropped records.
+ */
+std::uint64_t tcp_appender::get_dropped_count() const
+{
+    return f_dropped;
+}
+
+
+/** \brief Number of times a caller had to wait for room in the queue.
+ *
+ * This counter only increases with the "block" overflow policy.
+ *
+ * \return The number of records which had to wait.
+ */
+std::uint64_t tcp_appender::get_blocked_count() const
+{
+    return f_blocked;
+}
+
+
+/** \brief Number of records written to the server by the thread.
+ *
+ * \return The number of records sent.
+ */
+std::uint64_t tcp_appender::get_sent_count() const
+{
+    return f_sent;
+}
+
+
+/** \brief Number of writes used to send the records.
+ *
+ * The ratio between get_sent_count() and this number gives the average
+ * batch size.
+ *
+ * \return The number of batches sent.
+ */
+std::uint64_t tcp_appender::get_batch_count() const
+{
+    return f_batches;
 }
 
 
@@ -218,9 +783,20 @@ bool tcp_appender::process_message(
         , std::string const & formatted_message
         , snaplogger::component::pointer_t extra_component)
 {
+    if(f_shipping == shipping_t::SHIPPING_THREAD
+    && f_format == format_t::FORMAT_BINARY)
+    {
+        return queue_message(msg, std::string(), formatted_message, extra_component);
+    }
+
     ed::message log_message;
     log_message_to_ed_message(msg, log_message, extra_component);
 
+    if(f_shipping == shipping_t::SHIPPING_THREAD)
+    {
+        return queue_message(msg, log_message.to_string(), formatted_message, extra_component);
+    }
+
     // TODO: handle the possible compression
     //
     // 1. Grouping
@@ -238,8 +814,7 @@ bool tcp_appender::process_message(
     //
     // 4. Thread
     //
-    //    We should offer the ability to run in a thread (I think the core
-    //    library already does that part so probably useless here?)
+    //    See the "thread" shipping mode.
 
     snaplogger::guard g;
 
@@ -282,6 +857,169 @@ bool tcp_appender::process_message(
 
 
 
+/** \brief Push a record to the shipping queue.
+ *
+ * This function starts the shipping thread if necessary and pushes the
+ * serialized message to the queue. The thread is woken up once a full
+ * batch is available. Otherwise it picks up the records at the end of
+ * the batch delay.
+ *
+ * In the binary format, the message is encoded here. The encoder keeps
+ * state so the encoding and the push happen under the snaplogger guard,
+ * which keeps the records in the order the strings were defined.
+ *
+ * When the queue is full, the overflow policy applies: the record is
+ * dropped (and written to the console if the fallback is enabled) or
+ * the function waits until the thread makes room. The wait happens
+ * outside of the guard so other threads can still log. Since they may
+ * define strings in the meantime, the binary record is encoded again
+ * after each wait.
+ *
+ * \param[in] msg  The message to encode in the binary format.
+ * \param[in] text  The serialized message in the text format.
+ * \param[in] formatted_message  The formatted message for the console
+ * fallback.
+ * \param[in] extra_component  The "alert" component or nullptr.
+ *
+ * \return true if the record was queued or written to the console.
+ */
+bool tcp_appender::queue_message(
+          snaplogger::message const & msg
+        , std::string const & text
+        , std::string const & formatted_message
+        , snaplogger::component::pointer_t extra_component)
+{
+    bool blocked(false);
+    for(;;)
+    {
+        {
+            snaplogger::guard g;
+
+            start_shipping();
+
+            std::string record;
+            if(f_format == format_t::FORMAT_BINARY)
+            {
+                f_encoder.encode(msg, record, extra_component);
+            }
+            else
+            {
+                record = text;
+            }
+
+            if(f_queue->push(record))
+            {
+                ++f_queued;
+                if(f_queue->size() >= f_batch_size)
+                {
+                    wakeup_shipper();
+                }
+                return true;
+            }
+
+            // the strings defined by this record will not be sent
+            //
+            if(f_format == format_t::FORMAT_BINARY)
+            {
+                f_encoder.rollback();
+            }
+
+            if(f_overflow == overflow_t::OVERFLOW_DROP)
+            {
+                ++f_dropped;
+
+                // how could we report that? we are the logger...
+                //
+                if(f_fallback_to_console
+                && isatty(fileno(stdout)))
+                {
+                    std::cout << formatted_message.c_str();
+                    return true;
+                }
+                return false;
+            }
+
+            if(!blocked)
+            {
+                blocked = true;
+                ++f_blocked;
+            }
+            wakeup_shipper();
+        }
+
+        wait_for_room();
+    }
+}
+
+
+/** \brief Wait for the shipping thread to pop records.
+ *
+ * This function is called without holding the snaplogger guard. It
+ * returns once the shipping thread popped records from the queue or
+ * after ROOM_WAIT_DELAY, whichever comes first. The caller then tries
+ * to push its record again.
+ */
+void tcp_appender::wait_for_room()
+{
+    cppthread::guard lock(f_room_mutex);
+
+    ++f_room_waiters;
+    if(f_queue->size() >= f_queue->capacity())
+    {
+        f_room_mutex.timed_wait(ROOM_WAIT_DELAY);
+    }
+    --f_room_waiters;
+}
+
+
+void tcp_appender::start_shipping()
+{
+    if(f_thread != nullptr)
+    {
+        return;
+    }
+
+    if(f_queue == nullptr)
+    {
+        f_queue = std::make_shared<log_queue>(f_queue_size);
+    }
+    if(f_wakeup == nullptr)
+    {
+        // if this fails, the thread still wakes up after each batch delay
+        //
+        f_wakeup.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    }
+
+    f_shipper = std::make_shared<shipper>(this, f_server_address);
+    f_thread = std::make_shared<cppthread::thread>("tcp_appender", f_shipper);
+    f_thread->start();
+}
+
+
+void tcp_appender::stop_shipping()
+{
+    if(f_thread == nullptr)
+    {
+        return;
+    }
+
+    wakeup_shipper();
+    f_thread->stop();
+    f_thread.reset();
+    f_shipper.reset();
+}
+
+
+void tcp_appender::wakeup_shipper()
+{
+    if(f_wakeup != nullptr)
+    {
+        std::uint64_t const value(1);
+        snapdev::NOT_USED(write(f_wakeup.get(), &value, sizeof(value)));
+    }
+}
+
+
 
 } // namespace snaplogger_network
 // vim: ts=4 sw=4 et
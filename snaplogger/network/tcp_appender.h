@@ -27,6 +27,8 @@
 // self
 //
 #include    "base_network_appender.h"
+#include    "log_queue.h"
+#include    "log_record.h"
 
 
 
@@ -36,6 +38,22 @@
 #include    <eventdispatcher/connection.h>
 
 
+// cppthread
+//
+#include    <cppthread/mutex.h>
+#include    <cppthread/thread.h>
+
+
+// snapdev
+//
+#include    <snapdev/raii_generic_deleter.h>
+
+
+// C++
+//
+#include    <atomic>
+
+
 
 
 
@@ -44,12 +62,30 @@ namespace snaplogger_network
 
 
 
+enum class shipping_t
+{
+    SHIPPING_COMMUNICATOR,      // send from the caller's communicator (default)
+    SHIPPING_THREAD,            // send from a dedicated thread
+};
+
+
+enum class overflow_t
+{
+    OVERFLOW_DROP,              // drop the record when the queue is full (default)
+    OVERFLOW_BLOCK,             // wait for room in the queue
+};
+
+
 class tcp_appender
     : public base_network_appender
 {
 public:
     typedef std::shared_ptr<tcp_appender>      pointer_t;
 
+    static constexpr std::size_t const      DEFAULT_QUEUE_SIZE = 10'000;
+    static constexpr std::size_t const      DEFAULT_BATCH_SIZE = 100;
+    static constexpr std::int64_t const     DEFAULT_BATCH_DELAY = 100'000;     // 100ms
+
                                 tcp_appender(std::string const & name);
     virtual                     ~tcp_appender() override;
 
@@ -61,6 +97,14 @@ public:
     //
     virtual void                server_address_changed() override;
 
+    shipping_t                  get_shipping() const;
+    overflow_t                  get_overflow() const;
+    std::uint64_t               get_queued_count() const;
+    std::uint64_t               get_dropped_count() const;
+    std::uint64_t               get_blocked_count() const;
+    std::uint64_t               get_sent_count() const;
+    std::uint64_t               get_batch_count() const;
+
 protected:
     // implement appender
     //
@@ -74,10 +118,44 @@ protected:
                                         , snaplogger::component::pointer_t extra_component);
 
 private:
+    class shipper;
+
+    bool                        queue_message(
+                                          snaplogger::message const & msg
+                                        , std::string const & text
+                                        , std::string const & formatted_message
+                                        , snaplogger::component::pointer_t extra_component);
+    void                        wait_for_room();
+    void                        start_shipping();
+    void                        stop_shipping();
+    void                        wakeup_shipper();
+
     ed::communicator::pointer_t f_communicator = ed::communicator::pointer_t();
     compression_t               f_compression = compression_t::COMPRESSION_NONE;
     bool                        f_fallback_to_console = false;
     ed::connection::pointer_t   f_connection = ed::connection::pointer_t();
+
+    shipping_t                  f_shipping = shipping_t::SHIPPING_COMMUNICATOR;
+    overflow_t                  f_overflow = overflow_t::OVERFLOW_DROP;
+    std::size_t                 f_queue_size = DEFAULT_QUEUE_SIZE;
+    std::size_t                 f_batch_size = DEFAULT_BATCH_SIZE;
+    std::int64_t                f_batch_delay = DEFAULT_BATCH_DELAY;
+    log_queue::pointer_t        f_queue = log_queue::pointer_t();
+    snapdev::raii_fd_t          f_wakeup = snapdev::raii_fd_t();
+    cppthread::mutex            f_room_mutex = cppthread::mutex();
+    std::atomic<std::size_t>    f_room_waiters = 0;
+    std::shared_ptr<shipper>    f_shipper = std::shared_ptr<shipper>();
+    cppthread::thread::pointer_t
+                                f_thread = cppthread::thread::pointer_t();
+    log_record_encoder          f_encoder = log_record_encoder();
+    std::string                 f_dictionary = std::string();
+    std::string                 f_unsent = std::string();
+    std::size_t                 f_unsent_records = 0;
+    std::atomic<std::uint64_t>  f_queued = 0;
+    std::atomic<std::uint64_t>  f_dropped = 0;
+    std::atomic<std::uint64_t>  f_blocked = 0;
+    std::atomic<std::uint64_t>  f_sent = 0;
+    std::atomic<std::uint64_t>  f_batches = 0;
 };
 
 
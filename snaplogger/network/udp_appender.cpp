@@ -21,6 +21,13 @@
  *
  * This file implements the necessary to send UDP messages to the
  * snaplogger daemon.
+ *
+ * The appender packs as many records as possible in each datagram, up
+ * to the path MTU or the configured datagram size. Full datagrams are
+ * sent together with sendmmsg(). By default, the linger delay is 0 and
+ * each record is sent immediately. With a linger delay, the datagram
+ * being filled is sent once that delay elapsed since its first record.
+ * Records which could not be sent are counted as dropped.
  */
 
 // self
@@ -35,7 +42,8 @@
 
 // eventdispatcher
 //
-#include    <eventdispatcher/udp_server_message_connection.h>
+#include    <eventdispatcher/timer.h>
+#include    <eventdispatcher/utils.h>
 
 
 // C++
@@ -43,6 +51,13 @@
 #include    <iostream>
 
 
+// C
+//
+#include    <netinet/in.h>
+#include    <sys/socket.h>
+#include    <unistd.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -60,6 +75,39 @@ namespace
 APPENDER_FACTORY(udp);
 
 
+
+class linger_timer
+    : public ed::timer
+{
+public:
+                            linger_timer(udp_appender * appender);
+
+    // connection implementation
+    //
+    virtual void            process_timeout() override;
+
+private:
+    udp_appender *          f_appender = nullptr;
+};
+
+
+linger_timer::linger_timer(udp_appender * appender)
+    : timer(-1)
+    , f_appender(appender)
+{
+    set_name("udp-appender-linger");
+}
+
+
+void linger_timer::process_timeout()
+{
+    snaplogger::guard g;
+
+    f_appender->flush_datagrams();
+}
+
+
+
 }
 // no name namespace
 
@@ -67,12 +115,20 @@ APPENDER_FACTORY(udp);
 
 udp_appender::udp_appender(std::string const & name)
     : base_network_appender(name, "udp")
+    , f_communicator(ed::communicator::instance())
 {
 }
 
 
 udp_appender::~udp_appender()
 {
+    snaplogger::guard g;
+
+    flush_datagrams();
+    if(f_linger_timer != nullptr)
+    {
+        f_communicator->remove_connection(f_linger_timer);
+    }
 }
 
 
@@ -87,6 +143,108 @@ void udp_appender::set_config(advgetopt::getopt const & opts)
     {
         f_secret_code = opts.get_string(secret_code_field);
     }
+
+    // DATAGRAM SIZE (0 means use the path MTU)
+    //
+    std::string const datagram_size_field(get_name() + "::datagram_size");
+    if(opts.is_defined(datagram_size_field))
+    {
+        f_datagram_size = static_cast<std::size_t>(std::max(0L, opts.get_long(datagram_size_field)));
+    }
+
+    // MAXIMUM NUMBER OF DATAGRAMS SENT AT ONCE
+    //
+    std::string const max_datagrams_field(get_name() + "::max_datagrams");
+    if(opts.is_defined(max_datagrams_field))
+    {
+        f_max_datagrams = static_cast<std::size_t>(std::max(1L, opts.get_long(max_datagrams_field)));
+    }
+
+    // LINGER (in milliseconds, 0 means send each record immediately)
+    //
+    std::string const linger_field(get_name() + "::linger");
+    if(opts.is_defined(linger_field))
+    {
+        f_linger = std::max(0L, opts.get_long(linger_field)) * 1'000;
+    }
+}
+
+
+void udp_appender::server_address_changed()
+{
+    // the pending records were meant for the previous server
+    //
+    flush_datagrams();
+    f_socket.reset();
+}
+
+
+/** \brief Send all the pending records.
+ *
+ * This function closes the datagram being filled and sends it along
+ * the other datagrams waiting to be sent.
+ *
+ * The caller is expected to hold the snaplogger guard.
+ */
+void udp_appender::flush_datagrams()
+{
+    close_datagram();
+    send_datagrams();
+
+    if(f_linger_timer != nullptr)
+    {
+        f_linger_timer->set_timeout_date(-1);
+    }
+}
+
+
+/** \brief Get the maximum size of a datagram.
+ *
+ * When the "<name>::datagram_size" parameter is not defined (or 0),
+ * this is the path MTU to the server minus the IP and UDP headers.
+ * The size is determined when the socket gets created.
+ *
+ * \return The maximum size of a datagram or 0 if not yet known.
+ */
+std::size_t udp_appender::get_datagram_size() const
+{
+    return f_max_size;
+}
+
+
+/** \brief Number of records sent.
+ *
+ * \return The number of records sent since the appender was created.
+ */
+std::uint64_t udp_appender::get_sent_count() const
+{
+    return f_sent;
+}
+
+
+/** \brief Number of datagrams sent.
+ *
+ * The ratio between get_sent_count() and this number gives the average
+ * number of records per datagram.
+ *
+ * \return The number of datagrams sent.
+ */
+std::uint64_t udp_appender::get_datagram_count() const
+{
+    return f_sent_datagrams;
+}
+
+
+/** \brief Number of records dropped.
+ *
+ * Records get dropped when they do not fit in a datagram or when the
+ * sendmmsg() call fails to send their datagram.
+ *
+ * \return The number of dropped records.
+ */
+std::uint64_t udp_appender::get_dropped_count() const
+{
+    return f_dropped;
 }
 
 
@@ -94,6 +252,157 @@ bool udp_appender::process_message(snaplogger::message const & msg, std::string
 {
     snaplogger::guard g;
 
+    if(!open_socket()
+    || !add_record(msg))
+    {
+        ++f_dropped;
+
+        // how could we report that? we are the logger...
+        //
+        if(f_fallback_to_console
+        && isatty(fileno(stdout)))
+        {
+            std::cout << formatted_message.c_str();
+            return true;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+
+bool udp_appender::open_socket()
+{
+    if(f_socket != nullptr)
+    {
+        return true;
+    }
+
+    f_socket.reset(f_server_address.create_socket(
+              addr::addr::SOCKET_FLAG_NONBLOCK
+            | addr::addr::SOCKET_FLAG_CLOEXEC));
+    if(f_socket == nullptr)
+    {
+        return false;
+    }
+    if(f_server_address.connect(f_socket.get()) != 0)
+    {
+        f_socket.reset();
+        return false;
+    }
+
+    f_max_size = f_datagram_size;
+    if(f_max_size == 0)
+    {
+        // the socket is connected so the kernel knows the path MTU
+        //
+        bool const ipv4(f_server_address.is_ipv4());
+        int mtu(0);
+        socklen_t len(sizeof(mtu));
+        if(getsockopt(
+                  f_socket.get()
+                , ipv4 ? IPPROTO_IP : IPPROTO_IPV6
+                , ipv4 ? IP_MTU : IPV6_MTU
+                , &mtu
+                , &len) == 0
+        && mtu > 0)
+        {
+            f_max_size = static_cast<std::size_t>(mtu) - (ipv4 ? 20 : 40) - 8;
+        }
+        else
+        {
+            f_max_size = 1'472;
+        }
+    }
+    f_max_size = std::clamp(f_max_size, static_cast<std::size_t>(512), static_cast<std::size_t>(65'507));
+
+    return true;
+}
+
+
+bool udp_appender::add_record(snaplogger::message const & msg)
+{
+    std::int64_t const now(ed::get_current_date());
+    if(f_datagram_records == 0
+    && f_datagrams.empty())
+    {
+        f_linger_date = now + f_linger;
+    }
+
+    if(f_datagram.empty())
+    {
+        start_datagram();
+    }
+    encode_record(msg);
+    if(f_datagram.length() + f_record.length() > f_max_size)
+    {
+        if(f_format == format_t::FORMAT_BINARY)
+        {
+            f_encoder.rollback();
+        }
+        if(f_datagram_records == 0)
+        {
+            // too large even for an empty datagram
+            //
+            return false;
+        }
+
+        close_datagram();
+        start_datagram();
+        encode_record(msg);
+        if(f_datagram.length() + f_record.length() > f_max_size)
+        {
+            if(f_format == format_t::FORMAT_BINARY)
+            {
+                f_encoder.rollback();
+            }
+            return false;
+        }
+    }
+    f_datagram += f_record;
+    ++f_datagram_records;
+
+    if(f_datagrams.size() >= f_max_datagrams)
+    {
+        send_datagrams();
+    }
+
+    if(f_linger <= 0
+    || now >= f_linger_date)
+    {
+        flush_datagrams();
+    }
+    else
+    {
+        if(f_linger_timer == nullptr)
+        {
+            f_linger_timer = std::make_shared<linger_timer>(this);
+            if(!f_communicator->add_connection(f_linger_timer))
+            {
+                f_linger_timer.reset();
+            }
+        }
+        if(f_linger_timer != nullptr)
+        {
+            f_linger_timer->set_timeout_date(f_linger_date);
+        }
+    }
+
+    return true;
+}
+
+
+void udp_appender::encode_record(snaplogger::message const & msg)
+{
+    f_record.clear();
+
+    if(f_format == format_t::FORMAT_BINARY)
+    {
+        f_encoder.encode(msg, f_record);
+        return;
+    }
+
     ed::message log_message;
     log_message_to_ed_message(msg, log_message);
 
@@ -113,26 +422,97 @@ bool udp_appender::process_message(snaplogger::message const & msg, std::string
         // TODO: set a timeout & # of retries...
     }
 
-    // send message via UDP
+    if(!f_secret_code.empty())
+    {
+        log_message.add_parameter("secret_code", f_secret_code);
+    }
+
+    // the messages of a datagram are separated by newlines
     //
-    bool const success(ed::udp_server_message_connection::send_message(
-                  f_server_address
-                , log_message
-                , f_secret_code));
-    if(!success)
+    if(f_datagram_records > 0)
     {
-        // how could we report that? we are the logger...
-        //
-        if(f_fallback_to_console
-        && isatty(fileno(stdout)))
+        f_record += '\n';
+    }
+    f_record += log_message.to_message();
+}
+
+
+void udp_appender::start_datagram()
+{
+    f_datagram.clear();
+    f_datagram_records = 0;
+
+    // in binary, each datagram is a stream on its own
+    //
+    if(f_format == format_t::FORMAT_BINARY)
+    {
+        f_datagram.assign(LOG_RECORD_MAGIC, sizeof(LOG_RECORD_MAGIC));
+        if(!f_secret_code.empty())
         {
-            std::cout << formatted_message.c_str();
-            return true;
+            f_encoder.encode_secret_code(f_secret_code, f_datagram);
         }
-        return false;
+        f_encoder.reset();
+    }
+}
+
+
+void udp_appender::close_datagram()
+{
+    if(f_datagram_records > 0)
+    {
+        f_datagrams.push_back(std::move(f_datagram));
+        f_datagram_counts.push_back(f_datagram_records);
     }
+    f_datagram.clear();
+    f_datagram_records = 0;
+}
 
-    return true;
+
+void udp_appender::send_datagrams()
+{
+    std::size_t idx(0);
+    while(idx < f_datagrams.size())
+    {
+        std::size_t const count(std::min(f_datagrams.size() - idx, f_max_datagrams));
+        std::vector<iovec> iov(count);
+        std::vector<mmsghdr> msgs(count);
+        for(std::size_t i(0); i < count; ++i)
+        {
+            iov[i].iov_base = f_datagrams[idx + i].data();
+            iov[i].iov_len = f_datagrams[idx + i].length();
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int const r(sendmmsg(f_socket.get(), msgs.data(), static_cast<unsigned int>(count), 0));
+        if(r < 0
+        && errno == EINTR)
+        {
+            continue;
+        }
+        if(r <= 0)
+        {
+            // nothing was sent, trying again would loop forever
+            //
+            break;
+        }
+        for(int i(0); i < r; ++i)
+        {
+            f_sent += f_datagram_counts[idx];
+            ++f_sent_datagrams;
+            ++idx;
+        }
+    }
+
+    // whatever remains could not be sent
+    //
+    for(; idx < f_datagram_counts.size(); ++idx)
+    {
+        f_dropped += f_datagram_counts[idx];
+    }
+
+    f_datagrams.clear();
+    f_datagram_counts.clear();
 }
 
 
@@ -28,6 +28,25 @@
 // self
 //
 #include    "base_network_appender.h"
+#include    "log_record.h"
+
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/connection.h>
+
+
+// snapdev
+//
+#include    <snapdev/raii_generic_deleter.h>
+
+
+// C++
+//
+#include    <atomic>
+#include    <vector>
 
 
 
@@ -43,6 +62,9 @@ class udp_appender
 public:
     typedef std::shared_ptr<udp_appender>      pointer_t;
 
+    static constexpr std::size_t const      DEFAULT_MAX_DATAGRAMS = 16;
+    static constexpr std::int64_t const     DEFAULT_LINGER = 0;             // send immediately
+
                         udp_appender(std::string const & name);
     virtual             ~udp_appender() override;
 
@@ -50,13 +72,55 @@ public:
     //
     virtual void        set_config(advgetopt::getopt const & params) override;
 
+    // base_network_appender implementation
+    //
+    virtual void        server_address_changed() override;
+
+    void                flush_datagrams();
+    std::size_t         get_datagram_size() const;
+    std::uint64_t       get_sent_count() const;
+    std::uint64_t       get_datagram_count() const;
+    std::uint64_t       get_dropped_count() const;
+
 protected:
     virtual bool        process_message(
                                   snaplogger::message const & msg
                                 , std::string const & formatted_message) override;
 
 private:
+    bool                open_socket();
+    bool                add_record(snaplogger::message const & msg);
+    void                encode_record(snaplogger::message const & msg);
+    void                start_datagram();
+    void                close_datagram();
+    void                send_datagrams();
+
     std::string         f_secret_code = std::string();
+    std::size_t         f_datagram_size = 0;
+    std::size_t         f_max_datagrams = DEFAULT_MAX_DATAGRAMS;
+    std::int64_t        f_linger = DEFAULT_LINGER;
+
+    ed::communicator::pointer_t
+                        f_communicator = ed::communicator::pointer_t();
+    ed::connection::pointer_t
+                        f_linger_timer = ed::connection::pointer_t();
+    snapdev::raii_fd_t  f_socket = snapdev::raii_fd_t();
+    std::size_t         f_max_size = 0;
+    log_record_encoder  f_encoder = log_record_encoder();
+    std::string         f_record = std::string();
+    std::string         f_datagram = std::string();
+    std::size_t         f_datagram_records = 0;
+    std::vector<std::string>
+                        f_datagrams = std::vector<std::string>();
+    std::vector<std::size_t>
+                        f_datagram_counts = std::vector<std::size_t>();
+    std::int64_t        f_linger_date = 0;
+    std::atomic<std::uint64_t>
+                        f_sent = 0;
+    std::atomic<std::uint64_t>
+                        f_sent_datagrams = 0;
+    std::atomic<std::uint64_t>
+                        f_dropped = 0;
 };
 
 
@@ -24,9 +24,17 @@
  * It sends the logs using the parameters you provide on the command line.
  * It first loads defaults from configuration files that you can overwrite
  * with command line parameters.
+ *
+ * With the --query command, the tool instead searches the log store
+ * saved by snaploggerd and prints the matching messages.
  */
 
 
+// snaplogger_network
+//
+#include    "snaplogger/network/log_store.h"
+
+
 // eventdispatcher
 //
 #include    <eventdispatcher/communicator.h>
@@ -56,6 +64,17 @@
 #include    <snapdev/stringize.h>
 
 
+// C++
+//
+#include    <iomanip>
+#include    <iostream>
+
+
+// C
+//
+#include    <time.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -118,6 +137,20 @@ const advgetopt::option g_options[] =
             , advgetopt::GETOPT_FLAG_GROUP_COMMANDS>())
         , advgetopt::Help("the message to log (you may also use --message ... after a --fields or --components)")
     ),
+    advgetopt::define_option(
+          advgetopt::Name("min-severity")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("with --query, only print the messages with this severity or higher.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("query")
+        , advgetopt::ShortName('q')
+        , advgetopt::Flags(advgetopt::standalone_command_flags<
+              advgetopt::GETOPT_FLAG_GROUP_COMMANDS>())
+        , advgetopt::Help("search the snaploggerd log store instead of sending a message; use --since, --until, --min-severity, and --components to select the messages.")
+    ),
     advgetopt::define_option(
           advgetopt::Name("severity")
         , advgetopt::ShortName('s')
@@ -127,6 +160,28 @@ const advgetopt::option g_options[] =
         , advgetopt::DefaultValue("error")
         , advgetopt::Help("define the log message severity (default: \"error\")")
     ),
+    advgetopt::define_option(
+          advgetopt::Name("since")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("with --query, only print the messages logged at or after this time (\"YYYY-MM-DD HH:MM:SS\", a Unix time, or \"-<n>s|m|h|d\" relative to now).")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("store")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::DefaultValue("/var/lib/snaploggerd/store")
+        , advgetopt::Help("with --query, the directory of the log store (the snaploggerd store-path).")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("until")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("with --query, only print the messages logged before this time.")
+    ),
     advgetopt::end_options()
 };
 
@@ -179,6 +234,116 @@ advgetopt::options_environment const g_options_environment =
 };
 #pragma GCC diagnostic pop
 
+
+
+/** \brief Convert a time specification to a Unix time.
+ *
+ * The time is either a date and time in local time, a Unix time, or a
+ * number of seconds, minutes, hours, or days before now (i.e. "-1h").
+ *
+ * \param[in] spec  The time specification.
+ * \param[out] result  The corresponding Unix time.
+ *
+ * \return true if \p spec is valid.
+ */
+bool parse_time(std::string const & spec, std::int64_t & result)
+{
+    if(spec.length() >= 3
+    && spec[0] == '-')
+    {
+        std::int64_t unit(0);
+        switch(spec.back())
+        {
+        case 's': unit = 1;         break;
+        case 'm': unit = 60;        break;
+        case 'h': unit = 3600;      break;
+        case 'd': unit = 86400;     break;
+        default: return false;
+        }
+        std::string const count(spec.substr(1, spec.length() - 2));
+        if(count.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+        result = time(nullptr) - std::stoll(count) * unit;
+        return true;
+    }
+
+    if(!spec.empty()
+    && spec.find_first_not_of("0123456789") == std::string::npos)
+    {
+        result = std::stoll(spec);
+        return true;
+    }
+
+    for(char const * format : { "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d" })
+    {
+        tm t = {};
+        char const * end(strptime(spec.c_str(), format, &t));
+        if(end != nullptr
+        && *end == '\0')
+        {
+            t.tm_isdst = -1;
+            result = mktime(&t);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void print_record(snaplogger_network::log_record const & record)
+{
+    time_t const seconds(record.f_timestamp.tv_sec);
+    tm t = {};
+    localtime_r(&seconds, &t);
+    std::cout
+        << std::put_time(&t, "%Y-%m-%d %H:%M:%S")
+        << '.'
+        << std::setw(6) << std::setfill('0') << record.f_timestamp.tv_nsec / 1'000;
+
+    snaplogger::severity::pointer_t const sev(snaplogger::get_severity(record.f_severity));
+    if(sev != nullptr)
+    {
+        std::cout << " [" << sev->get_name() << ']';
+    }
+    else
+    {
+        std::cout << " [" << static_cast<int>(record.f_severity) << ']';
+    }
+
+    if(!record.f_components.empty())
+    {
+        char const * sep(" (");
+        for(auto const & c : record.f_components)
+        {
+            std::cout << sep << c;
+            sep = ",";
+        }
+        std::cout << ')';
+    }
+
+    if(!record.f_filename.empty())
+    {
+        std::cout << ' ' << record.f_filename;
+        if(record.f_line != 0)
+        {
+            std::cout << ':' << record.f_line;
+        }
+        std::cout << ':';
+    }
+
+    std::cout << ' ' << record.f_message;
+
+    for(auto const & f : record.f_fields)
+    {
+        std::cout << ' ' << f.first << '=' << f.second;
+    }
+    std::cout << '\n';
+}
+
+
 }
 // noname namespace
 
@@ -195,6 +360,8 @@ public:
     int                             run();
 
 private:
+    int                             query();
+
     advgetopt::getopt               f_opt;
 };
 
@@ -224,6 +391,11 @@ snaplog::snaplog(int argc, char * argv[])
 
 int snaplog::run()
 {
+    if(f_opt.is_defined("query"))
+    {
+        return query();
+    }
+
     std::string const severity_name(f_opt.get_string("severity"));
     snaplogger::severity::pointer_t sev(snaplogger::get_severity(severity_name));
 
@@ -300,6 +472,54 @@ int snaplog::run()
 }
 
 
+int snaplog::query()
+{
+    snaplogger_network::log_store_query q;
+
+    if(f_opt.is_defined("since"))
+    {
+        if(!parse_time(f_opt.get_string("since"), q.f_start))
+        {
+            std::cerr << "error: invalid --since time \"" << f_opt.get_string("since") << "\".\n";
+            return 1;
+        }
+    }
+
+    if(f_opt.is_defined("until"))
+    {
+        if(!parse_time(f_opt.get_string("until"), q.f_end))
+        {
+            std::cerr << "error: invalid --until time \"" << f_opt.get_string("until") << "\".\n";
+            return 1;
+        }
+    }
+
+    if(f_opt.is_defined("min-severity"))
+    {
+        std::string const severity_name(f_opt.get_string("min-severity"));
+        snaplogger::severity::pointer_t sev(snaplogger::get_severity(severity_name));
+        if(sev == nullptr)
+        {
+            std::cerr << "error: unknown severity \"" << severity_name << "\".\n";
+            return 1;
+        }
+        q.f_min_severity = sev->get_severity();
+    }
+
+    int comp_max(f_opt.size("components"));
+    for(int comp(0); comp < comp_max; ++comp)
+    {
+        q.f_components.push_back(f_opt.get_string("components", comp));
+    }
+
+    snaplogger_network::log_store_reader reader(f_opt.get_string("store"));
+    reader.query(q, print_record);
+    std::cout << std::flush;
+
+    return 0;
+}
+
+
 
 
 
@@ -0,0 +1,127 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Minimal benchmark harness.
+ *
+ * Each benchmark produces one result_t with the number of operations,
+ * the total elapsed time and, when available, one latency sample per
+ * operation. The results are printed and saved in a JSON file so two
+ * builds can be compared.
+ */
+
+// C++
+//
+#include    <cstdint>
+#include    <functional>
+#include    <string>
+#include    <vector>
+
+
+
+namespace bench
+{
+
+
+
+struct options_t
+{
+    std::size_t                 f_iterations = 100'000;
+    std::size_t                 f_messages = 20'000;
+    std::size_t                 f_window = 64;
+    std::size_t                 f_payload = 64;
+    int                         f_port = 20035;
+    std::string                 f_tmp_dir = "/tmp/eventdispatcher-bench";
+    std::string                 f_filter = std::string();
+};
+
+
+struct result_t
+{
+    std::string                 f_name = std::string();
+    std::uint64_t               f_operations = 0;
+    std::int64_t                f_elapsed_ns = 0;
+    std::vector<std::int64_t>   f_latencies_ns = std::vector<std::int64_t>();
+};
+
+
+class results
+{
+public:
+    void                        add(result_t && r);
+    bool                        save(std::string const & filename) const;
+
+private:
+    std::vector<result_t>       f_results = std::vector<result_t>();
+};
+
+
+typedef std::function<void(options_t const & opts, results & r)>   benchmark_t;
+
+
+bool                            enabled(options_t const & opts, std::string const & name);
+std::int64_t                    now();
+std::int64_t                    percentile(std::vector<std::int64_t> & sorted, double p);
+void                            keep(void const * p);
+
+
+/** \brief Time \p f \p iterations times.
+ *
+ * Each call is timed separately so the percentiles are available.
+ * A short warm up (1% of the iterations) runs first.
+ *
+ * \param[in] name  The name of the benchmark.
+ * \param[in] iterations  The number of times \p f gets called.
+ * \param[in] f  The function to benchmark.
+ *
+ * \return The result of the benchmark.
+ */
+template<typename F>
+result_t measure(std::string const & name, std::size_t iterations, F && f)
+{
+    for(std::size_t i(0); i < iterations / 100; ++i)
+    {
+        f();
+    }
+
+    result_t r;
+    r.f_name = name;
+    r.f_operations = iterations;
+    r.f_latencies_ns.reserve(iterations);
+    std::int64_t const start(now());
+    for(std::size_t i(0); i < iterations; ++i)
+    {
+        std::int64_t const s(now());
+        f();
+        r.f_latencies_ns.push_back(now() - s);
+    }
+    r.f_elapsed_ns = now() - start;
+    return r;
+}
+
+
+void                            bench_message(options_t const & opts, results & r);
+void                            bench_dispatcher(options_t const & opts, results & r);
+void                            bench_inter_thread(options_t const & opts, results & r);
+void                            bench_loopback(options_t const & opts, results & r);
+
+
+
+} // namespace bench
+// vim: ts=4 sw=4 et
@@ -0,0 +1,121 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Benchmarks of the dispatcher.
+ *
+ * The dispatcher goes through its matches in order. These benchmarks
+ * dispatch the message matching the last entry, which is the worst
+ * case, with dispatchers of various sizes.
+ */
+
+// self
+//
+#include    "bench.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/dispatcher.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_used.h>
+
+
+// C++
+//
+#include    <iomanip>
+#include    <sstream>
+#include    <vector>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace bench
+{
+
+
+
+namespace
+{
+
+
+std::string command_name(std::size_t idx)
+{
+    std::stringstream ss;
+    ss << "COMMAND" << std::setw(4) << std::setfill('0') << idx;
+    return ss.str();
+}
+
+
+} // no name namespace
+
+
+
+void bench_dispatcher(options_t const & opts, results & r)
+{
+    for(std::size_t const count : { 1, 10, 100 })
+    {
+        std::string const name("dispatcher.dispatch/" + std::to_string(count));
+        if(!enabled(opts, name))
+        {
+            continue;
+        }
+
+        // the matches keep a bare pointer to the expression
+        //
+        std::vector<std::string> commands;
+        for(std::size_t idx(0); idx < count; ++idx)
+        {
+            commands.push_back(command_name(idx));
+        }
+
+        std::size_t called(0);
+        ed::dispatcher d(nullptr);
+        for(auto const & c : commands)
+        {
+            d.add_match(ed::define_match(
+                  ed::Expression(c.c_str())
+                , ed::Callback([&called](ed::message & msg)
+                    {
+                        snapdev::NOT_USED(msg);
+                        ++called;
+                    })));
+        }
+
+        ed::message msg;
+        msg.set_command(commands.back());
+
+        r.add(measure(name, opts.f_iterations, [&d, &msg]()
+            {
+                d.dispatch(msg);
+            }));
+        keep(&called);
+    }
+}
+
+
+
+} // namespace bench
+// vim: ts=4 sw=4 et
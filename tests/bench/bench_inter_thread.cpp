@@ -0,0 +1,147 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Benchmark of the inter_thread_message_connection.
+ *
+ * A second thread sends messages as fast as it can and the communicator
+ * loop of the main thread receives them. The latency is the time from
+ * the send_message() call to the process_message_a() call.
+ */
+
+// self
+//
+#include    "bench.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/inter_thread_message_connection.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_used.h>
+
+
+// C++
+//
+#include    <thread>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace bench
+{
+
+
+
+namespace
+{
+
+
+
+class inter_thread_receiver
+    : public ed::inter_thread_message_connection
+{
+public:
+    typedef std::shared_ptr<inter_thread_receiver>  pointer_t;
+
+                        inter_thread_receiver(std::size_t count)
+                            : f_count(count)
+                        {
+                            set_name("bench-inter-thread");
+                            f_latencies.reserve(count);
+                        }
+
+    virtual void        process_message_a(ed::message & msg) override
+                        {
+                            f_latencies.push_back(now() - msg.get_integer_parameter("sent"));
+                            if(f_latencies.size() >= f_count)
+                            {
+                                f_end = now();
+                                ed::communicator::instance()->remove_connection(shared_from_this());
+                            }
+                        }
+
+    virtual void        process_message_b(ed::message & msg) override
+                        {
+                            snapdev::NOT_USED(msg);
+                        }
+
+    std::int64_t        get_end() const { return f_end; }
+    std::vector<std::int64_t> &
+                        get_latencies() { return f_latencies; }
+
+private:
+    std::size_t         f_count = 0;
+    std::int64_t        f_end = 0;
+    std::vector<std::int64_t>
+                        f_latencies = std::vector<std::int64_t>();
+};
+
+
+
+} // no name namespace
+
+
+
+void bench_inter_thread(options_t const & opts, results & r)
+{
+    std::string const name("inter_thread.send_message");
+    if(!enabled(opts, name)
+    || opts.f_iterations == 0)
+    {
+        return;
+    }
+
+    inter_thread_receiver::pointer_t receiver(std::make_shared<inter_thread_receiver>(opts.f_iterations));
+    ed::communicator::instance()->add_connection(receiver);
+
+    std::int64_t const start(now());
+    std::thread sender([&receiver, &opts]()
+        {
+            for(std::size_t i(0); i < opts.f_iterations; ++i)
+            {
+                ed::message msg;
+                msg.set_command("PING");
+                msg.add_parameter("sent", now());
+                receiver->send_message(msg);
+            }
+        });
+
+    ed::communicator::instance()->run();
+    sender.join();
+
+    result_t result;
+    result.f_name = name;
+    result.f_operations = receiver->get_latencies().size();
+    result.f_elapsed_ns = receiver->get_end() - start;
+    result.f_latencies_ns.swap(receiver->get_latencies());
+    r.add(std::move(result));
+}
+
+
+
+} // namespace bench
+// vim: ts=4 sw=4 et
@@ -0,0 +1,515 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief End to end benchmarks of the message connections.
+ *
+ * Each benchmark creates an echo server and a client in this process.
+ * The client sends PING messages with the time they were sent and the
+ * server replies with the same message renamed PONG. The latency is
+ * the round trip time.
+ *
+ * Each transport is run twice: once with a single message in flight
+ * (the "rtt" benchmarks) and once with several messages in flight (the
+ * "pipelined" benchmarks) which better shows the throughput.
+ */
+
+// self
+//
+#include    "bench.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/local_dgram_server_message_connection.h>
+#include    <eventdispatcher/local_stream_client_message_connection.h>
+#include    <eventdispatcher/local_stream_server_client_message_connection.h>
+#include    <eventdispatcher/local_stream_server_connection.h>
+#include    <eventdispatcher/tcp_client_message_connection.h>
+#include    <eventdispatcher/tcp_server_client_message_connection.h>
+#include    <eventdispatcher/tcp_server_connection.h>
+#include    <eventdispatcher/timer.h>
+#include    <eventdispatcher/udp_server_message_connection.h>
+#include    <eventdispatcher/utils.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <iostream>
+
+
+// C
+//
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace bench
+{
+
+
+
+namespace
+{
+
+
+
+constexpr std::int64_t const    LOOPBACK_TIMEOUT = 60'000'000;  // 1 minute in microseconds
+constexpr std::size_t const     UDP_MAX_PAYLOAD = 512;          // udp_server_message_connection::DATAGRAM_MAX_SIZE is 1024
+
+
+class ping_pong
+{
+public:
+    typedef std::function<bool(ed::message & msg)>   send_t;
+
+                        ping_pong(
+                              std::size_t count
+                            , std::size_t window
+                            , std::size_t payload);
+
+    void                set_send(send_t send);
+    void                add_connection(ed::connection::pointer_t c);
+    result_t            run(std::string const & name);
+    void                pong(ed::message & msg);
+    void                finish();
+
+private:
+    bool                send_ping();
+
+    std::size_t         f_count = 0;
+    std::size_t         f_window = 1;
+    std::string         f_payload = std::string();
+    send_t              f_send = send_t();
+    ed::connection::vector_t
+                        f_connections = ed::connection::vector_t();
+    std::size_t         f_sent = 0;
+    std::size_t         f_received = 0;
+    std::int64_t        f_start = 0;
+    std::int64_t        f_elapsed = 0;
+    bool                f_done = false;
+    std::vector<std::int64_t>
+                        f_latencies = std::vector<std::int64_t>();
+};
+
+
+class guard_timer
+    : public ed::timer
+{
+public:
+                        guard_timer(ping_pong * p)
+                            : timer(LOOPBACK_TIMEOUT)
+                            , f_ping_pong(p)
+                        {
+                            set_name("bench-guard-timer");
+                        }
+
+    virtual void        process_timeout() override
+                        {
+                            std::cerr << "warning: loopback benchmark timed out.\n";
+                            f_ping_pong->finish();
+                        }
+
+private:
+    ping_pong *         f_ping_pong = nullptr;
+};
+
+
+template<class C>
+class echo_connection
+    : public C
+{
+public:
+    template<typename ... ARGS>
+                        echo_connection(ARGS && ... args)
+                            : C(std::forward<ARGS>(args)...)
+                        {
+                        }
+
+    virtual void        process_message(ed::message & msg) override
+                        {
+                            msg.set_command("PONG");
+                            C::send_message(msg);
+                        }
+};
+
+
+template<class C>
+class ping_connection
+    : public C
+{
+public:
+    template<typename ... ARGS>
+                        ping_connection(ping_pong * p, ARGS && ... args)
+                            : C(std::forward<ARGS>(args)...)
+                            , f_ping_pong(p)
+                        {
+                        }
+
+    virtual void        process_message(ed::message & msg) override
+                        {
+                            f_ping_pong->pong(msg);
+                        }
+
+private:
+    ping_pong *         f_ping_pong = nullptr;
+};
+
+
+class tcp_echo_server
+    : public ed::tcp_server_connection
+{
+public:
+                        tcp_echo_server(ping_pong * p, addr::addr const & a)
+                            : tcp_server_connection(
+                                      a
+                                    , std::string()
+                                    , std::string()
+                                    , ed::mode_t::MODE_PLAIN
+                                    , -1
+                                    , true)
+                            , f_ping_pong(p)
+                        {
+                            set_name("bench-tcp-server");
+                        }
+
+    virtual void        process_accept() override
+                        {
+                            tcp_server_connection::process_accept();
+
+                            ed::tcp_bio_client::pointer_t client(accept());
+                            if(client == nullptr)
+                            {
+                                throw std::runtime_error("accept() failed to return a TCP client.");
+                            }
+                            auto c(std::make_shared<echo_connection<ed::tcp_server_client_message_connection>>(client));
+                            c->set_name("bench-tcp-echo");
+                            f_ping_pong->add_connection(c);
+                        }
+
+private:
+    ping_pong *         f_ping_pong = nullptr;
+};
+
+
+class local_stream_echo_server
+    : public ed::local_stream_server_connection
+{
+public:
+                        local_stream_echo_server(ping_pong * p, addr::addr_unix const & a)
+                            : local_stream_server_connection(a, ed::MAX_CONNECTIONS, true)
+                            , f_ping_pong(p)
+                        {
+                            set_name("bench-local-stream-server");
+                        }
+
+    virtual void        process_accept() override
+                        {
+                            snapdev::raii_fd_t s(accept());
+                            if(s == nullptr)
+                            {
+                                throw std::runtime_error("accept() failed to return a Unix socket.");
+                            }
+                            auto c(std::make_shared<echo_connection<ed::local_stream_server_client_message_connection>>(std::move(s)));
+                            c->set_name("bench-local-stream-echo");
+                            f_ping_pong->add_connection(c);
+                        }
+
+private:
+    ping_pong *         f_ping_pong = nullptr;
+};
+
+
+ping_pong::ping_pong(
+          std::size_t count
+        , std::size_t window
+        , std::size_t payload)
+    : f_count(count)
+    , f_window(window)
+    , f_payload(payload, 'x')
+{
+    f_latencies.reserve(count);
+}
+
+
+void ping_pong::set_send(send_t send)
+{
+    f_send = send;
+}
+
+
+void ping_pong::add_connection(ed::connection::pointer_t c)
+{
+    f_connections.push_back(c);
+    ed::communicator::instance()->add_connection(c);
+}
+
+
+result_t ping_pong::run(std::string const & name)
+{
+    add_connection(std::make_shared<guard_timer>(this));
+
+    f_start = now();
+    for(std::size_t i(0); i < f_window && f_sent < f_count; ++i)
+    {
+        if(!send_ping())
+        {
+            break;
+        }
+    }
+
+    ed::communicator::instance()->run();
+
+    result_t r;
+    r.f_name = name;
+    r.f_operations = f_received;
+    r.f_elapsed_ns = f_elapsed;
+    r.f_latencies_ns.swap(f_latencies);
+    return r;
+}
+
+
+bool ping_pong::send_ping()
+{
+    ed::message msg;
+    msg.set_command("PING");
+    msg.add_parameter("payload", f_payload);
+    msg.add_parameter("sent", now());
+    ++f_sent;
+    return f_send(msg);
+}
+
+
+void ping_pong::pong(ed::message & msg)
+{
+    if(f_done)
+    {
+        return;
+    }
+
+    f_latencies.push_back(now() - msg.get_integer_parameter("sent"));
+    ++f_received;
+    if(f_sent < f_count)
+    {
+        send_ping();
+    }
+    else if(f_received >= f_count)
+    {
+        finish();
+    }
+}
+
+
+void ping_pong::finish()
+{
+    if(f_done)
+    {
+        return;
+    }
+    f_done = true;
+    f_elapsed = now() - f_start;
+
+    ed::communicator::pointer_t communicator(ed::communicator::instance());
+    for(auto const & c : f_connections)
+    {
+        communicator->remove_connection(c);
+    }
+    f_connections.clear();
+}
+
+
+void run_tcp(options_t const & opts, results & r, std::string const & name, std::size_t window)
+{
+    addr::addr const a(addr::string_to_addr(
+              "127.0.0.1:" + std::to_string(opts.f_port)
+            , "127.0.0.1"
+            , opts.f_port
+            , "tcp"));
+
+    ping_pong p(opts.f_messages, window, opts.f_payload);
+    p.add_connection(std::make_shared<tcp_echo_server>(&p, a));
+
+    auto client(std::make_shared<ping_connection<ed::tcp_client_message_connection>>(&p, a));
+    client->set_name("bench-tcp-client");
+    p.add_connection(client);
+    p.set_send([c = client.get()](ed::message & msg) { return c->send_message(msg); });
+
+    r.add(p.run(name));
+}
+
+
+void run_local_stream(options_t const & opts, results & r, std::string const & name, std::size_t window)
+{
+    std::string const path(opts.f_tmp_dir + "/stream.sock");
+    unlink(path.c_str());
+    addr::addr_unix const a(path);
+
+    ping_pong p(opts.f_messages, window, opts.f_payload);
+    p.add_connection(std::make_shared<local_stream_echo_server>(&p, a));
+
+    auto client(std::make_shared<ping_connection<ed::local_stream_client_message_connection>>(&p, a));
+    client->set_name("bench-local-stream-client");
+    p.add_connection(client);
+    p.set_send([c = client.get()](ed::message & msg) { return c->send_message(msg); });
+
+    r.add(p.run(name));
+}
+
+
+void run_udp(options_t const & opts, results & r, std::string const & name, std::size_t window)
+{
+    addr::addr const server(addr::string_to_addr(
+              "127.0.0.1:" + std::to_string(opts.f_port + 1)
+            , "127.0.0.1"
+            , opts.f_port + 1
+            , "udp"));
+    addr::addr const client_address(addr::string_to_addr(
+              "127.0.0.1:" + std::to_string(opts.f_port + 2)
+            , "127.0.0.1"
+            , opts.f_port + 2
+            , "udp"));
+
+    ping_pong p(opts.f_messages, window, std::min(opts.f_payload, UDP_MAX_PAYLOAD));
+
+    auto echo(std::make_shared<echo_connection<ed::udp_server_message_connection>>(server, client_address));
+    echo->set_name("bench-udp-echo");
+    p.add_connection(echo);
+
+    auto client(std::make_shared<ping_connection<ed::udp_server_message_connection>>(&p, client_address, server));
+    client->set_name("bench-udp-client");
+    p.add_connection(client);
+    p.set_send([c = client.get()](ed::message & msg) { return c->send_message(msg); });
+
+    r.add(p.run(name));
+}
+
+
+void run_local_dgram(options_t const & opts, results & r, std::string const & name, std::size_t window)
+{
+    std::string const server_path(opts.f_tmp_dir + "/dgram-server.sock");
+    std::string const client_path(opts.f_tmp_dir + "/dgram-client.sock");
+    unlink(server_path.c_str());
+    unlink(client_path.c_str());
+    addr::addr_unix const server(server_path);
+    addr::addr_unix const client_address(client_path);
+
+    ping_pong p(opts.f_messages, window, opts.f_payload);
+
+    auto echo(std::make_shared<echo_connection<ed::local_dgram_server_message_connection>>(
+              server
+            , false
+            , true
+            , true
+            , client_address));
+    echo->set_name("bench-local-dgram-echo");
+    p.add_connection(echo);
+
+    auto client(std::make_shared<ping_connection<ed::local_dgram_server_message_connection>>(
+              &p
+            , client_address
+            , false
+            , true
+            , true
+            , server));
+    client->set_name("bench-local-dgram-client");
+    p.add_connection(client);
+    p.set_send([c = client.get()](ed::message & msg) { return c->send_message(msg); });
+
+    r.add(p.run(name));
+}
+
+
+typedef void (*loopback_t)(options_t const & opts, results & r, std::string const & name, std::size_t window);
+
+
+struct transport_t
+{
+    char const *        f_name = nullptr;
+    loopback_t          f_run = nullptr;
+};
+
+
+transport_t const g_transports[] =
+{
+    { "tcp",            &run_tcp },
+    { "local_stream",   &run_local_stream },
+    { "udp",            &run_udp },
+    { "local_dgram",    &run_local_dgram },
+};
+
+
+
+} // no name namespace
+
+
+
+void bench_loopback(options_t const & opts, results & r)
+{
+    if(opts.f_messages == 0)
+    {
+        return;
+    }
+
+    mkdir(opts.f_tmp_dir.c_str(), 0700);
+
+    for(auto const & t : g_transports)
+    {
+        std::vector<std::size_t> windows{ 1 };
+        if(opts.f_window > 1)
+        {
+            windows.push_back(opts.f_window);
+        }
+        for(std::size_t const window : windows)
+        {
+            std::string const name(
+                      std::string("loopback.")
+                    + t.f_name
+                    + (window == 1 ? ".rtt" : ".pipelined/" + std::to_string(window)));
+            if(!enabled(opts, name))
+            {
+                continue;
+            }
+            try
+            {
+                t.f_run(opts, r, name, window);
+            }
+            catch(std::exception const & e)
+            {
+                std::cerr << "error: benchmark \"" << name << "\" failed: " << e.what() << "\n";
+            }
+        }
+    }
+}
+
+
+
+} // namespace bench
+// vim: ts=4 sw=4 et
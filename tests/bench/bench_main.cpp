@@ -0,0 +1,322 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Benchmarks of the eventdispatcher library.
+ *
+ * Run the benchmarks with:
+ *
+ * \code
+ * make bench
+ * \endcode
+ *
+ * or run the executable directly to select a subset:
+ *
+ * \code
+ * ../../BUILD/Release/contrib/eventdispatcher/tests/bench/eventdispatcher-bench --filter tcp --output /tmp/tcp.json
+ * \endcode
+ *
+ * The output file is a JSON object with one entry per benchmark giving
+ * the number of operations per second and the p50, p99 and p999
+ * latencies in nanoseconds. Compare the files of two builds to detect
+ * regressions.
+ */
+
+// self
+//
+#include    "bench.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/version.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <cstring>
+#include    <ctime>
+#include    <fstream>
+#include    <iomanip>
+#include    <iostream>
+
+
+// C
+//
+#include    <time.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace bench
+{
+
+
+
+/** \brief Check whether a benchmark was selected.
+ *
+ * \param[in] opts  The command line options.
+ * \param[in] name  The name of the benchmark.
+ *
+ * \return true if no filter was specified or \p name includes the filter.
+ */
+bool enabled(options_t const & opts, std::string const & name)
+{
+    return opts.f_filter.empty()
+        || name.find(opts.f_filter) != std::string::npos;
+}
+
+
+/** \brief Get the current time in nanoseconds.
+ *
+ * \return The CLOCK_MONOTONIC time in nanoseconds.
+ */
+std::int64_t now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1'000'000'000LL + t.tv_nsec;
+}
+
+
+/** \brief Get a percentile from a sorted vector of samples.
+ *
+ * \param[in] sorted  The samples, sorted in ascending order.
+ * \param[in] p  The percentile, between 0.0 and 1.0.
+ *
+ * \return The sample at that percentile or 0 if there are no samples.
+ */
+std::int64_t percentile(std::vector<std::int64_t> & sorted, double p)
+{
+    if(sorted.empty())
+    {
+        return 0;
+    }
+    std::size_t const idx(std::min(
+              static_cast<std::size_t>(p * static_cast<double>(sorted.size()))
+            , sorted.size() - 1));
+    return sorted[idx];
+}
+
+
+/** \brief Prevent the compiler from optimizing away a result.
+ *
+ * \param[in] p  A pointer to the data to keep.
+ */
+void keep(void const * p)
+{
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+
+/** \brief Add a result.
+ *
+ * The latency samples get sorted here so the percentiles can be
+ * computed when printing and saving the results.
+ *
+ * \param[in] r  The result to add.
+ */
+void results::add(result_t && r)
+{
+    std::sort(r.f_latencies_ns.begin(), r.f_latencies_ns.end());
+    f_results.push_back(std::move(r));
+
+    result_t & last(f_results.back());
+    std::cout
+        << std::left << std::setw(40) << last.f_name << std::right
+        << std::setw(14) << std::fixed << std::setprecision(0)
+        << (last.f_elapsed_ns == 0 ? 0.0 : static_cast<double>(last.f_operations) * 1e9 / static_cast<double>(last.f_elapsed_ns))
+        << " ops/s"
+        << "  p50 " << std::setw(9) << percentile(last.f_latencies_ns, 0.5)
+        << "  p99 " << std::setw(9) << percentile(last.f_latencies_ns, 0.99)
+        << "  p999 " << std::setw(9) << percentile(last.f_latencies_ns, 0.999)
+        << " ns\n";
+}
+
+
+/** \brief Save the results in a JSON file.
+ *
+ * \param[in] filename  The name of the output file.
+ *
+ * \return true if the file was written.
+ */
+bool results::save(std::string const & filename) const
+{
+    std::ofstream out(filename);
+    if(!out.is_open())
+    {
+        return false;
+    }
+
+    out << "{\n"
+        << "  \"version\": \"" << ed::get_version_string() << "\",\n"
+        << "  \"date\": " << time(nullptr) << ",\n"
+        << "  \"results\": [";
+    char const * sep("\n");
+    for(auto const & r : f_results)
+    {
+        std::vector<std::int64_t> sorted(r.f_latencies_ns);
+        out << sep
+            << "    {\n"
+            << "      \"name\": \"" << r.f_name << "\",\n"
+            << "      \"operations\": " << r.f_operations << ",\n"
+            << "      \"elapsed_ns\": " << r.f_elapsed_ns << ",\n"
+            << "      \"ops_per_second\": " << std::fixed << std::setprecision(1)
+                << (r.f_elapsed_ns == 0 ? 0.0 : static_cast<double>(r.f_operations) * 1e9 / static_cast<double>(r.f_elapsed_ns)) << ",\n"
+            << "      \"p50_ns\": " << percentile(sorted, 0.5) << ",\n"
+            << "      \"p99_ns\": " << percentile(sorted, 0.99) << ",\n"
+            << "      \"p999_ns\": " << percentile(sorted, 0.999) << "\n"
+            << "    }";
+        sep = ",\n";
+    }
+    out << "\n  ]\n}\n";
+
+    return static_cast<bool>(out);
+}
+
+
+
+} // namespace bench
+
+
+
+namespace
+{
+
+
+void usage()
+{
+    std::cout << "Usage: eventdispatcher-bench <opts>\n";
+    std::cout << "Where <opts> is one or more of:\n";
+    std::cout << "  -h | --help           print out this help screen\n";
+    std::cout << "  --filter <name>       only run benchmarks which name includes <name>\n";
+    std::cout << "  --iterations <count>  number of iterations of the micro-benchmarks\n";
+    std::cout << "  --messages <count>    number of messages sent by the loopback benchmarks\n";
+    std::cout << "  --output <filename>   save the results in this JSON file\n";
+    std::cout << "  --payload <size>      size of the payload of the loopback messages\n";
+    std::cout << "  --port <port>         first of the three ports used on 127.0.0.1\n";
+    std::cout << "  --tmp-dir <path>      directory used for the Unix sockets\n";
+    std::cout << "  --window <count>      number of messages in flight in the pipelined benchmarks\n";
+}
+
+
+} // no name namespace
+
+
+
+int main(int argc, char * argv[])
+{
+    bench::options_t opts;
+    std::string output;
+
+    for(int i(1); i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-h") == 0
+        || strcmp(argv[i], "--help") == 0)
+        {
+            usage();
+            return 1;
+        }
+        if(i + 1 >= argc)
+        {
+            std::cerr << "error: unknown option or missing value for \"" << argv[i] << "\".\n";
+            return 1;
+        }
+        std::string const value(argv[i + 1]);
+        if(strcmp(argv[i], "--filter") == 0)
+        {
+            opts.f_filter = value;
+        }
+        else if(strcmp(argv[i], "--iterations") == 0)
+        {
+            opts.f_iterations = std::stoul(value);
+        }
+        else if(strcmp(argv[i], "--messages") == 0)
+        {
+            opts.f_messages = std::stoul(value);
+        }
+        else if(strcmp(argv[i], "--output") == 0)
+        {
+            output = value;
+        }
+        else if(strcmp(argv[i], "--payload") == 0)
+        {
+            opts.f_payload = std::stoul(value);
+        }
+        else if(strcmp(argv[i], "--port") == 0)
+        {
+            opts.f_port = std::stoi(value);
+        }
+        else if(strcmp(argv[i], "--tmp-dir") == 0)
+        {
+            opts.f_tmp_dir = value;
+        }
+        else if(strcmp(argv[i], "--window") == 0)
+        {
+            opts.f_window = std::max(std::stoul(value), 1UL);
+        }
+        else
+        {
+            std::cerr << "error: unknown option \"" << argv[i] << "\".\n";
+            return 1;
+        }
+        ++i;
+    }
+
+    try
+    {
+        bench::results r;
+
+        bench::benchmark_t const benchmarks[] =
+        {
+            &bench::bench_message,
+            &bench::bench_dispatcher,
+            &bench::bench_inter_thread,
+            &bench::bench_loopback,
+        };
+        for(auto const & b : benchmarks)
+        {
+            b(opts, r);
+        }
+
+        if(!output.empty())
+        {
+            if(!r.save(output))
+            {
+                std::cerr << "error: could not save results to \"" << output << "\".\n";
+                return 1;
+            }
+            std::cout << "results saved to \"" << output << "\".\n";
+        }
+    }
+    catch(std::exception const & e)
+    {
+        std::cerr << "error: exception caught: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// vim: ts=4 sw=4 et
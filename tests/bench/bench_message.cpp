@@ -0,0 +1,135 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Benchmarks of the message serialization.
+ *
+ * The message caches its serialized forms so the to_string() and
+ * to_json() benchmarks serialize a fresh copy of a message which was
+ * never serialized. The cost of that copy is measured separately by
+ * the "message.copy" benchmark.
+ */
+
+// self
+//
+#include    "bench.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/message.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace bench
+{
+
+
+
+namespace
+{
+
+
+ed::message create_message()
+{
+    ed::message msg;
+    msg.set_sent_from_server("monitor");
+    msg.set_sent_from_service("sitter");
+    msg.set_server("backend");
+    msg.set_service("snaplogger");
+    msg.set_command("LOG_MESSAGE");
+    msg.add_parameter("cache", "no");
+    msg.add_parameter("component", "normal");
+    msg.add_parameter("filename", "/usr/share/eventdispatcher/src/daemon.cpp");
+    msg.add_parameter("line", 1234);
+    msg.add_parameter("message", "connection to \"backend\" lost; retrying in 5s\n(attempt 3)");
+    msg.add_parameter("severity", "warning");
+    msg.add_parameter("timestamp", 1'700'000'000'123'456LL);
+    return msg;
+}
+
+
+} // no name namespace
+
+
+
+void bench_message(options_t const & opts, results & r)
+{
+    ed::message const original(create_message());
+    std::string const str(ed::message(original).to_string());
+    std::string const json(ed::message(original).to_json());
+
+    if(enabled(opts, "message.copy"))
+    {
+        r.add(measure("message.copy", opts.f_iterations, [&original]()
+            {
+                ed::message msg(original);
+                keep(&msg);
+            }));
+    }
+
+    if(enabled(opts, "message.from_string"))
+    {
+        r.add(measure("message.from_string", opts.f_iterations, [&str]()
+            {
+                ed::message msg;
+                msg.from_string(str);
+                keep(&msg);
+            }));
+    }
+
+    if(enabled(opts, "message.to_string"))
+    {
+        r.add(measure("message.to_string", opts.f_iterations, [&original]()
+            {
+                ed::message msg(original);
+                std::string const s(msg.to_string());
+                keep(s.data());
+            }));
+    }
+
+    if(enabled(opts, "message.from_json"))
+    {
+        r.add(measure("message.from_json", opts.f_iterations, [&json]()
+            {
+                ed::message msg;
+                msg.from_json(json);
+                keep(&msg);
+            }));
+    }
+
+    if(enabled(opts, "message.to_json"))
+    {
+        r.add(measure("message.to_json", opts.f_iterations, [&original]()
+            {
+                ed::message msg(original);
+                std::string const s(msg.to_json());
+                keep(s.data());
+            }));
+    }
+}
+
+
+
+} // namespace bench
+// vim: ts=4 sw=4 et
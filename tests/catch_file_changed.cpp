@@ -24,6 +24,7 @@
 // eventdispatcher
 //
 #include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/exception.h>
 #include    <eventdispatcher/file_changed.h>
 
 //#include    <eventdispatcher/local_stream_server_client_message_connection.h>
@@ -39,6 +40,7 @@
 
 // C
 //
+#include    <sys/stat.h>
 #include    <unistd.h>
 
 
@@ -101,7 +103,7 @@ class file_listener
 public:
     typedef std::shared_ptr<file_listener>        pointer_t;
 
-                                file_listener();
+                                file_listener(ed::file_changed_backend_t backend = ed::file_changed_backend_t::FILE_CHANGED_BACKEND_INOTIFY);
     virtual                     ~file_listener();
 
     void                        add_expected(
@@ -132,7 +134,8 @@ private:
 
 
 
-file_listener::file_listener()
+file_listener::file_listener(ed::file_changed_backend_t backend)
+    : file_changed(backend)
 {
     set_name("file-listener");
 
@@ -344,6 +347,192 @@ CATCH_TEST_CASE("file_changed_events", "[file_changed]")
         CATCH_REQUIRE(g_event_processed);
     }
     CATCH_END_SECTION()
+
+    CATCH_START_SECTION("file_changed_events: recursive watch adds new sub-directories")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+
+        std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("recursive"));
+        std::string const subdir(dir + "/sub");
+        std::string const filename(subdir + "/test.txt");
+        unlink(filename.c_str());
+        rmdir(subdir.c_str());
+
+        {
+            file_listener::pointer_t listener(std::make_shared<file_listener>());
+            listener->watch_files(
+                      dir
+                    , ed::SNAP_FILE_CHANGED_EVENT_CREATED
+                    | ed::SNAP_FILE_CHANGED_EVENT_RECURSIVE);
+
+            listener->add_expected(
+                  dir
+                , ed::SNAP_FILE_CHANGED_EVENT_CREATED
+                | ed::SNAP_FILE_CHANGED_EVENT_DIRECTORY
+                , "sub");
+
+            listener->add_expected(
+                  subdir
+                , ed::SNAP_FILE_CHANGED_EVENT_CREATED
+                , "test.txt");
+
+            communicator->add_connection(listener);
+
+            int r(0);
+            listener->run_test("recursive", [subdir, filename, &r]() {
+                    sleep(rand() % 3);
+                    r = mkdir(subdir.c_str(), 0700);
+
+                    // give the listener time to add the new watch
+                    //
+                    sleep(1);
+                    std::ofstream out(filename);
+                    out << "in a sub-directory" << std::endl;
+                    if(r == 0)
+                    {
+                        r = out.fail() ? 1 : 0;
+                    }
+                });
+
+            communicator->run();
+
+            CATCH_REQUIRE(r == 0);
+        }
+
+        CATCH_REQUIRE(g_event_processed);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("file_changed_events: coalesce a burst of writes")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+
+        std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("coalesce"));
+        std::string const filename(dir + "/test.txt");
+        {
+            std::ofstream out(filename);
+            out << "start" << std::endl;
+        }
+
+        {
+            file_listener::pointer_t listener(std::make_shared<file_listener>());
+            listener->watch_files(dir, ed::SNAP_FILE_CHANGED_EVENT_WRITE);
+            listener->set_coalescing_window(500'000);
+            CATCH_REQUIRE(listener->get_coalescing_window() == 500'000);
+
+            // five write() but only one event
+            //
+            listener->add_expected(
+                  dir
+                , ed::SNAP_FILE_CHANGED_EVENT_WRITE
+                , "test.txt");
+
+            communicator->add_connection(listener);
+
+            int r(0);
+            listener->run_test("coalesce", [filename, &r]() {
+                    sleep(rand() % 3);
+                    std::ofstream out(filename, std::ios::app);
+                    for(int i(0); i < 5; ++i)
+                    {
+                        out << "line " << i << std::endl;
+                    }
+                    r = out.fail() ? 1 : 0;
+                });
+
+            communicator->run();
+
+            CATCH_REQUIRE(r == 0);
+        }
+
+        CATCH_REQUIRE(g_event_processed);
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("file_changed_fanotify", "[file_changed][fanotify]")
+{
+    CATCH_START_SECTION("file_changed_fanotify: create and delete in a sub-directory")
+    {
+        // fanotify requires CAP_SYS_ADMIN
+        //
+        if(geteuid() != 0)
+        {
+            std::cerr << "--- skipping fanotify test, it requires root privileges.\n";
+        }
+        else
+        {
+            ed::communicator::pointer_t communicator(ed::communicator::instance());
+
+            std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("fanotify"));
+            std::string const subdir(dir + "/sub");
+            std::string const filename(subdir + "/test.txt");
+            unlink(filename.c_str());
+            rmdir(subdir.c_str());
+            CATCH_REQUIRE(mkdir(subdir.c_str(), 0700) == 0);
+
+            {
+                file_listener::pointer_t listener(std::make_shared<file_listener>(
+                            ed::file_changed_backend_t::FILE_CHANGED_BACKEND_FANOTIFY_FILESYSTEM));
+                CATCH_REQUIRE(listener->get_backend() == ed::file_changed_backend_t::FILE_CHANGED_BACKEND_FANOTIFY_FILESYSTEM);
+                listener->watch_files(
+                          dir
+                        , ed::SNAP_FILE_CHANGED_EVENT_CREATED
+                        | ed::SNAP_FILE_CHANGED_EVENT_DELETED
+                        | ed::SNAP_FILE_CHANGED_EVENT_RECURSIVE);
+
+                listener->add_expected(
+                      subdir
+                    , ed::SNAP_FILE_CHANGED_EVENT_CREATED
+                    , "test.txt");
+
+                listener->add_expected(
+                      subdir
+                    , ed::SNAP_FILE_CHANGED_EVENT_DELETED
+                    , "test.txt");
+
+                communicator->add_connection(listener);
+
+                int r(0);
+                listener->run_test("fanotify", [filename, &r]() {
+                        sleep(rand() % 3);
+                        {
+                            std::ofstream out(filename);
+                            out << "watched by fanotify" << std::endl;
+                            r = out.fail() ? 1 : 0;
+                        }
+                        sleep(1);
+                        if(unlink(filename.c_str()) != 0)
+                        {
+                            r = 1;
+                        }
+                    });
+
+                communicator->run();
+
+                CATCH_REQUIRE(r == 0);
+            }
+
+            CATCH_REQUIRE(g_event_processed);
+        }
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("file_changed_errors", "[file_changed][error]")
+{
+    CATCH_START_SECTION("file_changed_errors: negative coalescing window")
+    {
+        file_listener::pointer_t listener(std::make_shared<file_listener>());
+        CATCH_REQUIRE_THROWS_MATCHES(
+              listener->set_coalescing_window(-1)
+            , ed::parameter_error
+            , Catch::Matchers::ExceptionMessage(
+                  "parameter_error: file_changed::set_coalescing_window(): window_us parameter cannot be negative, -1 is not valid."));
+    }
+    CATCH_END_SECTION()
 }
 
 
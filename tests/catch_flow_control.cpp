@@ -0,0 +1,266 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// test standalone header
+//
+#include    <eventdispatcher/flow_control.h>
+
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/exception.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+// flow control which saves what gets written
+//
+class flow_test
+    : public ed::flow_control
+{
+public:
+    bool send(std::string const & buf)
+    {
+        return send_with_credits(buf);
+    }
+
+    bool receive(ed::message & msg)
+    {
+        return process_flow_message(msg);
+    }
+
+    void consumed(std::size_t size)
+    {
+        message_consumed(size);
+    }
+
+    virtual void process_flow_blocked(bool blocked) override
+    {
+        f_blocked_calls.push_back(blocked);
+    }
+
+    std::vector<std::string>    f_written = std::vector<std::string>();
+    std::vector<bool>           f_blocked_calls = std::vector<bool>();
+
+protected:
+    virtual bool write_flow_buffer(std::string const & buf) override
+    {
+        f_written.push_back(buf);
+        return true;
+    }
+};
+
+
+ed::message flow_control_message(std::int64_t credits)
+{
+    ed::message msg;
+    msg.set_command("FLOW_CONTROL");
+    msg.add_parameter("credits", credits);
+    return msg;
+}
+
+
+ed::message credits_message(std::int64_t credits)
+{
+    ed::message msg;
+    msg.set_command("CREDITS");
+    msg.add_parameter("credits", credits);
+    return msg;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("flow_control", "[flow_control]")
+{
+    CATCH_START_SECTION("flow_control: inactive by default")
+    {
+        flow_test f;
+        CATCH_REQUIRE_FALSE(f.is_flow_control_active());
+        for(int i(0); i < 10; ++i)
+        {
+            CATCH_REQUIRE(f.send("MSG\n"));
+        }
+        CATCH_REQUIRE(f.f_written.size() == 10);
+        CATCH_REQUIRE_FALSE(f.is_flow_blocked());
+        CATCH_REQUIRE(f.get_messages_in_flight() == 0);
+        CATCH_REQUIRE(f.f_blocked_calls.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("flow_control: block and unblock")
+    {
+        flow_test f;
+        ed::message fc(flow_control_message(2));
+        CATCH_REQUIRE(f.receive(fc));
+        CATCH_REQUIRE(f.is_flow_control_active());
+        CATCH_REQUIRE(f.get_message_credits() == 2);
+
+        CATCH_REQUIRE(f.send("A\n"));
+        CATCH_REQUIRE(f.send("B\n"));
+        CATCH_REQUIRE(f.f_written.size() == 2);
+        CATCH_REQUIRE(f.get_messages_in_flight() == 2);
+        CATCH_REQUIRE(f.get_message_credits() == 0);
+        CATCH_REQUIRE_FALSE(f.is_flow_blocked());
+
+        // out of credits, the message is held
+        //
+        CATCH_REQUIRE(f.send("C\n"));
+        CATCH_REQUIRE(f.send("D\n"));
+        CATCH_REQUIRE(f.f_written.size() == 2);
+        CATCH_REQUIRE(f.get_held_messages() == 2);
+        CATCH_REQUIRE(f.is_flow_blocked());
+        CATCH_REQUIRE(f.f_blocked_calls == std::vector<bool>{ true });
+
+        // one credit sends one held message, still blocked
+        //
+        ed::message one(credits_message(1));
+        CATCH_REQUIRE(f.receive(one));
+        CATCH_REQUIRE(f.f_written.size() == 3);
+        CATCH_REQUIRE(f.f_written[2] == "C\n");
+        CATCH_REQUIRE(f.get_held_messages() == 1);
+        CATCH_REQUIRE(f.is_flow_blocked());
+        CATCH_REQUIRE(f.f_blocked_calls.size() == 1);
+
+        // enough credits to flush and unblock
+        //
+        ed::message two(credits_message(2));
+        CATCH_REQUIRE(f.receive(two));
+        CATCH_REQUIRE(f.f_written.size() == 4);
+        CATCH_REQUIRE(f.f_written[3] == "D\n");
+        CATCH_REQUIRE(f.get_held_messages() == 0);
+        CATCH_REQUIRE(f.get_messages_in_flight() == 1);
+        CATCH_REQUIRE_FALSE(f.is_flow_blocked());
+        CATCH_REQUIRE(f.f_blocked_calls == std::vector<bool>{ true, false });
+
+        // turning the flow control off sends everything
+        //
+        ed::message off(flow_control_message(0));
+        CATCH_REQUIRE(f.receive(off));
+        CATCH_REQUIRE_FALSE(f.is_flow_control_active());
+        CATCH_REQUIRE(f.get_messages_in_flight() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("flow_control: messages in flight count against a new window")
+    {
+        flow_test f;
+        ed::message fc(flow_control_message(2));
+        CATCH_REQUIRE(f.receive(fc));
+        CATCH_REQUIRE(f.send("A\n"));
+        CATCH_REQUIRE(f.send("B\n"));
+
+        // the window grows by one, only one more message can go
+        //
+        ed::message grow(flow_control_message(3));
+        CATCH_REQUIRE(f.receive(grow));
+        CATCH_REQUIRE(f.get_message_credits() == 1);
+        CATCH_REQUIRE(f.send("C\n"));
+        CATCH_REQUIRE(f.send("D\n"));
+        CATCH_REQUIRE(f.f_written.size() == 3);
+        CATCH_REQUIRE(f.get_held_messages() == 1);
+        CATCH_REQUIRE(f.is_flow_blocked());
+
+        // more credits than messages in flight do not grow the window
+        //
+        ed::message extra(credits_message(10));
+        CATCH_REQUIRE(f.receive(extra));
+        CATCH_REQUIRE(f.get_messages_in_flight() == 1);
+        CATCH_REQUIRE(f.get_message_credits() == 2);
+        CATCH_REQUIRE(f.send("E\n"));
+        CATCH_REQUIRE(f.send("F\n"));
+        CATCH_REQUIRE(f.send("G\n"));
+        CATCH_REQUIRE(f.f_written.size() == 6);
+        CATCH_REQUIRE(f.get_held_messages() == 1);
+        CATCH_REQUIRE(f.get_messages_in_flight() == 3);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("flow_control: reject policy and held limit")
+    {
+        flow_test f;
+        ed::message fc(flow_control_message(1));
+        CATCH_REQUIRE(f.receive(fc));
+        f.set_flow_control_policy(ed::flow_control_policy_t::FLOW_CONTROL_POLICY_REJECT);
+        CATCH_REQUIRE(f.send("A\n"));
+        CATCH_REQUIRE_FALSE(f.send("B\n"));
+        CATCH_REQUIRE(f.get_held_messages() == 0);
+        CATCH_REQUIRE(f.is_flow_blocked());
+
+        f.set_flow_control_policy(ed::flow_control_policy_t::FLOW_CONTROL_POLICY_HOLD);
+        f.set_max_held_messages(2);
+        CATCH_REQUIRE(f.send("C\n"));
+        CATCH_REQUIRE(f.send("D\n"));
+        CATCH_REQUIRE_FALSE(f.send("E\n"));
+        CATCH_REQUIRE(f.get_held_messages() == 2);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("flow_control: receiver gives credits back")
+    {
+        flow_test f;
+        CATCH_REQUIRE(f.enable_flow_control(8));
+        CATCH_REQUIRE(f.is_flow_control_enabled());
+        CATCH_REQUIRE(f.f_written.size() == 1);
+        CATCH_REQUIRE(f.f_written[0].find("FLOW_CONTROL") != std::string::npos);
+
+        // a quarter of the window triggers a CREDITS message
+        //
+        f.consumed(10);
+        CATCH_REQUIRE(f.f_written.size() == 1);
+        f.consumed(10);
+        CATCH_REQUIRE(f.f_written.size() == 2);
+
+        ed::message credits;
+        CATCH_REQUIRE(credits.from_message(f.f_written[1].substr(0, f.f_written[1].length() - 1)));
+        CATCH_REQUIRE(credits.get_command() == "CREDITS");
+        CATCH_REQUIRE(credits.get_integer_parameter("credits") == 2);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("flow_control: negative credits")
+    {
+        flow_test f;
+        CATCH_REQUIRE_THROWS_MATCHES(
+              f.enable_flow_control(-1)
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage("event_dispatcher_exception: flow control credits cannot be negative."));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
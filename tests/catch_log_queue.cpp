@@ -0,0 +1,245 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// test standalone header
+//
+#include    <snaplogger/network/log_queue.h>
+
+
+// self
+//
+#include    "catch_main.h"
+
+
+// cppthread
+//
+#include    <cppthread/runner.h>
+#include    <cppthread/thread.h>
+
+
+// C
+//
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+// push "<producer>:<index>" records until all were accepted
+//
+class producer
+    : public cppthread::runner
+{
+public:
+    typedef std::shared_ptr<producer>       pointer_t;
+
+    producer(
+              snaplogger_network::log_queue::pointer_t queue
+            , int id
+            , int count)
+        : runner("producer-" + std::to_string(id))
+        , f_queue(queue)
+        , f_id(id)
+        , f_count(count)
+    {
+    }
+
+    virtual void run() override
+    {
+        for(int idx(0); idx < f_count; ++idx)
+        {
+            std::string record(std::to_string(f_id) + ":" + std::to_string(idx));
+            while(!f_queue->push(record))
+            {
+                usleep(10);
+            }
+        }
+    }
+
+private:
+    snaplogger_network::log_queue::pointer_t
+                                f_queue = snaplogger_network::log_queue::pointer_t();
+    int                         f_id = 0;
+    int                         f_count = 0;
+};
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("log_queue", "[log_queue]")
+{
+    CATCH_START_SECTION("log_queue: capacity is a power of two")
+    {
+        CATCH_REQUIRE(snaplogger_network::log_queue(0).capacity() == 2);
+        CATCH_REQUIRE(snaplogger_network::log_queue(2).capacity() == 2);
+        CATCH_REQUIRE(snaplogger_network::log_queue(3).capacity() == 4);
+        CATCH_REQUIRE(snaplogger_network::log_queue(1000).capacity() == 1024);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_queue: empty")
+    {
+        snaplogger_network::log_queue queue(4);
+        CATCH_REQUIRE(queue.size() == 0);
+
+        std::string record("unchanged");
+        CATCH_REQUIRE_FALSE(queue.pop(record));
+        CATCH_REQUIRE(record == "unchanged");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_queue: full")
+    {
+        snaplogger_network::log_queue queue(4);
+        for(int idx(0); idx < 4; ++idx)
+        {
+            std::string record("record " + std::to_string(idx));
+            CATCH_REQUIRE(queue.push(record));
+            CATCH_REQUIRE(queue.size() == static_cast<std::size_t>(idx + 1));
+        }
+
+        std::string extra("extra");
+        CATCH_REQUIRE_FALSE(queue.push(extra));
+        CATCH_REQUIRE(extra == "extra");
+        CATCH_REQUIRE(queue.size() == 4);
+
+        // popping one record makes room for one more
+        //
+        std::string record;
+        CATCH_REQUIRE(queue.pop(record));
+        CATCH_REQUIRE(record == "record 0");
+        CATCH_REQUIRE(queue.push(extra));
+        CATCH_REQUIRE_FALSE(queue.push(extra));
+
+        for(int idx(1); idx < 4; ++idx)
+        {
+            CATCH_REQUIRE(queue.pop(record));
+            CATCH_REQUIRE(record == "record " + std::to_string(idx));
+        }
+        CATCH_REQUIRE(queue.pop(record));
+        CATCH_REQUIRE(record == "extra");
+        CATCH_REQUIRE_FALSE(queue.pop(record));
+        CATCH_REQUIRE(queue.size() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_queue: wraparound")
+    {
+        // go around the ring many times with a varying number of records
+        // in the queue to verify the sequence numbers of each lap
+        //
+        snaplogger_network::log_queue queue(8);
+        int next_push(0);
+        int next_pop(0);
+        for(int lap(0); lap < 100; ++lap)
+        {
+            int const count(lap % 8 + 1);
+            for(int idx(0); idx < count; ++idx)
+            {
+                std::string record(std::to_string(next_push));
+                CATCH_REQUIRE(queue.push(record));
+                ++next_push;
+            }
+            CATCH_REQUIRE(queue.size() == static_cast<std::size_t>(count));
+            for(int idx(0); idx < count; ++idx)
+            {
+                std::string record;
+                CATCH_REQUIRE(queue.pop(record));
+                CATCH_REQUIRE(record == std::to_string(next_pop));
+                ++next_pop;
+            }
+            CATCH_REQUIRE(queue.size() == 0);
+        }
+        CATCH_REQUIRE(next_pop == next_push);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_queue: multiple producers")
+    {
+        constexpr int const PRODUCERS = 4;
+        constexpr int const COUNT = 10'000;
+
+        // a small queue so the producers often find it full
+        //
+        snaplogger_network::log_queue::pointer_t queue(std::make_shared<snaplogger_network::log_queue>(16));
+
+        std::vector<producer::pointer_t> producers;
+        std::vector<cppthread::thread::pointer_t> threads;
+        for(int id(0); id < PRODUCERS; ++id)
+        {
+            producers.push_back(std::make_shared<producer>(queue, id, COUNT));
+            threads.push_back(std::make_shared<cppthread::thread>("producer", producers.back()));
+            threads.back()->start();
+        }
+
+        // each producer's records must come out once and in order
+        //
+        std::vector<int> next(PRODUCERS, 0);
+        int received(0);
+        bool ordered(true);
+        std::string record;
+        while(received < PRODUCERS * COUNT)
+        {
+            if(!queue->pop(record))
+            {
+                usleep(10);
+                continue;
+            }
+            std::string::size_type const pos(record.find(':'));
+            int const id(std::stoi(record.substr(0, pos)));
+            int const idx(std::stoi(record.substr(pos + 1)));
+            ++received;
+            if(id < 0
+            || id >= PRODUCERS
+            || idx != next[id])
+            {
+                // keep popping so the producers can finish
+                //
+                ordered = false;
+                continue;
+            }
+            ++next[id];
+        }
+
+        for(auto & t : threads)
+        {
+            t->stop();
+        }
+
+        CATCH_REQUIRE(ordered);
+        CATCH_REQUIRE(received == PRODUCERS * COUNT);
+        CATCH_REQUIRE(next == std::vector<int>(PRODUCERS, COUNT));
+        CATCH_REQUIRE_FALSE(queue->pop(record));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
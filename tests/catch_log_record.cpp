@@ -0,0 +1,516 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// test standalone header
+//
+#include    <snaplogger/network/log_record.h>
+
+
+// self
+//
+#include    "catch_main.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+void append_varint(std::string & out, std::uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+
+void append_frame(std::string & out, snaplogger_network::frame_t type, std::string const & payload)
+{
+    out += static_cast<char>(type);
+    append_varint(out, payload.length());
+    out += payload;
+}
+
+
+std::string magic()
+{
+    return std::string(snaplogger_network::LOG_RECORD_MAGIC, sizeof(snaplogger_network::LOG_RECORD_MAGIC));
+}
+
+
+// a valid FRAME_RECORD payload without strings, the parameters are
+// saved as is so they can be out of range
+//
+std::string record_payload(
+          std::uint64_t severity = 200
+        , std::uint64_t nanoseconds = 0
+        , std::uint64_t filename = 0
+        , std::string const & message = "msg")
+{
+    std::string payload;
+    append_varint(payload, severity);
+    append_varint(payload, 1'700'000'000);     // seconds
+    append_varint(payload, nanoseconds);
+    append_varint(payload, filename);
+    append_varint(payload, 0);                 // function
+    append_varint(payload, 33);                // line
+    append_varint(payload, 4);                 // column
+    payload += '\0';                            // flags
+    append_varint(payload, 0);                 // components
+    append_varint(payload, message.length());
+    payload += message;
+    append_varint(payload, 0);                 // fields
+    return payload;
+}
+
+
+struct decoded
+{
+    bool decode(std::string const & data)
+    {
+        return f_decoder.decode(
+              data.data()
+            , data.length()
+            , [this](snaplogger_network::log_record const & record)
+            {
+                f_records.push_back(record);
+            });
+    }
+
+    snaplogger_network::log_record_decoder
+                                f_decoder = snaplogger_network::log_record_decoder();
+    std::vector<snaplogger_network::log_record>
+                                f_records = std::vector<snaplogger_network::log_record>();
+};
+
+
+void verify_record(
+      snaplogger_network::log_record const & record
+    , snaplogger::message const & msg
+    , snaplogger::component::pointer_t extra_component = snaplogger::component::pointer_t())
+{
+    CATCH_REQUIRE(record.f_severity == msg.get_severity());
+    CATCH_REQUIRE(record.f_timestamp.tv_sec == msg.get_timestamp().tv_sec);
+    CATCH_REQUIRE(record.f_timestamp.tv_nsec == msg.get_timestamp().tv_nsec);
+    CATCH_REQUIRE(record.f_filename == msg.get_filename());
+    CATCH_REQUIRE(record.f_function == msg.get_function());
+    CATCH_REQUIRE(record.f_line == static_cast<std::uint32_t>(msg.get_line()));
+    CATCH_REQUIRE(record.f_column == static_cast<std::uint32_t>(msg.get_column()));
+    CATCH_REQUIRE(record.f_recursive == msg.get_recursive_message());
+    CATCH_REQUIRE(record.f_message == msg.get_message());
+
+    std::vector<std::string> components;
+    if(extra_component != nullptr)
+    {
+        components.push_back(extra_component->get_name());
+    }
+    for(auto const & c : msg.get_components())
+    {
+        components.push_back(c->get_name());
+    }
+    CATCH_REQUIRE(record.f_components == components);
+
+    snaplogger::field_map_t const fields(msg.get_fields());
+    CATCH_REQUIRE(record.f_fields.size() == fields.size());
+    for(auto const & f : record.f_fields)
+    {
+        auto const it(fields.find(f.first));
+        CATCH_REQUIRE(it != fields.end());
+        CATCH_REQUIRE(it->second == f.second);
+    }
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("log_record_round_trip", "[log_record]")
+{
+    CATCH_START_SECTION("log_record_round_trip: all the fields")
+    {
+        snaplogger::message msg(snaplogger::severity_t::SEVERITY_WARNING, "catch_log_record.cpp", "round_trip", 1234);
+        msg.set_timestamp(timespec{ 1'700'000'123, 999'999'999 });
+        msg.set_recursive_message(true);
+        msg.add_component(snaplogger::get_component("database"));
+        msg.add_component(snaplogger::get_component("web"));
+        msg.add_field("user", "alexis");
+        msg.add_field("empty", "");
+        msg.add_field("binary", std::string("a\0b\x80\xFF", 5));
+        msg << "the message is long enough to have a size of more than one byte ("
+            << std::string(200, '*')
+            << ")";
+
+        snaplogger_network::log_record_encoder encoder;
+        snaplogger::component::pointer_t alert(snaplogger::get_component("alert"));
+        std::string data(magic());
+        encoder.encode(msg, data, alert);
+
+        decoded d;
+        CATCH_REQUIRE(d.decode(data));
+        CATCH_REQUIRE(d.f_decoder.get_pending_size() == 0);
+        CATCH_REQUIRE(d.f_records.size() == 1);
+        verify_record(d.f_records[0], msg, alert);
+        CATCH_REQUIRE(d.f_records[0].f_line == 1234);
+        CATCH_REQUIRE(d.f_records[0].f_components[0] == "alert");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_round_trip: every severity")
+    {
+        snaplogger_network::log_record_encoder encoder;
+        std::string data(magic());
+        std::vector<snaplogger::severity_t> const severities = {
+            snaplogger::severity_t::SEVERITY_ALL,
+            snaplogger::severity_t::SEVERITY_TRACE,
+            snaplogger::severity_t::SEVERITY_DEBUG,
+            snaplogger::severity_t::SEVERITY_INFORMATION,
+            snaplogger::severity_t::SEVERITY_WARNING,
+            snaplogger::severity_t::SEVERITY_ERROR,
+            snaplogger::severity_t::SEVERITY_FATAL,
+            snaplogger::severity_t::SEVERITY_OFF,
+        };
+        for(auto const s : severities)
+        {
+            snaplogger::message msg(s);
+            msg << "severity " << static_cast<int>(s);
+            encoder.encode(msg, data);
+        }
+
+        decoded d;
+        CATCH_REQUIRE(d.decode(data));
+        CATCH_REQUIRE(d.f_records.size() == severities.size());
+        for(std::size_t idx(0); idx < severities.size(); ++idx)
+        {
+            CATCH_REQUIRE(d.f_records[idx].f_severity == severities[idx]);
+            CATCH_REQUIRE(d.f_records[idx].f_message == "severity " + std::to_string(static_cast<int>(severities[idx])));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_round_trip: strings are defined once")
+    {
+        snaplogger_network::log_record_encoder encoder;
+        std::string data(magic());
+
+        snaplogger::message first(snaplogger::severity_t::SEVERITY_INFORMATION, "same_file.cpp", "same_function", 10);
+        first.add_component(snaplogger::get_component("database"));
+        first.add_field("user", "first");
+        first << "first";
+        encoder.encode(first, data);
+        std::size_t const first_size(data.length());
+
+        snaplogger::message second(snaplogger::severity_t::SEVERITY_INFORMATION, "same_file.cpp", "same_function", 10);
+        second.add_component(snaplogger::get_component("database"));
+        second.add_field("user", "second");
+        second << "first";
+        encoder.encode(second, data);
+
+        // the second record only has its own frame
+        //
+        CATCH_REQUIRE(data.length() - first_size < first_size - sizeof(snaplogger_network::LOG_RECORD_MAGIC));
+
+        decoded d;
+        CATCH_REQUIRE(d.decode(data));
+        CATCH_REQUIRE(d.f_records.size() == 2);
+        verify_record(d.f_records[0], first);
+        verify_record(d.f_records[1], second);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_round_trip: one byte at a time")
+    {
+        snaplogger_network::log_record_encoder encoder;
+        std::string data(magic());
+        snaplogger::message msg(snaplogger::severity_t::SEVERITY_ERROR, "split.cpp", "one_byte", 77);
+        msg.add_component(snaplogger::get_component("web"));
+        msg.add_field("size", "large");
+        msg << "split in many pieces";
+        encoder.encode(msg, data);
+        encoder.encode(msg, data);
+
+        decoded d;
+        for(std::size_t idx(0); idx < data.length(); ++idx)
+        {
+            CATCH_REQUIRE(d.decode(data.substr(idx, 1)));
+        }
+        CATCH_REQUIRE(d.f_decoder.get_pending_size() == 0);
+        CATCH_REQUIRE(d.f_records.size() == 2);
+        verify_record(d.f_records[0], msg);
+        verify_record(d.f_records[1], msg);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_round_trip: reset and rollback")
+    {
+        snaplogger_network::log_record_encoder encoder;
+        std::string data(magic());
+
+        snaplogger::message msg(snaplogger::severity_t::SEVERITY_INFORMATION, "reset.cpp", "before", 1);
+        msg << "before the reset";
+        encoder.encode(msg, data);
+
+        // the dropped record defines strings which must be defined again
+        //
+        snaplogger::message dropped(snaplogger::severity_t::SEVERITY_INFORMATION, "dropped.cpp", "dropped", 2);
+        dropped << "dropped";
+        std::string lost;
+        encoder.encode(dropped, lost);
+        encoder.rollback();
+
+        encoder.reset();
+        snaplogger::message after(snaplogger::severity_t::SEVERITY_INFORMATION, "dropped.cpp", "dropped", 3);
+        after << "after the reset";
+        encoder.encode(after, data);
+
+        decoded d;
+        CATCH_REQUIRE(d.decode(data));
+        CATCH_REQUIRE(d.f_records.size() == 2);
+        verify_record(d.f_records[0], msg);
+        verify_record(d.f_records[1], after);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_round_trip: secret code")
+    {
+        snaplogger_network::log_record_encoder encoder;
+        std::string data(magic());
+        encoder.encode_secret_code("top-secret", data);
+        snaplogger::message msg(snaplogger::severity_t::SEVERITY_INFORMATION);
+        msg << "with a secret code";
+        encoder.encode(msg, data);
+
+        decoded d;
+        CATCH_REQUIRE(d.decode(data));
+        CATCH_REQUIRE(d.f_decoder.get_secret_code() == "top-secret");
+        CATCH_REQUIRE(d.f_records.size() == 1);
+        verify_record(d.f_records[0], msg);
+
+        d.f_decoder.reset();
+        CATCH_REQUIRE(d.f_decoder.get_secret_code().empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_round_trip: undefined string")
+    {
+        // a lost FRAME_STRING gives an empty string
+        //
+        std::string data(magic());
+        append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, record_payload(200, 0, 5));
+
+        decoded d;
+        CATCH_REQUIRE(d.decode(data));
+        CATCH_REQUIRE(d.f_records.size() == 1);
+        CATCH_REQUIRE(d.f_records[0].f_filename.empty());
+        CATCH_REQUIRE(d.f_records[0].f_line == 33);
+        CATCH_REQUIRE(d.f_records[0].f_column == 4);
+        CATCH_REQUIRE(d.f_records[0].f_message == "msg");
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("log_record_truncated", "[log_record]")
+{
+    CATCH_START_SECTION("log_record_truncated: partial frames wait for more data")
+    {
+        snaplogger_network::log_record_encoder encoder;
+        std::string data(magic());
+        snaplogger::message msg(snaplogger::severity_t::SEVERITY_INFORMATION, "truncated.cpp", "partial", 5);
+        msg << "not complete yet";
+        encoder.encode(msg, data);
+
+        for(std::size_t size(1); size < data.length(); ++size)
+        {
+            decoded d;
+            CATCH_REQUIRE(d.decode(data.substr(0, size)));
+            CATCH_REQUIRE(d.f_records.empty());
+
+            CATCH_REQUIRE(d.decode(data.substr(size)));
+            CATCH_REQUIRE(d.f_records.size() == 1);
+            verify_record(d.f_records[0], msg);
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_truncated: record payload cut short")
+    {
+        std::string const payload(record_payload());
+        for(std::size_t size(0); size < payload.length(); ++size)
+        {
+            std::string data(magic());
+            append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, payload.substr(0, size));
+
+            decoded d;
+            CATCH_REQUIRE_FALSE(d.decode(data));
+            CATCH_REQUIRE(d.f_records.empty());
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_truncated: message size larger than the payload")
+    {
+        std::string payload(record_payload());
+
+        // the message size is right before "msg" and the field count
+        //
+        std::string::size_type const pos(payload.length() - 5);
+        CATCH_REQUIRE(payload[pos] == 3);
+        payload[pos] = 10;
+
+        std::string data(magic());
+        append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, payload);
+
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode(data));
+        CATCH_REQUIRE(d.f_records.empty());
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("log_record_corrupt", "[log_record]")
+{
+    CATCH_START_SECTION("log_record_corrupt: invalid magic")
+    {
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode("LOG!"));
+
+        // a partial magic must match too
+        //
+        decoded e;
+        CATCH_REQUIRE_FALSE(e.decode(std::string(1, 'L')));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_corrupt: unknown frame type")
+    {
+        std::string data(magic());
+        append_frame(data, static_cast<snaplogger_network::frame_t>(99), "?");
+
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode(data));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_corrupt: invalid frame size")
+    {
+        std::string data(magic());
+        data += static_cast<char>(snaplogger_network::frame_t::FRAME_RECORD);
+        data += std::string(20, '\xFF');
+
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode(data));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_corrupt: frame too large")
+    {
+        std::string data(magic());
+        data += static_cast<char>(snaplogger_network::frame_t::FRAME_RECORD);
+        append_varint(data, snaplogger_network::LOG_RECORD_MAX_FRAME_SIZE + 1);
+
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode(data));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_corrupt: invalid string numbers")
+    {
+        std::uint64_t const ids[] = { 0, snaplogger_network::LOG_RECORD_MAX_STRINGS + 1 };
+        for(auto const id : ids)
+        {
+            std::string payload;
+            append_varint(payload, id);
+            payload += "name";
+
+            std::string data(magic());
+            append_frame(data, snaplogger_network::frame_t::FRAME_STRING, payload);
+
+            decoded d;
+            CATCH_REQUIRE_FALSE(d.decode(data));
+        }
+
+        // a record referencing a string out of range
+        //
+        std::string data(magic());
+        append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, record_payload(200, 0, snaplogger_network::LOG_RECORD_MAX_STRINGS + 1));
+
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode(data));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_corrupt: out of range values")
+    {
+        {
+            std::string data(magic());
+            append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, record_payload(256));
+
+            decoded d;
+            CATCH_REQUIRE_FALSE(d.decode(data));
+        }
+
+        {
+            std::string data(magic());
+            append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, record_payload(200, 1'000'000'000));
+
+            decoded d;
+            CATCH_REQUIRE_FALSE(d.decode(data));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_corrupt: trailing bytes in a record")
+    {
+        std::string data(magic());
+        append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, record_payload() + "extra");
+
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode(data));
+        CATCH_REQUIRE(d.f_records.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_record_corrupt: valid records before the corrupt one are kept")
+    {
+        std::string data(magic());
+        append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, record_payload(200, 0, 0, "good"));
+        append_frame(data, snaplogger_network::frame_t::FRAME_RECORD, record_payload(200, 1'000'000'000, 0, "bad"));
+
+        decoded d;
+        CATCH_REQUIRE_FALSE(d.decode(data));
+        CATCH_REQUIRE(d.f_records.size() == 1);
+        CATCH_REQUIRE(d.f_records[0].f_message == "good");
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
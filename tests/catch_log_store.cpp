@@ -0,0 +1,364 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// test standalone header
+//
+#include    <snaplogger/network/log_store.h>
+
+
+// self
+//
+#include    "catch_main.h"
+
+
+// C++
+//
+#include    <algorithm>
+#include    <fstream>
+
+
+// C
+//
+#include    <dirent.h>
+#include    <string.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+constexpr std::int64_t const    FIRST_SECOND = 1'700'000'000;
+
+
+// an empty directory for one store
+//
+std::string store_path(std::string const & name)
+{
+    std::string const path(SNAP_CATCH2_NAMESPACE::get_tmp_dir("log_store") + "/" + name);
+    DIR * dir(opendir(path.c_str()));
+    if(dir != nullptr)
+    {
+        for(;;)
+        {
+            dirent const * entry(readdir(dir));
+            if(entry == nullptr)
+            {
+                break;
+            }
+            if(entry->d_name[0] != '.')
+            {
+                unlink((path + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    return path;
+}
+
+
+// the segment numbers found in the store, sorted
+//
+std::vector<std::uint64_t> list_segments(std::string const & path)
+{
+    std::vector<std::uint64_t> segments;
+    DIR * dir(opendir(path.c_str()));
+    CATCH_REQUIRE(dir != nullptr);
+    for(;;)
+    {
+        dirent const * entry(readdir(dir));
+        if(entry == nullptr)
+        {
+            break;
+        }
+        std::string const name(entry->d_name);
+        if(name.length() == 20
+        && name.substr(16) == ".idx")
+        {
+            segments.push_back(std::stoull(name.substr(0, 16)));
+        }
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+
+// the index entries of one segment
+//
+std::vector<snaplogger_network::log_store_block> read_index(std::string const & path, std::uint64_t segment)
+{
+    std::string name(std::to_string(segment));
+    name = path + "/" + std::string(16 - name.length(), '0') + name + ".idx";
+
+    std::ifstream in(name, std::ios::binary);
+    CATCH_REQUIRE(in.good());
+    char magic[sizeof(snaplogger_network::LOG_STORE_INDEX_MAGIC)];
+    CATCH_REQUIRE(in.read(magic, sizeof(magic)).good());
+    CATCH_REQUIRE(memcmp(magic, snaplogger_network::LOG_STORE_INDEX_MAGIC, sizeof(magic)) == 0);
+
+    std::vector<snaplogger_network::log_store_block> blocks;
+    snaplogger_network::log_store_block b;
+    while(in.read(reinterpret_cast<char *>(&b), sizeof(b)))
+    {
+        blocks.push_back(b);
+    }
+    return blocks;
+}
+
+
+// one record per second, with an ERROR every 10 records and the "db"
+// component every 7 records
+//
+void write_records(
+      snaplogger_network::log_store_writer & writer
+    , int first
+    , int count)
+{
+    for(int idx(first); idx < first + count; ++idx)
+    {
+        snaplogger::message msg(idx % 10 == 0
+                    ? snaplogger::severity_t::SEVERITY_ERROR
+                    : snaplogger::severity_t::SEVERITY_INFORMATION);
+        msg.set_timestamp(timespec{ FIRST_SECOND + idx, 0 });
+        msg.add_component(snaplogger::get_component(idx % 7 == 0 ? "db" : "web"));
+        msg.add_field("index", std::to_string(idx));
+        msg << "record #" << idx << " with a bit of text to fill the blocks";
+        writer.append(msg);
+    }
+}
+
+
+// the index of each matching record, in the order they were returned
+//
+std::vector<int> run_query(
+      snaplogger_network::log_store_reader & reader
+    , snaplogger_network::log_store_query const & q)
+{
+    std::vector<int> found;
+    std::size_t const count(reader.query(
+          q
+        , [&found](snaplogger_network::log_record const & record)
+        {
+            found.push_back(static_cast<int>(record.f_timestamp.tv_sec - FIRST_SECOND));
+            CATCH_REQUIRE(record.f_message == "record #" + std::to_string(found.back()) + " with a bit of text to fill the blocks");
+            auto const it(std::find_if(
+                  record.f_fields.begin()
+                , record.f_fields.end()
+                , [](auto const & f) { return f.first == "index"; }));
+            CATCH_REQUIRE(it != record.f_fields.end());
+            CATCH_REQUIRE(it->second == std::to_string(found.back()));
+        }));
+    CATCH_REQUIRE(count == found.size());
+    return found;
+}
+
+
+std::vector<int> expected_range(int start, int end)
+{
+    std::vector<int> result;
+    for(int idx(start); idx < end; ++idx)
+    {
+        result.push_back(idx);
+    }
+    return result;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("log_store", "[log_store]")
+{
+    CATCH_START_SECTION("log_store: write, rotate, and read everything back")
+    {
+        std::string const path(store_path("all"));
+        {
+            snaplogger_network::log_store_writer writer(path, 4096, 0, 1024);
+            write_records(writer, 0, 2000);
+            writer.close();
+            CATCH_REQUIRE(writer.get_record_count() == 2000);
+            CATCH_REQUIRE(writer.get_error_count() == 0);
+        }
+
+        // the small sizes create many blocks and segments
+        //
+        std::vector<std::uint64_t> const segments(list_segments(path));
+        CATCH_REQUIRE(segments.size() > 2);
+        std::size_t records(0);
+        for(auto const s : segments)
+        {
+            std::vector<snaplogger_network::log_store_block> const blocks(read_index(path, s));
+            CATCH_REQUIRE_FALSE(blocks.empty());
+            for(auto const & b : blocks)
+            {
+                records += b.f_count;
+            }
+        }
+        CATCH_REQUIRE(records == 2000);
+        CATCH_REQUIRE(read_index(path, segments[0]).size() > 1);
+
+        snaplogger_network::log_store_reader reader(path);
+        CATCH_REQUIRE(run_query(reader, snaplogger_network::log_store_query()) == expected_range(0, 2000));
+        CATCH_REQUIRE(reader.get_segments_scanned() == segments.size());
+        CATCH_REQUIRE(reader.get_segments_skipped() == 0);
+        CATCH_REQUIRE(reader.get_blocks_skipped() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_store: query across a block boundary")
+    {
+        std::string const path(store_path("block"));
+        {
+            snaplogger_network::log_store_writer writer(path, 1024 * 1024, 0, 1024);
+            write_records(writer, 0, 500);
+        }
+
+        std::vector<std::uint64_t> const segments(list_segments(path));
+        CATCH_REQUIRE(segments.size() == 1);
+        std::vector<snaplogger_network::log_store_block> const blocks(read_index(path, segments[0]));
+        CATCH_REQUIRE(blocks.size() > 2);
+
+        // the last record of the first block and the first of the second
+        //
+        snaplogger_network::log_store_query q;
+        q.f_start = blocks[0].f_max_time;
+        q.f_end = blocks[1].f_min_time + 1;
+        CATCH_REQUIRE(q.f_end - q.f_start == 2);
+
+        int const last(static_cast<int>(blocks[0].f_max_time - FIRST_SECOND));
+        snaplogger_network::log_store_reader reader(path);
+        CATCH_REQUIRE(run_query(reader, q) == expected_range(last, last + 2));
+        CATCH_REQUIRE(reader.get_blocks_scanned() == 2);
+        CATCH_REQUIRE(reader.get_blocks_skipped() == blocks.size() - 2);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_store: query across a segment boundary")
+    {
+        std::string const path(store_path("segment"));
+        {
+            snaplogger_network::log_store_writer writer(path, 4096, 0, 1024);
+            write_records(writer, 0, 2000);
+        }
+
+        std::vector<std::uint64_t> const segments(list_segments(path));
+        CATCH_REQUIRE(segments.size() > 2);
+        std::vector<snaplogger_network::log_store_block> const first(read_index(path, segments[1]));
+        std::vector<snaplogger_network::log_store_block> const second(read_index(path, segments[2]));
+
+        // the last record of one segment and the first of the next
+        //
+        snaplogger_network::log_store_query q;
+        q.f_start = first.back().f_max_time;
+        q.f_end = second.front().f_min_time + 1;
+        CATCH_REQUIRE(q.f_end - q.f_start == 2);
+
+        int const start(static_cast<int>(q.f_start - FIRST_SECOND));
+        snaplogger_network::log_store_reader reader(path);
+        CATCH_REQUIRE(run_query(reader, q) == expected_range(start, start + 2));
+        CATCH_REQUIRE(reader.get_segments_scanned() == 2);
+        CATCH_REQUIRE(reader.get_segments_skipped() == segments.size() - 2);
+        CATCH_REQUIRE(reader.get_blocks_scanned() == 2);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_store: filter by severity and component")
+    {
+        std::string const path(store_path("filter"));
+        {
+            snaplogger_network::log_store_writer writer(path, 4096, 0, 1024);
+            write_records(writer, 0, 2000);
+        }
+
+        std::vector<int> expected;
+        for(int idx(0); idx < 2000; idx += 70)
+        {
+            expected.push_back(idx);
+        }
+
+        snaplogger_network::log_store_query q;
+        q.f_min_severity = snaplogger::severity_t::SEVERITY_ERROR;
+        q.f_components = { "db" };
+        snaplogger_network::log_store_reader reader(path);
+        CATCH_REQUIRE(run_query(reader, q) == expected);
+
+        // a component which was never used skips everything
+        //
+        q.f_components = { "unused-component-name" };
+        std::vector<int> const none(run_query(reader, q));
+        CATCH_REQUIRE(none.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_store: old segments are removed")
+    {
+        std::string const path(store_path("rotate"));
+        {
+            snaplogger_network::log_store_writer writer(path, 4096, 2, 1024);
+            write_records(writer, 0, 2000);
+            writer.close();
+            CATCH_REQUIRE(writer.get_record_count() == 2000);
+        }
+
+        std::vector<std::uint64_t> const segments(list_segments(path));
+        CATCH_REQUIRE(segments.size() == 2);
+        CATCH_REQUIRE(segments[0] > 1);
+        CATCH_REQUIRE(segments[1] == segments[0] + 1);
+
+        std::vector<snaplogger_network::log_store_block> const blocks(read_index(path, segments[0]));
+        int const oldest(static_cast<int>(blocks.front().f_min_time - FIRST_SECOND));
+        CATCH_REQUIRE(oldest > 0);
+
+        snaplogger_network::log_store_reader reader(path);
+        CATCH_REQUIRE(run_query(reader, snaplogger_network::log_store_query()) == expected_range(oldest, 2000));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("log_store: a new writer starts a new segment")
+    {
+        std::string const path(store_path("restart"));
+        {
+            snaplogger_network::log_store_writer writer(path, 1024 * 1024, 0, 1024);
+            write_records(writer, 0, 100);
+        }
+        {
+            snaplogger_network::log_store_writer writer(path, 1024 * 1024, 0, 1024);
+            write_records(writer, 100, 100);
+        }
+
+        CATCH_REQUIRE(list_segments(path) == std::vector<std::uint64_t>({ 1, 2 }));
+
+        snaplogger_network::log_store_reader reader(path);
+        CATCH_REQUIRE(run_query(reader, snaplogger_network::log_store_query()) == expected_range(0, 200));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
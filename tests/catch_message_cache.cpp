@@ -0,0 +1,178 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/exception.h>
+#include    <eventdispatcher/message_cache.h>
+
+
+// C
+//
+#include    <unistd.h>
+
+
+
+namespace
+{
+
+
+ed::message create_message(int idx)
+{
+    ed::message msg;
+    msg.set_command("PING");
+    msg.add_parameter("index", idx);
+    return msg;
+}
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("message_cache", "[message][cache]")
+{
+    CATCH_START_SECTION("message_cache: drop oldest")
+    {
+        ed::message_cache cache(3);
+        CATCH_REQUIRE(cache.empty());
+        CATCH_REQUIRE(cache.get_max_size() == 3);
+        CATCH_REQUIRE(cache.get_overflow_policy() == ed::cache_overflow_t::CACHE_OVERFLOW_DROP_OLDEST);
+
+        for(int idx(0); idx < 5; ++idx)
+        {
+            CATCH_REQUIRE(cache.push(create_message(idx)));
+        }
+        CATCH_REQUIRE(cache.size() == 3);
+        CATCH_REQUIRE(cache.get_dropped() == 2);
+
+        ed::message msg;
+        for(int idx(2); idx < 5; ++idx)
+        {
+            CATCH_REQUIRE(cache.pop(msg));
+            CATCH_REQUIRE(msg.get_integer_parameter("index") == idx);
+        }
+        CATCH_REQUIRE_FALSE(cache.pop(msg));
+        CATCH_REQUIRE(cache.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("message_cache: drop newest")
+    {
+        ed::message_cache cache(3);
+        cache.set_overflow_policy(ed::cache_overflow_t::CACHE_OVERFLOW_DROP_NEWEST);
+
+        for(int idx(0); idx < 5; ++idx)
+        {
+            CATCH_REQUIRE(cache.push(create_message(idx)) == (idx < 3));
+        }
+        CATCH_REQUIRE(cache.size() == 3);
+        CATCH_REQUIRE(cache.get_dropped() == 2);
+
+        ed::message msg;
+        for(int idx(0); idx < 3; ++idx)
+        {
+            CATCH_REQUIRE(cache.pop(msg));
+            CATCH_REQUIRE(msg.get_integer_parameter("index") == idx);
+        }
+        CATCH_REQUIRE_FALSE(cache.pop(msg));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("message_cache: time to live")
+    {
+        ed::message_cache cache;
+        cache.set_ttl(100'000);     // 0.1s
+        CATCH_REQUIRE(cache.get_ttl() == 100'000);
+
+        CATCH_REQUIRE(cache.push(create_message(1)));
+        CATCH_REQUIRE(cache.push(create_message(2)));
+        usleep(200'000);
+        CATCH_REQUIRE(cache.push(create_message(3)));
+
+        ed::message msg;
+        CATCH_REQUIRE(cache.pop(msg));
+        CATCH_REQUIRE(msg.get_integer_parameter("index") == 3);
+        CATCH_REQUIRE(cache.get_expired() == 2);
+        CATCH_REQUIRE_FALSE(cache.pop(msg));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("message_cache: spill to file preserves order")
+    {
+        std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("message-cache"));
+        std::string const filename(dir + "/spill.txt");
+        unlink(filename.c_str());
+
+        ed::message_cache cache(2);
+        cache.set_overflow_policy(ed::cache_overflow_t::CACHE_OVERFLOW_SPILL);
+        cache.set_spill_filename(filename);
+        CATCH_REQUIRE(cache.get_spill_filename() == filename);
+
+        for(int idx(0); idx < 10; ++idx)
+        {
+            CATCH_REQUIRE(cache.push(create_message(idx)));
+        }
+        CATCH_REQUIRE(cache.size() == 10);
+        CATCH_REQUIRE(cache.get_spilled() == 8);
+
+        // pushing more while the file is being read back still spills
+        //
+        ed::message msg;
+        CATCH_REQUIRE(cache.pop(msg));
+        CATCH_REQUIRE(msg.get_integer_parameter("index") == 0);
+        CATCH_REQUIRE(cache.push(create_message(10)));
+
+        for(int idx(1); idx <= 10; ++idx)
+        {
+            CATCH_REQUIRE(cache.pop(msg));
+            CATCH_REQUIRE(msg.get_integer_parameter("index") == idx);
+        }
+        CATCH_REQUIRE_FALSE(cache.pop(msg));
+        CATCH_REQUIRE(cache.empty());
+        CATCH_REQUIRE(access(filename.c_str(), F_OK) != 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("message_cache: invalid parameters")
+    {
+        ed::message_cache cache;
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  cache.set_max_size(0)
+                , ed::invalid_parameter
+                , Catch::Matchers::ExceptionMessage(
+                          "event_dispatcher_exception: the message cache max_size must be at least 1"));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  cache.set_ttl(-1)
+                , ed::invalid_parameter
+                , Catch::Matchers::ExceptionMessage(
+                          "event_dispatcher_exception: the message cache TTL cannot be negative"));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,101 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/exception.h>
+#include    <eventdispatcher/message_capture.h>
+
+
+// C++
+//
+#include    <fstream>
+
+
+
+CATCH_TEST_CASE("message_capture", "[message][capture]")
+{
+    CATCH_START_SECTION("message_capture: write and read back")
+    {
+        std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("message-capture"));
+        std::string const filename(dir + "/traffic.edcap");
+
+        ed::message ping;
+        ping.set_command("PING");
+        ping.add_parameter("serial", 33);
+        ed::message pong;
+        pong.set_command("PONG");
+        pong.add_parameter("serial", 33);
+
+        // not active, nothing saved
+        //
+        CATCH_REQUIRE_FALSE(ed::message_capture::is_active());
+        ed::message_capture::capture(ed::capture_direction_t::CAPTURE_DIRECTION_RECEIVED, "ignored", ping);
+
+        ed::message_capture::start(filename);
+        CATCH_REQUIRE(ed::message_capture::is_active());
+        ed::message_capture::capture(ed::capture_direction_t::CAPTURE_DIRECTION_RECEIVED, "client", ping);
+        ed::message_capture::capture(ed::capture_direction_t::CAPTURE_DIRECTION_SENT, "client", pong);
+        ed::message_capture::stop();
+        CATCH_REQUIRE_FALSE(ed::message_capture::is_active());
+
+        ed::message_capture_reader reader(filename);
+        ed::capture_record_t first;
+        CATCH_REQUIRE(reader.next(first));
+        CATCH_REQUIRE(first.f_direction == ed::capture_direction_t::CAPTURE_DIRECTION_RECEIVED);
+        CATCH_REQUIRE(first.f_connection_name == "client");
+        CATCH_REQUIRE(first.f_message == ping.to_message());
+
+        ed::capture_record_t second;
+        CATCH_REQUIRE(reader.next(second));
+        CATCH_REQUIRE(second.f_direction == ed::capture_direction_t::CAPTURE_DIRECTION_SENT);
+        CATCH_REQUIRE(second.f_connection_name == "client");
+        CATCH_REQUIRE(second.f_message == pong.to_message());
+        CATCH_REQUIRE(second.f_timestamp >= first.f_timestamp);
+
+        ed::capture_record_t end;
+        CATCH_REQUIRE_FALSE(reader.next(end));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("message_capture: invalid file")
+    {
+        std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("message-capture"));
+        std::string const filename(dir + "/not-a-capture.txt");
+        {
+            std::ofstream out(filename);
+            out << "PING serial=1\n";
+        }
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  ed::message_capture_reader(filename)
+                , ed::runtime_error
+                , Catch::Matchers::ExceptionMessage(
+                          "event_dispatcher_exception: \"" + filename + "\" is not a message capture file."));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
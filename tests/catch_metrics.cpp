@@ -0,0 +1,149 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/dispatcher.h>
+#include    <eventdispatcher/metrics.h>
+#include    <eventdispatcher/timer.h>
+
+
+
+CATCH_TEST_CASE("metrics", "[metrics]")
+{
+    CATCH_START_SECTION("metrics: counters")
+    {
+        ed::metrics & m(ed::metrics::instance());
+        m.reset();
+
+        ed::metrics_counter & c(m.get_counter("test_counter_total"));
+        CATCH_REQUIRE(c.get_value() == 0);
+        c.increment();
+        c.increment(5);
+        CATCH_REQUIRE(c.get_value() == 6);
+        CATCH_REQUIRE(&m.get_counter("test_counter_total") == &c);
+
+        m.reset();
+        CATCH_REQUIRE(c.get_value() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("metrics: histogram buckets")
+    {
+        ed::metrics_histogram h;
+        h.record(5);            // bucket 0 (<= 10)
+        h.record(10);           // bucket 0 (<= 10)
+        h.record(11);           // bucket 1 (<= 50)
+        h.record(10'000'000);   // +Inf
+
+        CATCH_REQUIRE(h.get_count() == 4);
+        CATCH_REQUIRE(h.get_sum() == 10'000'026);
+        CATCH_REQUIRE(h.get_bucket(0) == 2);
+        CATCH_REQUIRE(h.get_bucket(1) == 1);
+        CATCH_REQUIRE(h.get_bucket(2) == 0);
+        CATCH_REQUIRE(h.get_bucket(ed::metrics_histogram::BUCKET_COUNT) == 1);
+        CATCH_REQUIRE(h.get_bucket(ed::metrics_histogram::BUCKET_COUNT + 1) == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("metrics: label escaping")
+    {
+        CATCH_REQUIRE(ed::metrics::label("command", "PING") == "command=\"PING\"");
+        CATCH_REQUIRE(ed::metrics::label("name", "a\"b\\c\nd") == "name=\"a\\\"b\\\\c\\nd\"");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("metrics: prometheus output")
+    {
+        ed::metrics & m(ed::metrics::instance());
+        m.reset();
+
+        m.get_counter("test_messages_total", ed::metrics::label("command", "PING")).increment(3);
+        m.get_histogram("test_duration_us").record(75);
+
+        std::string const text(m.to_prometheus());
+        CATCH_REQUIRE(text.find("# TYPE test_messages_total counter\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("test_messages_total{command=\"PING\"} 3\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("# TYPE test_duration_us histogram\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("test_duration_us_bucket{le=\"50\"} 0\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("test_duration_us_bucket{le=\"100\"} 1\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("test_duration_us_bucket{le=\"+Inf\"} 1\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("test_duration_us_sum 75\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("test_duration_us_count 1\n") != std::string::npos);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("metrics: unregistered commands are labelled \"other\"")
+    {
+        ed::metrics & m(ed::metrics::instance());
+        m.reset();
+
+        ed::dispatcher d(nullptr);
+        d.add_match(ed::define_match(
+                  ed::Expression("PING")
+                , ed::Callback([](ed::message & msg) { snapdev::NOT_USED(msg); })));
+
+        ed::message ping;
+        ping.set_command("PING");
+        d.dispatch(ping);
+        for(int i(0); i < 10; ++i)
+        {
+            ed::message random;
+            random.set_command("RANDOM" + std::to_string(i));
+            d.dispatch(random);
+        }
+
+        std::string const text(m.to_prometheus());
+        CATCH_REQUIRE(text.find("ed_dispatch_messages_total{command=\"PING\"} 1\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("ed_dispatch_messages_total{command=\"other\"} 10\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("ed_dispatch_unhandled_total{command=\"other\"} 10\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("RANDOM") == std::string::npos);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("metrics: connections with the same name get distinct series")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+        ed::timer::pointer_t t1(std::make_shared<ed::timer>(-1));
+        ed::timer::pointer_t t2(std::make_shared<ed::timer>(-1));
+        t1->set_name("same-name");
+        t2->set_name("same-name");
+        CATCH_REQUIRE(t1->get_id() != t2->get_id());
+
+        CATCH_REQUIRE(communicator->add_connection(t1));
+        CATCH_REQUIRE(communicator->add_connection(t2));
+
+        std::string const text(ed::metrics::instance().to_prometheus());
+        CATCH_REQUIRE(text.find("ed_connection_timeouts_total{connection=\"same-name\",id=\"" + std::to_string(t1->get_id()) + "\"} 0\n") != std::string::npos);
+        CATCH_REQUIRE(text.find("ed_connection_timeouts_total{connection=\"same-name\",id=\"" + std::to_string(t2->get_id()) + "\"} 0\n") != std::string::npos);
+
+        CATCH_REQUIRE(communicator->remove_connection(t1));
+        CATCH_REQUIRE(communicator->remove_connection(t2));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,161 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/exception.h>
+#include    <eventdispatcher/pause_durations.h>
+
+
+
+CATCH_TEST_CASE("pause_durations", "[pause_durations]")
+{
+    CATCH_START_SECTION("pause_durations: list")
+    {
+        ed::pause_durations p("-5,10,30");
+        CATCH_REQUIRE(p.get_mode() == ed::pause_mode_t::PAUSE_MODE_LIST);
+        CATCH_REQUIRE_FALSE(p.is_jittered());
+        CATCH_REQUIRE(p.initial_timer_value() == 5.0);
+        CATCH_REQUIRE(p.get_next_delay() == 10.0);
+        CATCH_REQUIRE(p.get_next_delay() == 30.0);
+        CATCH_REQUIRE(p.get_next_delay() == -1.0);
+
+        p.restart();
+        CATCH_REQUIRE(p.get_next_delay() == 10.0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("pause_durations: decorrelated jitter")
+    {
+        ed::pause_durations p(1'000'000, 20'000'000);
+        CATCH_REQUIRE(p.get_mode() == ed::pause_mode_t::PAUSE_MODE_DECORRELATED_JITTER);
+        CATCH_REQUIRE(p.is_jittered());
+        CATCH_REQUIRE(p.initial_timer_value() == 0.0);
+
+        double previous(1.0);
+        bool reached_cap(false);
+        for(int i(0); i < 1000; ++i)
+        {
+            double const delay(p.get_next_delay());
+            CATCH_REQUIRE(delay >= 1.0);
+            CATCH_REQUIRE(delay <= 20.0);
+            CATCH_REQUIRE(delay <= previous * 3.0);
+            reached_cap = reached_cap || delay == 20.0;
+            previous = delay;
+        }
+        CATCH_REQUIRE(reached_cap);
+
+        p.restart();
+        CATCH_REQUIRE(p.get_next_delay() <= 3.0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("pause_durations: jitter from a string")
+    {
+        ed::pause_durations p("jitter:2s:10s");
+        CATCH_REQUIRE(p.is_jittered());
+        for(int i(0); i < 100; ++i)
+        {
+            double const delay(p.get_next_delay());
+            CATCH_REQUIRE(delay >= 2.0);
+            CATCH_REQUIRE(delay <= 10.0);
+        }
+
+        ed::pause_durations d("jitter");
+        CATCH_REQUIRE(d.is_jittered());
+        CATCH_REQUIRE(d.get_next_delay() <= 3.0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("pause_durations: reconnect rate limit")
+    {
+        CATCH_REQUIRE(ed::pause_durations::acquire_reconnect_token(1'000'000) == 0);
+
+        ed::pause_durations::set_reconnect_rate_limit(10.0, 2.0);
+        CATCH_REQUIRE(ed::pause_durations::get_reconnect_rate_limit() == 10.0);
+
+        // the burst goes through, then one token every 100ms
+        //
+        CATCH_REQUIRE(ed::pause_durations::acquire_reconnect_token(1'000'000) == 0);
+        CATCH_REQUIRE(ed::pause_durations::acquire_reconnect_token(1'000'000) == 0);
+        CATCH_REQUIRE(ed::pause_durations::acquire_reconnect_token(1'000'000) == 1'100'000);
+        CATCH_REQUIRE(ed::pause_durations::acquire_reconnect_token(1'050'000) == 1'100'000);
+        CATCH_REQUIRE(ed::pause_durations::acquire_reconnect_token(1'100'000) == 0);
+
+        ed::pause_durations::set_reconnect_rate_limit(0.0, 1.0);
+        CATCH_REQUIRE(ed::pause_durations::acquire_reconnect_token(1'100'000) == 0);
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("pause_durations_errors", "[pause_durations][error]")
+{
+    CATCH_START_SECTION("pause_durations_errors: invalid jitter")
+    {
+        CATCH_REQUIRE_THROWS_MATCHES(
+              ed::pause_durations(5, 1'000'000)
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage(
+                  "event_dispatcher_exception: the jitter base pause (5us) must be at least 10us."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+              ed::pause_durations(1'000'000, 999'999)
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage(
+                  "event_dispatcher_exception: the jitter cap (999999us) cannot be smaller than the base (1000000us)."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+              ed::pause_durations("jitter:5s:1s")
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage(
+                  "event_dispatcher_exception: the jitter cap in \"jitter:5s:1s\" cannot be smaller than the base."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+              ed::pause_durations("jitter:1s:2s:3s")
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage(
+                  "event_dispatcher_exception: jitter pause \"jitter:1s:2s:3s\" is not valid, expected \"jitter[:<base>[:<cap>]]\"."));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("pause_durations_errors: invalid rate limit")
+    {
+        CATCH_REQUIRE_THROWS_MATCHES(
+              ed::pause_durations::set_reconnect_rate_limit(-1.0, 1.0)
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage(
+                  "event_dispatcher_exception: the reconnect rate limit cannot be negative."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+              ed::pause_durations::set_reconnect_rate_limit(10.0, 0.5)
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage(
+                  "event_dispatcher_exception: the reconnect burst must be at least 1."));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
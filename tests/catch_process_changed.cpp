@@ -0,0 +1,301 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// test standalone header
+//
+#include    <eventdispatcher/process_changed.h>
+
+
+// self
+//
+#include    "catch_main.h"
+
+
+// C
+//
+#include    <linux/cn_proc.h>
+#include    <linux/connector.h>
+#include    <linux/netlink.h>
+#include    <linux/version.h>
+#include    <string.h>
+#include    <sys/socket.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+// in newer versions of Linux the PROC_EVENT_... are not defined inside the
+// proc_event structure
+//
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,1)
+#define proc_event_namespace
+#else
+#define proc_event_namespace proc_event::
+#endif
+
+
+
+namespace
+{
+
+
+
+// a netlink message as sent by the proc connector
+//
+std::vector<char> make_packet(
+      proc_event const & event
+    , std::uint16_t type = NLMSG_DONE
+    , std::uint32_t idx = CN_IDX_PROC)
+{
+    std::vector<char> packet(NLMSG_HDRLEN + sizeof(cn_msg) + sizeof(proc_event));
+
+    nlmsghdr header = {};
+    header.nlmsg_len = static_cast<std::uint32_t>(packet.size());
+    header.nlmsg_type = type;
+    memcpy(packet.data(), &header, sizeof(header));
+
+    cn_msg msg = {};
+    msg.id.idx = idx;
+    msg.id.val = CN_VAL_PROC;
+    msg.len = sizeof(proc_event);
+    memcpy(packet.data() + NLMSG_HDRLEN, &msg, sizeof(msg));
+
+    memcpy(packet.data() + NLMSG_HDRLEN + sizeof(cn_msg), &event, sizeof(event));
+
+    return packet;
+}
+
+
+proc_event fork_event(pid_t parent, pid_t child)
+{
+    proc_event event = {};
+    event.what = proc_event_namespace PROC_EVENT_FORK;
+    event.event_data.fork.parent_pid = parent;
+    event.event_data.fork.parent_tgid = parent;
+    event.event_data.fork.child_pid = child;
+    event.event_data.fork.child_tgid = child;
+    return event;
+}
+
+
+proc_event exec_event(pid_t pid)
+{
+    proc_event event = {};
+    event.what = proc_event_namespace PROC_EVENT_EXEC;
+    event.event_data.exec.process_pid = pid;
+    event.event_data.exec.process_tgid = pid;
+    return event;
+}
+
+
+proc_event exit_event(pid_t pid, pid_t tgid)
+{
+    proc_event event = {};
+    event.what = proc_event_namespace PROC_EVENT_EXIT;
+    event.event_data.exit.process_pid = pid;
+    event.event_data.exit.process_tgid = tgid;
+    return event;
+}
+
+
+proc_event uid_event(pid_t pid, uid_t ruid, uid_t euid)
+{
+    proc_event event = {};
+    event.what = proc_event_namespace PROC_EVENT_UID;
+    event.event_data.id.process_pid = pid;
+    event.event_data.id.process_tgid = pid;
+    event.event_data.id.r.ruid = ruid;
+    event.event_data.id.e.euid = euid;
+    return event;
+}
+
+
+proc_event ack_event()
+{
+    proc_event event = {};
+    event.what = proc_event_namespace PROC_EVENT_NONE;
+    return event;
+}
+
+
+// let the kernel run the program: the packet is received only if the
+// filter accepted it
+//
+bool accepted(
+      std::vector<sock_filter> & program
+    , std::vector<char> const & packet)
+{
+    int fds[2];
+    CATCH_REQUIRE(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds) == 0);
+
+    sock_fprog fprog = {};
+    fprog.len = static_cast<unsigned short>(program.size());
+    fprog.filter = program.data();
+    CATCH_REQUIRE(setsockopt(fds[1], SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == 0);
+
+    CATCH_REQUIRE(send(fds[0], packet.data(), packet.size(), 0) == static_cast<ssize_t>(packet.size()));
+
+    char buf[1024];
+    ssize_t const r(recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT));
+    int const e(errno);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    if(r < 0)
+    {
+        CATCH_REQUIRE(e == EAGAIN);
+        return false;
+    }
+    CATCH_REQUIRE(r == static_cast<ssize_t>(packet.size()));
+    return true;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("process_changed_filter", "[process_changed]")
+{
+    CATCH_START_SECTION("process_changed_filter: no filters, no program")
+    {
+        CATCH_REQUIRE(ed::detail::build_process_filter(
+                  ed::process_event_set_t()
+                , ed::pid_set_t()
+                , snapdev::NO_UID).empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("process_changed_filter: event types")
+    {
+        std::vector<sock_filter> program(ed::detail::build_process_filter(
+                  { ed::process_event_t::PROCESS_EVENT_FORK, ed::process_event_t::PROCESS_EVENT_EXIT }
+                , ed::pid_set_t()
+                , snapdev::NO_UID));
+        CATCH_REQUIRE_FALSE(program.empty());
+
+        CATCH_REQUIRE(accepted(program, make_packet(fork_event(100, 101))));
+        CATCH_REQUIRE(accepted(program, make_packet(exit_event(101, 101))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(exec_event(101))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(uid_event(101, 0, 0))));
+
+        // acknowledgements and other messages always go through
+        //
+        CATCH_REQUIRE(accepted(program, make_packet(ack_event())));
+        CATCH_REQUIRE(accepted(program, make_packet(exec_event(101), NLMSG_ERROR)));
+        CATCH_REQUIRE(accepted(program, make_packet(exec_event(101), NLMSG_DONE, CN_IDX_PROC + 1)));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("process_changed_filter: unknown events cannot be filtered by the kernel")
+    {
+        std::vector<sock_filter> program(ed::detail::build_process_filter(
+                  { ed::process_event_t::PROCESS_EVENT_EXEC, ed::process_event_t::PROCESS_EVENT_UNKNOWN }
+                , ed::pid_set_t()
+                , snapdev::NO_UID));
+
+        CATCH_REQUIRE(accepted(program, make_packet(exec_event(101))));
+        CATCH_REQUIRE(accepted(program, make_packet(fork_event(100, 101))));
+        CATCH_REQUIRE(accepted(program, make_packet(exit_event(101, 101))));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("process_changed_filter: process identifiers")
+    {
+        std::vector<sock_filter> program(ed::detail::build_process_filter(
+                  ed::process_event_set_t()
+                , { 1234, 5678 }
+                , snapdev::NO_UID));
+
+        // a fork matches the parent or the child
+        //
+        CATCH_REQUIRE(accepted(program, make_packet(fork_event(1234, 999))));
+        CATCH_REQUIRE(accepted(program, make_packet(fork_event(999, 5678))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(fork_event(998, 999))));
+
+        // the other events match the process or its thread group
+        //
+        CATCH_REQUIRE(accepted(program, make_packet(exec_event(5678))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(exec_event(999))));
+        CATCH_REQUIRE(accepted(program, make_packet(exit_event(999, 1234))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(exit_event(999, 998))));
+
+        CATCH_REQUIRE(accepted(program, make_packet(ack_event())));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("process_changed_filter: event types and process identifiers")
+    {
+        std::vector<sock_filter> program(ed::detail::build_process_filter(
+                  { ed::process_event_t::PROCESS_EVENT_EXEC }
+                , { 1234 }
+                , snapdev::NO_UID));
+
+        CATCH_REQUIRE(accepted(program, make_packet(exec_event(1234))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(exec_event(999))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(exit_event(1234, 1234))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(fork_event(1234, 999))));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("process_changed_filter: too many process identifiers are checked in user space")
+    {
+        ed::pid_set_t pids;
+        for(pid_t pid(10'000); pid < 10'500; ++pid)
+        {
+            pids.insert(pid);
+        }
+        std::vector<sock_filter> program(ed::detail::build_process_filter(
+                  { ed::process_event_t::PROCESS_EVENT_EXEC }
+                , pids
+                , snapdev::NO_UID));
+        CATCH_REQUIRE(program.size() < BPF_MAXINSNS);
+
+        CATCH_REQUIRE(accepted(program, make_packet(exec_event(999))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(exit_event(10'000, 10'000))));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("process_changed_filter: user identifier")
+    {
+        std::vector<sock_filter> program(ed::detail::build_process_filter(
+                  ed::process_event_set_t()
+                , ed::pid_set_t()
+                , 1000));
+
+        CATCH_REQUIRE(accepted(program, make_packet(uid_event(999, 1000, 0))));
+        CATCH_REQUIRE(accepted(program, make_packet(uid_event(999, 0, 1000))));
+        CATCH_REQUIRE_FALSE(accepted(program, make_packet(uid_event(999, 0, 0))));
+
+        // the other events are not affected by the UID
+        //
+        CATCH_REQUIRE(accepted(program, make_packet(exec_event(999))));
+        CATCH_REQUIRE(accepted(program, make_packet(fork_event(998, 999))));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
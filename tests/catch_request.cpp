@@ -0,0 +1,239 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/connection_with_send_message.h>
+#include    <eventdispatcher/dispatcher_support.h>
+#include    <eventdispatcher/timer.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+// a connection without a socket which saves the messages it sends and
+// the messages it does not dispatch
+//
+class request_connection
+    : public ed::timer
+    , public ed::connection_with_send_message
+    , public ed::dispatcher_support
+{
+public:
+    typedef std::shared_ptr<request_connection>    pointer_t;
+
+    request_connection()
+        : timer(-1)
+    {
+        set_name("request_connection");
+    }
+
+    virtual bool send_message(ed::message & msg, bool cache) override
+    {
+        snapdev::NOT_USED(cache);
+        f_sent.push_back(msg);
+        return true;
+    }
+
+    virtual void process_message(ed::message & msg) override
+    {
+        f_received.push_back(msg);
+    }
+
+    ed::message::vector_t       f_sent = ed::message::vector_t();
+    ed::message::vector_t       f_received = ed::message::vector_t();
+};
+
+
+struct request_result
+{
+    void callback(ed::request_status_t status, ed::message & msg)
+    {
+        ++f_count;
+        f_status = status;
+        f_message = msg;
+    }
+
+    ed::connection_with_send_message::request_callback_t get_callback()
+    {
+        return std::bind(&request_result::callback, this, std::placeholders::_1, std::placeholders::_2);
+    }
+
+    int                         f_count = 0;
+    ed::request_status_t        f_status = ed::request_status_t::REQUEST_STATUS_CANCELED;
+    ed::message                 f_message = ed::message();
+};
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("request", "[request]")
+{
+    CATCH_START_SECTION("request: reply matched with reply_to")
+    {
+        request_connection::pointer_t c(std::make_shared<request_connection>());
+        request_result result;
+
+        ed::message ping;
+        ping.set_command("PING");
+        ed::connection_with_send_message::serial_t const serial(c->send_request(ping, result.get_callback(), -1));
+        CATCH_REQUIRE(serial != 0);
+        CATCH_REQUIRE(c->get_requests_in_flight() == 1);
+        CATCH_REQUIRE(c->f_sent.size() == 1);
+        CATCH_REQUIRE(c->f_sent[0].get_integer_parameter("serial") == serial);
+
+        ed::message pong;
+        pong.set_command("PONG");
+        ed::connection_with_send_message::mark_reply(pong, c->f_sent[0]);
+        CATCH_REQUIRE(pong.get_integer_parameter("reply_to") == serial);
+        CATCH_REQUIRE(c->dispatch_message(pong));
+
+        CATCH_REQUIRE(result.f_count == 1);
+        CATCH_REQUIRE(result.f_status == ed::request_status_t::REQUEST_STATUS_REPLIED);
+        CATCH_REQUIRE(result.f_message.get_command() == "PONG");
+        CATCH_REQUIRE(c->get_requests_in_flight() == 0);
+        CATCH_REQUIRE(c->f_received.empty());
+
+        ed::connection_with_send_message::request_stats_map_t const & stats(c->get_request_stats());
+        auto const it(stats.find("PING"));
+        CATCH_REQUIRE(it != stats.end());
+        CATCH_REQUIRE(it->second.f_sent == 1);
+        CATCH_REQUIRE(it->second.f_replied == 1);
+        CATCH_REQUIRE(it->second.f_in_flight == 0);
+
+        // a second reply is not a reply anymore
+        //
+        CATCH_REQUIRE_FALSE(c->dispatch_message(pong));
+        CATCH_REQUIRE(result.f_count == 1);
+        CATCH_REQUIRE(c->f_received.size() == 1);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("request: peer request using the same serial is dispatched")
+    {
+        request_connection::pointer_t c(std::make_shared<request_connection>());
+        request_result result;
+
+        ed::message ping;
+        ping.set_command("PING");
+        ed::connection_with_send_message::serial_t const serial(c->send_request(ping, result.get_callback(), -1));
+        CATCH_REQUIRE(serial == 1);
+
+        // the peer numbers its own requests from 1 too
+        //
+        ed::message peer_request;
+        peer_request.set_command("STATUS");
+        peer_request.add_parameter("serial", serial);
+        CATCH_REQUIRE_FALSE(c->dispatch_message(peer_request));
+
+        CATCH_REQUIRE(result.f_count == 0);
+        CATCH_REQUIRE(c->get_requests_in_flight() == 1);
+        CATCH_REQUIRE(c->f_received.size() == 1);
+        CATCH_REQUIRE(c->f_received[0].get_command() == "STATUS");
+
+        // our reply to the peer carries its serial in "reply_to"
+        //
+        ed::message alive;
+        alive.set_command("ALIVE");
+        alive.add_parameter("serial", 1);
+        c->msg_alive(alive);
+        CATCH_REQUIRE(c->f_sent.size() == 2);
+        CATCH_REQUIRE(c->f_sent[1].get_command() == "ABSOLUTELY");
+        CATCH_REQUIRE(c->f_sent[1].get_integer_parameter("reply_to") == 1);
+
+        c->cancel_requests();
+        CATCH_REQUIRE(result.f_count == 1);
+        CATCH_REQUIRE(result.f_status == ed::request_status_t::REQUEST_STATUS_CANCELED);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("request: timeout")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+        request_connection::pointer_t c(std::make_shared<request_connection>());
+        request_result result;
+
+        ed::message ping;
+        ping.set_command("PING");
+        CATCH_REQUIRE(c->send_request(ping, result.get_callback(), 50'000) != 0);
+        CATCH_REQUIRE(result.f_count == 0);
+
+        // the request timer is the only connection
+        //
+        communicator->run();
+
+        CATCH_REQUIRE(result.f_count == 1);
+        CATCH_REQUIRE(result.f_status == ed::request_status_t::REQUEST_STATUS_TIMEOUT);
+        CATCH_REQUIRE(result.f_message.get_command() == "PING");
+        CATCH_REQUIRE(c->get_requests_in_flight() == 0);
+        CATCH_REQUIRE(c->get_request_stats().at("PING").f_timed_out == 1);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("request: cancel on remove is deferred")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+        request_connection::pointer_t c(std::make_shared<request_connection>());
+        request_result result;
+
+        CATCH_REQUIRE(communicator->add_connection(c));
+
+        ed::message ping;
+        ping.set_command("PING");
+        CATCH_REQUIRE(c->send_request(ping, result.get_callback(), -1) != 0);
+
+        CATCH_REQUIRE(communicator->remove_connection(c));
+
+        // the callback does not run from within remove_connection()
+        //
+        CATCH_REQUIRE(result.f_count == 0);
+        CATCH_REQUIRE(c->get_requests_in_flight() == 0);
+        CATCH_REQUIRE(c->get_request_stats().at("PING").f_canceled == 1);
+
+        // the connection can go away before the loop runs
+        //
+        c.reset();
+        communicator->run();
+
+        CATCH_REQUIRE(result.f_count == 1);
+        CATCH_REQUIRE(result.f_status == ed::request_status_t::REQUEST_STATUS_CANCELED);
+        CATCH_REQUIRE(result.f_message.get_command() == "PING");
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,201 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// test standalone header
+//
+#include    <eventdispatcher/signal_child.h>
+
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/exception.h>
+
+
+// C
+//
+#include    <signal.h>
+#include    <sys/wait.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+// the child blocks on a pipe until the parent closes it, so the listener
+// is always registered before the child exits
+//
+pid_t start_child(int & release, int exit_code)
+{
+    int fds[2];
+    CATCH_REQUIRE(pipe(fds) == 0);
+
+    pid_t const child(fork());
+    CATCH_REQUIRE(child != -1);
+    if(child == 0)
+    {
+        close(fds[1]);
+        char c;
+        while(read(fds[0], &c, 1) > 0);
+        _exit(exit_code);
+    }
+
+    close(fds[0]);
+    release = fds[1];
+    return child;
+}
+
+
+struct child_result
+{
+    void callback(ed::child_status const & status)
+    {
+        ++f_count;
+        f_pid = status.child_pid();
+        f_exited = status.is_exited();
+        f_signaled = status.is_signaled();
+        f_exit_code = status.is_exited() ? status.exit_code() : -1;
+        f_signal = status.is_signaled() ? status.terminate_signal() : -1;
+    }
+
+    ed::signal_child::func_t get_callback()
+    {
+        return std::bind(&child_result::callback, this, std::placeholders::_1);
+    }
+
+    int                         f_count = 0;
+    pid_t                       f_pid = 0;
+    bool                        f_exited = false;
+    bool                        f_signaled = false;
+    int                         f_exit_code = -1;
+    int                         f_signal = -1;
+};
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("signal_child_pidfd", "[signal_child]")
+{
+    if(!ed::signal_child::is_pidfd_supported())
+    {
+        CATCH_WARN("pidfd_open() is not supported, skipping the pidfd mode tests.");
+        return;
+    }
+
+    CATCH_START_SECTION("signal_child_pidfd: child exit is reported and reaped")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+        ed::signal_child::pointer_t sc(ed::signal_child::get_instance());
+        sc->set_pidfd_mode(true);
+        CATCH_REQUIRE(sc->get_pidfd_mode());
+
+        int release(-1);
+        pid_t const child(start_child(release, 7));
+
+        child_result result;
+        sc->add_listener(child, result.get_callback());
+
+        // let the child exit, the pidfd connection is the only connection
+        // so run() returns once the child was processed
+        //
+        close(release);
+        communicator->run();
+
+        CATCH_REQUIRE(result.f_count == 1);
+        CATCH_REQUIRE(result.f_pid == child);
+        CATCH_REQUIRE(result.f_exited);
+        CATCH_REQUIRE_FALSE(result.f_signaled);
+        CATCH_REQUIRE(result.f_exit_code == 7);
+
+        // signal_child already released the zombie
+        //
+        int status(0);
+        CATCH_REQUIRE(waitpid(child, &status, WNOHANG) == -1);
+        CATCH_REQUIRE(errno == ECHILD);
+
+        sc->set_pidfd_mode(false);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("signal_child_pidfd: child killed by a signal")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+        ed::signal_child::pointer_t sc(ed::signal_child::get_instance());
+        sc->set_pidfd_mode(true);
+
+        int release(-1);
+        pid_t const child(start_child(release, 0));
+
+        child_result exited;
+        child_result signaled;
+        sc->add_listener(child, exited.get_callback(), ed::SIGNAL_CHILD_FLAG_EXITED);
+        sc->add_listener(child, signaled.get_callback(), ed::SIGNAL_CHILD_FLAG_SIGNALED);
+
+        CATCH_REQUIRE(kill(child, SIGKILL) == 0);
+        communicator->run();
+        close(release);
+
+        CATCH_REQUIRE(exited.f_count == 0);
+        CATCH_REQUIRE(signaled.f_count == 1);
+        CATCH_REQUIRE(signaled.f_pid == child);
+        CATCH_REQUIRE(signaled.f_signaled);
+        CATCH_REQUIRE(signaled.f_signal == SIGKILL);
+
+        int status(0);
+        CATCH_REQUIRE(waitpid(child, &status, WNOHANG) == -1);
+        CATCH_REQUIRE(errno == ECHILD);
+
+        sc->set_pidfd_mode(false);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("signal_child_pidfd: stopped and continued are not supported")
+    {
+        ed::signal_child::pointer_t sc(ed::signal_child::get_instance());
+        sc->set_pidfd_mode(true);
+
+        child_result result;
+        CATCH_REQUIRE_THROWS_MATCHES(
+              sc->add_listener(getpid(), result.get_callback(), ed::SIGNAL_CHILD_FLAG_STOPPED)
+            , ed::invalid_parameter
+            , Catch::Matchers::ExceptionMessage("event_dispatcher_exception: the stopped and continued flags are not supported in pidfd mode."));
+
+        sc->set_pidfd_mode(false);
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
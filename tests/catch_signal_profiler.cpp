@@ -0,0 +1,171 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/callback_context.h>
+#include    <eventdispatcher/exception.h>
+#include    <eventdispatcher/signal_profiler.h>
+#include    <eventdispatcher/utils.h>
+
+
+// C++
+//
+#include    <fstream>
+
+
+// C
+//
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+
+namespace
+{
+
+
+/** \brief Burn some CPU so the profiling timer expires.
+ */
+std::uint64_t spin(std::int64_t duration)
+{
+    std::uint64_t result(0);
+    std::int64_t const end(ed::get_current_date() + duration);
+    while(ed::get_current_date() < end)
+    {
+        for(int idx(0); idx < 1'000; ++idx)
+        {
+            result = result * 31 + idx;
+        }
+    }
+    return result;
+}
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("signal_profiler", "[profiler]")
+{
+    CATCH_START_SECTION("signal_profiler: samples are tagged and collapsed")
+    {
+        std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("profiler"));
+        std::string const filename(dir + "/profile.folded");
+        unlink(filename.c_str());
+
+        ed::signal_profiler::pointer_t profiler(std::make_shared<ed::signal_profiler>());
+        CATCH_REQUIRE_FALSE(profiler->is_running());
+        CATCH_REQUIRE(profiler->start(1'000, 0, filename));
+        CATCH_REQUIRE(profiler->is_running());
+        CATCH_REQUIRE(ed::signal_profiler::is_profiling());
+        CATCH_REQUIRE_FALSE(std::make_shared<ed::signal_profiler>()->start());
+
+        std::string const command("SPIN");
+        {
+            ed::command_guard cmd(command);
+            spin(200'000);
+        }
+
+        profiler->stop();
+        CATCH_REQUIRE_FALSE(profiler->is_running());
+        CATCH_REQUIRE_FALSE(ed::signal_profiler::is_profiling());
+        CATCH_REQUIRE(profiler->get_samples() > 0);
+
+        std::string const stacks(profiler->get_collapsed_stacks());
+        CATCH_REQUIRE(stacks.find("[connection:none];[command:SPIN];") != std::string::npos);
+
+        std::ifstream in(filename);
+        std::string const saved((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        CATCH_REQUIRE(saved == stacks);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("signal_profiler: invalid parameters")
+    {
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  ed::signal_profiler(1'000)
+                , ed::invalid_parameter
+                , Catch::Matchers::ExceptionMessage(
+                          "event_dispatcher_exception: the signal_profiler ring size must be a power of 2."));
+
+        ed::signal_profiler::pointer_t profiler(std::make_shared<ed::signal_profiler>());
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  profiler->start(0)
+                , ed::invalid_parameter
+                , Catch::Matchers::ExceptionMessage(
+                          "event_dispatcher_exception: the signal_profiler frequency must be between 1 and 10000."));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("signal_profiler: output file is never overwritten")
+    {
+        std::string const dir(SNAP_CATCH2_NAMESPACE::get_tmp_dir("profiler"));
+        std::string const filename(dir + "/new.folded");
+        std::string const existing(dir + "/existing.folded");
+        std::string const target(dir + "/target");
+        std::string const link(dir + "/link.folded");
+        unlink(filename.c_str());
+        unlink(existing.c_str());
+        unlink(target.c_str());
+        unlink(link.c_str());
+
+        ed::signal_profiler::pointer_t profiler(std::make_shared<ed::signal_profiler>());
+
+        // a new file gets created, only readable by the owner
+        //
+        CATCH_REQUIRE(profiler->write_collapsed_stacks(filename));
+        struct stat st;
+        CATCH_REQUIRE(lstat(filename.c_str(), &st) == 0);
+        CATCH_REQUIRE((st.st_mode & 0777) == 0600);
+
+        // an existing file is not overwritten
+        //
+        {
+            std::ofstream out(existing);
+            out << "keep\n";
+        }
+        CATCH_REQUIRE_FALSE(profiler->write_collapsed_stacks(existing));
+
+        // a symbolic link is not followed
+        //
+        CATCH_REQUIRE(symlink(target.c_str(), link.c_str()) == 0);
+        CATCH_REQUIRE_FALSE(profiler->write_collapsed_stacks(link));
+        CATCH_REQUIRE(access(target.c_str(), F_OK) != 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("signal_profiler: profile directory")
+    {
+        CATCH_REQUIRE(ed::signal_profiler::get_profile_directory().empty());
+        ed::signal_profiler::set_profile_directory("/var/lib/service/profiles//");
+        CATCH_REQUIRE(ed::signal_profiler::get_profile_directory() == "/var/lib/service/profiles");
+        ed::signal_profiler::set_profile_directory(std::string());
+        CATCH_REQUIRE(ed::signal_profiler::get_profile_directory().empty());
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,137 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/exception.h>
+#include    <eventdispatcher/stall_detector.h>
+#include    <eventdispatcher/timer.h>
+#include    <eventdispatcher/utils.h>
+
+
+// C++
+//
+#include    <atomic>
+
+
+// C
+//
+#include    <pthread.h>
+#include    <unistd.h>
+
+
+
+namespace
+{
+
+
+class test_detector
+    : public ed::stall_detector
+{
+public:
+    test_detector()
+        : stall_detector(10'000)
+    {
+    }
+
+    // called from the monitor thread
+    //
+    virtual void process_stall(ed::stall_report_t const & report) override
+    {
+        f_report = report;
+        f_reports.fetch_add(1, std::memory_order_release);
+    }
+
+    ed::stall_report_t  f_report = ed::stall_report_t();
+    std::atomic<int>    f_reports = 0;
+};
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("stall_detector", "[stall]")
+{
+    CATCH_START_SECTION("stall_detector: report a stalled callback")
+    {
+        test_detector detector;
+        detector.start();
+        CATCH_REQUIRE(detector.is_running());
+
+        ed::timer::pointer_t t(std::make_shared<ed::timer>(-1));
+        t->set_name("slow_timer");
+        std::string const command("SLOW");
+        {
+            ed::callback_guard callback(t.get(), ed::get_current_date());
+            ed::command_guard cmd(command);
+
+            // the signal interrupts usleep() so loop until reported
+            //
+            for(int count(0); count < 100 && detector.f_reports.load(std::memory_order_acquire) == 0; ++count)
+            {
+                usleep(10'000);
+            }
+        }
+
+        detector.stop();
+        CATCH_REQUIRE_FALSE(detector.is_running());
+        CATCH_REQUIRE(detector.f_reports == 1);
+        CATCH_REQUIRE(detector.get_stall_count() == 1);
+        CATCH_REQUIRE(detector.f_report.f_connection_name == "slow_timer");
+        CATCH_REQUIRE(detector.f_report.f_command == "SLOW");
+        CATCH_REQUIRE(detector.f_report.f_duration >= 10'000);
+        CATCH_REQUIRE_FALSE(detector.f_report.f_stack_trace.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("stall_detector: foreign signal is ignored")
+    {
+        test_detector detector;
+        detector.start();
+
+        // no stall pending, the signal was not sent by the detector
+        // and must not terminate the process
+        //
+        pthread_kill(pthread_self(), detector.get_signal());
+
+        detector.stop();
+        CATCH_REQUIRE(detector.f_reports == 0);
+        CATCH_REQUIRE(detector.get_stall_count() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("stall_detector: invalid threshold")
+    {
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  ed::stall_detector(999)
+                , ed::invalid_parameter
+                , Catch::Matchers::ExceptionMessage(
+                          "event_dispatcher_exception: the stall_detector threshold must be at least 1ms."));
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
@@ -30,10 +30,13 @@
 //
 #include    <eventdispatcher/communicator.h>
 #include    <eventdispatcher/dispatcher.h>
+#include    <eventdispatcher/metrics.h>
+#include    <eventdispatcher/utils.h>
 
 
 // C
 //
+#include    <poll.h>
 #include    <unistd.h>
 
 
@@ -151,6 +154,36 @@ bool timer_test::get_expect_remove() const
 
 
 
+// timer recording the date when it timed out
+//
+class slack_timer
+    : public ed::timer
+{
+public:
+    typedef std::shared_ptr<slack_timer>        pointer_t;
+
+                    slack_timer(std::int64_t date, std::int64_t slack)
+                        : timer(-1)
+                    {
+                        set_name("slack-timer");
+                        set_timeout_date(date);
+                        set_timeout_slack(slack);
+                    }
+
+    virtual void    process_timeout() override
+                    {
+                        f_fired = ed::get_current_date();
+                        remove_from_communicator();
+                    }
+
+    std::int64_t    get_fired() const { return f_fired; }
+
+private:
+    std::int64_t    f_fired = -1;
+};
+
+
+
 } // no name namespace
 
 
@@ -293,6 +326,69 @@ CATCH_TEST_CASE("timer", "[timer]")
     }
     CATCH_END_SECTION()
 
+    CATCH_START_SECTION("timer: slack coalesces timeouts")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+        ed::metrics_counter & saved(ed::metrics::instance().get_counter("ed_loop_timer_wakeups_saved_total"));
+        std::uint64_t const saved_before(saved.get_value());
+
+        // the first timer can wait until the second one is due
+        //
+        std::int64_t const now(ed::get_current_date());
+        slack_timer::pointer_t early(std::make_shared<slack_timer>(now + 20'000, 200'000));
+        slack_timer::pointer_t late(std::make_shared<slack_timer>(now + 60'000, 0));
+        CATCH_REQUIRE(early->get_timeout_slack() == 200'000);
+        CATCH_REQUIRE(late->get_timeout_slack() == 0);
+
+        CATCH_REQUIRE(communicator->add_connection(early));
+        CATCH_REQUIRE(communicator->add_connection(late));
+        communicator->run();
+
+        CATCH_REQUIRE(early->get_fired() >= now + 60'000);
+        CATCH_REQUIRE(late->get_fired() >= now + 60'000);
+        CATCH_REQUIRE(saved.get_value() == saved_before + 1);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timer: driven by process_events()")
+    {
+        ed::communicator::pointer_t communicator(ed::communicator::instance());
+
+        // an external loop waits on the poll fd with the poll timeout
+        //
+        std::int64_t const now(ed::get_current_date());
+        slack_timer::pointer_t t(std::make_shared<slack_timer>(now + 50'000, 0));
+        CATCH_REQUIRE(communicator->add_connection(t));
+
+        int const fd(communicator->get_poll_fd());
+        CATCH_REQUIRE(fd >= 0);
+        CATCH_REQUIRE(communicator->get_poll_fd() == fd);
+
+        CATCH_REQUIRE(communicator->process_events());
+        CATCH_REQUIRE(t->get_fired() == -1);
+        CATCH_REQUIRE(communicator->get_poll_timeout() > 0);
+        CATCH_REQUIRE(communicator->get_poll_timeout() <= 50);
+
+        int loops(0);
+        for(;;)
+        {
+            struct pollfd p = {};
+            p.fd = fd;
+            p.events = POLLIN;
+            poll(&p, 1, communicator->get_poll_timeout());
+            ++loops;
+            if(!communicator->process_events())
+            {
+                break;
+            }
+            CATCH_REQUIRE(loops < 100);
+        }
+
+        CATCH_REQUIRE(t->get_fired() >= now + 50'000);
+        CATCH_REQUIRE(communicator->get_poll_timeout() == -1);
+    }
+    CATCH_END_SECTION()
+
     CATCH_START_SECTION("timer: add connection, remove on process_hup()")
     {
         ed::communicator::pointer_t communicator(ed::communicator::instance());
@@ -388,6 +484,22 @@ CATCH_TEST_CASE("timer_errors", "[timer][error]")
     }
     CATCH_END_SECTION()
 
+    CATCH_START_SECTION("timer_errors: invalid timeout slack (negative)")
+    {
+        timer_test::pointer_t t(std::make_shared<timer_test>());
+        for(std::int64_t us(-100); us < 0; ++us)
+        {
+            CATCH_REQUIRE_THROWS_MATCHES(
+                  t->set_timeout_slack(us)
+                , ed::parameter_error
+                , Catch::Matchers::ExceptionMessage(
+                      "parameter_error: connection::set_timeout_slack(): slack_us parameter cannot be negative, "
+                    + std::to_string(us)
+                    + " is not valid."));
+        }
+    }
+    CATCH_END_SECTION()
+
     CATCH_START_SECTION("timer_errors: invalid timeout date (too small)")
     {
         timer_test::pointer_t t(std::make_shared<timer_test>());
@@ -120,20 +120,79 @@ void process_listener::process_event(ed::process_changed_event const & event)
 
 int main(int argc, char * argv[])
 {
-    if(argc > 1)
+    ed::process_event_set_t events;
+    ed::pid_set_t pids;
+    uid_t uid(snapdev::NO_UID);
+    for(int i(1); i < argc; ++i)
     {
-        if(strcmp(argv[1], "--help") == 0
-        || strcmp(argv[1], "-h") == 0)
+        if(strcmp(argv[i], "--help") == 0
+        || strcmp(argv[i], "-h") == 0)
         {
-            std::cout << "Usage: process-listener\n";
+            std::cout << "Usage: process-listener [--event <name>]... [--pid <pid>]... [--uid <uid>]\n"
+                         "where <name> is one of FORK, EXEC, UID, GID, SESSION, PTRACE, COMMAND, COREDUMP, EXIT\n";
             return 1;
         }
 
-        std::cerr << "error: no command line parameters are supported.\n";
-        return 1;
+        if(i + 1 >= argc)
+        {
+            std::cerr << "error: unknown command line parameter \"" << argv[i] << "\" or missing value.\n";
+            return 1;
+        }
+
+        if(strcmp(argv[i], "--event") == 0)
+        {
+            ++i;
+            bool found(false);
+            for(int e(static_cast<int>(ed::process_event_t::PROCESS_EVENT_FORK));
+                    e <= static_cast<int>(ed::process_event_t::PROCESS_EVENT_EXIT);
+                    ++e)
+            {
+                ed::process_event_t const event(static_cast<ed::process_event_t>(e));
+                if(strcmp(argv[i], ed::process_event_to_string(event)) == 0)
+                {
+                    events.insert(event);
+                    found = true;
+                    break;
+                }
+            }
+            if(!found)
+            {
+                std::cerr << "error: unknown event \"" << argv[i] << "\".\n";
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--pid") == 0)
+        {
+            ++i;
+            pids.insert(atoi(argv[i]));
+        }
+        else if(strcmp(argv[i], "--uid") == 0)
+        {
+            ++i;
+            uid = atoi(argv[i]);
+        }
+        else
+        {
+            std::cerr << "error: unknown command line parameter \"" << argv[i] << "\".\n";
+            return 1;
+        }
     }
 
     process_listener::pointer_t listen(std::make_shared<process_listener>());
+    listen->set_event_filter(events);
+    for(auto const pid : pids)
+    {
+        listen->add_pid_filter(pid);
+    }
+    listen->set_uid_filter(uid);
+    if(!events.empty()
+    || !pids.empty()
+    || uid != snapdev::NO_UID)
+    {
+        std::cout << "--- filtering "
+            << (listen->has_kernel_filter() ? "in the kernel" : "in user space")
+            << "\n";
+    }
 
     ed::communicator::pointer_t communicator(ed::communicator::instance());
     communicator->add_connection(listen);
@@ -0,0 +1,1055 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Tool used to generate load against a service.
+ *
+ * This tool opens any number of connections to a service and sends
+ * messages at a fixed rate. The rate is open loop: the messages are
+ * sent on schedule whether or not the service answered the previous
+ * ones. The connections can be opened gradually with the --ramp-up
+ * option.
+ *
+ * Basic usage example:
+ *
+ * \code
+ *     ed-load --host 127.0.0.1:4040 --connections 2000 --ramp-up 10 --rate 50000 --duration 60 --message 'PING seq=${seq}'
+ *     ed-load --host 10.0.0.1:4041 --tls --script /tmp/messages.txt
+ *     ed-load --unix /run/service/service.sock --rate 1000
+ *     ed-load --udp 127.0.0.1:4042 --rate 10000 --message 'LOG message=load'
+ * \endcode
+ *
+ * The messages are defined by templates. A template is a message in
+ * the string format in which the following variables get replaced:
+ *
+ * \li ${seq} -- the sequence number of the message (0, 1, 2, ...);
+ * \li ${connection} -- the index of the connection used to send it;
+ * \li ${date} -- the current date in microseconds;
+ * \li ${random} -- a random number.
+ *
+ * The --script option reads one template per line (empty lines and
+ * lines starting with '#' are ignored). The templates are used in turn.
+ *
+ * Each message is expected to generate exactly one reply on the same
+ * connection, except with --no-reply and with UDP which never waits
+ * for replies. The latency is measured from the date at which the
+ * message was scheduled to be sent, not the date at which it was
+ * actually sent. That way, a service which stalls gets charged for
+ * all the messages which could not be sent in the meantime, which is
+ * known as the coordinated omission correction. The uncorrected
+ * latencies are reported too.
+ *
+ * At the end, the tool prints a report with the throughput and the
+ * latency percentiles, one "name: value" per line.
+ */
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/local_stream_client_message_connection.h>
+#include    <eventdispatcher/signal_handler.h>
+#include    <eventdispatcher/tcp_client_message_connection.h>
+#include    <eventdispatcher/timer.h>
+#include    <eventdispatcher/udp_server_message_connection.h>
+#include    <eventdispatcher/utils.h>
+#include    <eventdispatcher/version.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/logger.h>
+#include    <snaplogger/message.h>
+#include    <snaplogger/options.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
+#include    <libaddr/addr_unix.h>
+
+
+// advgetopt
+//
+#include    <advgetopt/exception.h>
+#include    <advgetopt/validator_double.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_reached.h>
+#include    <snapdev/not_used.h>
+#include    <snapdev/stringize.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <deque>
+#include    <fstream>
+#include    <iomanip>
+#include    <random>
+
+
+// C
+//
+#include    <sys/resource.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+const advgetopt::option g_options[] =
+{
+    advgetopt::define_option(
+          advgetopt::Name("connections")
+        , advgetopt::ShortName('n')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("number of connections to open.")
+        , advgetopt::DefaultValue("1")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("duration")
+        , advgetopt::ShortName('d')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("number of seconds during which messages are sent, including the ramp up.")
+        , advgetopt::DefaultValue("10")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("host")
+        , advgetopt::ShortName('H')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("the IP address and port of the service (TCP).")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("message")
+        , advgetopt::ShortName('m')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("the template of the message to send; it may include ${seq}, ${connection}, ${date} and ${random}.")
+        , advgetopt::DefaultValue("PING")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("no-reply")
+        , advgetopt::Flags(advgetopt::standalone_command_flags<
+              advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("do not expect a reply to each message.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("ramp-up")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("number of seconds over which the connections get opened.")
+        , advgetopt::DefaultValue("0")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("rate")
+        , advgetopt::ShortName('r')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("number of messages sent per second, over all the connections.")
+        , advgetopt::DefaultValue("100")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("reply-timeout")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("number of seconds to wait for the last replies.")
+        , advgetopt::DefaultValue("5")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("script")
+        , advgetopt::ShortName('s')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("a file with one message template per line; the templates are sent in turn.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("tls")
+        , advgetopt::Flags(advgetopt::standalone_command_flags<
+              advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("use TLS to connect to the --host.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("udp")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("the IP address and port of the service (UDP); no replies are expected.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("unix")
+        , advgetopt::ShortName('u')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("the path to the Unix socket of the service.")
+    ),
+    advgetopt::end_options()
+};
+
+advgetopt::group_description const g_group_descriptions[] =
+{
+    advgetopt::define_group(
+          advgetopt::GroupNumber(advgetopt::GETOPT_FLAG_GROUP_COMMANDS)
+        , advgetopt::GroupName("command")
+        , advgetopt::GroupDescription("Commands:")
+    ),
+    advgetopt::define_group(
+          advgetopt::GroupNumber(advgetopt::GETOPT_FLAG_GROUP_OPTIONS)
+        , advgetopt::GroupName("option")
+        , advgetopt::GroupDescription("Options:")
+    ),
+    advgetopt::end_groups()
+};
+
+advgetopt::options_environment const g_options_environment =
+{
+    .f_project_name = "ed-load",
+    .f_group_name = "eventdispatcher",
+    .f_options = g_options,
+    .f_environment_variable_name = "ED_LOAD",
+    .f_environment_flags = advgetopt::GETOPT_ENVIRONMENT_FLAG_PROCESS_SYSTEM_PARAMETERS,
+    .f_help_header = "Usage: %p [-<opt>]\n"
+                     "where -<opt> is one or more of:",
+    .f_help_footer = "%c",
+    .f_version = EVENTDISPATCHER_VERSION_STRING,
+    .f_license = "GNU GPL v2 or newer",
+    .f_copyright = "Copyright (c) 2012-"
+                   SNAPDEV_STRINGIZE(UTC_BUILD_YEAR)
+                   " by Made to Order Software Corporation -- All Rights Reserved",
+    .f_groups = g_group_descriptions
+};
+
+
+
+constexpr std::size_t const     MAX_BATCH = 1'000;   // messages sent or connections opened per timeout
+
+
+enum class variable_t
+{
+    VARIABLE_NONE,          // literal text
+    VARIABLE_SEQ,
+    VARIABLE_CONNECTION,
+    VARIABLE_DATE,
+    VARIABLE_RANDOM,
+};
+
+
+struct template_part_t
+{
+    variable_t              f_variable = variable_t::VARIABLE_NONE;
+    std::string             f_text = std::string();
+};
+
+
+typedef std::vector<template_part_t>    message_template_t;
+
+
+struct pending_reply_t
+{
+    std::int64_t            f_scheduled_date = 0;   // microseconds
+    std::int64_t            f_sent_date = 0;        // microseconds
+};
+
+
+struct slot_t
+{
+    ed::connection::pointer_t
+                            f_connection = ed::connection::pointer_t();
+    ed::connection_with_send_message *
+                            f_messenger = nullptr;
+    ed::udp_client::pointer_t
+                            f_udp_client = ed::udp_client::pointer_t();
+    std::deque<pending_reply_t>
+                            f_pending = std::deque<pending_reply_t>();
+    bool                    f_open = false;
+};
+
+
+message_template_t parse_template(std::string const & text)
+{
+    message_template_t result;
+    std::string::size_type pos(0);
+    for(;;)
+    {
+        std::string::size_type const start(text.find("${", pos));
+        std::string::size_type const end(start == std::string::npos
+                ? std::string::npos
+                : text.find('}', start + 2));
+        if(end == std::string::npos)
+        {
+            result.push_back({ variable_t::VARIABLE_NONE, text.substr(pos) });
+            return result;
+        }
+        if(start > pos)
+        {
+            result.push_back({ variable_t::VARIABLE_NONE, text.substr(pos, start - pos) });
+        }
+        std::string const name(text.substr(start + 2, end - start - 2));
+        if(name == "seq")
+        {
+            result.push_back({ variable_t::VARIABLE_SEQ, std::string() });
+        }
+        else if(name == "connection")
+        {
+            result.push_back({ variable_t::VARIABLE_CONNECTION, std::string() });
+        }
+        else if(name == "date")
+        {
+            result.push_back({ variable_t::VARIABLE_DATE, std::string() });
+        }
+        else if(name == "random")
+        {
+            result.push_back({ variable_t::VARIABLE_RANDOM, std::string() });
+        }
+        else
+        {
+            throw std::runtime_error("unknown variable \"${" + name + "}\" in message template \"" + text + "\".");
+        }
+        pos = end + 1;
+    }
+}
+
+
+}
+// noname namespace
+
+
+
+class ed_load;
+
+
+template<typename T>
+class load_connection
+    : public T
+{
+public:
+    typedef std::shared_ptr<load_connection<T>>     pointer_t;
+
+    template<typename ... ARGS>
+                                    load_connection(ed_load * parent, std::size_t index, ARGS && ... args)
+                                        : T(std::forward<ARGS>(args)...)
+                                        , f_parent(parent)
+                                        , f_index(index)
+                                    {
+                                        T::set_name("ed_load_" + std::to_string(index));
+                                    }
+
+    // connection implementation
+    virtual void                    process_line(std::string const & line) override;
+    virtual void                    process_error() override;
+    virtual void                    process_hup() override;
+
+private:
+    ed_load *                       f_parent = nullptr;
+    std::size_t                     f_index = 0;
+};
+
+
+class load_timer
+    : public ed::timer
+{
+public:
+    typedef std::shared_ptr<load_timer>     pointer_t;
+
+                                    load_timer(ed_load * parent);
+
+    // ed::connection implementation
+    virtual void                    process_timeout() override;
+
+private:
+    ed_load *                       f_parent = nullptr;
+};
+
+
+class ed_load
+{
+public:
+                                    ed_load(int argc, char * argv[]);
+
+    int                             run();
+    void                            tick();
+    void                            reply_received(std::size_t index);
+    void                            disconnected(std::size_t index);
+
+private:
+    double                          get_double(std::string const & name) const;
+    void                            load_templates();
+    void                            raise_file_limit();
+    void                            open_connection();
+    void                            send_message(std::int64_t scheduled_date);
+    void                            done();
+    void                            report();
+
+    advgetopt::getopt               f_opts;
+    ed::communicator::pointer_t     f_communicator = ed::communicator::pointer_t();
+    load_timer::pointer_t           f_timer = load_timer::pointer_t();
+    std::vector<message_template_t> f_templates = std::vector<message_template_t>();
+    std::vector<slot_t>             f_slots = std::vector<slot_t>();
+    std::vector<std::size_t>        f_open_slots = std::vector<std::size_t>();
+    std::size_t                     f_next_open_slot = 0;
+    std::mt19937_64                 f_random = std::mt19937_64(std::random_device()());
+    addr::addr                      f_address = addr::addr();
+    addr::addr_unix                 f_unix_address = addr::addr_unix();
+    bool                            f_tls = false;
+    bool                            f_udp = false;
+    bool                            f_unix = false;
+    bool                            f_expect_reply = true;
+    double                          f_rate = 100.0;
+    std::int64_t                    f_ramp_up = 0;
+    std::int64_t                    f_duration = 0;
+    std::int64_t                    f_reply_timeout = 5'000'000;
+    std::int64_t                    f_start_date = 0;
+    std::int64_t                    f_end_date = 0;
+    std::uint64_t                   f_sequence = 0;
+    std::size_t                     f_failed_connections = 0;
+    std::size_t                     f_lost_connections = 0;
+    std::size_t                     f_send_errors = 0;
+    std::size_t                     f_replies = 0;
+    std::size_t                     f_unexpected_replies = 0;
+    std::size_t                     f_lost_replies = 0;
+    std::vector<std::int64_t>       f_latencies = std::vector<std::int64_t>();
+    std::vector<std::int64_t>       f_uncorrected_latencies = std::vector<std::int64_t>();
+    bool                            f_sending = true;
+    bool                            f_done = false;
+};
+
+
+
+template<typename T>
+void load_connection<T>::process_line(std::string const & line)
+{
+    snapdev::NOT_USED(line);
+    f_parent->reply_received(f_index);
+}
+
+
+template<typename T>
+void load_connection<T>::process_error()
+{
+    f_parent->disconnected(f_index);
+    T::process_error();
+}
+
+
+template<typename T>
+void load_connection<T>::process_hup()
+{
+    f_parent->disconnected(f_index);
+    T::process_hup();
+}
+
+
+
+load_timer::load_timer(ed_load * parent)
+    : timer(0)
+    , f_parent(parent)
+{
+    set_name("load_timer");
+}
+
+
+void load_timer::process_timeout()
+{
+    f_parent->tick();
+}
+
+
+
+ed_load::ed_load(int argc, char * argv[])
+    : f_opts(g_options_environment)
+{
+    snaplogger::add_logger_options(f_opts);
+    f_opts.finish_parsing(argc, argv);
+    if(!snaplogger::process_logger_options(
+          f_opts
+        , "/etc/eventdispatcher/logger"
+        , std::cout
+        , !isatty(fileno(stdin))))
+    {
+        // exit on any error
+        throw advgetopt::getopt_exit("logger options generated an error.", 1);
+    }
+}
+
+
+double ed_load::get_double(std::string const & name) const
+{
+    double result(0.0);
+    if(!advgetopt::validator_double::convert_string(f_opts.get_string(name), result)
+    || result < 0.0)
+    {
+        throw std::runtime_error("--" + name + " must be a positive number.");
+    }
+    return result;
+}
+
+
+int ed_load::run()
+{
+    if(static_cast<int>(f_opts.is_defined("host"))
+     + static_cast<int>(f_opts.is_defined("unix"))
+     + static_cast<int>(f_opts.is_defined("udp")) != 1)
+    {
+        throw std::runtime_error("exactly one of --host, --unix or --udp must be specified.");
+    }
+    if(f_opts.is_defined("host"))
+    {
+        f_address = addr::string_to_addr(
+                  f_opts.get_string("host")
+                , "127.0.0.1"
+                , 4040
+                , "tcp");
+        f_tls = f_opts.is_defined("tls");
+    }
+    else if(f_opts.is_defined("udp"))
+    {
+        f_address = addr::string_to_addr(
+                  f_opts.get_string("udp")
+                , "127.0.0.1"
+                , 4041
+                , "udp");
+        f_udp = true;
+    }
+    else
+    {
+        f_unix_address = addr::addr_unix(f_opts.get_string("unix"));
+        f_unix = true;
+    }
+    if(f_tls && !f_opts.is_defined("host"))
+    {
+        throw std::runtime_error("--tls is only available with --host.");
+    }
+    f_expect_reply = !f_udp && !f_opts.is_defined("no-reply");
+
+    long const connections(f_opts.get_long("connections"));
+    if(connections < 1)
+    {
+        throw std::runtime_error("--connections must be at least 1.");
+    }
+    f_slots.resize(connections);
+
+    f_rate = get_double("rate");
+    if(f_rate == 0.0)
+    {
+        throw std::runtime_error("--rate must be a positive number.");
+    }
+    f_ramp_up = static_cast<std::int64_t>(get_double("ramp-up") * 1'000'000.0);
+    f_duration = static_cast<std::int64_t>(get_double("duration") * 1'000'000.0);
+    f_reply_timeout = static_cast<std::int64_t>(get_double("reply-timeout") * 1'000'000.0);
+
+    load_templates();
+    raise_file_limit();
+
+    f_communicator = ed::communicator::instance();
+    f_timer = std::make_shared<load_timer>(this);
+    f_communicator->add_connection(f_timer);
+
+    f_start_date = ed::get_current_date();
+    f_communicator->run();
+
+    report();
+
+    return f_failed_connections == 0
+        && f_lost_connections == 0
+        && f_send_errors == 0
+        && f_lost_replies == 0 ? 0 : 1;
+}
+
+
+void ed_load::load_templates()
+{
+    if(f_opts.is_defined("script"))
+    {
+        std::string const filename(f_opts.get_string("script"));
+        std::ifstream in(filename);
+        if(!in.is_open())
+        {
+            throw std::runtime_error("could not open script \"" + filename + "\".");
+        }
+        std::string line;
+        while(std::getline(in, line))
+        {
+            if(line.empty()
+            || line[0] == '#')
+            {
+                continue;
+            }
+            f_templates.push_back(parse_template(line));
+        }
+        if(f_templates.empty())
+        {
+            throw std::runtime_error("script \"" + filename + "\" does not include any message.");
+        }
+    }
+    else
+    {
+        f_templates.push_back(parse_template(f_opts.get_string("message")));
+    }
+
+    // verify that each template generates a valid message
+    //
+    for(auto const & t : f_templates)
+    {
+        std::string text;
+        for(auto const & p : t)
+        {
+            text += p.f_variable == variable_t::VARIABLE_NONE ? p.f_text : "0";
+        }
+        ed::message msg;
+        if(!msg.from_message(text))
+        {
+            throw std::runtime_error("template \"" + text + "\" does not generate a valid message.");
+        }
+    }
+}
+
+
+void ed_load::raise_file_limit()
+{
+    // each connection uses one file descriptor
+    //
+    rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) != 0)
+    {
+        return;
+    }
+    rlim_t const needed(f_slots.size() + 100);
+    if(rl.rlim_cur >= needed)
+    {
+        return;
+    }
+    rl.rlim_cur = std::min(needed, rl.rlim_max);
+    if(setrlimit(RLIMIT_NOFILE, &rl) != 0
+    || rl.rlim_cur < needed)
+    {
+        SNAP_LOG_WARNING
+            << "could not raise the file descriptor limit to "
+            << needed
+            << "; some connections will fail."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
+void ed_load::tick()
+{
+    std::int64_t const now(ed::get_current_date());
+    if(!f_sending)
+    {
+        // the reply timeout elapsed
+        //
+        done();
+        return;
+    }
+
+    // open the connections which are due
+    //
+    std::size_t opened(0);
+    std::size_t const total_slots(f_slots.size());
+    std::int64_t next_connection_date(-1);
+    while(f_next_open_slot < total_slots)
+    {
+        std::int64_t const date(f_start_date
+                + static_cast<std::int64_t>(f_ramp_up * f_next_open_slot / total_slots));
+        if(date > now
+        || opened >= MAX_BATCH)
+        {
+            next_connection_date = std::max(date, now);
+            break;
+        }
+        open_connection();
+        ++opened;
+    }
+
+    // send the messages which are due
+    //
+    std::int64_t const end(f_start_date + f_duration);
+    std::int64_t next_message_date(-1);
+    for(std::size_t count(0);; ++count)
+    {
+        std::int64_t const scheduled(f_start_date
+                + static_cast<std::int64_t>(static_cast<double>(f_sequence) * 1'000'000.0 / f_rate));
+        if(scheduled >= end)
+        {
+            break;
+        }
+        if(scheduled > now
+        || count >= MAX_BATCH)
+        {
+            // give the loop a chance to read the replies
+            //
+            next_message_date = std::max(scheduled, now);
+            break;
+        }
+        send_message(scheduled);
+    }
+
+    if(next_message_date >= 0
+    || next_connection_date >= 0)
+    {
+        std::int64_t next(next_message_date);
+        if(next < 0
+        || (next_connection_date >= 0 && next_connection_date < next))
+        {
+            next = next_connection_date;
+        }
+        f_timer->set_timeout_date(next);
+        return;
+    }
+
+    // we are done sending, wait for the last replies
+    //
+    f_sending = false;
+    f_end_date = ed::get_current_date();
+    bool pending(false);
+    for(auto const & s : f_slots)
+    {
+        if(!s.f_pending.empty())
+        {
+            pending = true;
+            break;
+        }
+    }
+    if(pending)
+    {
+        f_timer->set_timeout_date(f_end_date + f_reply_timeout);
+    }
+    else
+    {
+        done();
+    }
+}
+
+
+void ed_load::open_connection()
+{
+    std::size_t const index(f_next_open_slot);
+    ++f_next_open_slot;
+
+    slot_t & s(f_slots[index]);
+    try
+    {
+        if(f_udp)
+        {
+            s.f_udp_client = std::make_shared<ed::udp_client>(f_address);
+        }
+        else if(f_unix)
+        {
+            auto c(std::make_shared<load_connection<ed::local_stream_client_message_connection>>(this, index, f_unix_address));
+            s.f_messenger = c.get();
+            s.f_connection = c;
+        }
+        else
+        {
+            auto c(std::make_shared<load_connection<ed::tcp_client_message_connection>>(
+                      this
+                    , index
+                    , f_address
+                    , f_tls ? ed::mode_t::MODE_SECURE : ed::mode_t::MODE_PLAIN));
+            s.f_messenger = c.get();
+            s.f_connection = c;
+        }
+    }
+    catch(std::exception const & e)
+    {
+        ++f_failed_connections;
+        SNAP_LOG_ERROR
+            << "connection #"
+            << index
+            << " failed: "
+            << e.what()
+            << SNAP_LOG_SEND;
+        return;
+    }
+
+    if(s.f_connection != nullptr
+    && !f_communicator->add_connection(s.f_connection))
+    {
+        ++f_failed_connections;
+        s.f_connection.reset();
+        s.f_messenger = nullptr;
+        return;
+    }
+
+    s.f_open = true;
+    f_open_slots.push_back(index);
+}
+
+
+void ed_load::send_message(std::int64_t scheduled_date)
+{
+    std::uint64_t const seq(f_sequence);
+    ++f_sequence;
+
+    if(f_open_slots.empty())
+    {
+        // the scheduled message is lost; with the correction, this
+        // shows up as an error rather than being silently skipped
+        //
+        ++f_send_errors;
+        return;
+    }
+    std::size_t const index(f_open_slots[seq % f_open_slots.size()]);
+    slot_t & s(f_slots[index]);
+
+    std::string text;
+    for(auto const & p : f_templates[seq % f_templates.size()])
+    {
+        switch(p.f_variable)
+        {
+        case variable_t::VARIABLE_NONE:
+            text += p.f_text;
+            break;
+
+        case variable_t::VARIABLE_SEQ:
+            text += std::to_string(seq);
+            break;
+
+        case variable_t::VARIABLE_CONNECTION:
+            text += std::to_string(index);
+            break;
+
+        case variable_t::VARIABLE_DATE:
+            text += std::to_string(ed::get_current_date());
+            break;
+
+        case variable_t::VARIABLE_RANDOM:
+            text += std::to_string(f_random());
+            break;
+
+        }
+    }
+    ed::message msg;
+    if(!msg.from_message(text))
+    {
+        ++f_send_errors;
+        return;
+    }
+
+    bool sent(false);
+    if(s.f_udp_client != nullptr)
+    {
+        sent = ed::udp_server_message_connection::send_message(*s.f_udp_client, msg);
+    }
+    else
+    {
+        if(f_expect_reply)
+        {
+            s.f_pending.push_back({ scheduled_date, ed::get_current_date() });
+        }
+        sent = s.f_messenger->send_message(msg);
+        if(!sent
+        && f_expect_reply)
+        {
+            s.f_pending.pop_back();
+        }
+    }
+    if(!sent)
+    {
+        ++f_send_errors;
+    }
+}
+
+
+void ed_load::reply_received(std::size_t index)
+{
+    ++f_replies;
+    slot_t & s(f_slots[index]);
+    if(s.f_pending.empty())
+    {
+        ++f_unexpected_replies;
+        return;
+    }
+
+    std::int64_t const now(ed::get_current_date());
+    pending_reply_t const & p(s.f_pending.front());
+    f_latencies.push_back(now - p.f_scheduled_date);
+    f_uncorrected_latencies.push_back(now - p.f_sent_date);
+    s.f_pending.pop_front();
+
+    if(!f_sending
+    && s.f_pending.empty())
+    {
+        for(auto const & o : f_slots)
+        {
+            if(!o.f_pending.empty())
+            {
+                return;
+            }
+        }
+        done();
+    }
+}
+
+
+void ed_load::disconnected(std::size_t index)
+{
+    slot_t & s(f_slots[index]);
+    if(!s.f_open)
+    {
+        return;
+    }
+    s.f_open = false;
+    ++f_lost_connections;
+    f_lost_replies += s.f_pending.size();
+    s.f_pending.clear();
+    s.f_messenger = nullptr;
+
+    auto it(std::find(f_open_slots.begin(), f_open_slots.end(), index));
+    if(it != f_open_slots.end())
+    {
+        f_open_slots.erase(it);
+    }
+
+    if(!f_done)
+    {
+        SNAP_LOG_WARNING
+            << "connection #"
+            << index
+            << " was closed by the service."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
+void ed_load::done()
+{
+    if(f_done)
+    {
+        return;
+    }
+    f_done = true;
+
+    if(f_end_date == 0)
+    {
+        f_end_date = ed::get_current_date();
+    }
+    for(auto & s : f_slots)
+    {
+        f_lost_replies += s.f_pending.size();
+        s.f_pending.clear();
+        s.f_open = false;
+        if(s.f_connection != nullptr)
+        {
+            f_communicator->remove_connection(s.f_connection);
+        }
+    }
+    f_communicator->remove_connection(f_timer);
+}
+
+
+void ed_load::report()
+{
+    double const duration(static_cast<double>(f_end_date - f_start_date) / 1'000'000.0);
+    std::size_t const sent(f_sequence - f_send_errors);
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "connections_requested: " << f_slots.size() << '\n'
+              << "connections_opened: " << f_next_open_slot - f_failed_connections << '\n'
+              << "connections_failed: " << f_failed_connections << '\n'
+              << "connections_lost: " << f_lost_connections << '\n'
+              << "messages_scheduled: " << f_sequence << '\n'
+              << "messages_sent: " << sent << '\n'
+              << "send_errors: " << f_send_errors << '\n'
+              << "replies_received: " << f_replies << '\n'
+              << "replies_missing: " << f_lost_replies << '\n'
+              << "replies_unexpected: " << f_unexpected_replies << '\n'
+              << "duration_seconds: " << duration << '\n'
+              << "target_rate_messages_per_second: " << f_rate << '\n'
+              << "throughput_messages_per_second: "
+                    << (duration > 0.0 ? static_cast<double>(sent) / duration : 0.0) << '\n';
+
+    auto percentiles = [](std::string const & prefix, std::vector<std::int64_t> & latencies)
+    {
+        if(latencies.empty())
+        {
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p)
+        {
+            std::size_t const idx(static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1) + 0.5));
+            return latencies[idx];
+        };
+        std::cout << prefix << "_p50_us: " << percentile(0.50) << '\n'
+                  << prefix << "_p90_us: " << percentile(0.90) << '\n'
+                  << prefix << "_p99_us: " << percentile(0.99) << '\n'
+                  << prefix << "_p999_us: " << percentile(0.999) << '\n'
+                  << prefix << "_max_us: " << latencies.back() << '\n';
+    };
+    percentiles("latency", f_latencies);
+    percentiles("latency_uncorrected", f_uncorrected_latencies);
+}
+
+
+
+int main(int argc, char * argv[])
+{
+    ed::signal_handler::create_instance();
+
+    try
+    {
+        ed_load l(argc, argv);
+        return l.run();
+    }
+    catch(advgetopt::getopt_exit const & e)
+    {
+        exit(e.code());
+    }
+    catch(std::exception const & e)
+    {
+        SNAP_LOG_FATAL
+            << "an exception occurred (1): "
+            << e.what()
+            << SNAP_LOG_SEND;
+        exit(1);
+    }
+    catch(...)
+    {
+        SNAP_LOG_FATAL
+            << "an unknown exception occurred (2)."
+            << SNAP_LOG_SEND;
+        exit(2);
+    }
+    snapdev::NOT_REACHED();
+}
+
+
+// vim: ts=4 sw=4 et
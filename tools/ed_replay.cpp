@@ -0,0 +1,628 @@
+// Copyright (c) 2012-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/eventdispatcher
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Tool used to replay a message capture against a service.
+ *
+ * The capture is created with the ed::message_capture class. This tool
+ * reads the messages the service received and sends them again to a
+ * running instance of the service, respecting the original timing, a
+ * multiple of it, or as fast as possible.
+ *
+ * Basic usage example:
+ *
+ * \code
+ *     ed-replay --host 127.0.0.1:4040 --speed 10 /tmp/service.edcap
+ *     ed-replay --unix /run/service/service.sock --speed max /tmp/service.edcap
+ * \endcode
+ *
+ * The capture also tells us which messages the service answered. The
+ * tool expects the same number of replies and uses them to measure the
+ * latency. The replies are expected in order, which is the case of a
+ * service answering requests on one connection.
+ *
+ * At the end, the tool prints a report with the throughput and the
+ * latency percentiles, one "name: value" per line.
+ */
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+#include    <eventdispatcher/local_stream_client_message_connection.h>
+#include    <eventdispatcher/message_capture.h>
+#include    <eventdispatcher/signal_handler.h>
+#include    <eventdispatcher/tcp_client_message_connection.h>
+#include    <eventdispatcher/timer.h>
+#include    <eventdispatcher/utils.h>
+#include    <eventdispatcher/version.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/logger.h>
+#include    <snaplogger/message.h>
+#include    <snaplogger/options.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
+#include    <libaddr/addr_unix.h>
+
+
+// advgetopt
+//
+#include    <advgetopt/exception.h>
+#include    <advgetopt/validator_double.h>
+
+
+// snapdev
+//
+#include    <snapdev/not_reached.h>
+#include    <snapdev/not_used.h>
+#include    <snapdev/stringize.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <deque>
+#include    <iomanip>
+#include    <map>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+const advgetopt::option g_options[] =
+{
+    advgetopt::define_option(
+          advgetopt::Name("capture")
+        , advgetopt::Flags(advgetopt::any_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_COMMAND_LINE
+            , advgetopt::GETOPT_FLAG_GROUP_COMMANDS
+            , advgetopt::GETOPT_FLAG_DEFAULT_OPTION>())
+        , advgetopt::Help("the capture file to replay.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("connection")
+        , advgetopt::ShortName('c')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("only replay the messages received by the connection with that name.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("host")
+        , advgetopt::ShortName('H')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("the IP address and port of the service to replay the capture against (TCP).")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("reply-timeout")
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("number of seconds to wait for the last replies.")
+        , advgetopt::DefaultValue("5")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("speed")
+        , advgetopt::ShortName('s')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("replay speed: 1 for the original timing, N to go N times faster, \"max\" to send as fast as possible.")
+        , advgetopt::DefaultValue("1")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("unix")
+        , advgetopt::ShortName('u')
+        , advgetopt::Flags(advgetopt::all_flags<
+              advgetopt::GETOPT_FLAG_REQUIRED
+            , advgetopt::GETOPT_FLAG_GROUP_OPTIONS>())
+        , advgetopt::Help("the path to the Unix socket of the service to replay the capture against.")
+    ),
+    advgetopt::end_options()
+};
+
+advgetopt::group_description const g_group_descriptions[] =
+{
+    advgetopt::define_group(
+          advgetopt::GroupNumber(advgetopt::GETOPT_FLAG_GROUP_COMMANDS)
+        , advgetopt::GroupName("command")
+        , advgetopt::GroupDescription("Commands:")
+    ),
+    advgetopt::define_group(
+          advgetopt::GroupNumber(advgetopt::GETOPT_FLAG_GROUP_OPTIONS)
+        , advgetopt::GroupName("option")
+        , advgetopt::GroupDescription("Options:")
+    ),
+    advgetopt::end_groups()
+};
+
+advgetopt::options_environment const g_options_environment =
+{
+    .f_project_name = "ed-replay",
+    .f_group_name = "eventdispatcher",
+    .f_options = g_options,
+    .f_environment_variable_name = "ED_REPLAY",
+    .f_environment_flags = advgetopt::GETOPT_ENVIRONMENT_FLAG_PROCESS_SYSTEM_PARAMETERS,
+    .f_help_header = "Usage: %p [-<opt>] <capture file>\n"
+                     "where -<opt> is one or more of:",
+    .f_help_footer = "%c",
+    .f_version = EVENTDISPATCHER_VERSION_STRING,
+    .f_license = "GNU GPL v2 or newer",
+    .f_copyright = "Copyright (c) 2012-"
+                   SNAPDEV_STRINGIZE(UTC_BUILD_YEAR)
+                   " by Made to Order Software Corporation -- All Rights Reserved",
+    .f_groups = g_group_descriptions
+};
+
+
+
+constexpr std::size_t const     MAX_BATCH = 1'000;   // messages sent per timeout at max speed
+
+
+struct replay_message_t
+{
+    std::int64_t            f_offset = 0;       // nanoseconds since first message
+    ed::message             f_message = ed::message();
+    std::size_t             f_expected_replies = 0;
+};
+
+
+struct pending_reply_t
+{
+    std::int64_t            f_sent_date = 0;    // microseconds
+    std::size_t             f_expected_replies = 0;
+};
+
+
+
+}
+// noname namespace
+
+
+
+class ed_replay;
+
+
+template<typename T>
+class replay_connection
+    : public T
+{
+public:
+    typedef std::shared_ptr<replay_connection<T>>   pointer_t;
+
+    template<typename A>
+                                    replay_connection(ed_replay * parent, A const & address)
+                                        : T(address)
+                                        , f_parent(parent)
+                                    {
+                                        T::set_name("ed_replay");
+                                    }
+
+    // connection implementation
+    virtual void                    process_line(std::string const & line) override;
+    virtual void                    process_hup() override;
+
+private:
+    ed_replay *                     f_parent = nullptr;
+};
+
+
+class replay_timer
+    : public ed::timer
+{
+public:
+    typedef std::shared_ptr<replay_timer>   pointer_t;
+
+                                    replay_timer(ed_replay * parent);
+
+    // ed::connection implementation
+    virtual void                    process_timeout() override;
+
+private:
+    ed_replay *                     f_parent = nullptr;
+};
+
+
+class ed_replay
+{
+public:
+                                    ed_replay(int argc, char * argv[]);
+
+    int                             run();
+    void                            send_next();
+    void                            reply_received();
+    void                            disconnected();
+
+private:
+    void                            load_capture();
+    void                            done();
+    void                            report();
+
+    advgetopt::getopt               f_opts;
+    ed::communicator::pointer_t     f_communicator = ed::communicator::pointer_t();
+    ed::connection::pointer_t       f_connection = ed::connection::pointer_t();
+    ed::connection_with_send_message *
+                                    f_messenger = nullptr;
+    replay_timer::pointer_t         f_timer = replay_timer::pointer_t();
+    std::vector<replay_message_t>   f_messages = std::vector<replay_message_t>();
+    std::size_t                     f_next = 0;
+    double                          f_speed = 1.0;      // 0 means as fast as possible
+    std::int64_t                    f_reply_timeout = 5'000'000;
+    std::int64_t                    f_start_date = 0;
+    std::int64_t                    f_end_date = 0;
+    std::deque<pending_reply_t>     f_pending = std::deque<pending_reply_t>();
+    std::vector<std::int64_t>       f_latencies = std::vector<std::int64_t>();
+    std::size_t                     f_replies = 0;
+    std::size_t                     f_unexpected_replies = 0;
+    bool                            f_done = false;
+};
+
+
+
+template<typename T>
+void replay_connection<T>::process_line(std::string const & line)
+{
+    snapdev::NOT_USED(line);
+    f_parent->reply_received();
+}
+
+
+template<typename T>
+void replay_connection<T>::process_hup()
+{
+    T::process_hup();
+    f_parent->disconnected();
+}
+
+
+
+replay_timer::replay_timer(ed_replay * parent)
+    : timer(0)
+    , f_parent(parent)
+{
+    set_name("replay_timer");
+}
+
+
+void replay_timer::process_timeout()
+{
+    f_parent->send_next();
+}
+
+
+
+ed_replay::ed_replay(int argc, char * argv[])
+    : f_opts(g_options_environment)
+{
+    snaplogger::add_logger_options(f_opts);
+    f_opts.finish_parsing(argc, argv);
+    if(!snaplogger::process_logger_options(
+          f_opts
+        , "/etc/eventdispatcher/logger"
+        , std::cout
+        , !isatty(fileno(stdin))))
+    {
+        // exit on any error
+        throw advgetopt::getopt_exit("logger options generated an error.", 1);
+    }
+}
+
+
+int ed_replay::run()
+{
+    if(!f_opts.is_defined("capture"))
+    {
+        throw std::runtime_error("a capture filename is required.");
+    }
+
+    std::string const speed(f_opts.get_string("speed"));
+    if(speed == "max")
+    {
+        f_speed = 0.0;
+    }
+    else if(!advgetopt::validator_double::convert_string(speed, f_speed)
+         || f_speed <= 0.0)
+    {
+        throw std::runtime_error("--speed must be \"max\" or a positive number.");
+    }
+    f_reply_timeout = f_opts.get_long("reply-timeout") * 1'000'000;
+
+    load_capture();
+    if(f_messages.empty())
+    {
+        std::cerr << "error: no messages to replay in \""
+                  << f_opts.get_string("capture")
+                  << "\".\n";
+        return 1;
+    }
+
+    if(f_opts.is_defined("host") == f_opts.is_defined("unix"))
+    {
+        throw std::runtime_error("exactly one of --host or --unix must be specified.");
+    }
+    if(f_opts.is_defined("host"))
+    {
+        addr::addr const address(addr::string_to_addr(
+                  f_opts.get_string("host")
+                , "127.0.0.1"
+                , 4040
+                , "tcp"));
+        auto c(std::make_shared<replay_connection<ed::tcp_client_message_connection>>(this, address));
+        f_messenger = c.get();
+        f_connection = c;
+    }
+    else
+    {
+        addr::addr_unix const address(f_opts.get_string("unix"));
+        auto c(std::make_shared<replay_connection<ed::local_stream_client_message_connection>>(this, address));
+        f_messenger = c.get();
+        f_connection = c;
+    }
+
+    f_communicator = ed::communicator::instance();
+    f_communicator->add_connection(f_connection);
+    f_timer = std::make_shared<replay_timer>(this);
+    f_communicator->add_connection(f_timer);
+
+    f_start_date = ed::get_current_date();
+    f_communicator->run();
+
+    report();
+
+    return f_pending.empty() ? 0 : 1;
+}
+
+
+void ed_replay::load_capture()
+{
+    ed::message_capture_reader reader(f_opts.get_string("capture"));
+    std::string const connection_name(f_opts.is_defined("connection")
+            ? f_opts.get_string("connection")
+            : std::string());
+
+    std::int64_t first_timestamp(-1);
+    std::map<std::string, std::size_t> last_received;
+    ed::capture_record_t record;
+    while(reader.next(record))
+    {
+        if(!connection_name.empty()
+        && record.f_connection_name != connection_name)
+        {
+            continue;
+        }
+
+        if(record.f_direction == ed::capture_direction_t::CAPTURE_DIRECTION_SENT)
+        {
+            // count the replies the service sent on that connection
+            //
+            auto it(last_received.find(record.f_connection_name));
+            if(it != last_received.end())
+            {
+                ++f_messages[it->second].f_expected_replies;
+            }
+            continue;
+        }
+
+        replay_message_t m;
+        if(!m.f_message.from_message(record.f_message))
+        {
+            SNAP_LOG_WARNING
+                << "skipping invalid message \""
+                << record.f_message
+                << "\"."
+                << SNAP_LOG_SEND;
+            continue;
+        }
+        if(first_timestamp < 0)
+        {
+            first_timestamp = record.f_timestamp;
+        }
+        m.f_offset = record.f_timestamp - first_timestamp;
+        last_received[record.f_connection_name] = f_messages.size();
+        f_messages.push_back(m);
+    }
+}
+
+
+void ed_replay::send_next()
+{
+    if(f_next >= f_messages.size())
+    {
+        // all sent, this is the reply timeout
+        //
+        done();
+        return;
+    }
+
+    std::int64_t const now(ed::get_current_date());
+    for(std::size_t count(0); f_next < f_messages.size(); ++count)
+    {
+        if(count >= MAX_BATCH)
+        {
+            // give the loop a chance to read the replies
+            //
+            f_timer->set_timeout_date(now);
+            return;
+        }
+
+        replay_message_t & m(f_messages[f_next]);
+        std::int64_t const date(f_speed == 0.0
+                ? 0
+                : f_start_date + static_cast<std::int64_t>(m.f_offset / 1'000.0 / f_speed));
+        if(date > now)
+        {
+            f_timer->set_timeout_date(date);
+            return;
+        }
+
+        if(m.f_expected_replies > 0)
+        {
+            f_pending.push_back({ed::get_current_date(), m.f_expected_replies});
+        }
+        f_messenger->send_message(m.f_message);
+        ++f_next;
+    }
+
+    f_end_date = ed::get_current_date();
+    if(f_pending.empty())
+    {
+        done();
+    }
+    else
+    {
+        f_timer->set_timeout_date(f_end_date + f_reply_timeout);
+    }
+}
+
+
+void ed_replay::reply_received()
+{
+    ++f_replies;
+    if(f_pending.empty())
+    {
+        ++f_unexpected_replies;
+        return;
+    }
+
+    pending_reply_t & p(f_pending.front());
+    if(p.f_sent_date != 0)
+    {
+        f_latencies.push_back(ed::get_current_date() - p.f_sent_date);
+        p.f_sent_date = 0;
+    }
+    --p.f_expected_replies;
+    if(p.f_expected_replies == 0)
+    {
+        f_pending.pop_front();
+    }
+
+    if(f_pending.empty()
+    && f_next >= f_messages.size())
+    {
+        done();
+    }
+}
+
+
+void ed_replay::disconnected()
+{
+    SNAP_LOG_ERROR
+        << "the service closed the connection."
+        << SNAP_LOG_SEND;
+    done();
+}
+
+
+void ed_replay::done()
+{
+    if(f_done)
+    {
+        return;
+    }
+    f_done = true;
+
+    if(f_end_date == 0)
+    {
+        f_end_date = ed::get_current_date();
+    }
+    f_communicator->remove_connection(f_connection);
+    f_communicator->remove_connection(f_timer);
+}
+
+
+void ed_replay::report()
+{
+    double const duration(static_cast<double>(f_end_date - f_start_date) / 1'000'000.0);
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "messages_sent: " << f_next << '\n'
+              << "messages_total: " << f_messages.size() << '\n'
+              << "replies_received: " << f_replies << '\n'
+              << "replies_missing: " << f_pending.size() << '\n'
+              << "replies_unexpected: " << f_unexpected_replies << '\n'
+              << "duration_seconds: " << duration << '\n'
+              << "throughput_messages_per_second: "
+                    << (duration > 0.0 ? static_cast<double>(f_next) / duration : 0.0) << '\n';
+
+    if(f_latencies.empty())
+    {
+        return;
+    }
+    std::sort(f_latencies.begin(), f_latencies.end());
+    auto percentile = [this](double p)
+    {
+        std::size_t const idx(static_cast<std::size_t>(p * static_cast<double>(f_latencies.size() - 1) + 0.5));
+        return f_latencies[idx];
+    };
+    std::cout << "latency_p50_us: " << percentile(0.50) << '\n'
+              << "latency_p90_us: " << percentile(0.90) << '\n'
+              << "latency_p99_us: " << percentile(0.99) << '\n'
+              << "latency_max_us: " << f_latencies.back() << '\n';
+}
+
+
+
+int main(int argc, char * argv[])
+{
+    ed::signal_handler::create_instance();
+
+    try
+    {
+        ed_replay r(argc, argv);
+        return r.run();
+    }
+    catch(advgetopt::getopt_exit const & e)
+    {
+        exit(e.code());
+    }
+    catch(std::exception const & e)
+    {
+        SNAP_LOG_FATAL
+            << "an exception occurred (1): "
+            << e.what()
+            << SNAP_LOG_SEND;
+        exit(1);
+    }
+    catch(...)
+    {
+        SNAP_LOG_FATAL
+            << "an unknown exception occurred (2)."
+            << SNAP_LOG_SEND;
+        exit(2);
+    }
+    snapdev::NOT_REACHED();
+}
+
+
+// vim: ts=4 sw=4 et